@@ -0,0 +1,120 @@
+#define _POSIX_C_SOURCE 199309L  // clock_gettime and sysconf under -std=c99
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "msdradixsort.h"
+
+#define DATA_SIZE (1<<20)
+
+static const char* keyTypeNames[] = {"uint32", "uint64", "string"};
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static uint64_t rand64(void) {
+    uint64_t r = 0;
+    for(int i = 0; i < 4; i++)
+        r = (r << 16) ^ (uint64_t)rand();
+    return r;
+}
+
+static int compareUint32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int compareUint64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int compareStrings(const void* a, const void* b) {
+    return msdCompareStrings((const MsdString*)a, (const MsdString*)b, 0);
+}
+
+// Strings of 0 to 24 bytes over a four letter alphabet behind one of a
+// few shared prefixes, so buckets go many digits deep and often hold
+// equal strings; bytes are stored back to back in text
+static void fillStrings(MsdString* strings, unsigned char* text, size_t n) {
+    static const char* prefixes[] = {"", "user/", "user/session/", "item-0000"};
+    unsigned char* t = text;
+    for(size_t i = 0; i < n; i++) {
+        const char* prefix = prefixes[rand() % 4];
+        size_t length = strlen(prefix);
+        memcpy(t, prefix, length);
+        size_t tail = rand() % 25;
+        for(size_t j = 0; j < tail; j++)
+            t[length++] = "acgt"[rand() % 4];
+        strings[i].data = t;
+        strings[i].length = length;
+        t += length;
+    }
+}
+
+int main(int argc, char** argv) {
+    // [n] [threads] [keyBits]: random keys below 2^keyBits, a baseline
+    // for the GPU radix sort of the same keys
+    size_t dataSize = DATA_SIZE;
+    int numThreads = 0;
+    int keyBits = 64;
+    if(argc > 1) dataSize = strtoul(argv[1], NULL, 10);
+    if(argc > 2) numThreads = atoi(argv[2]);
+    if(argc > 3) keyBits = atoi(argv[3]);
+    if(numThreads <= 0) numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+
+    void* keys = malloc(dataSize * sizeof(MsdString));
+    void* reference = malloc(dataSize * sizeof(MsdString));
+    unsigned char* text = (unsigned char*) malloc(dataSize * 40 + 1);
+    printf("elementCount: %zu, threads: %d\n", dataSize, numThreads);
+
+    for(int keyType = MSD_KEY_UINT32; keyType <= MSD_KEY_STRING; keyType++) {
+        size_t size = msdKeySize((MsdKeyType)keyType);
+        int (*compare)(const void*, const void*) =
+            keyType == MSD_KEY_UINT32 ? compareUint32 :
+            keyType == MSD_KEY_UINT64 ? compareUint64 : compareStrings;
+
+        if(keyType == MSD_KEY_STRING) {
+            fillStrings((MsdString*)keys, text, dataSize);
+        } else {
+            int bits = keyBits < (int)size * 8 ? keyBits : (int)size * 8;
+            uint64_t mask = bits < 64 ? ((uint64_t)1 << bits) - 1 : ~(uint64_t)0;
+            for(size_t i = 0; i < dataSize; i++) {
+                if(keyType == MSD_KEY_UINT32) ((uint32_t*)keys)[i] = (uint32_t)(rand64() & mask);
+                else                          ((uint64_t*)keys)[i] = rand64() & mask;
+            }
+        }
+        memcpy(reference, keys, dataSize * size);
+
+        double start = now();
+        int error = msdRadixSort(keys, dataSize, (MsdKeyType)keyType, numThreads);
+        double seconds = now() - start;
+        if(error != 0) {
+            printf("%s: out of memory\n", keyTypeNames[keyType]);
+            continue;
+        }
+
+        start = now();
+        qsort(reference, dataSize, size, compare);
+        double qsortSeconds = now() - start;
+
+        // The sort is not stable, but equal keys are alike byte for byte
+        // except for where string data sits; compare those by content
+        size_t acc = 0;
+        for(size_t i = 0; i < dataSize; i++) {
+            if(compare((char*)keys + i * size, (char*)reference + i * size) == 0) acc++;
+        }
+        printf("%s: %.3f ms, %.2f Mkeys/s (qsort %.3f ms, %.2f Mkeys/s)\n", keyTypeNames[keyType],
+               seconds * 1e3, dataSize / seconds * 1e-6, qsortSeconds * 1e3, dataSize / qsortSeconds * 1e-6);
+        if (acc == dataSize) printf("Passed:%zu!\n", acc); else printf("Failed:%zu!\n", acc);
+    }
+
+    free(keys);
+    free(reference);
+    free(text);
+    return 0;
+}
@@ -0,0 +1,546 @@
+#ifndef MSDRADIXSORT_H_
+#define MSDRADIXSORT_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// Buckets smaller than this are finished by insertion sort
+#define MSD_INSERTION_CUTOFF 32
+
+// Buckets at least this large become tasks other threads may steal;
+// smaller ones are sorted right away by the thread that found them
+#define MSD_TASK_CUTOFF 4096
+
+// Inputs at least this large are split on their leading digit by all
+// threads together before the bucket tasks start
+#define MSD_PARALLEL_SPLIT (1 << 16)
+
+// One digit is a byte; strings use one more bucket, first, for strings
+// that end before the digit
+#define MSD_RADIX 256
+#define MSD_STRING_RADIX (MSD_RADIX + 1)
+
+// A byte string of any length; bytes compare unsigned, a string sorts
+// before every longer string it is a prefix of
+typedef struct {
+    const unsigned char* data;
+    size_t length;
+} MsdString;
+
+typedef enum {
+    MSD_KEY_UINT32,
+    MSD_KEY_UINT64,
+    MSD_KEY_STRING
+} MsdKeyType;
+
+// A bucket still to sort: count keys from begin on, equal in every digit
+// before depth.  Buckets of the leading split first copy themselves back
+// from the scratch array.
+typedef struct {
+    size_t begin;
+    size_t count;
+    int depth;
+    int copyBack;
+} MsdTask;
+
+// Tasks of one thread.  The owner pushes and pops at the tail, so it
+// works depth first on what it just split; thieves take from the head,
+// the oldest and so largest buckets.
+typedef struct {
+    MsdTask* tasks;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+    pthread_mutex_t lock;
+} MsdDeque;
+
+struct MsdPool;
+
+typedef struct {
+    struct MsdPool* pool;
+    int id;
+    unsigned int seed;          // picks the first victim to steal from
+} MsdWorker;
+
+// ****************************************************************************
+// Struct: MsdPool
+//
+// Purpose:
+//   Work-stealing pool of one sort.  queued counts tasks sitting in the
+//   deques, pending those not yet finished; idle threads sleep on work
+//   until a task is queued or nothing is pending any more.
+// ****************************************************************************
+typedef struct MsdPool {
+    MsdKeyType keyType;
+    void* keys;
+    void* scratch;
+    int numThreads;
+    MsdDeque* deques;
+    MsdWorker* workers;
+
+    long queued;                // both only touched atomically
+    long pending;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+} MsdPool;
+
+static long msdLoad(long* counter) {
+    return __atomic_load_n(counter, __ATOMIC_SEQ_CST);
+}
+
+static void msdPush(MsdPool* p, int id, MsdTask task) {
+    MsdDeque* q = &p->deques[id];
+    pthread_mutex_lock(&q->lock);
+    if(q->tail == q->capacity) {
+        if(q->head > 0) {
+            memmove(q->tasks, q->tasks + q->head, (q->tail - q->head) * sizeof(MsdTask));
+            q->tail -= q->head;
+            q->head = 0;
+        } else {
+            q->capacity = q->capacity ? 2 * q->capacity : 64;
+            q->tasks = (MsdTask*) realloc(q->tasks, q->capacity * sizeof(MsdTask));
+        }
+    }
+    q->tasks[q->tail++] = task;
+    pthread_mutex_unlock(&q->lock);
+
+    __atomic_add_fetch(&p->pending, 1, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&p->queued, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&p->lock);
+    pthread_cond_signal(&p->work);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static int msdTakeFrom(MsdPool* p, int id, int own, MsdTask* task) {
+    MsdDeque* q = &p->deques[id];
+    int found = 0;
+    pthread_mutex_lock(&q->lock);
+    if(q->head < q->tail) {
+        *task = own ? q->tasks[--q->tail] : q->tasks[q->head++];
+        if(q->head == q->tail) q->head = q->tail = 0;
+        found = 1;
+    }
+    pthread_mutex_unlock(&q->lock);
+    if(found) __atomic_sub_fetch(&p->queued, 1, __ATOMIC_SEQ_CST);
+    return found;
+}
+
+// Takes the newest task of the own deque, or else the oldest of another
+// one, trying the others from a random one on
+static int msdTake(MsdPool* p, MsdWorker* w, MsdTask* task) {
+    if(msdTakeFrom(p, w->id, 1, task)) return 1;
+    w->seed = w->seed * 1103515245u + 12345u;
+    int start = (int)((w->seed >> 16) % p->numThreads);
+    for(int i = 0; i < p->numThreads; i++) {
+        int id = (start + i) % p->numThreads;
+        if(id != w->id && msdTakeFrom(p, id, 0, task)) return 1;
+    }
+    return 0;
+}
+
+static int msdCompareStrings(const MsdString* a, const MsdString* b, size_t depth) {
+    size_t la = a->length - depth;
+    size_t lb = b->length - depth;
+    int c = memcmp(a->data + depth, b->data + depth, la < lb ? la : lb);
+    if(c != 0) return c;
+    return (la > lb) - (la < lb);
+}
+
+static int msdStringDigit(const MsdString* s, size_t depth) {
+    return depth < s->length ? s->data[depth] + 1 : 0;
+}
+
+// ****************************************************************************
+// Function: msdSortUint32, msdSortUint64
+//
+// Purpose:
+//   Sorts a bucket of keys that agree in their digits before depth,
+//   most significant byte first.  A digit shared by every key costs only
+//   the count; otherwise the keys are permuted in place into their
+//   buckets, American flag style, and each bucket is sorted in turn:
+//   small ones by insertion sort, large ones pushed for any thread.
+//
+// Returns:  nothing
+// ****************************************************************************
+#define MSD_DEFINE_INTEGER_SORT(NAME, TYPE)                                     \
+static void NAME(MsdPool* p, int id, TYPE* keys, size_t n, int depth) {         \
+    const int digits = (int)sizeof(TYPE);                                       \
+    size_t count[MSD_RADIX], next[MSD_RADIX], end[MSD_RADIX];                   \
+    for(;;) {                                                                   \
+        if(n < MSD_INSERTION_CUTOFF) {                                          \
+            for(size_t i = 1; i < n; i++) {                                     \
+                TYPE key = keys[i];                                             \
+                size_t j = i;                                                   \
+                for(; j > 0 && keys[j - 1] > key; j--) keys[j] = keys[j - 1];   \
+                keys[j] = key;                                                  \
+            }                                                                   \
+            return;                                                             \
+        }                                                                       \
+        int shift = 8 * (digits - 1 - depth);                                   \
+        memset(count, 0, sizeof(count));                                        \
+        for(size_t i = 0; i < n; i++)                                           \
+            count[(keys[i] >> shift) & 0xFF]++;                                 \
+        if(count[(keys[0] >> shift) & 0xFF] == n) {                             \
+            if(++depth == digits) return;                                       \
+            continue;                                                           \
+        }                                                                       \
+        size_t sum = 0;                                                         \
+        for(int b = 0; b < MSD_RADIX; b++) {                                    \
+            next[b] = sum;                                                      \
+            sum += count[b];                                                    \
+            end[b] = sum;                                                       \
+        }                                                                       \
+        for(int b = 0; b < MSD_RADIX; b++) {                                    \
+            while(next[b] < end[b]) {                                           \
+                TYPE key = keys[next[b]];                                       \
+                int d = (int)((key >> shift) & 0xFF);                           \
+                while(d != b) {                                                 \
+                    TYPE t = keys[next[d]];                                     \
+                    keys[next[d]++] = key;                                      \
+                    key = t;                                                    \
+                    d = (int)((key >> shift) & 0xFF);                           \
+                }                                                               \
+                keys[next[b]++] = key;                                          \
+            }                                                                   \
+        }                                                                       \
+        if(depth + 1 == digits) return;                                         \
+        size_t begin = 0;                                                       \
+        for(int b = 0; b < MSD_RADIX; b++) {                                    \
+            if(count[b] >= MSD_TASK_CUTOFF) {                                   \
+                MsdTask task = {(size_t)(keys - (TYPE*)p->keys) + begin,        \
+                                count[b], depth + 1, 0};                        \
+                msdPush(p, id, task);                                           \
+            } else if(count[b] > 1) {                                           \
+                NAME(p, id, keys + begin, count[b], depth + 1);                 \
+            }                                                                   \
+            begin += count[b];                                                  \
+        }                                                                       \
+        return;                                                                 \
+    }                                                                           \
+}
+
+MSD_DEFINE_INTEGER_SORT(msdSortUint32, uint32_t)
+MSD_DEFINE_INTEGER_SORT(msdSortUint64, uint64_t)
+
+// Same for strings, one byte of them per digit.  Strings that end
+// before the digit are equal and need no more sorting.
+static void msdSortStrings(MsdPool* p, int id, MsdString* keys, size_t n, int depth) {
+    size_t count[MSD_STRING_RADIX], next[MSD_STRING_RADIX], end[MSD_STRING_RADIX];
+    for(;;) {
+        if(n < MSD_INSERTION_CUTOFF) {
+            for(size_t i = 1; i < n; i++) {
+                MsdString key = keys[i];
+                size_t j = i;
+                for(; j > 0 && msdCompareStrings(&keys[j - 1], &key, depth) > 0; j--) keys[j] = keys[j - 1];
+                keys[j] = key;
+            }
+            return;
+        }
+        memset(count, 0, sizeof(count));
+        for(size_t i = 0; i < n; i++)
+            count[msdStringDigit(&keys[i], depth)]++;
+        if(count[0] == n) return;
+        if(count[msdStringDigit(&keys[0], depth)] == n) {
+            depth++;
+            continue;
+        }
+        size_t sum = 0;
+        for(int b = 0; b < MSD_STRING_RADIX; b++) {
+            next[b] = sum;
+            sum += count[b];
+            end[b] = sum;
+        }
+        for(int b = 0; b < MSD_STRING_RADIX; b++) {
+            while(next[b] < end[b]) {
+                MsdString key = keys[next[b]];
+                int d = msdStringDigit(&key, depth);
+                while(d != b) {
+                    MsdString t = keys[next[d]];
+                    keys[next[d]++] = key;
+                    key = t;
+                    d = msdStringDigit(&key, depth);
+                }
+                keys[next[b]++] = key;
+            }
+        }
+        size_t begin = count[0];
+        for(int b = 1; b < MSD_STRING_RADIX; b++) {
+            if(count[b] >= MSD_TASK_CUTOFF) {
+                MsdTask task = {(size_t)(keys - (MsdString*)p->keys) + begin, count[b], depth + 1, 0};
+                msdPush(p, id, task);
+            } else if(count[b] > 1) {
+                msdSortStrings(p, id, keys + begin, count[b], depth + 1);
+            }
+            begin += count[b];
+        }
+        return;
+    }
+}
+
+static size_t msdKeySize(MsdKeyType keyType) {
+    switch(keyType) {
+        case MSD_KEY_UINT32: return sizeof(uint32_t);
+        case MSD_KEY_UINT64: return sizeof(uint64_t);
+        default:             return sizeof(MsdString);
+    }
+}
+
+static void msdRunTask(MsdPool* p, int id, MsdTask task) {
+    size_t size = msdKeySize(p->keyType);
+    char* keys = (char*)p->keys + task.begin * size;
+    if(task.copyBack)
+        memcpy(keys, (char*)p->scratch + task.begin * size, task.count * size);
+    switch(p->keyType) {
+        case MSD_KEY_UINT32: msdSortUint32(p, id, (uint32_t*)keys, task.count, task.depth); break;
+        case MSD_KEY_UINT64: msdSortUint64(p, id, (uint64_t*)keys, task.count, task.depth); break;
+        default:             msdSortStrings(p, id, (MsdString*)keys, task.count, task.depth); break;
+    }
+}
+
+static void* msdWorkerThread(void* arg) {
+    MsdWorker* w = (MsdWorker*) arg;
+    MsdPool* p = w->pool;
+    MsdTask task;
+
+    for(;;) {
+        if(msdTake(p, w, &task)) {
+            msdRunTask(p, w->id, task);
+            if(__atomic_sub_fetch(&p->pending, 1, __ATOMIC_SEQ_CST) == 0) {
+                pthread_mutex_lock(&p->lock);
+                pthread_cond_broadcast(&p->work);
+                pthread_mutex_unlock(&p->lock);
+            }
+            continue;
+        }
+        pthread_mutex_lock(&p->lock);
+        while(msdLoad(&p->queued) == 0 && msdLoad(&p->pending) > 0)
+            pthread_cond_wait(&p->work, &p->lock);
+        int done = (msdLoad(&p->pending) == 0);
+        pthread_mutex_unlock(&p->lock);
+        if(done) return NULL;
+    }
+}
+
+// Digit of key i of the leading split, MSD_STRING_RADIX buckets for
+// strings and MSD_RADIX for integers
+static int msdDigit(MsdKeyType keyType, const void* keys, size_t i, int depth) {
+    switch(keyType) {
+        case MSD_KEY_UINT32: return (int)((((const uint32_t*)keys)[i] >> (8 * (3 - depth))) & 0xFF);
+        case MSD_KEY_UINT64: return (int)((((const uint64_t*)keys)[i] >> (8 * (7 - depth))) & 0xFF);
+        default:             return msdStringDigit(&((const MsdString*)keys)[i], depth);
+    }
+}
+
+// One thread's share of the leading split: a contiguous chunk of keys,
+// counted by digit, then scattered to the scratch array from offsets
+typedef struct {
+    MsdPool* pool;
+    size_t first;
+    size_t last;
+    int depth;
+    size_t count[MSD_STRING_RADIX];
+    size_t offset[MSD_STRING_RADIX];
+} MsdSplit;
+
+static void* msdSplitCount(void* arg) {
+    MsdSplit* s = (MsdSplit*) arg;
+    memset(s->count, 0, sizeof(s->count));
+    for(size_t i = s->first; i < s->last; i++)
+        s->count[msdDigit(s->pool->keyType, s->pool->keys, i, s->depth)]++;
+    return NULL;
+}
+
+static void* msdSplitScatter(void* arg) {
+    MsdSplit* s = (MsdSplit*) arg;
+    MsdPool* p = s->pool;
+    size_t size = msdKeySize(p->keyType);
+    for(size_t i = s->first; i < s->last; i++) {
+        int d = msdDigit(p->keyType, p->keys, i, s->depth);
+        memcpy((char*)p->scratch + s->offset[d]++ * size, (char*)p->keys + i * size, size);
+    }
+    return NULL;
+}
+
+// Runs a phase on every split, split 0 and those whose thread fails to
+// start on the calling thread
+static void msdSplitRun(MsdSplit* splits, int numThreads, void* (*phase)(void*)) {
+    pthread_t* threads = (pthread_t*) malloc(numThreads * sizeof(pthread_t));
+    char* started = (char*) calloc(numThreads, 1);
+    for(int t = 1; t < numThreads; t++) {
+        if(threads != NULL && started != NULL && pthread_create(&threads[t], NULL, phase, &splits[t]) == 0)
+            started[t] = 1;
+        else
+            phase(&splits[t]);
+    }
+    phase(&splits[0]);
+    for(int t = 1; t < numThreads; t++)
+        if(started != NULL && started[t]) pthread_join(threads[t], NULL);
+    free(started);
+    free(threads);
+}
+
+// ****************************************************************************
+// Function: msdSplit
+//
+// Purpose:
+//   Splits a large input on its leading digit with every thread: each
+//   counts the digits of its chunk, then scatters the chunk to the
+//   scratch array.  Leading digits all keys share are passed over.  One
+//   task per bucket is queued, round robin over the threads; it copies
+//   its bucket back before sorting it.
+//
+// Returns:  0 on success, -1 if the scratch array can't be allocated
+// ****************************************************************************
+static int msdSplit(MsdPool* p, size_t n) {
+    size_t size = msdKeySize(p->keyType);
+    int radix = (p->keyType == MSD_KEY_STRING) ? MSD_STRING_RADIX : MSD_RADIX;
+    int digits = (p->keyType == MSD_KEY_STRING) ? -1 : (int)size;
+    int numThreads = p->numThreads;
+    MsdSplit* splits = (MsdSplit*) calloc(numThreads, sizeof(MsdSplit));
+    p->scratch = malloc(n * size);
+    if(splits == NULL || p->scratch == NULL) {
+        free(splits);
+        return -1;
+    }
+    for(int t = 0; t < numThreads; t++) {
+        splits[t].pool = p;
+        splits[t].first = n * t / numThreads;
+        splits[t].last = n * (t + 1) / numThreads;
+    }
+
+    size_t total[MSD_STRING_RADIX];
+    int depth = 0;
+    for(;;) {
+        for(int t = 0; t < numThreads; t++) splits[t].depth = depth;
+        msdSplitRun(splits, numThreads, msdSplitCount);
+        memset(total, 0, sizeof(total));
+        int shared = 0;
+        for(int b = 0; b < radix; b++) {
+            for(int t = 0; t < numThreads; t++) total[b] += splits[t].count[b];
+            if(total[b] == n) shared = 1;
+        }
+        if(!shared) break;
+        // All keys equal so far; strings that all ended are sorted
+        if(++depth == digits || (digits < 0 && total[0] == n)) {
+            free(splits);
+            return 0;
+        }
+    }
+
+    size_t begin = 0;
+    for(int b = 0; b < radix; b++) {
+        size_t offset = begin;
+        for(int t = 0; t < numThreads; t++) {
+            splits[t].offset[b] = offset;
+            offset += splits[t].count[b];
+        }
+        begin += total[b];
+    }
+    msdSplitRun(splits, numThreads, msdSplitScatter);
+
+    // Strings that ended before the digit are equal, as are integers
+    // after the last digit, and just go back
+    int last = (depth + 1 == digits);
+    begin = 0;
+    for(int b = 0, t = 0; b < radix; b++) {
+        if(total[b] > 0) {
+            MsdTask task = {begin, total[b], depth + 1, 1};
+            if(last || (digits < 0 && b == 0))
+                memcpy((char*)p->keys + begin * size, (char*)p->scratch + begin * size, total[b] * size);
+            else if(total[b] < MSD_INSERTION_CUTOFF)
+                msdRunTask(p, 0, task);
+            else
+                msdPush(p, t++ % numThreads, task);
+        }
+        begin += total[b];
+    }
+    free(splits);
+    return 0;
+}
+
+// ****************************************************************************
+// Function: msdRadixSort
+//
+// Purpose:
+//   Sorts n keys of keyType in place, ascending, with a parallel
+//   most-significant-digit-first radix sort.  Buckets are split
+//   recursively; buckets too large to sort on the spot become tasks of a
+//   work-stealing pool, so uneven key distributions still keep every
+//   thread busy.  Unlike an LSD sort it only looks at as many digits as
+//   it takes to tell keys apart, which is what makes strings of any
+//   length possible.  The sort is not stable.
+//
+// Arguments:
+//   keys: n keys; uint32_t, uint64_t or MsdString as keyType says
+//   n: number of keys
+//   keyType: type of the keys
+//   numThreads: number of threads, 0 for one per online processor
+//
+// Returns:  0 on success, -1 if memory runs out
+// ****************************************************************************
+static int msdRadixSort(void* keys, size_t n, MsdKeyType keyType, int numThreads) {
+    MsdPool pool;
+    MsdPool* p = &pool;
+    int status = 0;
+
+    if(n < 2) return 0;
+    if(numThreads <= 0) numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if(numThreads <= 0) numThreads = 1;
+
+    memset(p, 0, sizeof(*p));
+    p->keyType = keyType;
+    p->keys = keys;
+    p->numThreads = numThreads;
+    p->deques = (MsdDeque*) calloc(numThreads, sizeof(MsdDeque));
+    p->workers = (MsdWorker*) calloc(numThreads, sizeof(MsdWorker));
+    if(p->deques == NULL || p->workers == NULL) {
+        free(p->deques);
+        free(p->workers);
+        return -1;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work, NULL);
+    for(int t = 0; t < numThreads; t++) {
+        pthread_mutex_init(&p->deques[t].lock, NULL);
+        p->workers[t].pool = p;
+        p->workers[t].id = t;
+        p->workers[t].seed = (unsigned int)t * 2654435761u;
+    }
+
+    if(numThreads > 1 && n >= MSD_PARALLEL_SPLIT) {
+        status = msdSplit(p, n);
+    } else {
+        MsdTask task = {0, n, 0, 0};
+        msdPush(p, 0, task);
+    }
+
+    if(status == 0 && msdLoad(&p->pending) > 0) {
+        // A worker whose thread fails to start is left out: the others,
+        // the caller's among them, steal what is queued on its deque
+        pthread_t* threads = (pthread_t*) malloc(numThreads * sizeof(pthread_t));
+        char* started = (char*) calloc(numThreads, 1);
+        for(int t = 1; t < numThreads && threads != NULL && started != NULL; t++)
+            started[t] = pthread_create(&threads[t], NULL, msdWorkerThread, &p->workers[t]) == 0;
+        msdWorkerThread(&p->workers[0]);
+        for(int t = 1; t < numThreads; t++)
+            if(started != NULL && started[t]) pthread_join(threads[t], NULL);
+        free(started);
+        free(threads);
+    }
+
+    for(int t = 0; t < numThreads; t++) {
+        pthread_mutex_destroy(&p->deques[t].lock);
+        free(p->deques[t].tasks);
+    }
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->work);
+    free(p->deques);
+    free(p->workers);
+    free(p->scratch);
+    return status;
+}
+
+#endif // MSDRADIXSORT_H_
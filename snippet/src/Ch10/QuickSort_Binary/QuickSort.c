@@ -0,0 +1,264 @@
+#define _POSIX_C_SOURCE 199309L  // clock_gettime under -std=c99
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <alloca.h>
+#include <time.h>
+
+#include "quicksort_config.h"
+#include "samplesort.h"
+#include "radixsort.h"
+#include "bitonicsort.h"
+
+#define DATA_SIZE (1<<20)
+
+// A custom ordering radix sort has no digits for: floats by magnitude,
+// largest first
+static const char* MAGNITUDE_ORDER =
+    "#define KEY_T float\n"
+    "#define KEY_LESS(a, b) (fabs(a) > fabs(b))\n";
+
+void loadProgramSource(const char** files,
+                       size_t length,
+                       char** buffer,
+                       size_t* sizes) {
+    /* Read each source file (*.cl) and store the contents into a temporary datastore */
+    for(size_t i=0; i < length; i++) {
+        FILE* file = fopen(files[i], "r");
+        if(file == NULL) {
+            perror("Couldn't read the program file");
+            exit(1);
+        }
+        fseek(file, 0, SEEK_END);
+        sizes[i] = ftell(file);
+        rewind(file); // reset the file pointer so that 'fread' reads from the front
+        buffer[i] = (char*)malloc(sizes[i]+1);
+        buffer[i][sizes[i]] = '\0';
+        fread(buffer[i], sizeof(char), sizes[i], file);
+        fclose(file);
+    }
+}
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int compareUint(const void* a, const void* b) {
+    cl_uint x = *(const cl_uint*)a, y = *(const cl_uint*)b;
+    return (x > y) - (x < y);
+}
+
+static int compareMagnitude(const void* a, const void* b) {
+    float x = fabsf(*(const float*)a), y = fabsf(*(const float*)b);
+    return (x < y) - (x > y);
+}
+
+// Key distributions the sample sort has to cope with
+enum { UNIFORM, FEW_DISTINCT, SKEWED, SORTED, ALL_EQUAL, NUM_DISTRIBUTIONS };
+static const char* distributionNames[] = {"uniform", "16 distinct", "skewed", "sorted", "all equal"};
+
+void fillKeys(cl_uint* data, size_t length, int distribution) {
+    for(size_t i = 0; i < length; ++i) {
+        cl_uint r = ((cl_uint)rand() << 16) ^ (cl_uint)rand();
+        switch(distribution) {
+            case FEW_DISTINCT: data[i] = r % 16 * 0x10000001u; break;
+            case SKEWED:       data[i] = (cl_uint)(pow((double)r / 4294967296.0, 8) * 4294967295.0); break;
+            case SORTED:       data[i] = (cl_uint)i; break;
+            case ALL_EQUAL:    data[i] = 42; break;
+            default:           data[i] = r; break;
+        }
+    }
+}
+
+// ****************************************************************************
+// Function: bitonicSortGPU
+//
+// Purpose:
+//   Sorts n keys ascending with the kernels and launch schedule of
+//   Ch9/BitonicSort_GPU, padded with UINT_MAX to a power of two.
+//
+// Returns:  nothing
+// ****************************************************************************
+static void bitonicSortGPU(cl_context context, cl_command_queue queue, cl_program program,
+                           cl_uint localSize, cl_uint* keys, size_t n) {
+    cl_int error;
+    size_t length = localSize;
+    while(length < n) length <<= 1;
+
+    cl_uint* padded = (cl_uint*) malloc(length * sizeof(cl_uint));
+    memcpy(padded, keys, n * sizeof(cl_uint));
+    for(size_t i = n; i < length; i++) padded[i] = 0xFFFFFFFFu;
+    cl_mem data_d = clCreateBuffer(context, CL_MEM_READ_WRITE|CL_MEM_COPY_HOST_PTR,
+                                   length * sizeof(cl_uint), padded, &error);
+    CHECK_ERROR(error, CL_SUCCESS, "failed to allocate the bitonic sort buffer");
+
+    cl_kernel kernel = clCreateKernel(program, "bitonicSort", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create bitonicSort kernel");
+    cl_kernel localKernel = clCreateKernel(program, "bitonicSort_local", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create bitonicSort_local kernel");
+
+    cl_uint launches;
+    error = bitonicSortEnqueue(queue, kernel, localKernel, data_d, length, localSize, 1, NULL, &launches);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to enqueue the bitonic sort");
+
+    error = clEnqueueReadBuffer(queue, data_d, CL_TRUE, 0, n * sizeof(cl_uint), keys, 0, NULL, NULL);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to read the bitonic sort keys");
+
+    clReleaseKernel(kernel);
+    clReleaseKernel(localKernel);
+    clReleaseMemObject(data_d);
+    free(padded);
+}
+
+static void report(const char* name, size_t n, double seconds, int passed) {
+    printf("  %-12s %10.3f ms %10.2f Mkeys/s  %s\n", name, seconds * 1e3, n / seconds * 1e-6,
+           passed ? "Passed" : "Failed");
+}
+
+int main(int argc, char** argv) {
+    /* OpenCL 1.1 data structures */
+    cl_platform_id* platforms;
+    cl_device_id device;
+    cl_uint numOfPlatforms;
+    cl_int  error;
+
+    size_t dataSize = DATA_SIZE;
+    if(argc > 1) dataSize = strtoul(argv[1], NULL, 10);
+
+    cl_uint* unsortedData = (cl_uint*) malloc(dataSize * sizeof(cl_uint));
+    cl_uint* reference = (cl_uint*) malloc(dataSize * sizeof(cl_uint));
+    cl_uint* sortedData = (cl_uint*) malloc(dataSize * sizeof(cl_uint));
+
+    //Get the number of platforms
+    //Remember that for each vendor's SDK installed on the computer,
+    //the number of available platform also increased.
+    error = clGetPlatformIDs(0, NULL, &numOfPlatforms);
+    if(error != CL_SUCCESS) {
+        perror("Unable to find any OpenCL platforms");
+        exit(1);
+    }
+
+    platforms = (cl_platform_id*) alloca(sizeof(cl_platform_id) * numOfPlatforms);
+    printf("Number of OpenCL platforms found: %d\n", numOfPlatforms);
+
+    error = clGetPlatformIDs(numOfPlatforms, platforms, NULL);
+    if(error != CL_SUCCESS) {
+        perror("Unable to find any OpenCL platforms");
+        exit(1);
+    }
+    // Search for a GPU device through the installed platforms
+    for(cl_int i = 0; i < numOfPlatforms; i++ ) {
+        // Get the GPU device
+        error = clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_GPU, 1, &device, NULL);
+
+        if(error != CL_SUCCESS) {
+            perror("Can't locate a OpenCL compliant device i.e. GPU");
+            exit(1);
+        }
+        // Create a context
+        cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &error);
+        if(error != CL_SUCCESS) {
+            perror("Can't create a valid OpenCL context");
+            exit(1);
+        }
+
+        // The sample sort and the scan it runs on, and the radix and
+        // bitonic sorts it is measured against
+        const char *file_names[] = {"SampleSort.cl", "Scan.cl", "RadixSort.cl", "BitonicSort.cl"};
+        const int NUMBER_OF_FILES = 4;
+        char* buffer[NUMBER_OF_FILES];
+        size_t sizes[NUMBER_OF_FILES];
+        loadProgramSource(file_names, NUMBER_OF_FILES, buffer, sizes);
+
+        cl_command_queue commandQueue = clCreateCommandQueue(context, device, 0, &error);
+        CHECK_ERROR(error, CL_SUCCESS, "failed to create command queue");
+
+        SampleSorter sampleSorter;
+        sampleSorterCreate(&sampleSorter, context, device, commandQueue, buffer[0], sizes[0], buffer[1], sizes[1], NULL, 0);
+        RadixSorter radixSorter;
+        radixSorterCreate(&radixSorter, context, device, commandQueue, buffer[2], sizes[2], RADIX_KEY_UINT, 0);
+
+        // Bitonic tiles as in Ch9
+        cl_uint bitonicLocalSize = bitonicLocalSortSize(device, dataSize);
+        cl_program bitonicProgram = clCreateProgramWithSource(context, 1, (const char**)&buffer[3], &sizes[3], &error);
+        CHECK_ERROR(error, CL_SUCCESS, "Can't create the bitonic sort program");
+        char options[32];
+        sprintf(options, "-DLOCAL_SORT_SIZE=%u", bitonicLocalSize);
+        error = clBuildProgram(bitonicProgram, 1, &device, options, NULL, NULL);
+        CHECK_ERROR(error, CL_SUCCESS, "Can't build the bitonic sort program");
+
+        printf("elementCount: %zu\n", dataSize);
+        for(int distribution = 0; distribution < NUM_DISTRIBUTIONS; distribution++) {
+            fillKeys(unsortedData, dataSize, distribution);
+            memcpy(reference, unsortedData, dataSize * sizeof(cl_uint));
+            qsort(reference, dataSize, sizeof(cl_uint), compareUint);
+            printf("%s keys:\n", distributionNames[distribution]);
+
+            memcpy(sortedData, unsortedData, dataSize * sizeof(cl_uint));
+            double start = now();
+            error = sampleSortGPU(&sampleSorter, sortedData, dataSize);
+            CHECK_ERROR(error, 0, "sample sort failed");
+            double seconds = now() - start;
+            report("sample sort", dataSize, seconds, memcmp(sortedData, reference, dataSize * sizeof(cl_uint)) == 0);
+            printf("  %-12s %d levels\n", "", sampleSorter.levels);
+
+            memcpy(sortedData, unsortedData, dataSize * sizeof(cl_uint));
+            start = now();
+            error = radixSortGPU(&radixSorter, sortedData, NULL, 0, dataSize);
+            CHECK_ERROR(error, 0, "radix sort failed");
+            seconds = now() - start;
+            report("radix sort", dataSize, seconds, memcmp(sortedData, reference, dataSize * sizeof(cl_uint)) == 0);
+
+            memcpy(sortedData, unsortedData, dataSize * sizeof(cl_uint));
+            start = now();
+            bitonicSortGPU(context, commandQueue, bitonicProgram, bitonicLocalSize, sortedData, dataSize);
+            seconds = now() - start;
+            report("bitonic sort", dataSize, seconds, memcmp(sortedData, reference, dataSize * sizeof(cl_uint)) == 0);
+        }
+
+        // Comparison sorting proper: floats by magnitude, largest first.
+        // Keys of equal magnitude may come in any order, so the check is
+        // on the order and on the keys being the same ones.
+        {
+            SampleSorter magnitudeSorter;
+            sampleSorterCreate(&magnitudeSorter, context, device, commandQueue, buffer[0], sizes[0],
+                               buffer[1], sizes[1], MAGNITUDE_ORDER, sizeof(cl_float));
+            float* floats = (float*) sortedData;
+            for(size_t k = 0; k < dataSize; k++)
+                floats[k] = (float)(rand() % 2001 - 1000) * 0.25f;
+            memcpy(unsortedData, floats, dataSize * sizeof(float));
+
+            double start = now();
+            error = sampleSortGPU(&magnitudeSorter, floats, dataSize);
+            CHECK_ERROR(error, 0, "sample sort failed");
+            double seconds = now() - start;
+
+            int passed = 1;
+            for(size_t k = 1; k < dataSize; k++)
+                if(compareMagnitude(&floats[k-1], &floats[k]) > 0) passed = 0;
+            memcpy(reference, floats, dataSize * sizeof(float));
+            qsort(reference, dataSize, sizeof(cl_uint), compareUint);
+            qsort(unsortedData, dataSize, sizeof(cl_uint), compareUint);
+            if(memcmp(reference, unsortedData, dataSize * sizeof(cl_uint)) != 0) passed = 0;
+            printf("floats by magnitude:\n");
+            report("sample sort", dataSize, seconds, passed);
+            sampleSorterRelease(&magnitudeSorter);
+        }
+
+        // Clean up
+        for(int j=0; j< NUMBER_OF_FILES; j++) { free(buffer[j]); }
+
+        sampleSorterRelease(&sampleSorter);
+        radixSorterRelease(&radixSorter);
+        clReleaseProgram(bitonicProgram);
+        clReleaseCommandQueue(commandQueue);
+        clReleaseContext(context);
+    }
+
+    free(unsortedData);
+    free(reference);
+    free(sortedData);
+}
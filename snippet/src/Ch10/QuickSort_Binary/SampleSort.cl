@@ -0,0 +1,230 @@
+/* Key type and strict weak ordering; the host may define both ahead of
+   this file to sort anything a comparison can order */
+#ifndef KEY_T
+#define KEY_T uint
+#endif
+#ifndef KEY_LESS
+#define KEY_LESS(a, b) ((a) < (b))
+#endif
+
+#define GROUP_SIZE 256
+
+/* Splitters per segment, and the buckets they make: one between each
+   two splitters, and one for the keys equal to each splitter */
+#define NUM_SPLITTERS 127
+#define NUM_BUCKETS (2 * NUM_SPLITTERS + 1)
+
+/* Splitters are every OVERSAMPLING-th of a sorted random sample */
+#define OVERSAMPLING 8
+#define NUM_SAMPLES (OVERSAMPLING * (NUM_SPLITTERS + 1))
+
+/* Keys per work-group of bucketHistogram and bucketScatter */
+#define TILE_KEYS 4096
+
+/* Largest bucket finishBuckets sorts in local memory */
+#ifndef LOCAL_SORT_SIZE
+#define LOCAL_SORT_SIZE 2048
+#endif
+
+/* A segment is a run of keys still to split, segment.x keys from
+   segment.y on; segment.z is its first tile and segment.w the keys of
+   all segments before it, which is where its counts start after the scan */
+
+/* Orders keys, padding (pad != 0) after every key */
+bool keyBefore(KEY_T a, uchar padA, KEY_T b, uchar padB) {
+    if(padA) return false;
+    if(padB) return true;
+    return KEY_LESS(a, b);
+}
+
+/* Bitonic sort of size (a power of two) keys in local memory, ascending */
+void localBitonicSort(__local KEY_T* keys, __local uchar* pad, uint size) {
+    uint localId = get_local_id(0);
+    uint localSize = get_local_size(0);
+
+    for(uint k = 2; k <= size; k <<= 1) {
+        for(uint j = k >> 1; j > 0; j >>= 1) {
+            for(uint i = localId; i < size; i += localSize) {
+                uint partner = i ^ j;
+                if(partner > i) {
+                    bool ascending = (i & k) == 0;
+                    bool swap = ascending ? keyBefore(keys[partner], pad[partner], keys[i], pad[i])
+                                          : keyBefore(keys[i], pad[i], keys[partner], pad[partner]);
+                    if(swap) {
+                        KEY_T key = keys[i];
+                        keys[i] = keys[partner];
+                        keys[partner] = key;
+                        uchar p = pad[i];
+                        pad[i] = pad[partner];
+                        pad[partner] = p;
+                    }
+                }
+            }
+            barrier(CLK_LOCAL_MEM_FENCE);
+        }
+    }
+}
+
+/* Bucket of a key: 2j for keys between splitters j-1 and j, 2j+1 for
+   keys equal to splitter j.  Equal splitters leave empty buckets. */
+uint bucketOf(KEY_T key, __local KEY_T* splitters) {
+    uint lo = 0, hi = NUM_SPLITTERS;
+    while(lo < hi) {
+        uint mid = (lo + hi) >> 1;
+        if(KEY_LESS(splitters[mid], key)) lo = mid + 1;
+        else hi = mid;
+    }
+    if(lo < NUM_SPLITTERS && !KEY_LESS(key, splitters[lo]))
+        return 2 * lo + 1;
+    return 2 * lo;
+}
+
+uint hashIndex(uint i, uint seed) {
+    uint h = i * 0x9E3779B1u ^ seed * 0x85EBCA6Bu;
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    return h;
+}
+
+/* One work-group per segment: sorts a random sample of its keys and
+   keeps every OVERSAMPLING-th.  Every splitter is a key of the segment,
+   so each split leaves every bucket between splitters smaller. */
+__kernel void selectSplitters(__global const KEY_T* data,
+                              __global const uint4* segments,
+                              __global KEY_T* splitters,
+                              __local KEY_T* samples,
+                              __local uchar* pad,
+                              uint seed) {
+
+    uint localId = get_local_id(0);
+    uint segment = get_group_id(0);
+    uint4 s = segments[segment];
+
+    for(uint i = localId; i < NUM_SAMPLES; i += get_local_size(0)) {
+        samples[i] = data[s.y + hashIndex(i, seed + segment) % s.x];
+        pad[i] = 0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    localBitonicSort(samples, pad, NUM_SAMPLES);
+
+    for(uint j = localId; j < NUM_SPLITTERS; j += get_local_size(0))
+        splitters[segment * NUM_SPLITTERS + j] = samples[(j + 1) * OVERSAMPLING];
+}
+
+/* Loads the splitters of a segment into local memory */
+void loadSplitters(__global const KEY_T* splitters, uint segment, __local KEY_T* local_splitters) {
+    for(uint j = get_local_id(0); j < NUM_SPLITTERS; j += get_local_size(0))
+        local_splitters[j] = splitters[segment * NUM_SPLITTERS + j];
+}
+
+/* Counts of a tile's keys per bucket.  Counts are laid out segment by
+   segment, bucket-major within one, so one exclusive scan over all of
+   them gives every tile the place of its keys in every bucket. */
+__kernel void bucketHistogram(__global const KEY_T* data,
+                              __global const uint4* segments,
+                              __global const uint* tileSegments,
+                              __global const KEY_T* splitters,
+                              __global uint* counts,
+                              __local KEY_T* local_splitters,
+                              __local uint* histogram) {
+
+    uint localId = get_local_id(0);
+    uint tile = get_group_id(0);
+    uint segment = tileSegments[tile];
+    uint4 s = segments[segment];
+    uint segmentTiles = (s.x + TILE_KEYS - 1) / TILE_KEYS;
+    uint first = (tile - s.z) * TILE_KEYS;
+    uint last = min(first + TILE_KEYS, s.x);
+
+    loadSplitters(splitters, segment, local_splitters);
+    for(uint b = localId; b < NUM_BUCKETS; b += get_local_size(0))
+        histogram[b] = 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(uint i = first + localId; i < last; i += get_local_size(0))
+        atomic_inc(histogram + bucketOf(data[s.y + i], local_splitters));
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(uint b = localId; b < NUM_BUCKETS; b += get_local_size(0))
+        counts[s.z * NUM_BUCKETS + b * segmentTiles + (tile - s.z)] = histogram[b];
+}
+
+/* Moves a tile's keys to their buckets.  Keys of one tile and bucket
+   land in any order: the sort is not stable. */
+__kernel void bucketScatter(__global const KEY_T* data,
+                            __global KEY_T* sortedData,
+                            __global const uint4* segments,
+                            __global const uint* tileSegments,
+                            __global const KEY_T* splitters,
+                            __global const uint* counts,
+                            __local KEY_T* local_splitters,
+                            __local uint* offsets) {
+
+    uint localId = get_local_id(0);
+    uint tile = get_group_id(0);
+    uint segment = tileSegments[tile];
+    uint4 s = segments[segment];
+    uint segmentTiles = (s.x + TILE_KEYS - 1) / TILE_KEYS;
+    uint first = (tile - s.z) * TILE_KEYS;
+    uint last = min(first + TILE_KEYS, s.x);
+
+    loadSplitters(splitters, segment, local_splitters);
+    for(uint b = localId; b < NUM_BUCKETS; b += get_local_size(0))
+        offsets[b] = s.y + counts[s.z * NUM_BUCKETS + b * segmentTiles + (tile - s.z)] - s.w;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(uint i = first + localId; i < last; i += get_local_size(0)) {
+        KEY_T key = data[s.y + i];
+        uint position = atomic_inc(offsets + bucketOf(key, local_splitters));
+        sortedData[position] = key;
+    }
+}
+
+/* Where every bucket of every segment starts, for the host to plan the
+   next level */
+__kernel void bucketBounds(__global const uint4* segments,
+                           __global const uint* counts,
+                           __global uint* bounds,
+                           uint numSegments) {
+
+    uint gidx = get_global_id(0);
+    if(gidx >= numSegments * NUM_BUCKETS) return;
+    uint4 s = segments[gidx / NUM_BUCKETS];
+    uint b = gidx % NUM_BUCKETS;
+    uint segmentTiles = (s.x + TILE_KEYS - 1) / TILE_KEYS;
+    bounds[gidx] = s.y + counts[s.z * NUM_BUCKETS + b * segmentTiles] - s.w;
+}
+
+/* One work-group per bucket, bucket.x keys from bucket.y on: moved
+   from data to sortedData as they are if bucket.z is set (keys all
+   equal), else sorted in local memory on the way */
+__kernel void finishBuckets(__global const KEY_T* data,
+                            __global KEY_T* sortedData,
+                            __global const uint4* buckets,
+                            __local KEY_T* keys,
+                            __local uchar* pad) {
+
+    uint localId = get_local_id(0);
+    uint4 bucket = buckets[get_group_id(0)];
+
+    if(bucket.z) {
+        for(uint i = localId; i < bucket.x; i += get_local_size(0))
+            sortedData[bucket.y + i] = data[bucket.y + i];
+        return;
+    }
+
+    uint size = 2;
+    while(size < bucket.x) size <<= 1;
+    for(uint i = localId; i < size; i += get_local_size(0)) {
+        pad[i] = (i >= bucket.x);
+        if(i < bucket.x) keys[i] = data[bucket.y + i];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    localBitonicSort(keys, pad, size);
+
+    for(uint i = localId; i < bucket.x; i += get_local_size(0))
+        sortedData[bucket.y + i] = keys[i];
+}
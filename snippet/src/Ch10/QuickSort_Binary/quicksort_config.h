@@ -0,0 +1,2 @@
+#define DEBUG
+#define DEBUG_VERBOSE
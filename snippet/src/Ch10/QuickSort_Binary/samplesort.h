@@ -0,0 +1,338 @@
+#ifndef SAMPLESORT_H_
+#define SAMPLESORT_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "scan.h"
+
+#ifdef  __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Must match SampleSort.cl
+#define SAMPLE_GROUP_SIZE 256
+#define NUM_SPLITTERS 127
+#define NUM_BUCKETS (2 * NUM_SPLITTERS + 1)
+#define NUM_SAMPLES (8 * (NUM_SPLITTERS + 1))
+#define TILE_KEYS 4096
+#define LOCAL_SORT_SIZE 2048
+
+// Device state of one sample sorter: the kernels of SampleSort.cl built
+// for one key type and ordering, and the buffers they work on.  The
+// buffers only ever grow.
+typedef struct {
+    cl_context context;
+    cl_device_id device;
+    cl_command_queue commandQueue;
+    cl_program program;
+    size_t keySize;
+    int levels;                 // splitting levels the last sort took
+
+    cl_kernel selectSplittersKernel;
+    cl_kernel histogramKernel;
+    cl_kernel scatterKernel;
+    cl_kernel boundsKernel;
+    cl_kernel finishKernel;
+    Scanner scanner;            // exclusive scan of the tile counts
+
+    cl_mem data_d[2];           // keys; each level splits from one into the other
+    cl_mem segments_d;
+    cl_mem tileSegments_d;
+    cl_mem splitters_d;
+    cl_mem counts_d;
+    cl_mem bounds_d;
+    cl_mem buckets_d;
+    size_t capacity[8];         // bytes of each of the buffers above
+
+    // host side of the per-level tables
+    cl_uint* segments;          // 4 per segment, as uint4 in SampleSort.cl
+    cl_uint* tileSegments;
+    cl_uint* bounds;
+    cl_uint* buckets;           // 4 per bucket
+    cl_uint* nextSegments;
+} SampleSorter;
+
+// Builds SampleSort.cl and creates its kernels.  keyDefinition, if not
+// NULL, goes ahead of the source and defines KEY_T, of keySize bytes,
+// and KEY_LESS(a, b), a strict weak ordering of two keys; the default
+// sorts cl_uint ascending.  scanSource is Scan.cl of Scan_GPU, which
+// scans the bucket counts.
+static void sampleSorterCreate(SampleSorter* s,
+                               cl_context context,
+                               cl_device_id device,
+                               cl_command_queue commandQueue,
+                               const char* source,
+                               size_t sourceSize,
+                               const char* scanSource,
+                               size_t scanSourceSize,
+                               const char* keyDefinition,
+                               size_t keySize) {
+    cl_int error;
+
+    memset(s, 0, sizeof(*s));
+    s->context = context;
+    s->device = device;
+    s->commandQueue = commandQueue;
+    s->keySize = keyDefinition != NULL ? keySize : sizeof(cl_uint);
+
+    const char* sources[2] = {keyDefinition != NULL ? keyDefinition : "", source};
+    size_t sizes[2] = {strlen(sources[0]), sourceSize};
+    s->program = clCreateProgramWithSource(context, 2, sources, sizes, &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Can't create the OpenCL program object");
+
+    // Build OpenCL program object and dump the error message, if any
+    error = clBuildProgram(s->program, 1, &device, NULL, NULL, NULL);
+    if(error != CL_SUCCESS) {
+        // If there's an error whilst building the program, dump the log
+        size_t log_size;
+        clGetProgramBuildInfo(s->program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+        char *program_log = (char*) malloc(log_size+1);
+        program_log[log_size] = '\0';
+        clGetProgramBuildInfo(s->program, device, CL_PROGRAM_BUILD_LOG,
+                              log_size+1, program_log, NULL);
+        printf("\n=== ERROR ===\n\n%s\n=============\n", program_log);
+        free(program_log);
+        exit(1);
+    }
+
+    s->selectSplittersKernel = clCreateKernel(s->program, "selectSplitters", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create selectSplitters kernel");
+    s->histogramKernel = clCreateKernel(s->program, "bucketHistogram", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create bucketHistogram kernel");
+    s->scatterKernel = clCreateKernel(s->program, "bucketScatter", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create bucketScatter kernel");
+    s->boundsKernel = clCreateKernel(s->program, "bucketBounds", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create bucketBounds kernel");
+    s->finishKernel = clCreateKernel(s->program, "finishBuckets", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create finishBuckets kernel");
+
+    scannerCreate(&s->scanner, context, device, commandQueue, scanSource, scanSourceSize,
+                  SCAN_UINT, SCAN_ADD, NULL, NULL);
+}
+
+// Grows device buffer i of the sorter to at least size bytes
+static cl_mem* sampleSortBuffer(SampleSorter* s, int i, size_t size, const char* name) {
+    cl_mem* buffers[] = {&s->data_d[0], &s->data_d[1], &s->segments_d, &s->tileSegments_d,
+                         &s->splitters_d, &s->counts_d, &s->bounds_d, &s->buckets_d};
+    cl_int error;
+    if(size > s->capacity[i]) {
+        if(*buffers[i] != NULL) clReleaseMemObject(*buffers[i]);
+        *buffers[i] = clCreateBuffer(s->context, CL_MEM_READ_WRITE, size, NULL, &error);
+        CHECK_ERROR(error, CL_SUCCESS, name);
+        s->capacity[i] = size;
+    }
+    return buffers[i];
+}
+
+static void sampleSortLaunch(SampleSorter* s, cl_kernel kernel, size_t groups, const char* msg) {
+    size_t globalThreads = groups * SAMPLE_GROUP_SIZE;
+    size_t localThreads = SAMPLE_GROUP_SIZE;
+    cl_int status = clEnqueueNDRangeKernel(s->commandQueue, kernel, 1, NULL,
+                                           &globalThreads, &localThreads, 0, NULL, NULL);
+    CHECK_ERROR(status, CL_SUCCESS, msg);
+}
+
+// Splits every segment of a level from data_d[src] into its buckets in
+// data_d[1-src], and reads back where the buckets start
+static void sampleSortSplit(SampleSorter* s, int src, cl_uint numSegments, cl_uint numTiles, cl_uint level) {
+    cl_int status;
+    cl_mem segments_d = *sampleSortBuffer(s, 2, numSegments * 4 * sizeof(cl_uint), "failed to allocate segments_d");
+    cl_mem tileSegments_d = *sampleSortBuffer(s, 3, numTiles * sizeof(cl_uint), "failed to allocate tileSegments_d");
+    cl_mem splitters_d = *sampleSortBuffer(s, 4, numSegments * NUM_SPLITTERS * s->keySize, "failed to allocate splitters_d");
+    cl_mem counts_d = *sampleSortBuffer(s, 5, numTiles * NUM_BUCKETS * sizeof(cl_uint), "failed to allocate counts_d");
+    cl_mem bounds_d = *sampleSortBuffer(s, 6, numSegments * NUM_BUCKETS * sizeof(cl_uint), "failed to allocate bounds_d");
+
+    // The queue runs in order; the host arrays stay untouched until the
+    // blocking read of the bounds
+    status = clEnqueueWriteBuffer(s->commandQueue, segments_d, CL_FALSE, 0, numSegments * 4 * sizeof(cl_uint), s->segments, 0, NULL, NULL);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to write segments");
+    status = clEnqueueWriteBuffer(s->commandQueue, tileSegments_d, CL_FALSE, 0, numTiles * sizeof(cl_uint), s->tileSegments, 0, NULL, NULL);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to write tile segments");
+
+    cl_uint seed = level * 7919u;
+    status = clSetKernelArg(s->selectSplittersKernel, 0, sizeof(cl_mem), (void*)&s->data_d[src]);
+    status |= clSetKernelArg(s->selectSplittersKernel, 1, sizeof(cl_mem), (void*)&segments_d);
+    status |= clSetKernelArg(s->selectSplittersKernel, 2, sizeof(cl_mem), (void*)&splitters_d);
+    status |= clSetKernelArg(s->selectSplittersKernel, 3, NUM_SAMPLES * s->keySize, NULL);
+    status |= clSetKernelArg(s->selectSplittersKernel, 4, NUM_SAMPLES, NULL);
+    status |= clSetKernelArg(s->selectSplittersKernel, 5, sizeof(cl_uint), (void*)&seed);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to set selectSplitters kernel arguments");
+    sampleSortLaunch(s, s->selectSplittersKernel, numSegments, "Failed to enqueue selectSplitters kernel");
+
+    status = clSetKernelArg(s->histogramKernel, 0, sizeof(cl_mem), (void*)&s->data_d[src]);
+    status |= clSetKernelArg(s->histogramKernel, 1, sizeof(cl_mem), (void*)&segments_d);
+    status |= clSetKernelArg(s->histogramKernel, 2, sizeof(cl_mem), (void*)&tileSegments_d);
+    status |= clSetKernelArg(s->histogramKernel, 3, sizeof(cl_mem), (void*)&splitters_d);
+    status |= clSetKernelArg(s->histogramKernel, 4, sizeof(cl_mem), (void*)&counts_d);
+    status |= clSetKernelArg(s->histogramKernel, 5, NUM_SPLITTERS * s->keySize, NULL);
+    status |= clSetKernelArg(s->histogramKernel, 6, NUM_BUCKETS * sizeof(cl_uint), NULL);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to set bucketHistogram kernel arguments");
+    sampleSortLaunch(s, s->histogramKernel, numTiles, "Failed to enqueue bucketHistogram kernel");
+
+    // The counts of a level, tiles times buckets, outgrow one work-group
+    // on large inputs: the scan of Scan_GPU runs over the whole device
+    cl_uint numCounts = numTiles * NUM_BUCKETS;
+    clReleaseEvent(scanDevice(&s->scanner, counts_d, counts_d, numCounts, 1, NULL));
+
+    status = clSetKernelArg(s->scatterKernel, 0, sizeof(cl_mem), (void*)&s->data_d[src]);
+    status |= clSetKernelArg(s->scatterKernel, 1, sizeof(cl_mem), (void*)&s->data_d[1 - src]);
+    status |= clSetKernelArg(s->scatterKernel, 2, sizeof(cl_mem), (void*)&segments_d);
+    status |= clSetKernelArg(s->scatterKernel, 3, sizeof(cl_mem), (void*)&tileSegments_d);
+    status |= clSetKernelArg(s->scatterKernel, 4, sizeof(cl_mem), (void*)&splitters_d);
+    status |= clSetKernelArg(s->scatterKernel, 5, sizeof(cl_mem), (void*)&counts_d);
+    status |= clSetKernelArg(s->scatterKernel, 6, NUM_SPLITTERS * s->keySize, NULL);
+    status |= clSetKernelArg(s->scatterKernel, 7, NUM_BUCKETS * sizeof(cl_uint), NULL);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to set bucketScatter kernel arguments");
+    sampleSortLaunch(s, s->scatterKernel, numTiles, "Failed to enqueue bucketScatter kernel");
+
+    status = clSetKernelArg(s->boundsKernel, 0, sizeof(cl_mem), (void*)&segments_d);
+    status |= clSetKernelArg(s->boundsKernel, 1, sizeof(cl_mem), (void*)&counts_d);
+    status |= clSetKernelArg(s->boundsKernel, 2, sizeof(cl_mem), (void*)&bounds_d);
+    status |= clSetKernelArg(s->boundsKernel, 3, sizeof(cl_uint), (void*)&numSegments);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to set bucketBounds kernel arguments");
+    sampleSortLaunch(s, s->boundsKernel, (numSegments * NUM_BUCKETS + SAMPLE_GROUP_SIZE - 1) / SAMPLE_GROUP_SIZE,
+                     "Failed to enqueue bucketBounds kernel");
+
+    status = clEnqueueReadBuffer(s->commandQueue, bounds_d, CL_TRUE, 0, numSegments * NUM_BUCKETS * sizeof(cl_uint), s->bounds, 0, NULL, NULL);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to read bucket bounds");
+}
+
+// Sorts or moves the listed buckets from data_d[src] to data_d[0]
+static void sampleSortFinish(SampleSorter* s, int src, cl_uint numBuckets) {
+    cl_int status;
+    if(numBuckets == 0) return;
+    cl_mem buckets_d = *sampleSortBuffer(s, 7, numBuckets * 4 * sizeof(cl_uint), "failed to allocate buckets_d");
+    status = clEnqueueWriteBuffer(s->commandQueue, buckets_d, CL_FALSE, 0, numBuckets * 4 * sizeof(cl_uint), s->buckets, 0, NULL, NULL);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to write buckets");
+
+    status = clSetKernelArg(s->finishKernel, 0, sizeof(cl_mem), (void*)&s->data_d[src]);
+    status |= clSetKernelArg(s->finishKernel, 1, sizeof(cl_mem), (void*)&s->data_d[0]);
+    status |= clSetKernelArg(s->finishKernel, 2, sizeof(cl_mem), (void*)&buckets_d);
+    status |= clSetKernelArg(s->finishKernel, 3, LOCAL_SORT_SIZE * s->keySize, NULL);
+    status |= clSetKernelArg(s->finishKernel, 4, LOCAL_SORT_SIZE, NULL);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to set finishBuckets kernel arguments");
+    sampleSortLaunch(s, s->finishKernel, numBuckets, "Failed to enqueue finishBuckets kernel");
+}
+
+// ****************************************************************************
+// Function: sampleSortGPU
+//
+// Purpose:
+//   Sorts n keys in place by the sorter's KEY_LESS, not stably.  Each
+//   level splits every segment still too large for local memory around
+//   splitters sampled from it: a histogram of the buckets per tile of
+//   keys, a scan of the histograms, and a scatter.  Buckets that fit in
+//   local memory are sorted there, buckets of keys equal to a splitter
+//   need no sorting at all, and the rest make up the next level.  Skewed
+//   inputs only cost more levels; the host waits once per level for the
+//   bucket bounds.
+//
+// Arguments:
+//   s: sorter created by sampleSorterCreate
+//   keys: n keys of s->keySize bytes, sorted on return
+//   n: number of keys
+//
+// Returns:  0 on success, -1 if n is too large
+// ****************************************************************************
+static int sampleSortGPU(SampleSorter* s, void* keys, size_t n) {
+    cl_int status;
+
+    if(n > (size_t)0xFFFFFFFF - TILE_KEYS) return -1;
+    s->levels = 0;
+    if(n < 2) return 0;
+
+    size_t maxSegments = n / LOCAL_SORT_SIZE + 1;
+    size_t maxTiles = n / TILE_KEYS + maxSegments;
+    free(s->segments); free(s->tileSegments); free(s->bounds); free(s->buckets); free(s->nextSegments);
+    s->segments = (cl_uint*) malloc(maxSegments * 4 * sizeof(cl_uint));
+    s->nextSegments = (cl_uint*) malloc(maxSegments * 2 * sizeof(cl_uint));
+    s->tileSegments = (cl_uint*) malloc(maxTiles * sizeof(cl_uint));
+    s->bounds = (cl_uint*) malloc(maxSegments * NUM_BUCKETS * sizeof(cl_uint));
+    s->buckets = (cl_uint*) malloc((maxSegments * NUM_BUCKETS + 1) * 4 * sizeof(cl_uint));
+
+    sampleSortBuffer(s, 0, n * s->keySize, "failed to allocate data_d[0]");
+    status = clEnqueueWriteBuffer(s->commandQueue, s->data_d[0], CL_FALSE, 0, n * s->keySize, keys, 0, NULL, NULL);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to write keys");
+
+    // Segments of the next level as (count, offset) pairs
+    cl_uint numNext = 0;
+    if(n <= LOCAL_SORT_SIZE) {
+        cl_uint bucket[4] = {(cl_uint)n, 0, 0, 0};
+        memcpy(s->buckets, bucket, sizeof(bucket));
+        sampleSortFinish(s, 0, 1);
+    } else {
+        sampleSortBuffer(s, 1, n * s->keySize, "failed to allocate data_d[1]");
+        s->nextSegments[0] = (cl_uint)n;
+        s->nextSegments[1] = 0;
+        numNext = 1;
+    }
+
+    int src = 0;
+    while(numNext > 0) {
+        cl_uint numSegments = numNext;
+        cl_uint numTiles = 0, prefix = 0;
+        for(cl_uint g = 0; g < numSegments; g++) {
+            cl_uint count = s->nextSegments[2 * g], offset = s->nextSegments[2 * g + 1];
+            cl_uint tiles = (count + TILE_KEYS - 1) / TILE_KEYS;
+            cl_uint segment[4] = {count, offset, numTiles, prefix};
+            memcpy(s->segments + 4 * g, segment, sizeof(segment));
+            for(cl_uint t = 0; t < tiles; t++) s->tileSegments[numTiles++] = g;
+            prefix += count;
+        }
+        sampleSortSplit(s, src, numSegments, numTiles, (cl_uint)s->levels);
+        src = 1 - src;
+        s->levels++;
+
+        // Buckets of equal keys only move, to data_d[0] if they are not
+        // there yet; small ones are sorted into place; the rest go on
+        cl_uint numBuckets = 0;
+        numNext = 0;
+        for(cl_uint g = 0; g < numSegments; g++) {
+            cl_uint segmentEnd = s->segments[4 * g + 1] + s->segments[4 * g];
+            for(cl_uint b = 0; b < NUM_BUCKETS; b++) {
+                cl_uint offset = s->bounds[g * NUM_BUCKETS + b];
+                cl_uint end = (b + 1 < NUM_BUCKETS) ? s->bounds[g * NUM_BUCKETS + b + 1] : segmentEnd;
+                cl_uint count = end - offset;
+                int equal = (b & 1) || count == 1;
+                if(count == 0 || (equal && src == 0)) continue;
+                if(equal || count <= LOCAL_SORT_SIZE) {
+                    cl_uint bucket[4] = {count, offset, (cl_uint)equal, 0};
+                    memcpy(s->buckets + 4 * numBuckets++, bucket, sizeof(bucket));
+                } else {
+                    s->nextSegments[2 * numNext] = count;
+                    s->nextSegments[2 * numNext + 1] = offset;
+                    numNext++;
+                }
+            }
+        }
+        sampleSortFinish(s, src, numBuckets);
+    }
+
+    status = clEnqueueReadBuffer(s->commandQueue, s->data_d[0], CL_TRUE, 0, n * s->keySize, keys, 0, NULL, NULL);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to read keys");
+    return 0;
+}
+
+static void sampleSorterRelease(SampleSorter* s) {
+    cl_mem buffers[] = {s->data_d[0], s->data_d[1], s->segments_d, s->tileSegments_d,
+                        s->splitters_d, s->counts_d, s->bounds_d, s->buckets_d};
+    for(int i = 0; i < sizeof(buffers)/sizeof(buffers[0]); i++)
+        if(buffers[i] != NULL) clReleaseMemObject(buffers[i]);
+
+    clReleaseKernel(s->selectSplittersKernel);
+    clReleaseKernel(s->histogramKernel);
+    clReleaseKernel(s->scatterKernel);
+    clReleaseKernel(s->boundsKernel);
+    clReleaseKernel(s->finishKernel);
+    clReleaseProgram(s->program);
+    scannerRelease(&s->scanner);
+    free(s->segments); free(s->tileSegments); free(s->bounds); free(s->buckets); free(s->nextSegments);
+    memset(s, 0, sizeof(*s));
+}
+
+#endif // SAMPLESORT_H_
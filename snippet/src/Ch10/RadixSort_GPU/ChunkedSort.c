@@ -0,0 +1,169 @@
+#define _POSIX_C_SOURCE 200112L  // clock_gettime, sysconf and mmap under -std=c99
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <alloca.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "radixsort_config.h"
+#include "chunkedsort.h"
+#include "sortutil.h"
+
+#define DATA_SIZE (1<<22)
+
+// Whether out holds the keys of in in order, going by the keys as
+// ordered integers: ascending, with the same sum and xor
+static int sortedPermutation(const void* in, const void* out, size_t n, RadixKeyType keyType) {
+    cl_ulong sumIn = 0, sumOut = 0, xorIn = 0, xorOut = 0;
+    for(size_t i = 0; i < n; i++) {
+        cl_ulong a = encodeKeyCPU(in, i, keyType);
+        cl_ulong b = encodeKeyCPU(out, i, keyType);
+        if(i > 0 && encodeKeyCPU(out, i - 1, keyType) > b) return 0;
+        sumIn += a; xorIn ^= a;
+        sumOut += b; xorOut ^= b;
+    }
+    return sumIn == sumOut && xorIn == xorOut;
+}
+
+int main(int argc, char** argv) {
+    /* OpenCL 1.1 data structures */
+    cl_platform_id* platforms;
+    cl_device_id device;
+    cl_uint numOfPlatforms;
+    cl_int  error;
+
+    // [n] [chunkKeys] [type] [keyFile]: n random keys, or the keys of
+    // keyFile, raw and of the given type, mapped rather than read.  The
+    // chunk is sized from the device unless given.
+    size_t dataSize = DATA_SIZE;
+    size_t chunkKeys = 0;
+    RadixKeyType keyType = RADIX_KEY_UINT;
+    const char* keyFile = NULL;
+    if(argc > 1) dataSize = strtoul(argv[1], NULL, 10);
+    if(argc > 2) chunkKeys = strtoul(argv[2], NULL, 10);
+    if(argc > 3) {
+        for(int t = 0; t <= RADIX_KEY_DOUBLE; t++)
+            if(strcmp(argv[3], keyTypeNames[t]) == 0) keyType = (RadixKeyType)t;
+    }
+    if(argc > 4) keyFile = argv[4];
+    size_t keySize = RADIX_KEY_SIZE(keyType);
+
+    void* keys;
+    size_t mappedSize = 0;
+    if(keyFile != NULL) {
+        int fd = open(keyFile, O_RDONLY);
+        struct stat st;
+        if(fd < 0 || fstat(fd, &st) != 0) {
+            perror("Couldn't open the key file");
+            exit(1);
+        }
+        mappedSize = (size_t)st.st_size;
+        if(dataSize == 0 || dataSize > mappedSize / keySize) dataSize = mappedSize / keySize;
+        keys = mmap(NULL, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(keys == MAP_FAILED) {
+            perror("Couldn't map the key file");
+            exit(1);
+        }
+    } else {
+        keys = malloc(dataSize * keySize + 1);
+        fillRandom(keys, dataSize, keyType);
+    }
+    void* runs = malloc(dataSize * keySize + 1);
+    void* sorted = malloc(dataSize * keySize + 1);
+
+    //Get the number of platforms
+    //Remember that for each vendor's SDK installed on the computer,
+    //the number of available platform also increased.
+    error = clGetPlatformIDs(0, NULL, &numOfPlatforms);
+    if(error != CL_SUCCESS) {
+        perror("Unable to find any OpenCL platforms");
+        exit(1);
+    }
+
+    platforms = (cl_platform_id*) alloca(sizeof(cl_platform_id) * numOfPlatforms);
+    printf("Number of OpenCL platforms found: %d\n", numOfPlatforms);
+
+    error = clGetPlatformIDs(numOfPlatforms, platforms, NULL);
+    if(error != CL_SUCCESS) {
+        perror("Unable to find any OpenCL platforms");
+        exit(1);
+    }
+    for(cl_int i = 0; i < numOfPlatforms; i++ ) {
+        // Get the GPU device
+        error = clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_GPU, 1, &device, NULL);
+
+        if(error != CL_SUCCESS) {
+            perror("Can't locate a OpenCL compliant device i.e. GPU");
+            exit(1);
+        }
+        // Create a context
+        cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &error);
+        if(error != CL_SUCCESS) {
+            perror("Can't create a valid OpenCL context");
+            exit(1);
+        }
+
+        const char *file_names[] = {"RadixSort.cl"};
+        const int NUMBER_OF_FILES = 1;
+        char* buffer[NUMBER_OF_FILES];
+        size_t sizes[NUMBER_OF_FILES];
+        loadProgramSource(file_names, NUMBER_OF_FILES, buffer, sizes);
+
+        // One queue sorts, the other moves chunks in and runs out
+        cl_command_queue commandQueue = clCreateCommandQueue(context, device, 0, &error);
+        CHECK_ERROR(error, CL_SUCCESS, "failed to create command queue");
+        cl_command_queue transferQueue = clCreateCommandQueue(context, device, 0, &error);
+        CHECK_ERROR(error, CL_SUCCESS, "failed to create transfer queue");
+
+        RadixSorter sorter;
+        radixSorterCreate(&sorter, context, device, commandQueue, buffer[0], sizes[0], keyType, 0);
+        size_t deviceKeys = chunkedSortChooseChunk(&sorter);
+
+        ChunkedSorter chunked;
+        chunkedSorterCreate(&chunked, &sorter, transferQueue, chunkKeys);
+        printf("elementCount: %zu %s keys%s, chunk: %zu keys, %zu runs, device holds %zu keys\n",
+               dataSize, keyTypeNames[keyType], keyFile != NULL ? " (mapped)" : "", chunked.chunkKeys,
+               (dataSize + chunked.chunkKeys - 1) / chunked.chunkKeys, deviceKeys);
+
+        double start = now();
+        chunkedSortRuns(&chunked, keys, runs, dataSize);
+        double runsSeconds = now() - start;
+        error = chunkedSortMerge(&chunked, runs, sorted, dataSize, 0);
+        CHECK_ERROR(error, 0, "chunked sort failed");
+        double seconds = now() - start;
+        printf("Chunked sort:   %9.3f ms %8.2f Mkeys/s (runs %.3f ms, merge %.3f ms)\n", seconds * 1e3,
+               dataSize / seconds * 1e-6, runsSeconds * 1e3, (seconds - runsSeconds) * 1e3);
+        int passed = sortedPermutation(keys, sorted, dataSize, keyType);
+
+        // The same keys at once, for the throughput to hold the chunked
+        // sort against, when the device holds them
+        if(dataSize <= deviceKeys) {
+            memcpy(runs, keys, dataSize * keySize);
+            start = now();
+            error = radixSortGPU(&sorter, runs, NULL, 0, dataSize);
+            CHECK_ERROR(error, 0, "radix sort failed");
+            seconds = now() - start;
+            printf("In-memory sort: %9.3f ms %8.2f Mkeys/s\n", seconds * 1e3, dataSize / seconds * 1e-6);
+            passed = passed && memcmp(runs, sorted, dataSize * keySize) == 0;
+        }
+        if (passed) printf("Passed:%zu!\n", dataSize); else printf("Failed!\n");
+
+        for(int j=0; j< NUMBER_OF_FILES; j++) { free(buffer[j]); }
+
+        chunkedSorterRelease(&chunked);
+        radixSorterRelease(&sorter);
+        clReleaseCommandQueue(transferQueue);
+        clReleaseCommandQueue(commandQueue);
+        clReleaseContext(context);
+    }
+
+    if(keyFile != NULL) munmap(keys, mappedSize); else free(keys);
+    free(runs);
+    free(sorted);
+    return 0;
+}
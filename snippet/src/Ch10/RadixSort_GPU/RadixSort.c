@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 199309L  // clock_gettime under -std=c99
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
@@ -8,70 +9,46 @@
 #include <time.h>
 
 #include "radixsort_config.h"
-#include "common.h"
-
-#ifdef  __APPLE__
-#include <OpenCL/opencl.h>
-#else
-#include <CL/cl.h>
-#endif
-
-#define GROUP_SIZE 64                   // ATI HD7870 has 20 parallel compute units, !!!wavefront programming!!!
-#define BIN_SIZE 256
+#include "radixsort.h"
+#include "sortutil.h"
 
 #define DATA_SIZE (1<<16)
 
-cl_kernel histogramKernel;
-cl_kernel permuteKernel  ;
-cl_kernel unifiedBlockScanKernel ;
-cl_kernel blockScanKernel ;
-cl_kernel prefixSumKernel;
-cl_kernel blockAddKernel ;
-cl_kernel mergePrefixSumsKernel   ;
-cl_mem unsortedData_d    ;
-cl_mem histogram_d       ;
-cl_mem scannedHistogram_d;
-cl_mem sortedData_d      ;
-cl_mem sum_in_d          ;
-cl_mem sum_out_d         ;
-cl_mem summary_in_d      ;
-cl_mem summary_out_d     ;
-cl_command_queue commandQueue;
-
-
-int
-waitAndReleaseDevice(cl_event* event) {
-    cl_int status = CL_SUCCESS;
-    cl_int eventStatus = CL_QUEUED;
-    while(eventStatus != CL_COMPLETE) {
-        clGetEventInfo(*event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &eventStatus, NULL);
-    }
-    status = clReleaseEvent(*event);
-    CHECK_ERROR(status, CL_SUCCESS, "Failed to release event\n");
-    return 0;
-}
-
 
 // Translated from the COUNTING-SORT algorithm presented in their
-// paper "Radix Sort for Vector Multiprocessors" by Zagha and Blelloch
-int radixSortCPU(cl_uint* unsortedData, cl_uint* hSortedData) {
-
+// paper "Radix Sort for Vector Multiprocessors" by Zagha and Blelloch;
+// the payload of valueSize bytes per key, if any, moves with its key.
+// Digits are bitsbyte bits wide.  Keys are encoded as they are copied
+// in and decoded by the last pass, as on the device.
+int radixSortCPU(const void* unsortedData, void* hSortedData, size_t n, RadixKeyType keyType,
+                 const void* values, void* sortedValues, size_t valueSize,
+                 int bitsbyte) {
+
+    const int R = 1 << bitsbyte;
+    const cl_uint R_MASK = R - 1;
+    const int keyBits = (int)RADIX_KEY_SIZE(keyType) * 8;
+    const int passes = (keyBits + bitsbyte - 1) / bitsbyte;
     cl_uint *histogram = (cl_uint*) malloc(R * sizeof(cl_uint));
-    cl_uint *scratch = (cl_uint*) malloc(DATA_SIZE * sizeof(cl_uint));
+    cl_ulong *scratch = (cl_ulong*) malloc(n * sizeof(cl_ulong) + 1);
+    cl_ulong *sorted = (cl_ulong*) malloc(n * sizeof(cl_ulong) + 1);
+    char *valueScratch = (char*) malloc(n * valueSize + 1);
 
-    if(histogram != NULL && scratch != NULL) {
+    if(histogram != NULL && scratch != NULL && sorted != NULL && valueScratch != NULL) {
 
-        memcpy(scratch, unsortedData, DATA_SIZE * sizeof(cl_uint));
-        for(int bits = 0; bits < sizeof(cl_uint) * bitsbyte ; bits += bitsbyte) {
+        for(size_t i = 0; i < n; ++i)
+            scratch[i] = encodeKeyCPU(unsortedData, i, keyType);
+        if(valueSize > 0) memcpy(valueScratch, values, n * valueSize);
+        for(int bits = 0; bits < passes * bitsbyte ; bits += bitsbyte) {
+            int last = (bits == bitsbyte * (passes - 1));
 
             // Initialize histogram bucket to zeros
             memset(histogram, 0, R * sizeof(cl_uint));
 
-            // Calculate 256 histogram for all element
-            for(int i = 0; i < DATA_SIZE; ++i)
+            // Calculate R histogram for all element
+            for(size_t i = 0; i < n; ++i)
             {
-                cl_uint element = scratch[i];
-                cl_uint value = (element >> bits) & R_MASK;
+                cl_ulong element = scratch[i];
+                cl_uint value = (cl_uint)(element >> bits) & R_MASK;
                 histogram[value]++;
             }
 
@@ -93,250 +70,121 @@ int radixSortCPU(cl_uint* unsortedData, cl_uint* hSortedData) {
             // Rearrange  the elements based on prescanned histogram
             // Thus far, the preceding code is basically adopted from
             // the "counting sort" algorithm.
-            for(int i = 0; i < DATA_SIZE; ++i)
+            for(size_t i = 0; i < n; ++i)
             {
-                cl_uint element = scratch[i];
-                cl_uint value = (element >> bits) & R_MASK;
+                cl_ulong element = scratch[i];
+                cl_uint value = (cl_uint)(element >> bits) & R_MASK;
                 cl_uint index = histogram[value];
-                hSortedData[index] = scratch[i];
+                if(last)
+                    decodeKeyCPU(hSortedData, index, element, keyType);
+                else
+                    sorted[index] = element;
+                if(valueSize > 0)
+                    memcpy((char*)sortedValues + index * valueSize, valueScratch + i * valueSize, valueSize);
                 histogram[value] = index + 1;
             }
 
             // Copy to 'scratch' for further use
-            if(bits != bitsbyte * 3)
-                memcpy(scratch, hSortedData, DATA_SIZE * sizeof(cl_uint));
+            if(!last) {
+                memcpy(scratch, sorted, n * sizeof(cl_ulong));
+                if(valueSize > 0) memcpy(valueScratch, sortedValues, n * valueSize);
+            }
         }
     }
 
+    free(valueScratch);
+    free(sorted);
     free(scratch);
     free(histogram);
     return 1;
 }
 
-// This is the threaded-historgram which builds histograms
-// and bins them based on a size of 256 or 1<<8
-void computeHistogram(int currByte) {
-    cl_event execEvt;
-    cl_int status;
-    size_t globalThreads = DATA_SIZE;
-    size_t localThreads  = BIN_SIZE;
-    status = clSetKernelArg(histogramKernel, 0, sizeof(cl_mem), (void*)&unsortedData_d);
-    status = clSetKernelArg(histogramKernel, 1, sizeof(cl_mem), (void*)&histogram_d);
-    status = clSetKernelArg(histogramKernel, 2, sizeof(cl_int), (void*)&currByte);
-    status = clSetKernelArg(histogramKernel, 3, sizeof(cl_int) * BIN_SIZE, NULL); 
-    status = clEnqueueNDRangeKernel(
-        commandQueue, 
-        histogramKernel,
-        1,
-        NULL,
-        &globalThreads,
-        &localThreads,
-        0,
-        NULL,
-        &execEvt);
-    clFlush(commandQueue);
-    waitAndReleaseDevice(&execEvt);
-}
-
-void computeRankingNPermutations(int currByte, size_t groupSize) {
-    cl_int status;
-    cl_event execEvt;
-
-    size_t globalThreads = DATA_SIZE/R;
-    size_t localThreads  = groupSize;
-
-    status = clSetKernelArg(permuteKernel, 0, sizeof(cl_mem), (void*)&unsortedData_d);
-    status = clSetKernelArg(permuteKernel, 1, sizeof(cl_mem), (void*)&scannedHistogram_d);
-    status = clSetKernelArg(permuteKernel, 2, sizeof(cl_int), (void*)&currByte);
-    status = clSetKernelArg(permuteKernel, 3, groupSize * R * sizeof(cl_ushort), NULL); // shared memory
-    status = clSetKernelArg(permuteKernel, 4, sizeof(cl_mem), (void*)&sortedData_d);
-
-    status = clEnqueueNDRangeKernel(commandQueue, permuteKernel, 1, NULL, &globalThreads, &localThreads, 0, NULL, &execEvt);
-    clFlush(commandQueue);
-    waitAndReleaseDevice(&execEvt);
-
-    cl_event copyEvt;
-    status = clEnqueueCopyBuffer(commandQueue, sortedData_d, unsortedData_d, 0, 0, DATA_SIZE * sizeof(cl_uint), 0, NULL, &copyEvt);
-    clFlush(commandQueue);
-    waitAndReleaseDevice(&copyEvt);
-}
-
-void computeBlockScans() {
-    cl_int status;
+// Random integer keys of keyBits bits, centred on zero for signed types;
+// floating point keys spread around zero with -0.0, infinities and NaNs
+// of both signs mixed in
+void fillRandomBits(void* data, size_t length, RadixKeyType keyType, int keyBits) {
+    static const double specials[] = {-0.0, 0.0, INFINITY, -INFINITY, NAN, -NAN};
+    int width = (int)RADIX_KEY_SIZE(keyType) * 8;
+    cl_ulong mask = keyBits < 64 ? (1ull << keyBits) - 1 : ~0ull;
     
-    size_t numOfGroups = DATA_SIZE / BIN_SIZE;
-    size_t globalThreads[2] = {numOfGroups, R};
-    size_t localThreads[2]  = {GROUP_SIZE, 1};
-    cl_uint groupSize = GROUP_SIZE;
-
-    status = clSetKernelArg(blockScanKernel, 0, sizeof(cl_mem), (void*)&scannedHistogram_d);
-    status = clSetKernelArg(blockScanKernel, 1, sizeof(cl_mem), (void*)&histogram_d);
-    status = clSetKernelArg(blockScanKernel, 2, GROUP_SIZE * sizeof(cl_uint), NULL);
-    status = clSetKernelArg(blockScanKernel, 3, sizeof(cl_uint), &groupSize); 
-    status = clSetKernelArg(blockScanKernel, 4, sizeof(cl_mem), &sum_in_d);
-
-    cl_event execEvt;
-    status = clEnqueueNDRangeKernel(
-                commandQueue,
-                blockScanKernel,
-                2,
-                NULL,
-                globalThreads,
-                localThreads,
-                0, 
-                NULL,
-                &execEvt);
-    clFlush(commandQueue);
-    waitAndReleaseDevice(&execEvt);
-
-    // If there is only 1 workgroup, we will skip the block-addition and prefix-sum kernel
-    if(numOfGroups/GROUP_SIZE != 1) {
-        size_t globalThreadsPrefix[2] = {numOfGroups/GROUP_SIZE, R};
-        status = clSetKernelArg(prefixSumKernel, 0, sizeof(cl_mem), (void*)&sum_out_d);
-        status = clSetKernelArg(prefixSumKernel, 1, sizeof(cl_mem), (void*)&sum_in_d);
-        status = clSetKernelArg(prefixSumKernel, 2, sizeof(cl_mem), (void*)&summary_in_d);
-        cl_uint stride = (cl_uint)numOfGroups/GROUP_SIZE;
-        status = clSetKernelArg(prefixSumKernel, 3, sizeof(cl_uint), (void*)&stride);
-        cl_event prefixSumEvt;
-        status = clEnqueueNDRangeKernel(
-                    commandQueue,
-                    prefixSumKernel,
-                    2,
-                    NULL,
-                    globalThreadsPrefix,
-                    NULL,
-                    0,
-                    NULL,
-                    &prefixSumEvt);
-        clFlush(commandQueue);
-        waitAndReleaseDevice(&prefixSumEvt);
-        
-        // Run block-addition kernel
-        cl_event execEvt2;
-        size_t globalThreadsAdd[2] = {numOfGroups, R};
-        size_t localThreadsAdd[2]  = {GROUP_SIZE, 1};
-        status = clSetKernelArg(blockAddKernel, 0, sizeof(cl_mem), (void*)&sum_out_d);  
-        status = clSetKernelArg(blockAddKernel, 1, sizeof(cl_mem), (void*)&scannedHistogram_d);  
-        status = clSetKernelArg(blockAddKernel, 2, sizeof(cl_uint), (void*)&stride);  
-        status = clEnqueueNDRangeKernel(
-                    commandQueue,
-                    blockAddKernel,
-                    2,
-                    NULL,
-                    globalThreadsAdd,
-                    localThreadsAdd,
-                    0,
-                    NULL,
-                    &execEvt2);
-        clFlush(commandQueue);
-        waitAndReleaseDevice(&execEvt2);
-
-        // Run parallel array scan since we have GROUP_SIZE values which are summarized from each row
-        // and we accumulate them
-        size_t globalThreadsScan[1] = {R};
-        size_t localThreadsScan[1] = {R};
-        status = clSetKernelArg(unifiedBlockScanKernel, 0, sizeof(cl_mem), (void*)&summary_out_d);
-        if(numOfGroups/GROUP_SIZE != 1) 
-            status = clSetKernelArg(unifiedBlockScanKernel, 1, sizeof(cl_mem), (void*)&summary_in_d); 
-        else
-            status = clSetKernelArg(unifiedBlockScanKernel, 1, sizeof(cl_mem), (void*)&sum_in_d); 
-
-        status = clSetKernelArg(unifiedBlockScanKernel, 2, R * sizeof(cl_uint), NULL);  // shared memory
-        groupSize = R;
-        status = clSetKernelArg(unifiedBlockScanKernel, 3, sizeof(cl_uint), (void*)&groupSize); 
-        cl_event execEvt3;
-        status = clEnqueueNDRangeKernel(
-                    commandQueue,
-                    unifiedBlockScanKernel,
-                    1,
-                    NULL,
-                    globalThreadsScan,
-                    localThreadsScan,
-                    0, 
-                    NULL, 
-                    &execEvt3);
-        clFlush(commandQueue);
-        waitAndReleaseDevice(&execEvt3);
-
-        cl_event execEvt4;
-        size_t globalThreadsOffset[2] = {numOfGroups, R};
-        status = clSetKernelArg(mergePrefixSumsKernel, 0, sizeof(cl_mem), (void*)&summary_out_d);
-        status = clSetKernelArg(mergePrefixSumsKernel, 1, sizeof(cl_mem), (void*)&scannedHistogram_d);
-        status = clEnqueueNDRangeKernel(commandQueue, mergePrefixSumsKernel, 2, NULL, globalThreadsOffset, NULL, 0, NULL, &execEvt4);
-        clFlush(commandQueue);
-        waitAndReleaseDevice(&execEvt4);
-    }
-}
-
-// Function that invokes the execution of the kernels
-void runKernels(cl_uint* dSortedData,
-                size_t numOfGroups,
-                size_t groupSize) {
-
-    for(int currByte = 0; currByte < sizeof(cl_uint) * bitsbyte ; currByte += bitsbyte) {
-        computeHistogram(currByte);
-        computeBlockScans();
-        computeRankingNPermutations(currByte, groupSize);
+    for(size_t i = 0 ; i < length; ++i) {
+        cl_ulong r = rand64() & mask;
+        if((keyType == RADIX_KEY_INT || keyType == RADIX_KEY_LONG) && keyBits < width)
+            r -= 1ull << (keyBits - 1);
+        double d = (i % 97 == 0) ? specials[(i / 97) % 6] : ((double)rand() / RAND_MAX - 0.5) * 2e6;
+        switch(keyType) {
+            case RADIX_KEY_FLOAT:  ((cl_float*)data)[i] = (cl_float)d; break;
+            case RADIX_KEY_DOUBLE: ((cl_double*)data)[i] = d; break;
+            case RADIX_KEY_UINT:
+            case RADIX_KEY_INT:    ((cl_uint*)data)[i] = (cl_uint)r; break;
+            default:               ((cl_ulong*)data)[i] = r; break;
+        }
     }
-
-    cl_int status;
-    cl_uint* data = (cl_uint*)clEnqueueMapBuffer(commandQueue, sortedData_d, CL_TRUE, CL_MAP_READ, 0, DATA_SIZE*sizeof(cl_uint),0,NULL,NULL,&status);
-    CHECK_ERROR(status, CL_SUCCESS, "mapping buffer failed");
-    memcpy(dSortedData, data, DATA_SIZE*sizeof(cl_uint));
-    clEnqueueUnmapMemObject(commandQueue,sortedData_d,data,0,NULL,NULL);
 }
 
-
-void loadProgramSource(const char** files,
-                       size_t length,
-                       char** buffer,
-                       size_t* sizes) {
-    /* Read each source file (*.cl) and store the contents into a temporary datastore */
-    for(size_t i=0; i < length; i++) {
-        FILE* file = fopen(files[i], "r");
-        if(file == NULL) {
-            perror("Couldn't read the program file");
-            exit(1);
+// Whether the keys ascend in their own type; comparisons with NaN are
+// left to the check against the CPU sort
+int keysOrdered(const void* data, size_t length, RadixKeyType keyType) {
+    for(size_t i = 1; i < length; ++i) {
+        int ordered;
+        switch(keyType) {
+            case RADIX_KEY_UINT:   ordered = ((const cl_uint*)data)[i-1] <= ((const cl_uint*)data)[i]; break;
+            case RADIX_KEY_INT:    ordered = ((const cl_int*)data)[i-1] <= ((const cl_int*)data)[i]; break;
+            case RADIX_KEY_FLOAT:  ordered = !(((const cl_float*)data)[i-1] > ((const cl_float*)data)[i]); break;
+            case RADIX_KEY_ULONG:  ordered = ((const cl_ulong*)data)[i-1] <= ((const cl_ulong*)data)[i]; break;
+            case RADIX_KEY_LONG:   ordered = ((const cl_long*)data)[i-1] <= ((const cl_long*)data)[i]; break;
+            default:               ordered = !(((const cl_double*)data)[i-1] > ((const cl_double*)data)[i]); break;
         }
-        fseek(file, 0, SEEK_END);
-        sizes[i] = ftell(file);
-        rewind(file); // reset the file pointer so that 'fread' reads from the front
-        buffer[i] = (char*)malloc(sizes[i]+1);
-        buffer[i][sizes[i]] = '\0';
-        fread(buffer[i], sizeof(char), sizes[i], file);
-        fclose(file);
+        if(!ordered) return 0;
     }
-}
-
-void fillRandom(cl_uint* data, unsigned int length) {
-    cl_uint* iptr = data;
-    
-    for(int i = 0 ; i < length; ++i) 
-            iptr[i] = (cl_uint)rand();
+    return 1;
 }
 
 int main(int argc, char** argv) {
-    cl_uint* unsortedData = NULL;
-    cl_uint* dSortedData = NULL;
-    cl_uint* hSortedData = NULL;
+    cl_ulong* unsortedData = NULL;
+    cl_ulong* dSortedData = NULL;
+    cl_ulong* hSortedData = NULL;
+    cl_ulong* values = NULL;
+    cl_ulong* dSortedValues = NULL;
+    cl_ulong* hSortedValues = NULL;
 
     /* OpenCL 1.1 data structures */
     cl_platform_id* platforms;
     cl_device_id device;
     cl_uint numOfPlatforms;
     cl_int  error;
-    cl_program program;
-    cl_uint groupSize = GROUP_SIZE;
-    cl_uint numOfGroups = DATA_SIZE / (groupSize * R); 
 
-    unsortedData = (cl_uint*) malloc(DATA_SIZE * sizeof(cl_uint));
-    fillRandom(unsortedData, DATA_SIZE);
+    // Any number of keys can be sorted, the default keeps the old size;
+    // the digit width is chosen from the device unless given.  Keys of
+    // fewer bits need fewer passes.  The key type is one of keyTypeNames.
+    size_t dataSize = DATA_SIZE;
+    int bits = 0;
+    int keyBits = 0;
+    RadixKeyType keyType = RADIX_KEY_UINT;
+    if(argc > 1) dataSize = strtoul(argv[1], NULL, 10);
+    if(argc > 2) bits = atoi(argv[2]);
+    if(argc > 3) keyBits = atoi(argv[3]);
+    if(argc > 4) {
+        for(int t = 0; t <= RADIX_KEY_DOUBLE; t++)
+            if(strcmp(argv[4], keyTypeNames[t]) == 0) keyType = (RadixKeyType)t;
+    }
+    size_t keySize = RADIX_KEY_SIZE(keyType);
+    if(keyBits <= 0 || keyBits > (int)keySize * 8) keyBits = (int)keySize * 8;
+
+    // Room for the largest keys, 64 bits each
+    unsortedData = (cl_ulong*) malloc(dataSize * sizeof(cl_ulong));
+    fillRandomBits(unsortedData, dataSize, keyType, keyBits);
 
-    dSortedData = (cl_uint*) malloc(DATA_SIZE * sizeof(cl_uint));
-	memset(dSortedData, 0, DATA_SIZE * sizeof(cl_uint));
+    dSortedData = (cl_ulong*) malloc(dataSize * sizeof(cl_ulong));
+	memset(dSortedData, 0, dataSize * sizeof(cl_ulong));
     
-    hSortedData = (cl_uint*) malloc(DATA_SIZE * sizeof(cl_uint)); 
-	memset(hSortedData, 0, DATA_SIZE * sizeof(cl_uint));
+    hSortedData = (cl_ulong*) malloc(dataSize * sizeof(cl_ulong)); 
+	memset(hSortedData, 0, dataSize * sizeof(cl_ulong));
+
+    // Room for the largest payload, 64 bits per key
+    values        = (cl_ulong*) malloc(dataSize * sizeof(cl_ulong));
+    dSortedValues = (cl_ulong*) malloc(dataSize * sizeof(cl_ulong));
+    hSortedValues = (cl_ulong*) malloc(dataSize * sizeof(cl_ulong));
 
     //Get the number of platforms
     //Remember that for each vendor's SDK installed on the computer,
@@ -379,106 +227,66 @@ int main(int argc, char** argv) {
         size_t sizes[NUMBER_OF_FILES];
         loadProgramSource(file_names, NUMBER_OF_FILES, buffer, sizes);
         
-        // Create the OpenCL program object 
-        program = clCreateProgramWithSource(context, NUMBER_OF_FILES, (const char**)buffer, sizes, &error);
-	    if(error != CL_SUCCESS) {
-            perror("Can't create the OpenCL program object");
-            exit(1);
-	    }
-        // Build OpenCL program object and dump the error message, if any 
-        char *program_log;
-        const char options[] = "";
-        size_t log_size;
-
-        error = clBuildProgram(program, 1, &device, options, NULL, NULL);
-	    if(error != CL_SUCCESS) {
-            // If there's an error whilst building the program, dump the log
-            clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
-            program_log = (char*) malloc(log_size+1);
-            program_log[log_size] = '\0';
-            clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG,
-                                  log_size+1, program_log, NULL);
-            printf("\n=== ERROR ===\n\n%s\n=============\n", program_log);
-            free(program_log);
-            exit(1);
-	    }
-       
         // Queue is created with profiling enabled 
-        cl_command_queue_properties props;
+        cl_command_queue_properties props = 0;
         props |= CL_QUEUE_PROFILING_ENABLE;
 
-        commandQueue = clCreateCommandQueue(context, device, props, &error);
+        cl_command_queue commandQueue = clCreateCommandQueue(context, device, props, &error);
         CHECK_ERROR(error, CL_SUCCESS, "failed to create command queue");
 
-        unsortedData_d     = clCreateBuffer(context, CL_MEM_READ_ONLY|CL_MEM_USE_HOST_PTR, sizeof(cl_uint) * DATA_SIZE, unsortedData, &error);
-        CHECK_ERROR(error, CL_SUCCESS, "failed to allocate unsortedData_d");
-        histogram_d        = clCreateBuffer(context, CL_MEM_READ_WRITE, numOfGroups * groupSize * R * sizeof(cl_uint), NULL, &error);
-        CHECK_ERROR(error, CL_SUCCESS, "failed to allocate histogram_d");
-        scannedHistogram_d = clCreateBuffer(context, CL_MEM_READ_WRITE, numOfGroups * groupSize * R * sizeof(cl_uint), NULL, &error);
-        CHECK_ERROR(error, CL_SUCCESS, "failed to allocate scannedHistogram_d");
-        sortedData_d       = clCreateBuffer(context, CL_MEM_WRITE_ONLY, DATA_SIZE * sizeof(cl_uint), NULL, &error);
-        CHECK_ERROR(error, CL_SUCCESS, "failed to allocate sortedData_d");
-        sum_in_d           = clCreateBuffer(context, CL_MEM_READ_WRITE, (DATA_SIZE/groupSize) * sizeof(cl_uint), NULL, &error);
-        CHECK_ERROR(error, CL_SUCCESS, "failed to allocate sum_in_d");
-        sum_out_d          = clCreateBuffer(context, CL_MEM_READ_WRITE, (DATA_SIZE/groupSize) * sizeof(cl_uint), NULL, &error);
-        CHECK_ERROR(error, CL_SUCCESS, "failed to allocate sum_out_d");
-        summary_in_d       = clCreateBuffer(context, CL_MEM_READ_WRITE, R * sizeof(cl_uint), NULL, &error);
-        CHECK_ERROR(error, CL_SUCCESS, "failed to allocate summary_in_d");
-        summary_out_d      = clCreateBuffer(context, CL_MEM_READ_WRITE, R * sizeof(cl_uint), NULL, &error);
-        CHECK_ERROR(error, CL_SUCCESS, "failed to allocate summary_out_d");
-
-        histogramKernel = clCreateKernel(program, "computeHistogram", &error);
-        CHECK_ERROR(error, CL_SUCCESS, "Failed to create histogram kernel");
-        permuteKernel   = clCreateKernel(program, "rankNPermute", &error);
-        CHECK_ERROR(error, CL_SUCCESS, "Failed to create permute kernel");
-        unifiedBlockScanKernel  = clCreateKernel(program, "unifiedBlockScan", &error);
-        CHECK_ERROR(error, CL_SUCCESS, "Failed to create unifiedBlockScan kernel");
-        blockScanKernel  = clCreateKernel(program, "blockScan", &error);
-        CHECK_ERROR(error, CL_SUCCESS, "Failed to create blockScan kernel");
-        prefixSumKernel = clCreateKernel(program, "blockPrefixSum", &error);
-        CHECK_ERROR(error, CL_SUCCESS, "Failed to create compute block prefix sum kernel");
-        blockAddKernel  = clCreateKernel(program, "blockAdd", &error);
-        CHECK_ERROR(error, CL_SUCCESS, "Failed to create block addition kernel");
-        mergePrefixSumsKernel    = clCreateKernel(program, "mergePrefixSums", &error);
-        CHECK_ERROR(error, CL_SUCCESS, "Failed to create fix offset kernel");
-
-printf("elementCount: %u, numOfGroups: %u, groupSize: %u\n", DATA_SIZE, numOfGroups, groupSize);
-        runKernels(
-                   dSortedData,
-                   numOfGroups, groupSize);
-
+        RadixSorter sorter;
+        radixSorterCreate(&sorter, context, device, commandQueue, buffer[0], sizes[0], keyType, bits);
+        printf("Keys: %s, digit width: %d bits, %d passes, permuteGroupSize: %zu\n",
+               keyTypeNames[keyType], sorter.bits, sorter.passes, sorter.permuteGroupSize);
+
+        // Keys alone, then with 32-bit and 64-bit payloads; the second and
+        // third sort reuse the device buffers of the first
+        for(size_t valueSize = 0; valueSize <= sizeof(cl_ulong); valueSize += sizeof(cl_uint)) {
+            for(size_t k = 0; k < dataSize; k++) {
+                if(valueSize == sizeof(cl_uint))
+                    ((cl_uint*)values)[k] = (cl_uint)k;
+                else
+                    values[k] = ((cl_ulong)k << 32) | (cl_uint)~k;
+            }
+            memcpy(dSortedData, unsortedData, dataSize * keySize);
+            memcpy(dSortedValues, values, dataSize * valueSize);
+
+printf("elementCount: %zu, valueSize: %zu\n", dataSize, valueSize);
+            // Wall time against the CPU time the host spent meanwhile; the
+            // host only blocks once, at the end of the sort
+            struct timespec start, end;
+            clock_t cpuStart = clock();
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            error = radixSortGPU(&sorter, dSortedData, valueSize ? dSortedValues : NULL, valueSize, dataSize);
+            CHECK_ERROR(error, 0, "radix sort failed");
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+            double cpuSeconds = (double)(clock() - cpuStart) / CLOCKS_PER_SEC;
+            printf("Sort time: %.3f ms (host CPU %.3f ms), %.2f Mkeys/s, %d of %d passes\n",
+                   seconds * 1e3, cpuSeconds * 1e3, dataSize / seconds * 1e-6, sorter.passesRun, sorter.passes);
+
+            // Verification Checks
+            radixSortCPU(unsortedData, hSortedData, dataSize, keyType, values, hSortedValues, valueSize, sorter.bits);
+            size_t acc = 0;
+            for(size_t k = 0; k < dataSize; k++) {
+                if (memcmp((char*)hSortedData + k * keySize, (char*)dSortedData + k * keySize, keySize) == 0 &&
+                    memcmp((char*)hSortedValues + k * valueSize, (char*)dSortedValues + k * valueSize, valueSize) == 0) acc++;
+            }
+            if (acc == dataSize && keysOrdered(dSortedData, dataSize, keyType)) printf("Passed:%zu!\n", acc); else printf("Failed:%zu!\n", acc);
+        }
 
         // Clean up 
         for(int j=0; j< NUMBER_OF_FILES; j++) { free(buffer[j]); }
 
-        clReleaseMemObject(unsortedData_d);
-        clReleaseMemObject(histogram_d);
-        clReleaseMemObject(scannedHistogram_d);
-        clReleaseMemObject(sortedData_d);
-        clReleaseMemObject(sum_in_d);
-        clReleaseMemObject(sum_out_d);
-        clReleaseMemObject(summary_out_d);
-        clReleaseMemObject(summary_out_d);
-        clReleaseKernel(histogramKernel);
-        clReleaseKernel(permuteKernel);
-        clReleaseKernel(unifiedBlockScanKernel);
-        clReleaseKernel(blockScanKernel);
-        clReleaseKernel(prefixSumKernel);
-        clReleaseKernel(blockAddKernel);
-        clReleaseKernel(mergePrefixSumsKernel);
+        radixSorterRelease(&sorter);
+        clReleaseCommandQueue(commandQueue);
+        clReleaseContext(context);
+    }
 
-        // Verification Checks
-        radixSortCPU(unsortedData, hSortedData);
-        for(int k = 0, acc = 0; k < DATA_SIZE; k++) { 
-            if (hSortedData[k] == dSortedData[k]) acc++;
-            if ((k+1) == DATA_SIZE) {
-                if (acc == DATA_SIZE) printf("Passed:%u!\n", acc); else printf("Failed:%u!\n", acc);
-            }
-        }
-        
     free(unsortedData);
     free(dSortedData);
     free(hSortedData);
-    }
-    
+    free(values);
+    free(dSortedValues);
+    free(hSortedValues);
 }
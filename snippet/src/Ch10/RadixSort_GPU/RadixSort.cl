@@ -1,66 +1,180 @@
+/* Digit width, set by the host to suit the device's local memory */
+#ifndef bitsbyte
 #define bitsbyte 8
+#endif
 #define R (1 << bitsbyte)
+#define R_MASK (R - 1)
 
-__kernel void computeHistogram(__global const uint* data,
+/* Keys per block: histogrammed by one work-group of computeHistogram,
+   ranked by one work-item of rankNPermute */
+#define BLOCK_KEYS (R > 256 ? R : 256)
+
+/* Key type, set by the host like the digit width: 0 uint, 1 int,
+   2 float, 3 ulong, 4 long, 5 double.  Keys arrive as their raw bits. */
+#ifndef KEY_TYPE
+#define KEY_TYPE 0
+#endif
+#if KEY_TYPE >= 3
+#define KEY_T ulong
+#define KEY_BITS 64
+#else
+#define KEY_T uint
+#define KEY_BITS 32
+#endif
+#define KEY_SIGN ((KEY_T)1 << (KEY_BITS - 1))
+#define KEY_SIGNED (KEY_TYPE == 1 || KEY_TYPE == 4)
+#define KEY_FLOAT (KEY_TYPE == 2 || KEY_TYPE == 5)
+
+/* Maps the bits of a key onto an unsigned integer of the same order.
+   Signed keys flip the sign bit.  Floats flip the sign bit of positive
+   values and all bits of negative ones, which gives the IEEE 754
+   totalOrder: -NaN < -Inf < ... < -0.0 < +0.0 < ... < +Inf < +NaN. */
+KEY_T encodeKey(KEY_T key) {
+#if KEY_SIGNED
+    return key ^ KEY_SIGN;
+#elif KEY_FLOAT
+    return (key & KEY_SIGN) ? ~key : key ^ KEY_SIGN;
+#else
+    return key;
+#endif
+}
+
+KEY_T decodeKey(KEY_T key) {
+#if KEY_SIGNED
+    return key ^ KEY_SIGN;
+#elif KEY_FLOAT
+    return (key & KEY_SIGN) ? key ^ KEY_SIGN : ~key;
+#else
+    return key;
+#endif
+}
+
+/* Counts of every digit of passes firstPass to firstPass+passCount-1,
+   accumulated over the whole input; counts must be zero on entry.  A pass
+   whose digit all keys share leaves the order as it is, so the host skips
+   it.  The launch with firstPass 0 also encodes the keys in place, saving
+   the sort a sweep of its own over them. */
+__kernel void computeDigitCounts(__global KEY_T* data,
+                                 __global uint* counts,
+                                 __local uint* sharedCounts,
+                                 uint firstPass,
+                                 uint passCount,
+                                 uint n) {
+
+    size_t localId = get_local_id(0);
+    size_t groupSize = get_local_size(0);
+
+    for(uint i = localId; i < passCount * R; i += groupSize)
+        sharedCounts[i] = 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(size_t k = get_global_id(0); k < n; k += get_global_size(0)) {
+        KEY_T key = data[k];
+#if KEY_SIGNED || KEY_FLOAT
+        if(firstPass == 0) {
+            key = encodeKey(key);
+            data[k] = key;
+        }
+#endif
+        for(uint p = 0; p < passCount; ++p)
+            atomic_inc(sharedCounts + p * R + (uint)((key >> ((firstPass + p) * bitsbyte)) & R_MASK));
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(uint i = localId; i < passCount * R; i += groupSize)
+        if(sharedCounts[i] != 0)
+            atomic_add(counts + firstPass * R + i, sharedCounts[i]);
+}
+
+/* Undoes encodeKey for a sort that skipped every pass; otherwise the
+   last rankNPermute decodes the keys as it writes them */
+__kernel void decodeKeys(__global KEY_T* data,
+                         uint n) {
+
+    size_t gidx = get_global_id(0);
+    if(gidx < n)
+        data[gidx] = decodeKey(data[gidx]);
+}
+
+
+__kernel void computeHistogram(__global const KEY_T* data,
                                __global uint* buckets,
                                uint shiftBy,
-                               __local uint* sharedArray) {
+                               __local uint* sharedArray,
+                               uint n) {
 
     size_t localId = get_local_id(0);
-    size_t globalId = get_global_id(0);
     size_t groupId = get_group_id(0);
     size_t groupSize = get_local_size(0);
     
-    /* Initialize shared array to zero i.e. sharedArray[0..63] = {0}*/
-    sharedArray[localId] = 0;
+    /* Initialize shared array to zero i.e. sharedArray[0..R-1] = {0}*/
+    for(uint i = localId; i < R; i += groupSize)
+        sharedArray[i] = 0;
     barrier(CLK_LOCAL_MEM_FENCE);
     
     /* Calculate thread-histograms local/shared memory range from 32KB to 64KB */
 
-    uint result= (data[globalId] >> shiftBy) & 0xFFU;
-    atomic_inc(sharedArray+result);
+    /* The last block may be partial */
+    size_t first = groupId * BLOCK_KEYS;
+    for(uint i = localId; i < BLOCK_KEYS; i += groupSize) {
+        if(first + i < n) {
+            uint result= (uint)((data[first + i] >> shiftBy) & R_MASK);
+            atomic_inc(sharedArray+result);
+        }
+    }
     
     barrier(CLK_LOCAL_MEM_FENCE);
     
     /* Copy calculated histogram bin to global memory */
     
-    uint bucketPos = groupId  * groupSize + localId ;
-    buckets[bucketPos] = sharedArray[localId];
+    for(uint i = localId; i < R; i += groupSize)
+        buckets[groupId * R + i] = sharedArray[i];
 }
 
-__kernel void rankNPermute(__global const uint* unsortedData,
+__kernel void rankNPermute(__global const KEY_T* unsortedData,
                            __global const uint* scannedHistogram,
                            uint shiftCount,
-                           __local ushort* sharedBuckets,
-                           __global uint* sortedData) { 
+                           __local uint* sharedBuckets,
+                           __global KEY_T* sortedData,
+                           __global const uint* unsortedValues,
+                           __global uint* sortedValues,
+                           uint valueWords,
+                           uint n,
+                           uint decode) {
 
-    size_t groupId = get_group_id(0);
     size_t idx = get_local_id(0);
     size_t gidx = get_global_id(0);
-    size_t groupSize = get_local_size(0);
-    
+
+    /* Each work-item ranks the block of keys histogrammed by work-group
+       gidx of computeHistogram, in order, so the sort is stable.  It only
+       touches its own row of sharedBuckets, hence no barriers.
+     */
+    size_t first = gidx * BLOCK_KEYS;
+    if(first >= n) return;
+    uint count = (n - first < BLOCK_KEYS) ? (uint)(n - first) : BLOCK_KEYS;
+
     /* There are now GROUP_SIZE * RADIX buckets and we fill
        the shared memory with those prefix-sums computed previously
      */ 
     for(int i = 0; i < R; ++i)
     {
-        uint bucketPos = groupId * R * groupSize + idx * R + i;
-        sharedBuckets[idx * R + i] = scannedHistogram[bucketPos];
+        sharedBuckets[idx * R + i] = scannedHistogram[gidx * R + i];
     }
-
-    barrier(CLK_LOCAL_MEM_FENCE);
    
     /* Using the idea behind COUNTING-SORT to place the data values in its sorted
-       order based on the current examined key
+       order based on the current examined key; the payload of valueWords
+       uints per key, if any, moves with it.  The last pass writes the keys
+       back in their own encoding.
      */
-    for(int i = 0; i < R; ++i)
+    for(uint i = 0; i < count; ++i)
     {
-        uint value = unsortedData[gidx * R + i];
-        value = (value >> shiftCount) & 0xFFU;
+        KEY_T key = unsortedData[first + i];
+        uint value = (uint)((key >> shiftCount) & R_MASK);
         uint index = sharedBuckets[idx * R + value];
-        sortedData[index] = unsortedData[gidx * R + i];
+        sortedData[index] = decode ? decodeKey(key) : key;
+        for(uint w = 0; w < valueWords; ++w)
+            sortedValues[index * valueWords + w] = unsortedValues[(first + i) * valueWords + w];
         sharedBuckets[idx * R + value] = index + 1;
-        barrier(CLK_LOCAL_MEM_FENCE);
     }
 }
 
@@ -69,7 +183,8 @@ __kernel void blockScan(__global uint *output,
                         __global uint *histogram,
                         __local uint* sharedMem,
                         const uint block_size,
-                        __global uint* sumBuffer) {
+                        __global uint* sumBuffer,
+                        uint numBlocks) {
       int idx = get_local_id(0);
 	  int gidx = get_global_id(0);
 	  int gidy = get_global_id(1);
@@ -80,9 +195,10 @@ __kernel void blockScan(__global uint *output,
 	  int groupIndex = bidy * (get_global_size(0)/block_size) + bidx;
 	  
 	  /* Cache the histogram buckets into shared memory 
-         and memory reads into shared memory is coalesced
+         and memory reads into shared memory is coalesced;
+         blocks past the end pad the last group with zeros
       */
-	  sharedMem[idx] = histogram[gpos];
+	  sharedMem[idx] = (gidx < numBlocks) ? histogram[gpos] : 0;
 	  barrier(CLK_LOCAL_MEM_FENCE);
 
     /* 
@@ -107,11 +223,10 @@ __kernel void blockScan(__global uint *output,
 	{	
         /* store the value in sum buffer before making it to 0 */ 	
 	    sumBuffer[groupIndex] = sharedMem[block_size-1];
-		output[gpos] = 0;
 	}
-	else
+	if(gidx < numBlocks)
 	{
-		output[gpos] = sharedMem[idx-1];
+		output[gpos] = (idx == 0) ? 0 : sharedMem[idx-1];
 	}
 }   
 
@@ -121,16 +236,23 @@ __kernel void unifiedBlockScan(__global uint *output,
                                const uint block_size) {
 
     int id = get_local_id(0);
- 	int gid = get_global_id(0);
-	int bid = get_group_id(0);
-	
+    int groupSize = get_local_size(0);
+
+    /* With more values than work-items, each work-item first sums its
+       own run of them */
+    int perItem = block_size / groupSize;
+    uint runSum = 0;
+    for(int i = 0; i < perItem; i++)
+        runSum += input[id * perItem + i];
+
     /* Cache the computational window in shared memory */
-	sharedMem[id] = input[gid];
+	sharedMem[id] = runSum;
+	barrier(CLK_LOCAL_MEM_FENCE);
 
 	uint cache = sharedMem[0];
 
     /* build the sum in place up the tree */
-	for(int stride = 1; stride < block_size; stride <<= 1)
+	for(int stride = 1; stride < groupSize; stride <<= 1)
 	{
 		if(id>=stride)
 		{
@@ -143,10 +265,11 @@ __kernel void unifiedBlockScan(__global uint *output,
 		
 	}
     /*write the results back to global memory */
-	if(id == 0) {	
-		output[gid] = 0;
-	} else {
-		output[gid] = sharedMem[id-1];
+	uint prefix = (id == 0) ? 0 : sharedMem[id-1];
+	for(int i = 0; i < perItem; i++) {
+		uint value = input[id * perItem + i];
+		output[id * perItem + i] = prefix;
+		prefix += value;
 	}
 } 
   
@@ -176,7 +299,8 @@ __kernel void blockPrefixSum(__global uint* output,
   
 __kernel void blockAdd(__global uint* input,
                        __global uint* output,
-                       uint stride) {
+                       uint stride,
+                       uint numBlocks) {
 
 	  int gidx = get_global_id(0);
 	  int gidy = get_global_id(1);
@@ -188,6 +312,8 @@ __kernel void blockAdd(__global uint* input,
 	 
 	  int groupIndex = bidy * stride + bidx;
 	  
+	  if(gidx >= numBlocks) return;
+
 	  uint temp;
 	  temp = input[groupIndex];
 	  
@@ -202,3 +328,132 @@ __kernel void mergePrefixSums(__global uint* input,
    int gpos = gidy + (gidx << bitsbyte );
    output[gpos] += input[gidy];
 }           
+
+/* Segmented sort of small segments.  A tile is a run of whole segments,
+   tile.y keys from tile.x on, segments tile.z to tile.w - 1; one
+   work-group sorts it in local memory by segment, then key, which
+   sorts every segment of the tile at once.  Padding up to a power of
+   two takes segment 0xFFFF and sorts last. */
+__kernel void sortSegmentTiles(__global KEY_T* data,
+                               __global const uint* offsets,
+                               __global const uint4* tiles,
+                               __local KEY_T* keys,
+                               __local ushort* segments) {
+
+    uint localId = get_local_id(0);
+    uint localSize = get_local_size(0);
+    uint4 tile = tiles[get_group_id(0)];
+
+    uint size = 2;
+    while(size < tile.y) size <<= 1;
+    for(uint i = localId; i < size; i += localSize) {
+        if(i < tile.y) {
+            /* Last segment starting at or before the key; empty
+               segments start where the next one does */
+            uint k = tile.x + i;
+            uint lo = tile.z, hi = tile.w - 1;
+            while(lo < hi) {
+                uint mid = (lo + hi + 1) >> 1;
+                if(offsets[mid] <= k) lo = mid;
+                else hi = mid - 1;
+            }
+            segments[i] = (ushort)(lo - tile.z);
+            keys[i] = encodeKey(data[k]);
+        } else {
+            segments[i] = 0xFFFF;
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(uint k = 2; k <= size; k <<= 1) {
+        for(uint j = k >> 1; j > 0; j >>= 1) {
+            for(uint i = localId; i < size; i += localSize) {
+                uint partner = i ^ j;
+                if(partner > i) {
+                    bool before = segments[partner] != segments[i] ? segments[partner] < segments[i]
+                                                                   : keys[partner] < keys[i];
+                    bool after = segments[partner] != segments[i] ? segments[partner] > segments[i]
+                                                                  : keys[partner] > keys[i];
+                    if((i & k) == 0 ? before : after) {
+                        KEY_T key = keys[i];
+                        keys[i] = keys[partner];
+                        keys[partner] = key;
+                        ushort segment = segments[i];
+                        segments[i] = segments[partner];
+                        segments[partner] = segment;
+                    }
+                }
+            }
+            barrier(CLK_LOCAL_MEM_FENCE);
+        }
+    }
+
+    for(uint i = localId; i < tile.y; i += localSize)
+        data[tile.x + i] = decodeKey(keys[i]);
+}
+
+/* Digit of a key as radix select ranks it: the digit at shift of the
+   encoded key, turned around when the smallest keys are selected */
+uint selectDigit(KEY_T key, uint shift, uint largest) {
+    uint digit = (uint)((encodeKey(key) >> shift) & R_MASK);
+    return largest ? digit : R_MASK - digit;
+}
+
+/* Radix select, counting: how many of the n candidates have each digit
+   at shift; counts must be zero on entry.  Not computeDigitCounts, which
+   encodes the keys in place where the selection leaves them as they
+   are, nor computeHistogram, whose counts are per block for the scan
+   where the selection wants one total per digit, read back at once. */
+__kernel void selectDigitCounts(__global const KEY_T* data,
+                                __global uint* counts,
+                                __local uint* sharedCounts,
+                                uint shift,
+                                uint largest,
+                                uint n) {
+
+    size_t localId = get_local_id(0);
+    size_t groupSize = get_local_size(0);
+
+    for(uint i = localId; i < R; i += groupSize)
+        sharedCounts[i] = 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(size_t k = get_global_id(0); k < n; k += get_global_size(0))
+        atomic_inc(sharedCounts + selectDigit(data[k], shift, largest));
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(uint i = localId; i < R; i += groupSize)
+        if(sharedCounts[i] != 0)
+            atomic_add(counts + i, sharedCounts[i]);
+}
+
+/* Radix select, gathering: candidates with a digit above bucket are
+   selected, appended to out from outBase on.  Those in bucket are kept
+   as the next round's candidates if compact is set, or else the first
+   take of them are selected too, from bucketBase on.  counters[0] and
+   counters[1] count the two, and must be zero on entry. */
+__kernel void selectGather(__global const KEY_T* data,
+                           __global KEY_T* out,
+                           __global KEY_T* candidates,
+                           __global uint* counters,
+                           uint shift,
+                           uint largest,
+                           uint bucket,
+                           uint outBase,
+                           uint bucketBase,
+                           uint compact,
+                           uint take,
+                           uint n) {
+
+    for(size_t k = get_global_id(0); k < n; k += get_global_size(0)) {
+        KEY_T key = data[k];
+        uint digit = selectDigit(key, shift, largest);
+        if(digit > bucket) {
+            out[outBase + atomic_inc(counters)] = key;
+        } else if(digit == bucket) {
+            uint index = atomic_inc(counters + 1);
+            if(compact) candidates[index] = key;
+            else if(index < take) out[bucketBase + index] = key;
+        }
+    }
+}
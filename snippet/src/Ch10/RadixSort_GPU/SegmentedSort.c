@@ -0,0 +1,135 @@
+#define _POSIX_C_SOURCE 199309L  // clock_gettime under -std=c99
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <alloca.h>
+#include <time.h>
+
+#include "radixsort_config.h"
+#include "segmentedsort.h"
+#include "sortutil.h"
+
+#define NUM_SEGMENTS (1<<18)
+#define MAX_SMALL_SEGMENT 64
+#define LARGE_SEGMENT_EVERY 4099        // one segment in so many is longer than a tile
+
+// qsort has no argument for the key type
+static RadixKeyType compareKeyType;
+
+static int compareKeys(const void* a, const void* b) {
+    cl_ulong x = encodeKeyCPU(a, 0, compareKeyType);
+    cl_ulong y = encodeKeyCPU(b, 0, compareKeyType);
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char** argv) {
+    /* OpenCL 1.1 data structures */
+    cl_platform_id* platforms;
+    cl_device_id device;
+    cl_uint numOfPlatforms;
+    cl_int  error;
+
+    // [numSegments] [maxSmall] [type]: segments of 0 to maxSmall keys,
+    // with now and then one longer than a tile
+    size_t numSegments = NUM_SEGMENTS;
+    size_t maxSmall = MAX_SMALL_SEGMENT;
+    RadixKeyType keyType = RADIX_KEY_UINT;
+    if(argc > 1) numSegments = strtoul(argv[1], NULL, 10);
+    if(argc > 2) maxSmall = strtoul(argv[2], NULL, 10);
+    if(argc > 3) {
+        for(int t = 0; t <= RADIX_KEY_DOUBLE; t++)
+            if(strcmp(argv[3], keyTypeNames[t]) == 0) keyType = (RadixKeyType)t;
+    }
+    size_t keySize = RADIX_KEY_SIZE(keyType);
+
+    //Get the number of platforms
+    //Remember that for each vendor's SDK installed on the computer,
+    //the number of available platform also increased.
+    error = clGetPlatformIDs(0, NULL, &numOfPlatforms);
+    if(error != CL_SUCCESS) {
+        perror("Unable to find any OpenCL platforms");
+        exit(1);
+    }
+
+    platforms = (cl_platform_id*) alloca(sizeof(cl_platform_id) * numOfPlatforms);
+    printf("Number of OpenCL platforms found: %d\n", numOfPlatforms);
+
+    error = clGetPlatformIDs(numOfPlatforms, platforms, NULL);
+    if(error != CL_SUCCESS) {
+        perror("Unable to find any OpenCL platforms");
+        exit(1);
+    }
+    for(cl_int i = 0; i < numOfPlatforms; i++ ) {
+        // Get the GPU device
+        error = clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_GPU, 1, &device, NULL);
+
+        if(error != CL_SUCCESS) {
+            perror("Can't locate a OpenCL compliant device i.e. GPU");
+            exit(1);
+        }
+        // Create a context
+        cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &error);
+        if(error != CL_SUCCESS) {
+            perror("Can't create a valid OpenCL context");
+            exit(1);
+        }
+
+        const char *file_names[] = {"RadixSort.cl"};
+        const int NUMBER_OF_FILES = 1;
+        char* buffer[NUMBER_OF_FILES];
+        size_t sizes[NUMBER_OF_FILES];
+        loadProgramSource(file_names, NUMBER_OF_FILES, buffer, sizes);
+
+        cl_command_queue commandQueue = clCreateCommandQueue(context, device, 0, &error);
+        CHECK_ERROR(error, CL_SUCCESS, "failed to create command queue");
+
+        RadixSorter sorter;
+        radixSorterCreate(&sorter, context, device, commandQueue, buffer[0], sizes[0], keyType, 0);
+        SegmentedSorter segmented;
+        segmentedSorterCreate(&segmented, &sorter);
+
+        cl_uint* offsets = (cl_uint*) malloc((numSegments + 1) * sizeof(cl_uint));
+        offsets[0] = 0;
+        for(size_t g = 0; g < numSegments; g++) {
+            size_t count = (g % LARGE_SEGMENT_EVERY == LARGE_SEGMENT_EVERY - 1)
+                         ? segmented.tileKeys + rand() % (4 * segmented.tileKeys)
+                         : rand() % (maxSmall + 1);
+            offsets[g + 1] = offsets[g] + (cl_uint)count;
+        }
+        size_t dataSize = offsets[numSegments];
+        void* keys = malloc(dataSize * keySize + 1);
+        void* sorted = malloc(dataSize * keySize + 1);
+        fillRandom(keys, dataSize, keyType);
+        memcpy(sorted, keys, dataSize * keySize);
+
+        double start = now();
+        error = segmentedSortGPU(&segmented, sorted, offsets, numSegments);
+        CHECK_ERROR(error, 0, "segmented sort failed");
+        double seconds = now() - start;
+        printf("%zu segments of %s keys, %zu keys, tile of %u keys: %zu tiles, %zu long segments\n",
+               numSegments, keyTypeNames[keyType], dataSize, segmented.tileKeys, segmented.numTiles, segmented.numLarge);
+        printf("Segmented sort: %.3f ms, %.2f Mkeys/s, %.2f Msegments/s\n",
+               seconds * 1e3, dataSize / seconds * 1e-6, numSegments / seconds * 1e-6);
+
+        // Verification Checks: every segment against qsort
+        compareKeyType = keyType;
+        for(size_t g = 0; g < numSegments; g++)
+            qsort((char*)keys + offsets[g] * keySize, offsets[g + 1] - offsets[g], keySize, compareKeys);
+        size_t acc = 0;
+        for(size_t k = 0; k < dataSize; k++) {
+            if (memcmp((char*)keys + k * keySize, (char*)sorted + k * keySize, keySize) == 0) acc++;
+        }
+        if (acc == dataSize) printf("Passed:%zu!\n", acc); else printf("Failed:%zu!\n", acc);
+
+        for(int j=0; j< NUMBER_OF_FILES; j++) { free(buffer[j]); }
+        free(offsets);
+        free(keys);
+        free(sorted);
+
+        segmentedSorterRelease(&segmented);
+        radixSorterRelease(&sorter);
+        clReleaseCommandQueue(commandQueue);
+        clReleaseContext(context);
+    }
+    return 0;
+}
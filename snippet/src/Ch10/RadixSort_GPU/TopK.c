@@ -0,0 +1,127 @@
+#define _POSIX_C_SOURCE 199309L  // clock_gettime under -std=c99
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <alloca.h>
+#include <time.h>
+
+#include "radixsort_config.h"
+#include "topk.h"
+#include "sortutil.h"
+
+#define DATA_SIZE (1<<22)
+#define TOP_K 100
+
+int main(int argc, char** argv) {
+    /* OpenCL 1.1 data structures */
+    cl_platform_id* platforms;
+    cl_device_id device;
+    cl_uint numOfPlatforms;
+    cl_int  error;
+
+    // [n] [k] [type]: the k largest and the k smallest of n random keys
+    size_t dataSize = DATA_SIZE;
+    size_t k = TOP_K;
+    RadixKeyType keyType = RADIX_KEY_UINT;
+    if(argc > 1) dataSize = strtoul(argv[1], NULL, 10);
+    if(argc > 2) k = strtoul(argv[2], NULL, 10);
+    if(argc > 3) {
+        for(int t = 0; t <= RADIX_KEY_DOUBLE; t++)
+            if(strcmp(argv[3], keyTypeNames[t]) == 0) keyType = (RadixKeyType)t;
+    }
+    if(k > dataSize) k = dataSize;
+    size_t keySize = RADIX_KEY_SIZE(keyType);
+
+    //Get the number of platforms
+    //Remember that for each vendor's SDK installed on the computer,
+    //the number of available platform also increased.
+    error = clGetPlatformIDs(0, NULL, &numOfPlatforms);
+    if(error != CL_SUCCESS) {
+        perror("Unable to find any OpenCL platforms");
+        exit(1);
+    }
+
+    platforms = (cl_platform_id*) alloca(sizeof(cl_platform_id) * numOfPlatforms);
+    printf("Number of OpenCL platforms found: %d\n", numOfPlatforms);
+
+    error = clGetPlatformIDs(numOfPlatforms, platforms, NULL);
+    if(error != CL_SUCCESS) {
+        perror("Unable to find any OpenCL platforms");
+        exit(1);
+    }
+    for(cl_int i = 0; i < numOfPlatforms; i++ ) {
+        // Get the GPU device
+        error = clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_GPU, 1, &device, NULL);
+
+        if(error != CL_SUCCESS) {
+            perror("Can't locate a OpenCL compliant device i.e. GPU");
+            exit(1);
+        }
+        // Create a context
+        cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &error);
+        if(error != CL_SUCCESS) {
+            perror("Can't create a valid OpenCL context");
+            exit(1);
+        }
+
+        const char *file_names[] = {"RadixSort.cl"};
+        const int NUMBER_OF_FILES = 1;
+        char* buffer[NUMBER_OF_FILES];
+        size_t sizes[NUMBER_OF_FILES];
+        loadProgramSource(file_names, NUMBER_OF_FILES, buffer, sizes);
+
+        cl_command_queue commandQueue = clCreateCommandQueue(context, device, 0, &error);
+        CHECK_ERROR(error, CL_SUCCESS, "failed to create command queue");
+
+        RadixSorter sorter;
+        radixSorterCreate(&sorter, context, device, commandQueue, buffer[0], sizes[0], keyType, 0);
+        TopKSelector selector;
+        topKSelectorCreate(&selector, &sorter);
+
+        void* keys = malloc(dataSize * keySize + 1);
+        void* sorted = malloc(dataSize * keySize + 1);
+        void* largest = malloc(k * keySize + 1);
+        void* smallest = malloc(k * keySize + 1);
+        fillRandom(keys, dataSize, keyType);
+        memcpy(sorted, keys, dataSize * keySize);
+        printf("elementCount: %zu %s keys, k: %zu\n", dataSize, keyTypeNames[keyType], k);
+
+        double start = now();
+        error = topKSelectGPU(&selector, keys, dataSize, k, 1, largest);
+        CHECK_ERROR(error, 0, "top-k selection failed");
+        double seconds = now() - start;
+        printf("Top-k largest:  %9.3f ms %8.2f Mkeys/s, %d rounds\n", seconds * 1e3, dataSize / seconds * 1e-6, selector.rounds);
+        start = now();
+        error = topKSelectGPU(&selector, keys, dataSize, k, 0, smallest);
+        CHECK_ERROR(error, 0, "top-k selection failed");
+        seconds = now() - start;
+        printf("Top-k smallest: %9.3f ms %8.2f Mkeys/s, %d rounds\n", seconds * 1e3, dataSize / seconds * 1e-6, selector.rounds);
+
+        // The full sort, to hold the selection against
+        start = now();
+        error = radixSortGPU(&sorter, sorted, NULL, 0, dataSize);
+        CHECK_ERROR(error, 0, "radix sort failed");
+        seconds = now() - start;
+        printf("Full sort:      %9.3f ms %8.2f Mkeys/s\n", seconds * 1e3, dataSize / seconds * 1e-6);
+
+        // Verification Checks: the head of the sort, and its tail reversed
+        size_t acc = 0;
+        for(size_t j = 0; j < k; j++) {
+            if (memcmp((char*)smallest + j * keySize, (char*)sorted + j * keySize, keySize) == 0) acc++;
+            if (memcmp((char*)largest + j * keySize, (char*)sorted + (dataSize - 1 - j) * keySize, keySize) == 0) acc++;
+        }
+        if (acc == 2 * k) printf("Passed:%zu!\n", acc); else printf("Failed:%zu!\n", acc);
+
+        for(int j=0; j< NUMBER_OF_FILES; j++) { free(buffer[j]); }
+        free(keys);
+        free(sorted);
+        free(largest);
+        free(smallest);
+
+        topKSelectorRelease(&selector);
+        radixSorterRelease(&sorter);
+        clReleaseCommandQueue(commandQueue);
+        clReleaseContext(context);
+    }
+    return 0;
+}
@@ -0,0 +1,399 @@
+#ifndef CHUNKEDSORT_H_
+#define CHUNKEDSORT_H_
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "radixsort.h"
+
+// Fewest keys per thread worth a thread of the host merge
+#define CHUNKED_MERGE_MIN_KEYS (1 << 16)
+
+// Keys each thread of the host merge samples from every run to place
+// the splitters between the threads
+#define CHUNKED_MERGE_SAMPLES 64
+
+// Device state of an out-of-core sort: a radix sorter sized for one
+// chunk, and two staging buffers the chunks take turns in.  Uploads and
+// downloads go through their own queue, so the transfers of one chunk
+// overlap the sort of the next.
+typedef struct {
+    RadixSorter* sorter;
+    cl_command_queue transferQueue;
+    size_t chunkKeys;           // keys per chunk, so per sorted run
+    cl_mem staging_d[2];
+} ChunkedSorter;
+
+// Largest chunk that leaves half of the device memory free: a chunk
+// lives in two staging and two key buffers of the sorter, plus its
+// histograms, and a single buffer holds it whole
+static inline size_t chunkedSortChooseChunk(RadixSorter* s) {
+    cl_ulong globalMemSize = 0, maxAllocSize = 0;
+    clGetDeviceInfo(s->device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &globalMemSize, NULL);
+    clGetDeviceInfo(s->device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &maxAllocSize, NULL);
+    size_t bytesPerKey = 4 * s->keySize + 2 * s->radix * sizeof(cl_uint) / s->blockKeys + 1;
+    cl_ulong chunk = globalMemSize / 2 / bytesPerKey;
+    if(chunk > maxAllocSize / s->keySize) chunk = maxAllocSize / s->keySize;
+    if(chunk > 0x7FFFFFFF) chunk = 0x7FFFFFFF;
+    chunk = chunk / s->blockKeys * s->blockKeys;
+    return chunk > s->blockKeys ? (size_t)chunk : s->blockKeys;
+}
+
+// Sets up the staging buffers and sizes the sorter for chunks of
+// chunkKeys keys, or of what the device holds if chunkKeys is 0
+static inline void chunkedSorterCreate(ChunkedSorter* c,
+                                       RadixSorter* sorter,
+                                       cl_command_queue transferQueue,
+                                       size_t chunkKeys) {
+    cl_int error;
+
+    memset(c, 0, sizeof(*c));
+    c->sorter = sorter;
+    c->transferQueue = transferQueue;
+    c->chunkKeys = chunkKeys > 0 ? chunkKeys : chunkedSortChooseChunk(sorter);
+
+    radixSorterReserve(sorter, c->chunkKeys, 0);
+    for(int b = 0; b < 2; b++) {
+        c->staging_d[b] = clCreateBuffer(sorter->context, CL_MEM_READ_WRITE, c->chunkKeys * sorter->keySize, NULL, &error);
+        CHECK_ERROR(error, CL_SUCCESS, "failed to allocate staging_d");
+    }
+}
+
+// Starts copying chunk i of the keys into its staging buffer once the
+// chunk before it there has been downloaded
+static inline cl_event chunkedSortUpload(ChunkedSorter* c, const void* keys, size_t n, size_t i, cl_event* downloaded) {
+    cl_int status;
+    int b = (int)(i % 2);
+    size_t first = i * c->chunkKeys;
+    size_t count = n - first < c->chunkKeys ? n - first : c->chunkKeys;
+    size_t keySize = c->sorter->keySize;
+
+    cl_event uploaded;
+    status = clEnqueueWriteBuffer(c->transferQueue, c->staging_d[b], CL_FALSE, 0, count * keySize,
+                                  (const char*)keys + first * keySize,
+                                  downloaded[b] != NULL ? 1 : 0, downloaded[b] != NULL ? &downloaded[b] : NULL, &uploaded);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to upload a chunk");
+    if(downloaded[b] != NULL) {
+        clReleaseEvent(downloaded[b]);
+        downloaded[b] = NULL;
+    }
+    clFlush(c->transferQueue);
+    return uploaded;
+}
+
+// ****************************************************************************
+// Function: chunkedSortRuns
+//
+// Purpose:
+//   Sorts the keys a chunk at a time into runs of chunkKeys keys, the
+//   last one shorter.  Chunk i goes through staging buffer i % 2: while
+//   the sorter works on one chunk, the transfer queue brings the last
+//   run home and the next chunk in.  keys may be an mmap'd file; it is
+//   only read, a chunk at a time.
+//
+// Arguments:
+//   c: sorter created by chunkedSorterCreate
+//   keys: n keys of the sorter's type
+//   runs: room for n keys, the sorted runs on return
+//   n: number of keys
+//
+// Returns:  the number of runs
+// ****************************************************************************
+static inline size_t chunkedSortRuns(ChunkedSorter* c, const void* keys, void* runs, size_t n) {
+    cl_int status;
+    RadixSorter* s = c->sorter;
+    size_t numChunks = (n + c->chunkKeys - 1) / c->chunkKeys;
+    cl_event uploaded[2] = {NULL, NULL};
+    cl_event downloaded[2] = {NULL, NULL};
+
+    if(numChunks > 0) uploaded[0] = chunkedSortUpload(c, keys, n, 0, downloaded);
+    for(size_t i = 0; i < numChunks; i++) {
+        int b = (int)(i % 2);
+        size_t first = i * c->chunkKeys;
+        size_t count = n - first < c->chunkKeys ? n - first : c->chunkKeys;
+
+        // The next chunk goes in before this one is sorted, so the
+        // transfer queue has it ready when the sorter is
+        if(i + 1 < numChunks) uploaded[1 - b] = chunkedSortUpload(c, keys, n, i + 1, downloaded);
+
+        cl_event evt;
+        status = clEnqueueCopyBuffer(s->commandQueue, c->staging_d[b], s->data_d[0], 0, 0, count * s->keySize,
+                                     1, &uploaded[b], &evt);
+        CHECK_ERROR(status, CL_SUCCESS, "Failed to copy a chunk to the sorter");
+        clReleaseEvent(uploaded[b]);
+        uploaded[b] = NULL;
+
+        int src;
+        evt = radixSortDevice(s, count, 0, evt, &src);
+
+        cl_event sorted;
+        status = clEnqueueCopyBuffer(s->commandQueue, s->data_d[src], c->staging_d[b], 0, 0, count * s->keySize,
+                                     1, &evt, &sorted);
+        CHECK_ERROR(status, CL_SUCCESS, "Failed to copy a run from the sorter");
+        clReleaseEvent(evt);
+        clFlush(s->commandQueue);
+
+        status = clEnqueueReadBuffer(c->transferQueue, c->staging_d[b], CL_FALSE, 0, count * s->keySize,
+                                     (char*)runs + first * s->keySize, 1, &sorted, &downloaded[b]);
+        CHECK_ERROR(status, CL_SUCCESS, "Failed to download a run");
+        clReleaseEvent(sorted);
+        clFlush(c->transferQueue);
+    }
+
+    for(int b = 0; b < 2; b++) {
+        if(downloaded[b] == NULL) continue;
+        status = clWaitForEvents(1, &downloaded[b]);
+        CHECK_ERROR(status, CL_SUCCESS, "Failed to wait for the runs");
+        clReleaseEvent(downloaded[b]);
+    }
+    return numChunks;
+}
+
+// A key of the merge, as the unsigned integer of the same order, and
+// the run it comes from.  Keys equal as integers order by run and then
+// by position, so every key has its own place and a split never
+// depends on how duplicates fall.
+typedef struct {
+    cl_ulong key;
+    size_t run;
+    size_t index;
+} ChunkedMergeKey;
+
+static inline int chunkedMergeKeyCompare(const void* a, const void* b) {
+    const ChunkedMergeKey* x = (const ChunkedMergeKey*)a;
+    const ChunkedMergeKey* y = (const ChunkedMergeKey*)b;
+    if(x->key != y->key) return x->key < y->key ? -1 : 1;
+    if(x->run != y->run) return x->run < y->run ? -1 : 1;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+// Shared state of the host merge: the runs and, for every thread, where
+// its part of each run begins; thread t merges up to where thread t+1
+// begins
+typedef struct {
+    const void* runs;
+    void* out;
+    size_t n;
+    size_t chunkKeys;
+    size_t numRuns;
+    RadixKeyType keyType;
+    size_t* begin;              // numThreads + 1 rows of numRuns
+} ChunkedMerge;
+
+typedef struct {
+    ChunkedMerge* merge;
+    int id;
+    int started;                // whether a thread of its own runs it
+} ChunkedMergeWorker;
+
+static inline size_t chunkedRunLength(ChunkedMerge* m, size_t r) {
+    size_t first = r * m->chunkKeys;
+    return m->n - first < m->chunkKeys ? m->n - first : m->chunkKeys;
+}
+
+// Keys of run r that come before the splitter
+static inline size_t chunkedRunRank(ChunkedMerge* m, size_t r, const ChunkedMergeKey* splitter) {
+    if(r == splitter->run) return splitter->index;
+    const void* run = (const char*)m->runs + r * m->chunkKeys * RADIX_KEY_SIZE(m->keyType);
+    size_t lo = 0, hi = chunkedRunLength(m, r);
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        cl_ulong key = encodeKeyCPU(run, mid, m->keyType);
+        if(key < splitter->key || (key == splitter->key && r < splitter->run)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// ****************************************************************************
+// Function: chunkedMergeWorker
+//
+// Purpose:
+//   Merges one thread's part of every run with a binary heap of the
+//   runs' next keys, writing from where the parts before it end
+//
+// Returns:  NULL
+// ****************************************************************************
+static inline void* chunkedMergeWorker(void* arg) {
+    ChunkedMergeWorker* w = (ChunkedMergeWorker*)arg;
+    ChunkedMerge* m = w->merge;
+    size_t k = m->numRuns;
+    size_t keySize = RADIX_KEY_SIZE(m->keyType);
+    const size_t* begin = m->begin + w->id * k;
+    const size_t* end = begin + k;
+    size_t* next = (size_t*) malloc(k * sizeof(size_t));
+    ChunkedMergeKey* heap = (ChunkedMergeKey*) malloc(k * sizeof(ChunkedMergeKey));
+
+    size_t pos = 0, heapSize = 0;
+    for(size_t r = 0; r < k; r++) {
+        pos += begin[r];
+        next[r] = begin[r];
+        if(next[r] == end[r]) continue;
+        // sift up
+        const void* run = (const char*)m->runs + r * m->chunkKeys * keySize;
+        ChunkedMergeKey key = {encodeKeyCPU(run, next[r], m->keyType), r, 0};
+        size_t i = heapSize++;
+        while(i > 0 && chunkedMergeKeyCompare(&key, &heap[(i - 1) / 2]) < 0) {
+            heap[i] = heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        heap[i] = key;
+    }
+
+    while(heapSize > 0) {
+        ChunkedMergeKey top = heap[0];
+        decodeKeyCPU(m->out, pos++, top.key, m->keyType);
+
+        // Replace the top by the next key of its run, or by the last
+        // entry once the run's part is done, and sift it down
+        size_t r = top.run;
+        const void* run = (const char*)m->runs + r * m->chunkKeys * keySize;
+        ChunkedMergeKey key;
+        if(++next[r] < end[r]) {
+            key.key = encodeKeyCPU(run, next[r], m->keyType);
+            key.run = r;
+            key.index = 0;
+        } else {
+            key = heap[--heapSize];
+        }
+        size_t i = 0;
+        for(;;) {
+            size_t child = 2 * i + 1;
+            if(child >= heapSize) break;
+            if(child + 1 < heapSize && chunkedMergeKeyCompare(&heap[child + 1], &heap[child]) < 0) child++;
+            if(chunkedMergeKeyCompare(&heap[child], &key) >= 0) break;
+            heap[i] = heap[child];
+            i = child;
+        }
+        if(heapSize > 0) heap[i] = key;
+    }
+
+    free(next);
+    free(heap);
+    return NULL;
+}
+
+// ****************************************************************************
+// Function: chunkedSortMerge
+//
+// Purpose:
+//   Merges the sorted runs into one sorted array on the host.  Splitters
+//   taken from a sample of every run cut the runs into one part per
+//   thread, all parts of a thread holding keys between the same two
+//   splitters, and the threads merge their parts side by side.
+//
+// Arguments:
+//   c: sorter the runs came from
+//   runs: the runs, as left by chunkedSortRuns
+//   out: room for n keys, sorted on return; not runs
+//   n: number of keys
+//   numThreads: number of threads, 0 for one per online processor
+//
+// Returns:  0, or -1 if out of memory
+// ****************************************************************************
+static inline int chunkedSortMerge(ChunkedSorter* c, const void* runs, void* out, size_t n, int numThreads) {
+    ChunkedMerge m;
+    m.runs = runs;
+    m.out = out;
+    m.n = n;
+    m.chunkKeys = c->chunkKeys;
+    m.numRuns = (n + c->chunkKeys - 1) / c->chunkKeys;
+    m.keyType = c->sorter->keyType;
+
+    if(m.numRuns <= 1) {
+        memcpy(out, runs, n * c->sorter->keySize);
+        return 0;
+    }
+    if(numThreads <= 0) numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if((size_t)numThreads > n / CHUNKED_MERGE_MIN_KEYS) numThreads = (int)(n / CHUNKED_MERGE_MIN_KEYS);
+    if(numThreads < 1) numThreads = 1;
+
+    size_t k = m.numRuns;
+    size_t samplesPerRun = (size_t)numThreads * CHUNKED_MERGE_SAMPLES;
+    m.begin = (size_t*) malloc((numThreads + 1) * k * sizeof(size_t));
+    ChunkedMergeKey* samples = (ChunkedMergeKey*) malloc(k * samplesPerRun * sizeof(ChunkedMergeKey));
+    ChunkedMergeWorker* workers = (ChunkedMergeWorker*) malloc(numThreads * sizeof(ChunkedMergeWorker));
+    pthread_t* threads = (pthread_t*) malloc(numThreads * sizeof(pthread_t));
+    if(m.begin == NULL || samples == NULL || workers == NULL || threads == NULL) {
+        free(m.begin);
+        free(samples);
+        free(workers);
+        free(threads);
+        return -1;
+    }
+
+    // Evenly spaced keys of every run, sorted; every samplesPerRun-th
+    // of them splits the threads' parts
+    size_t numSamples = 0;
+    for(size_t r = 0; r < k; r++) {
+        size_t length = chunkedRunLength(&m, r);
+        const void* run = (const char*)runs + r * m.chunkKeys * c->sorter->keySize;
+        for(size_t j = 0; j < samplesPerRun && j < length; j++) {
+            size_t index = j * length / samplesPerRun;
+            ChunkedMergeKey sample = {encodeKeyCPU(run, index, m.keyType), r, index};
+            samples[numSamples++] = sample;
+        }
+    }
+    qsort(samples, numSamples, sizeof(ChunkedMergeKey), chunkedMergeKeyCompare);
+
+    for(size_t r = 0; r < k; r++) {
+        m.begin[r] = 0;
+        m.begin[numThreads * k + r] = chunkedRunLength(&m, r);
+    }
+    for(int t = 1; t < numThreads; t++) {
+        const ChunkedMergeKey* splitter = &samples[numSamples * t / numThreads];
+        for(size_t r = 0; r < k; r++)
+            m.begin[t * k + r] = chunkedRunRank(&m, r, splitter);
+    }
+
+    // the caller takes part as thread 0
+    for(int t = 0; t < numThreads; t++) {
+        workers[t].merge = &m;
+        workers[t].id = t;
+    }
+    // and merges the part of any thread that fails to start itself
+    for(int t = 1; t < numThreads; t++) {
+        workers[t].started = pthread_create(&threads[t], NULL, chunkedMergeWorker, &workers[t]) == 0;
+        if(!workers[t].started) chunkedMergeWorker(&workers[t]);
+    }
+    chunkedMergeWorker(&workers[0]);
+    for(int t = 1; t < numThreads; t++)
+        if(workers[t].started) pthread_join(threads[t], NULL);
+
+    free(m.begin);
+    free(samples);
+    free(workers);
+    free(threads);
+    return 0;
+}
+
+// ****************************************************************************
+// Function: chunkedSortGPU
+//
+// Purpose:
+//   Sorts n keys of any number, however many more than the device
+//   holds: sorted runs of a chunk each from the device, then a multi-way
+//   merge on the host.  Like radixSortGPU but for keys only.
+//
+// Arguments:
+//   c: sorter created by chunkedSorterCreate
+//   keys: n keys, left as they are; may be an mmap'd file
+//   runs: room for n keys the runs go to
+//   out: room for n keys, sorted on return
+//   n: number of keys
+//   numThreads: threads of the host merge, 0 for one per processor
+//
+// Returns:  0, or -1 if out of memory
+// ****************************************************************************
+static inline int chunkedSortGPU(ChunkedSorter* c, const void* keys, void* runs, void* out, size_t n, int numThreads) {
+    chunkedSortRuns(c, keys, runs, n);
+    return chunkedSortMerge(c, runs, out, n, numThreads);
+}
+
+static inline void chunkedSorterRelease(ChunkedSorter* c) {
+    for(int b = 0; b < 2; b++)
+        if(c->staging_d[b] != NULL) clReleaseMemObject(c->staging_d[b]);
+    memset(c, 0, sizeof(*c));
+}
+
+#endif // CHUNKEDSORT_H_
@@ -0,0 +1,580 @@
+#ifndef RADIXSORT_H_
+#define RADIXSORT_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+#ifdef  __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#define GROUP_SIZE 64                   // ATI HD7870 has 20 parallel compute units, !!!wavefront programming!!!
+#define BIN_SIZE 256
+
+// Digit widths the kernels support; radixSorterCreate picks one from
+// the device's local memory unless told otherwise
+#define RADIX_MIN_BITS 4
+#define RADIX_MAX_BITS 11
+
+// Fewest work-items per rankNPermute group a digit width has to allow
+#define MIN_PERMUTE_GROUP 8
+
+// Key types the sorter handles, numbered as KEY_TYPE in RadixSort.cl.
+// Keys are passed as their raw bits; the kernels map signed and floating
+// point keys onto unsigned ones of the same order while counting digits,
+// and back in the last pass.  Floats sort by the IEEE 754 totalOrder:
+// -0.0 before +0.0, NaNs with the sign bit set first, the others last.
+typedef enum {
+    RADIX_KEY_UINT,
+    RADIX_KEY_INT,
+    RADIX_KEY_FLOAT,
+    RADIX_KEY_ULONG,
+    RADIX_KEY_LONG,
+    RADIX_KEY_DOUBLE
+} RadixKeyType;
+
+#define RADIX_KEY_SIZE(type) ((type) >= RADIX_KEY_ULONG ? sizeof(cl_ulong) : sizeof(cl_uint))
+#define RADIX_KEY_ENCODED(type) ((type) != RADIX_KEY_UINT && (type) != RADIX_KEY_ULONG)
+
+// Host twins of encodeKey and decodeKey in RadixSort.cl: key i of an
+// array of keyType as an unsigned integer of the same order, and back
+static inline cl_ulong encodeKeyCPU(const void* keys, size_t i, RadixKeyType keyType) {
+    if(RADIX_KEY_SIZE(keyType) == sizeof(cl_uint)) {
+        cl_uint key = ((const cl_uint*)keys)[i];
+        if(keyType == RADIX_KEY_INT) key ^= 0x80000000u;
+        if(keyType == RADIX_KEY_FLOAT) key = (key & 0x80000000u) ? ~key : key ^ 0x80000000u;
+        return key;
+    }
+    cl_ulong key = ((const cl_ulong*)keys)[i];
+    if(keyType == RADIX_KEY_LONG) key ^= 0x8000000000000000ull;
+    if(keyType == RADIX_KEY_DOUBLE) key = (key & 0x8000000000000000ull) ? ~key : key ^ 0x8000000000000000ull;
+    return key;
+}
+
+static inline void decodeKeyCPU(void* keys, size_t i, cl_ulong key, RadixKeyType keyType) {
+    if(RADIX_KEY_SIZE(keyType) == sizeof(cl_uint)) {
+        cl_uint k = (cl_uint)key;
+        if(keyType == RADIX_KEY_INT) k ^= 0x80000000u;
+        if(keyType == RADIX_KEY_FLOAT) k = (k & 0x80000000u) ? k ^ 0x80000000u : ~k;
+        ((cl_uint*)keys)[i] = k;
+        return;
+    }
+    if(keyType == RADIX_KEY_LONG) key ^= 0x8000000000000000ull;
+    if(keyType == RADIX_KEY_DOUBLE) key = (key & 0x8000000000000000ull) ? key ^ 0x8000000000000000ull : ~key;
+    ((cl_ulong*)keys)[i] = key;
+}
+
+// Device state of one radix sorter: the kernels of RadixSort.cl and the
+// buffers they work on.  The buffers only ever grow, so sorting many
+// arrays of similar size allocates once.
+typedef struct {
+    cl_context context;
+    cl_device_id device;
+    cl_command_queue commandQueue;
+    cl_program program;
+
+    RadixKeyType keyType;       // RadixSort.cl is built for it
+    size_t keySize;             // bytes per key, 4 or 8
+    int bits;                   // digit width, likewise
+    cl_uint radix;              // 1 << bits buckets per pass
+    cl_uint blockKeys;          // keys per histogram work-group / ranking work-item
+    int passes;                 // passes a full key needs
+    int countPasses;            // passes computeDigitCounts counts per launch
+    int passesRun;              // passes the last sort did not skip
+
+    cl_kernel digitCountsKernel;
+    cl_kernel decodeKeysKernel;
+    cl_kernel histogramKernel;
+    cl_kernel permuteKernel;
+    cl_kernel unifiedBlockScanKernel;
+    cl_kernel blockScanKernel;
+    cl_kernel prefixSumKernel;
+    cl_kernel blockAddKernel;
+    cl_kernel mergePrefixSumsKernel;
+
+    cl_mem data_d[2];           // keys, each pass reads one and writes the other
+    cl_mem values_d[2];         // payloads, likewise
+    cl_mem histogram_d;
+    cl_mem scannedHistogram_d;
+    cl_mem sum_in_d;
+    cl_mem sum_out_d;
+    cl_mem summary_in_d;
+    cl_mem summary_out_d;
+    cl_mem digitCounts_d;       // counts of every digit of every pass
+    cl_uint* digitCounts;
+
+    size_t capacity;            // keys the key and histogram buffers hold
+    size_t valueCapacity;       // uints the value buffers hold
+    size_t permuteGroupSize;    // work-items per group of rankNPermute
+} RadixSorter;
+
+// Enqueues one kernel of a pass.  Every step waits on the event of the
+// step before it, which it releases, and returns its own; the host never
+// waits between steps, only for the sorted keys at the end.
+static inline cl_event radixSortEnqueue(RadixSorter* s,
+                                        cl_kernel kernel,
+                                        cl_uint dims,
+                                        const size_t* globalThreads,
+                                        const size_t* localThreads,
+                                        cl_event waitEvt,
+                                        const char* msg) {
+    cl_event execEvt;
+    cl_int status = clEnqueueNDRangeKernel(
+        s->commandQueue,
+        kernel,
+        dims,
+        NULL,
+        globalThreads,
+        localThreads,
+        waitEvt != NULL ? 1 : 0,
+        waitEvt != NULL ? &waitEvt : NULL,
+        &execEvt);
+    CHECK_ERROR(status, CL_SUCCESS, msg);
+    if(waitEvt != NULL) clReleaseEvent(waitEvt);
+    return execEvt;
+}
+
+// Number of blocks of keys, each histogrammed by one work-group and
+// ranked by one work-item
+static inline size_t radixSortBlocks(RadixSorter* s, size_t n) {
+    return (n + s->blockKeys - 1) / s->blockKeys;
+}
+
+// Number of GROUP_SIZE-wide groups blockScan splits the blocks into
+static inline size_t radixSortScanGroups(RadixSorter* s, size_t n) {
+    return (radixSortBlocks(s, n) + GROUP_SIZE - 1) / GROUP_SIZE;
+}
+
+// Widest digits cost fewer passes but a rankNPermute work-item keeps one
+// running offset per bucket in local memory.  Take the fewest passes
+// local memory allows, then the narrowest digit that still needs no more.
+static inline int radixSortChooseBits(cl_ulong localMemSize, int keyBits) {
+    int maxBits = RADIX_MIN_BITS;
+    while(maxBits < RADIX_MAX_BITS &&
+          (MIN_PERMUTE_GROUP << (maxBits + 1)) * sizeof(cl_uint) <= localMemSize)
+        maxBits++;
+    int passes = (keyBits + maxBits - 1) / maxBits;
+    return (keyBits + passes - 1) / passes;
+}
+
+// Builds RadixSort.cl for a key type and digit width and creates its
+// kernels; no key buffers are allocated until the first sort.  bits is
+// the digit width, RADIX_MIN_BITS to RADIX_MAX_BITS, or 0 to choose it
+// from the device.
+static inline void radixSorterCreate(RadixSorter* s,
+                                     cl_context context,
+                                     cl_device_id device,
+                                     cl_command_queue commandQueue,
+                                     const char* source,
+                                     size_t sourceSize,
+                                     RadixKeyType keyType,
+                                     int bits) {
+    cl_int error;
+
+    memset(s, 0, sizeof(*s));
+    s->context = context;
+    s->device = device;
+    s->commandQueue = commandQueue;
+
+    cl_ulong localMemSize = 0;
+    clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &localMemSize, NULL);
+    int keyBits = (int)RADIX_KEY_SIZE(keyType) * 8;
+    if(bits == 0) bits = radixSortChooseBits(localMemSize, keyBits);
+    if(bits < RADIX_MIN_BITS) bits = RADIX_MIN_BITS;
+    if(bits > RADIX_MAX_BITS) bits = RADIX_MAX_BITS;
+    s->keyType = keyType;
+    s->keySize = RADIX_KEY_SIZE(keyType);
+    s->bits = bits;
+    s->radix = 1u << bits;
+    s->blockKeys = s->radix > BIN_SIZE ? s->radix : BIN_SIZE;
+    s->passes = (keyBits + bits - 1) / bits;
+
+    // Create the OpenCL program object 
+    s->program = clCreateProgramWithSource(context, 1, &source, &sourceSize, &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Can't create the OpenCL program object");
+
+    // Build OpenCL program object and dump the error message, if any 
+    char options[48];
+    sprintf(options, "-Dbitsbyte=%d -DKEY_TYPE=%d", bits, (int)keyType);
+    error = clBuildProgram(s->program, 1, &device, options, NULL, NULL);
+    if(error != CL_SUCCESS) {
+        // If there's an error whilst building the program, dump the log
+        size_t log_size;
+        clGetProgramBuildInfo(s->program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+        char *program_log = (char*) malloc(log_size+1);
+        program_log[log_size] = '\0';
+        clGetProgramBuildInfo(s->program, device, CL_PROGRAM_BUILD_LOG,
+                              log_size+1, program_log, NULL);
+        printf("\n=== ERROR ===\n\n%s\n=============\n", program_log);
+        free(program_log);
+        exit(1);
+    }
+    cl_program program = s->program;
+
+    s->digitCountsKernel = clCreateKernel(program, "computeDigitCounts", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create digit counts kernel");
+    s->decodeKeysKernel = clCreateKernel(program, "decodeKeys", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create decode keys kernel");
+    s->histogramKernel = clCreateKernel(program, "computeHistogram", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create histogram kernel");
+    s->permuteKernel   = clCreateKernel(program, "rankNPermute", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create permute kernel");
+    s->unifiedBlockScanKernel  = clCreateKernel(program, "unifiedBlockScan", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create unifiedBlockScan kernel");
+    s->blockScanKernel  = clCreateKernel(program, "blockScan", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create blockScan kernel");
+    s->prefixSumKernel = clCreateKernel(program, "blockPrefixSum", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create compute block prefix sum kernel");
+    s->blockAddKernel  = clCreateKernel(program, "blockAdd", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create block addition kernel");
+    s->mergePrefixSumsKernel    = clCreateKernel(program, "mergePrefixSums", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create fix offset kernel");
+
+    // Every work-item of rankNPermute keeps a row of radix running
+    // offsets in local memory
+    s->permuteGroupSize = GROUP_SIZE;
+    while(s->permuteGroupSize > 1 && s->permuteGroupSize * s->radix * sizeof(cl_uint) > localMemSize)
+        s->permuteGroupSize >>= 1;
+
+    // Likewise computeDigitCounts keeps a row of counts per pass; wide
+    // digits of 64-bit keys take it more than one launch
+    s->countPasses = s->passes;
+    while(s->countPasses > 1 && s->countPasses * s->radix * sizeof(cl_uint) > localMemSize)
+        s->countPasses--;
+
+    s->digitCounts = (cl_uint*) malloc(s->passes * s->radix * sizeof(cl_uint));
+    s->digitCounts_d = clCreateBuffer(context, CL_MEM_READ_WRITE, s->passes * s->radix * sizeof(cl_uint), NULL, &error);
+    CHECK_ERROR(error, CL_SUCCESS, "failed to allocate digitCounts_d");
+}
+
+static inline cl_mem radixSortBuffer(RadixSorter* s, cl_mem old, size_t size, const char* name) {
+    cl_int error;
+    if(old != NULL) clReleaseMemObject(old);
+    cl_mem buffer = clCreateBuffer(s->context, CL_MEM_READ_WRITE, size, NULL, &error);
+    CHECK_ERROR(error, CL_SUCCESS, name);
+    return buffer;
+}
+
+// Grows the device buffers to hold n keys with valueWords uints of
+// payload each; buffers large enough already are kept
+static inline void radixSorterReserve(RadixSorter* s, size_t n, size_t valueWords) {
+    if(n > s->capacity) {
+        // Round up to whole blocks so a little growth does not reallocate
+        size_t capacity = radixSortBlocks(s, n) * s->blockKeys;
+        size_t histogramSize = radixSortBlocks(s, n) * s->radix * sizeof(cl_uint);
+        size_t scanSize = radixSortScanGroups(s, capacity) * s->radix * sizeof(cl_uint);
+        s->data_d[0]          = radixSortBuffer(s, s->data_d[0], capacity * s->keySize, "failed to allocate data_d[0]");
+        s->data_d[1]          = radixSortBuffer(s, s->data_d[1], capacity * s->keySize, "failed to allocate data_d[1]");
+        s->histogram_d        = radixSortBuffer(s, s->histogram_d, histogramSize, "failed to allocate histogram_d");
+        s->scannedHistogram_d = radixSortBuffer(s, s->scannedHistogram_d, histogramSize, "failed to allocate scannedHistogram_d");
+        s->sum_in_d           = radixSortBuffer(s, s->sum_in_d, scanSize, "failed to allocate sum_in_d");
+        s->sum_out_d          = radixSortBuffer(s, s->sum_out_d, scanSize, "failed to allocate sum_out_d");
+        if(s->summary_in_d == NULL) {
+            s->summary_in_d   = radixSortBuffer(s, NULL, s->radix * sizeof(cl_uint), "failed to allocate summary_in_d");
+            s->summary_out_d  = radixSortBuffer(s, NULL, s->radix * sizeof(cl_uint), "failed to allocate summary_out_d");
+        }
+        s->capacity = capacity;
+    }
+    if(n * valueWords > s->valueCapacity) {
+        size_t valueCapacity = radixSortBlocks(s, n) * s->blockKeys * valueWords;
+        s->values_d[0] = radixSortBuffer(s, s->values_d[0], valueCapacity * sizeof(cl_uint), "failed to allocate values_d[0]");
+        s->values_d[1] = radixSortBuffer(s, s->values_d[1], valueCapacity * sizeof(cl_uint), "failed to allocate values_d[1]");
+        s->valueCapacity = valueCapacity;
+    }
+}
+
+// Counts every digit of every pass, in one read of the keys unless the
+// counts outgrow local memory, so passes on a digit all keys share can be
+// skipped.  The first launch also encodes signed and floating point keys.
+static inline cl_event computeDigitCounts(RadixSorter* s, cl_uint n, cl_event waitEvt) {
+    cl_int status;
+    size_t numOfGroups = radixSortBlocks(s, n) < 64 ? radixSortBlocks(s, n) : 64;
+    size_t globalThreads = numOfGroups * BIN_SIZE;
+    size_t localThreads  = BIN_SIZE;
+    for(int pass = 0; pass < s->passes; pass += s->countPasses) {
+        cl_uint firstPass = (cl_uint)pass;
+        cl_uint passCount = (cl_uint)(s->passes - pass < s->countPasses ? s->passes - pass : s->countPasses);
+        status = clSetKernelArg(s->digitCountsKernel, 0, sizeof(cl_mem), (void*)&s->data_d[0]);
+        status |= clSetKernelArg(s->digitCountsKernel, 1, sizeof(cl_mem), (void*)&s->digitCounts_d);
+        status |= clSetKernelArg(s->digitCountsKernel, 2, passCount * s->radix * sizeof(cl_uint), NULL);
+        status |= clSetKernelArg(s->digitCountsKernel, 3, sizeof(cl_uint), (void*)&firstPass);
+        status |= clSetKernelArg(s->digitCountsKernel, 4, sizeof(cl_uint), (void*)&passCount);
+        status |= clSetKernelArg(s->digitCountsKernel, 5, sizeof(cl_uint), (void*)&n);
+        CHECK_ERROR(status, CL_SUCCESS, "Failed to set digit counts kernel arguments");
+        waitEvt = radixSortEnqueue(s, s->digitCountsKernel, 1, &globalThreads, &localThreads, waitEvt, "Failed to enqueue digit counts kernel");
+    }
+    return waitEvt;
+}
+
+// Turns encoded keys back into their own type when no pass ran to do it
+static inline cl_event computeDecodeKeys(RadixSorter* s, cl_uint n, cl_event waitEvt) {
+    cl_int status;
+    size_t localThreads  = BIN_SIZE;
+    size_t globalThreads = (n + BIN_SIZE - 1) / BIN_SIZE * BIN_SIZE;
+    status = clSetKernelArg(s->decodeKeysKernel, 0, sizeof(cl_mem), (void*)&s->data_d[0]);
+    status |= clSetKernelArg(s->decodeKeysKernel, 1, sizeof(cl_uint), (void*)&n);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to set decode keys kernel arguments");
+    return radixSortEnqueue(s, s->decodeKeysKernel, 1, &globalThreads, &localThreads, waitEvt, "Failed to enqueue decode keys kernel");
+}
+
+// This is the threaded-historgram which builds histograms
+// and bins them based on a size of radix
+static inline cl_event computeHistogram(RadixSorter* s, cl_mem data_d, int currByte, cl_uint n, cl_event waitEvt) {
+    cl_int status;
+    size_t globalThreads = radixSortBlocks(s, n) * BIN_SIZE;
+    size_t localThreads  = BIN_SIZE;
+    status = clSetKernelArg(s->histogramKernel, 0, sizeof(cl_mem), (void*)&data_d);
+    status |= clSetKernelArg(s->histogramKernel, 1, sizeof(cl_mem), (void*)&s->histogram_d);
+    status |= clSetKernelArg(s->histogramKernel, 2, sizeof(cl_int), (void*)&currByte);
+    status |= clSetKernelArg(s->histogramKernel, 3, sizeof(cl_int) * s->radix, NULL);
+    status |= clSetKernelArg(s->histogramKernel, 4, sizeof(cl_uint), (void*)&n);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to set histogram kernel arguments");
+    return radixSortEnqueue(s, s->histogramKernel, 1, &globalThreads, &localThreads, waitEvt, "Failed to enqueue histogram kernel");
+}
+
+// Scatters keys and payloads from buffer src to buffer 1-src; there is
+// no copy back, the next pass reads where this one wrote.  The last pass
+// decodes the keys as it scatters them.
+static inline cl_event computeRankingNPermutations(RadixSorter* s, int src, int currByte, cl_uint n, cl_uint valueWords, cl_uint decode, cl_event waitEvt) {
+    cl_int status;
+
+    size_t groupSize = s->permuteGroupSize;
+    size_t localThreads  = groupSize;
+    size_t globalThreads = (radixSortBlocks(s, n) + groupSize - 1) / groupSize * groupSize;
+
+    status = clSetKernelArg(s->permuteKernel, 0, sizeof(cl_mem), (void*)&s->data_d[src]);
+    status |= clSetKernelArg(s->permuteKernel, 1, sizeof(cl_mem), (void*)&s->scannedHistogram_d);
+    status |= clSetKernelArg(s->permuteKernel, 2, sizeof(cl_int), (void*)&currByte);
+    status |= clSetKernelArg(s->permuteKernel, 3, groupSize * s->radix * sizeof(cl_uint), NULL); // shared memory
+    status |= clSetKernelArg(s->permuteKernel, 4, sizeof(cl_mem), (void*)&s->data_d[1 - src]);
+    status |= clSetKernelArg(s->permuteKernel, 5, sizeof(cl_mem), (void*)&s->values_d[src]);
+    status |= clSetKernelArg(s->permuteKernel, 6, sizeof(cl_mem), (void*)&s->values_d[1 - src]);
+    status |= clSetKernelArg(s->permuteKernel, 7, sizeof(cl_uint), (void*)&valueWords);
+    status |= clSetKernelArg(s->permuteKernel, 8, sizeof(cl_uint), (void*)&n);
+    status |= clSetKernelArg(s->permuteKernel, 9, sizeof(cl_uint), (void*)&decode);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to set permute kernel arguments");
+    return radixSortEnqueue(s, s->permuteKernel, 1, &globalThreads, &localThreads, waitEvt, "Failed to enqueue permute kernel");
+}
+
+// Turns the per-block digit counts into the global offset of every
+// (block, digit) pair: digits in order, blocks in order within a digit
+static inline cl_event computeBlockScans(RadixSorter* s, cl_uint n, cl_event waitEvt) {
+    cl_int status;
+
+    cl_uint numOfBlocks = (cl_uint)radixSortBlocks(s, n);
+    size_t numOfGroups = radixSortScanGroups(s, n) * GROUP_SIZE;
+    size_t globalThreads[2] = {numOfGroups, s->radix};
+    size_t localThreads[2]  = {GROUP_SIZE, 1};
+    cl_uint groupSize = GROUP_SIZE;
+
+    status = clSetKernelArg(s->blockScanKernel, 0, sizeof(cl_mem), (void*)&s->scannedHistogram_d);
+    status |= clSetKernelArg(s->blockScanKernel, 1, sizeof(cl_mem), (void*)&s->histogram_d);
+    status |= clSetKernelArg(s->blockScanKernel, 2, GROUP_SIZE * sizeof(cl_uint), NULL);
+    status |= clSetKernelArg(s->blockScanKernel, 3, sizeof(cl_uint), &groupSize);
+    status |= clSetKernelArg(s->blockScanKernel, 4, sizeof(cl_mem), &s->sum_in_d);
+    status |= clSetKernelArg(s->blockScanKernel, 5, sizeof(cl_uint), &numOfBlocks);
+
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to set blockScan kernel arguments");
+    cl_event execEvt = radixSortEnqueue(s, s->blockScanKernel, 2, globalThreads, localThreads, waitEvt, "Failed to enqueue blockScan kernel");
+
+    // Offsets of the groups within each digit, and the total of each
+    // digit.  Needed even with a single group: the digit totals feed the
+    // scan below.
+    size_t globalThreadsPrefix[2] = {numOfGroups/GROUP_SIZE, s->radix};
+    status = clSetKernelArg(s->prefixSumKernel, 0, sizeof(cl_mem), (void*)&s->sum_out_d);
+    status |= clSetKernelArg(s->prefixSumKernel, 1, sizeof(cl_mem), (void*)&s->sum_in_d);
+    status |= clSetKernelArg(s->prefixSumKernel, 2, sizeof(cl_mem), (void*)&s->summary_in_d);
+    cl_uint stride = (cl_uint)numOfGroups/GROUP_SIZE;
+    status |= clSetKernelArg(s->prefixSumKernel, 3, sizeof(cl_uint), (void*)&stride);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to set blockPrefixSum kernel arguments");
+    execEvt = radixSortEnqueue(s, s->prefixSumKernel, 2, globalThreadsPrefix, NULL, execEvt, "Failed to enqueue blockPrefixSum kernel");
+
+    // Run block-addition kernel, only needed when a digit spans several groups
+    if(stride != 1) {
+        size_t globalThreadsAdd[2] = {numOfGroups, s->radix};
+        size_t localThreadsAdd[2]  = {GROUP_SIZE, 1};
+        status = clSetKernelArg(s->blockAddKernel, 0, sizeof(cl_mem), (void*)&s->sum_out_d);
+        status |= clSetKernelArg(s->blockAddKernel, 1, sizeof(cl_mem), (void*)&s->scannedHistogram_d);
+        status |= clSetKernelArg(s->blockAddKernel, 2, sizeof(cl_uint), (void*)&stride);
+        status |= clSetKernelArg(s->blockAddKernel, 3, sizeof(cl_uint), (void*)&numOfBlocks);
+        CHECK_ERROR(status, CL_SUCCESS, "Failed to set blockAdd kernel arguments");
+        execEvt = radixSortEnqueue(s, s->blockAddKernel, 2, globalThreadsAdd, localThreadsAdd, execEvt, "Failed to enqueue blockAdd kernel");
+    }
+
+    // Run parallel array scan since we have GROUP_SIZE values which are summarized from each row
+    // and we accumulate them; one work-group, each work-item scanning a
+    // run of digits when there are more digits than work-items
+    size_t scanGroupSize = s->radix < BIN_SIZE ? s->radix : BIN_SIZE;
+    size_t globalThreadsScan[1] = {scanGroupSize};
+    size_t localThreadsScan[1] = {scanGroupSize};
+    status = clSetKernelArg(s->unifiedBlockScanKernel, 0, sizeof(cl_mem), (void*)&s->summary_out_d);
+    status |= clSetKernelArg(s->unifiedBlockScanKernel, 1, sizeof(cl_mem), (void*)&s->summary_in_d);
+    status |= clSetKernelArg(s->unifiedBlockScanKernel, 2, scanGroupSize * sizeof(cl_uint), NULL);  // shared memory
+    groupSize = s->radix;
+    status |= clSetKernelArg(s->unifiedBlockScanKernel, 3, sizeof(cl_uint), (void*)&groupSize);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to set unifiedBlockScan kernel arguments");
+    execEvt = radixSortEnqueue(s, s->unifiedBlockScanKernel, 1, globalThreadsScan, localThreadsScan, execEvt, "Failed to enqueue unifiedBlockScan kernel");
+
+    size_t globalThreadsOffset[2] = {numOfBlocks, s->radix};
+    status = clSetKernelArg(s->mergePrefixSumsKernel, 0, sizeof(cl_mem), (void*)&s->summary_out_d);
+    status |= clSetKernelArg(s->mergePrefixSumsKernel, 1, sizeof(cl_mem), (void*)&s->scannedHistogram_d);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to set mergePrefixSums kernel arguments");
+    return radixSortEnqueue(s, s->mergePrefixSumsKernel, 2, globalThreadsOffset, NULL, execEvt, "Failed to enqueue mergePrefixSums kernel");
+}
+
+// Whether all n keys share their digit of a pass, going by the digit
+// counts read back before the first pass
+static inline int radixSortPassShared(RadixSorter* s, int pass, size_t n) {
+    for(cl_uint d = 0; d < s->radix; d++)
+        if(s->digitCounts[pass * s->radix + d] == n) return 1;
+    return 0;
+}
+
+// Sorts the n keys already in data_d[0], and their payloads in
+// values_d[0], once evt completes; evt is released.  The host waits
+// once, for the digit counts.  The sorted keys end up in
+// data_d[*sorted], ready when the returned event completes.
+static inline cl_event radixSortDevice(RadixSorter* s, size_t n, cl_uint valueWords, cl_event evt, int* sorted) {
+    cl_int status;
+
+    // Count the digits of all passes up front.  The host waits for these
+    // few counts once, and leaves out every pass whose digit is the same
+    // for all keys: it would not change the order.
+    cl_event countsEvt;
+    memset(s->digitCounts, 0, s->passes * s->radix * sizeof(cl_uint));
+    status = clEnqueueWriteBuffer(s->commandQueue, s->digitCounts_d, CL_FALSE, 0, s->passes * s->radix * sizeof(cl_uint), s->digitCounts, 1, &evt, &countsEvt);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to clear digit counts");
+    clReleaseEvent(evt);
+    evt = computeDigitCounts(s, (cl_uint)n, countsEvt);
+    status = clEnqueueReadBuffer(s->commandQueue, s->digitCounts_d, CL_FALSE, 0, s->passes * s->radix * sizeof(cl_uint), s->digitCounts, 1, &evt, &countsEvt);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to read digit counts");
+    clReleaseEvent(evt);
+    evt = countsEvt;
+
+    // The passes to run depend on the counts, so the host waits for the
+    // read, and for nothing else queued
+    clFlush(s->commandQueue);
+    status = clWaitForEvents(1, &evt);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to wait for digit counts");
+
+    // The last pass run decodes the keys
+    int lastPass = -1;
+    for(int pass = 0; pass < s->passes; pass++)
+        if(!radixSortPassShared(s, pass, n)) lastPass = pass;
+    cl_uint encoded = RADIX_KEY_ENCODED(s->keyType) ? 1 : 0;
+
+    // Ping-pong between the two buffers: each pass run moves the keys
+    // to the other one
+    int src = 0;
+    s->passesRun = 0;
+    for(int pass = 0; pass <= lastPass; pass++) {
+        if(radixSortPassShared(s, pass, n)) continue;
+
+        int currByte = pass * s->bits;
+        evt = computeHistogram(s, s->data_d[src], currByte, (cl_uint)n, evt);
+        evt = computeBlockScans(s, (cl_uint)n, evt);
+        evt = computeRankingNPermutations(s, src, currByte, (cl_uint)n, valueWords,
+                                          pass == lastPass ? encoded : 0, evt);
+        src = 1 - src;
+        s->passesRun++;
+    }
+    if(s->passesRun == 0 && encoded)
+        evt = computeDecodeKeys(s, (cl_uint)n, evt);
+
+    *sorted = src;
+    return evt;
+}
+
+// ****************************************************************************
+// Function: radixSortGPU
+//
+// Purpose:
+//   Sorts n keys in place, ascending and stable, with an optional payload
+//   of valueSize bytes per key (0, sizeof(cl_uint) or sizeof(cl_ulong))
+//   moved along with them.  n need not be a multiple of anything; the
+//   last block of keys is simply shorter.  The keys are of the type the
+//   sorter was created for.
+//
+// Arguments:
+//   s: sorter created by radixSorterCreate
+//   keys: n keys of s->keySize bytes, sorted on return
+//   values: n payloads, permuted like the keys; NULL if valueSize is 0
+//   valueSize: bytes of payload per key
+//   n: number of keys
+//
+// Returns:  0 on success, -1 if the arguments are not supported
+// ****************************************************************************
+static inline int radixSortGPU(RadixSorter* s,
+                               void* keys,
+                               void* values,
+                               size_t valueSize,
+                               size_t n) {
+    cl_int status;
+
+    if(valueSize % sizeof(cl_uint) != 0 || valueSize > sizeof(cl_ulong) ||
+       (valueSize > 0 && values == NULL) || n > (size_t)0x7FFFFFFF) {
+        return -1;
+    }
+    if(n == 0) return 0;
+
+    cl_uint valueWords = (cl_uint)(valueSize / sizeof(cl_uint));
+    radixSorterReserve(s, n, valueWords);
+
+    cl_event evt;
+    status = clEnqueueWriteBuffer(s->commandQueue, s->data_d[0], CL_FALSE, 0, n * s->keySize, keys, 0, NULL, &evt);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to write keys");
+    if(valueWords > 0) {
+        cl_event writeEvt;
+        status = clEnqueueWriteBuffer(s->commandQueue, s->values_d[0], CL_FALSE, 0, n * valueSize, values, 1, &evt, &writeEvt);
+        CHECK_ERROR(status, CL_SUCCESS, "Failed to write values");
+        clReleaseEvent(evt);
+        evt = writeEvt;
+    }
+
+    int src;
+    evt = radixSortDevice(s, n, valueWords, evt, &src);
+    clFlush(s->commandQueue);
+
+    // The only other point where the host waits
+    cl_event readEvt[2];
+    status = clEnqueueReadBuffer(s->commandQueue, s->data_d[src], CL_FALSE, 0, n * s->keySize, keys, 1, &evt, &readEvt[0]);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to read keys");
+    if(valueWords > 0) {
+        status = clEnqueueReadBuffer(s->commandQueue, s->values_d[src], CL_FALSE, 0, n * valueSize, values, 1, &evt, &readEvt[1]);
+        CHECK_ERROR(status, CL_SUCCESS, "Failed to read values");
+    }
+    clReleaseEvent(evt);
+    status = clWaitForEvents(valueWords > 0 ? 2 : 1, readEvt);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to wait for the sort");
+    clReleaseEvent(readEvt[0]);
+    if(valueWords > 0) clReleaseEvent(readEvt[1]);
+    return 0;
+}
+
+static inline void radixSorterRelease(RadixSorter* s) {
+    cl_mem buffers[] = {s->data_d[0], s->data_d[1], s->values_d[0], s->values_d[1],
+                        s->histogram_d, s->scannedHistogram_d, s->sum_in_d, s->sum_out_d,
+                        s->summary_in_d, s->summary_out_d, s->digitCounts_d};
+    for(int i = 0; i < sizeof(buffers)/sizeof(buffers[0]); i++)
+        if(buffers[i] != NULL) clReleaseMemObject(buffers[i]);
+
+    clReleaseKernel(s->digitCountsKernel);
+    clReleaseKernel(s->decodeKeysKernel);
+    clReleaseKernel(s->histogramKernel);
+    clReleaseKernel(s->permuteKernel);
+    clReleaseKernel(s->unifiedBlockScanKernel);
+    clReleaseKernel(s->blockScanKernel);
+    clReleaseKernel(s->prefixSumKernel);
+    clReleaseKernel(s->blockAddKernel);
+    clReleaseKernel(s->mergePrefixSumsKernel);
+    clReleaseProgram(s->program);
+    free(s->digitCounts);
+    memset(s, 0, sizeof(*s));
+}
+
+#endif // RADIXSORT_H_
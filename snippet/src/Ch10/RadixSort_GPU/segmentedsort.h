@@ -0,0 +1,208 @@
+#ifndef SEGMENTEDSORT_H_
+#define SEGMENTEDSORT_H_
+
+#include "radixsort.h"
+
+// Largest tile of small segments one work-group sorts
+#define SEGMENT_TILE_MAX 4096
+
+// Segments a tile may hold; sortSegmentTiles numbers them in a ushort
+// and keeps 0xFFFF for padding
+#define SEGMENT_TILE_SEGMENTS 0xFFFF
+
+// ****************************************************************************
+// Struct: SegmentedSorter
+//
+// Purpose:
+//   Sorts many independent segments of one array in one call.  Segments
+//   up to a tile long are packed, whole and in order, into tiles sorted
+//   by one work-group each in a single launch; longer ones go one by one
+//   through the radix sorter, whose program holds the tile kernel too.
+// ****************************************************************************
+typedef struct {
+    RadixSorter* sorter;
+    cl_kernel tileKernel;
+    cl_uint tileKeys;           // keys per tile, a power of two
+
+    cl_mem keys_d;
+    cl_mem offsets_d;
+    cl_mem tiles_d;
+    size_t keyCapacity;
+    size_t offsetCapacity;
+    size_t tileCapacity;
+    size_t listCapacity;        // segments the host lists hold
+    cl_uint* tiles;             // uint4 per tile, as sortSegmentTiles reads them
+    size_t* large;              // the segments longer than a tile
+
+    size_t numTiles;            // of the last sort
+    size_t numLarge;
+} SegmentedSorter;
+
+// Largest power of two number of keys, at most SEGMENT_TILE_MAX, whose
+// keys and segment numbers fit in half of the device's local memory
+static inline cl_uint segmentedSortTileKeys(RadixSorter* s) {
+    cl_ulong localMemSize = 0;
+    clGetDeviceInfo(s->device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &localMemSize, NULL);
+    cl_uint size = BIN_SIZE;
+    while((size << 1) <= SEGMENT_TILE_MAX &&
+          (size << 1) * (s->keySize + sizeof(cl_ushort)) <= localMemSize / 2)
+        size <<= 1;
+    return size;
+}
+
+static inline void segmentedSorterCreate(SegmentedSorter* ss, RadixSorter* sorter) {
+    cl_int error;
+
+    memset(ss, 0, sizeof(*ss));
+    ss->sorter = sorter;
+    ss->tileKeys = segmentedSortTileKeys(sorter);
+    ss->tileKernel = clCreateKernel(sorter->program, "sortSegmentTiles", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create segment tiles kernel");
+}
+
+// Grows a device buffer to hold size bytes; *capacity is its size
+static inline void segmentedSortBuffer(SegmentedSorter* ss, cl_mem* buffer, size_t* capacity, size_t size, const char* name) {
+    if(size <= *capacity) return;
+    *buffer = radixSortBuffer(ss->sorter, *buffer, size, name);
+    *capacity = size;
+}
+
+// ****************************************************************************
+// Function: segmentedSortPlan
+//
+// Purpose:
+//   Packs consecutive segments into tiles of at most tileKeys keys and
+//   SEGMENT_TILE_SEGMENTS segments, and lists the longer segments, which
+//   end the tile before them
+//
+// Returns:  the length of the longest segment
+// ****************************************************************************
+static inline size_t segmentedSortPlan(SegmentedSorter* ss, const cl_uint* offsets, size_t numSegments) {
+    size_t longest = 0;
+    ss->numTiles = 0;
+    ss->numLarge = 0;
+    cl_uint* tile = NULL;
+    for(size_t g = 0; g < numSegments; g++) {
+        cl_uint count = offsets[g + 1] - offsets[g];
+        if(count > longest) longest = count;
+        if(count > ss->tileKeys) {
+            ss->large[ss->numLarge++] = g;
+            tile = NULL;
+            continue;
+        }
+        if(tile == NULL || tile[1] + count > ss->tileKeys || tile[3] - tile[2] == SEGMENT_TILE_SEGMENTS) {
+            tile = ss->tiles + 4 * ss->numTiles++;
+            tile[0] = offsets[g];
+            tile[1] = 0;
+            tile[2] = (cl_uint)g;
+            tile[3] = (cl_uint)g;
+        }
+        tile[1] += count;
+        tile[3]++;
+    }
+    return longest;
+}
+
+// ****************************************************************************
+// Function: segmentedSortGPU
+//
+// Purpose:
+//   Sorts every segment of keys on its own, ascending.  Segment g holds
+//   the keys from offsets[g] to offsets[g+1]; keys outside all segments
+//   are left as they are.  Small segments cost one launch for all of
+//   them, long ones a radix sort each, all behind one upload and one
+//   download.
+//
+// Arguments:
+//   ss: sorter created by segmentedSorterCreate
+//   keys: offsets[numSegments] keys of the radix sorter's type
+//   offsets: numSegments + 1 ascending offsets into keys
+//   numSegments: number of segments
+//
+// Returns:  0 on success, -1 if the keys are too many
+// ****************************************************************************
+static inline int segmentedSortGPU(SegmentedSorter* ss,
+                                   void* keys,
+                                   const cl_uint* offsets,
+                                   size_t numSegments) {
+    cl_int status;
+    RadixSorter* s = ss->sorter;
+
+    if(numSegments == 0) return 0;
+    size_t n = offsets[numSegments];
+    if(n > (size_t)0x7FFFFFFF) return -1;
+    if(n == 0) return 0;
+
+    // Host lists of at most one tile and one long segment per segment
+    if(numSegments > ss->listCapacity) {
+        free(ss->tiles);
+        free(ss->large);
+        ss->tiles = (cl_uint*) malloc(numSegments * 4 * sizeof(cl_uint));
+        ss->large = (size_t*) malloc(numSegments * sizeof(size_t));
+        ss->listCapacity = numSegments;
+    }
+    size_t longest = segmentedSortPlan(ss, offsets, numSegments);
+
+    segmentedSortBuffer(ss, &ss->keys_d, &ss->keyCapacity, n * s->keySize, "failed to allocate keys_d");
+    segmentedSortBuffer(ss, &ss->offsets_d, &ss->offsetCapacity, (numSegments + 1) * sizeof(cl_uint), "failed to allocate offsets_d");
+    segmentedSortBuffer(ss, &ss->tiles_d, &ss->tileCapacity, (ss->numTiles > 0 ? ss->numTiles : 1) * 4 * sizeof(cl_uint), "failed to allocate tiles_d");
+    if(ss->numLarge > 0) radixSorterReserve(s, longest, 0);
+
+    cl_event evt, writeEvt;
+    status = clEnqueueWriteBuffer(s->commandQueue, ss->keys_d, CL_FALSE, 0, n * s->keySize, keys, 0, NULL, &evt);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to write keys");
+    status = clEnqueueWriteBuffer(s->commandQueue, ss->offsets_d, CL_FALSE, 0, (numSegments + 1) * sizeof(cl_uint), offsets, 1, &evt, &writeEvt);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to write offsets");
+    clReleaseEvent(evt);
+    evt = writeEvt;
+
+    if(ss->numTiles > 0) {
+        status = clEnqueueWriteBuffer(s->commandQueue, ss->tiles_d, CL_FALSE, 0, ss->numTiles * 4 * sizeof(cl_uint), ss->tiles, 1, &evt, &writeEvt);
+        CHECK_ERROR(status, CL_SUCCESS, "Failed to write tiles");
+        clReleaseEvent(evt);
+
+        size_t localThreads = BIN_SIZE;
+        size_t globalThreads = ss->numTiles * BIN_SIZE;
+        status = clSetKernelArg(ss->tileKernel, 0, sizeof(cl_mem), (void*)&ss->keys_d);
+        status |= clSetKernelArg(ss->tileKernel, 1, sizeof(cl_mem), (void*)&ss->offsets_d);
+        status |= clSetKernelArg(ss->tileKernel, 2, sizeof(cl_mem), (void*)&ss->tiles_d);
+        status |= clSetKernelArg(ss->tileKernel, 3, ss->tileKeys * s->keySize, NULL);
+        status |= clSetKernelArg(ss->tileKernel, 4, ss->tileKeys * sizeof(cl_ushort), NULL);
+        CHECK_ERROR(status, CL_SUCCESS, "Failed to set segment tiles kernel arguments");
+        evt = radixSortEnqueue(s, ss->tileKernel, 1, &globalThreads, &localThreads, writeEvt, "Failed to enqueue segment tiles kernel");
+    }
+
+    // Long segments through the radix sorter, each copied in and back
+    for(size_t l = 0; l < ss->numLarge; l++) {
+        size_t g = ss->large[l];
+        size_t first = offsets[g];
+        size_t count = offsets[g + 1] - offsets[g];
+        status = clEnqueueCopyBuffer(s->commandQueue, ss->keys_d, s->data_d[0], first * s->keySize, 0, count * s->keySize, 1, &evt, &writeEvt);
+        CHECK_ERROR(status, CL_SUCCESS, "Failed to copy a segment to the sorter");
+        clReleaseEvent(evt);
+
+        int src;
+        evt = radixSortDevice(s, count, 0, writeEvt, &src);
+        status = clEnqueueCopyBuffer(s->commandQueue, s->data_d[src], ss->keys_d, 0, first * s->keySize, count * s->keySize, 1, &evt, &writeEvt);
+        CHECK_ERROR(status, CL_SUCCESS, "Failed to copy a segment from the sorter");
+        clReleaseEvent(evt);
+        evt = writeEvt;
+    }
+
+    status = clEnqueueReadBuffer(s->commandQueue, ss->keys_d, CL_TRUE, 0, n * s->keySize, keys, 1, &evt, NULL);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to read keys");
+    clReleaseEvent(evt);
+    return 0;
+}
+
+static inline void segmentedSorterRelease(SegmentedSorter* ss) {
+    cl_mem buffers[] = {ss->keys_d, ss->offsets_d, ss->tiles_d};
+    for(int i = 0; i < sizeof(buffers)/sizeof(buffers[0]); i++)
+        if(buffers[i] != NULL) clReleaseMemObject(buffers[i]);
+    clReleaseKernel(ss->tileKernel);
+    free(ss->tiles);
+    free(ss->large);
+    memset(ss, 0, sizeof(*ss));
+}
+
+#endif // SEGMENTEDSORT_H_
@@ -0,0 +1,67 @@
+#ifndef SORTUTIL_H_
+#define SORTUTIL_H_
+
+// Host helpers the drivers of the radix sort engines share: program
+// loading, timing, and random keys of every type
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "radixsort.h"
+
+// Names of the key types, in RadixKeyType order, as given on the
+// command line
+static const char* keyTypeNames[] = {"uint", "int", "float", "ulong", "long", "double"};
+
+static inline void loadProgramSource(const char** files,
+                                     size_t length,
+                                     char** buffer,
+                                     size_t* sizes) {
+    /* Read each source file (*.cl) and store the contents into a temporary datastore */
+    for(size_t i=0; i < length; i++) {
+        FILE* file = fopen(files[i], "r");
+        if(file == NULL) {
+            perror("Couldn't read the program file");
+            exit(1);
+        }
+        fseek(file, 0, SEEK_END);
+        sizes[i] = ftell(file);
+        rewind(file); // reset the file pointer so that 'fread' reads from the front
+        buffer[i] = (char*)malloc(sizes[i]+1);
+        buffer[i][sizes[i]] = '\0';
+        fread(buffer[i], sizeof(char), sizes[i], file);
+        fclose(file);
+    }
+}
+
+// Seconds on a monotonic clock; needs _POSIX_C_SOURCE under -std=c99
+static inline double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static inline cl_ulong rand64(void) {
+    cl_ulong r = 0;
+    for(int i = 0; i < 4; i++)
+        r = (r << 16) ^ (cl_ulong)rand();
+    return r;
+}
+
+// Random bits for integer keys, keys spread around zero for floating
+// point ones
+static inline void fillRandom(void* data, size_t length, RadixKeyType keyType) {
+    for(size_t i = 0 ; i < length; ++i) {
+        double d = ((double)rand() / RAND_MAX - 0.5) * 2e6;
+        switch(keyType) {
+            case RADIX_KEY_FLOAT:  ((cl_float*)data)[i] = (cl_float)d; break;
+            case RADIX_KEY_DOUBLE: ((cl_double*)data)[i] = d; break;
+            case RADIX_KEY_UINT:
+            case RADIX_KEY_INT:    ((cl_uint*)data)[i] = (cl_uint)rand64(); break;
+            default:               ((cl_ulong*)data)[i] = rand64(); break;
+        }
+    }
+}
+
+#endif // SORTUTIL_H_
@@ -0,0 +1,286 @@
+#ifndef TOPK_H_
+#define TOPK_H_
+
+#include "segmentedsort.h"
+
+// Most work-groups a gather launch strides over its candidates with
+#define TOPK_GATHER_GROUPS 1024
+
+// ****************************************************************************
+// Struct: TopKSelector
+//
+// Purpose:
+//   Finds the k largest or smallest keys without sorting the others, by
+//   radix select on the digits of the radix sorter: count the candidates
+//   per digit, take every bucket wholly above the k-th key, and go on
+//   with the bucket holding it, compacted, on the next digit.  The k keys
+//   found are sorted last, by the segment tile kernel or, when more than
+//   a tile, by the radix sorter.
+// ****************************************************************************
+typedef struct {
+    RadixSorter* sorter;
+    cl_kernel countsKernel;
+    cl_kernel gatherKernel;
+    cl_kernel tileKernel;
+    cl_uint tileKeys;
+
+    cl_mem keys_d;
+    cl_mem candidates_d[2];     // the bucket of each round, compacted
+    cl_mem out_d;
+    cl_mem counters_d;
+    cl_mem offsets_d;           // one segment, one tile, of the k keys
+    cl_mem tiles_d;
+    size_t keyCapacity;
+    size_t outCapacity;
+
+    int rounds;                 // digits the last selection counted
+} TopKSelector;
+
+static inline void topKSelectorCreate(TopKSelector* t, RadixSorter* sorter) {
+    cl_int error;
+
+    memset(t, 0, sizeof(*t));
+    t->sorter = sorter;
+    t->tileKeys = segmentedSortTileKeys(sorter);
+    t->countsKernel = clCreateKernel(sorter->program, "selectDigitCounts", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create select digit counts kernel");
+    t->gatherKernel = clCreateKernel(sorter->program, "selectGather", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create select gather kernel");
+    t->tileKernel = clCreateKernel(sorter->program, "sortSegmentTiles", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create segment tiles kernel");
+    t->counters_d = radixSortBuffer(sorter, NULL, 2 * sizeof(cl_uint), "failed to allocate counters_d");
+    t->offsets_d = radixSortBuffer(sorter, NULL, 2 * sizeof(cl_uint), "failed to allocate offsets_d");
+    t->tiles_d = radixSortBuffer(sorter, NULL, 4 * sizeof(cl_uint), "failed to allocate tiles_d");
+}
+
+// Counts the n candidates per digit at shift into the sorter's digit
+// counts; the host waits for them
+static inline cl_event topKCountDigits(TopKSelector* t, cl_mem candidates, cl_uint shift, cl_uint largest, cl_uint n, cl_event evt) {
+    cl_int status;
+    RadixSorter* s = t->sorter;
+
+    cl_event clearEvt;
+    memset(s->digitCounts, 0, s->radix * sizeof(cl_uint));
+    status = clEnqueueWriteBuffer(s->commandQueue, s->digitCounts_d, CL_FALSE, 0, s->radix * sizeof(cl_uint), s->digitCounts, 1, &evt, &clearEvt);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to clear digit counts");
+    clReleaseEvent(evt);
+
+    size_t numOfGroups = radixSortBlocks(s, n) < 64 ? radixSortBlocks(s, n) : 64;
+    size_t globalThreads = numOfGroups * BIN_SIZE;
+    size_t localThreads  = BIN_SIZE;
+    status = clSetKernelArg(t->countsKernel, 0, sizeof(cl_mem), (void*)&candidates);
+    status |= clSetKernelArg(t->countsKernel, 1, sizeof(cl_mem), (void*)&s->digitCounts_d);
+    status |= clSetKernelArg(t->countsKernel, 2, s->radix * sizeof(cl_uint), NULL);
+    status |= clSetKernelArg(t->countsKernel, 3, sizeof(cl_uint), (void*)&shift);
+    status |= clSetKernelArg(t->countsKernel, 4, sizeof(cl_uint), (void*)&largest);
+    status |= clSetKernelArg(t->countsKernel, 5, sizeof(cl_uint), (void*)&n);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to set select digit counts kernel arguments");
+    evt = radixSortEnqueue(s, t->countsKernel, 1, &globalThreads, &localThreads, clearEvt, "Failed to enqueue select digit counts kernel");
+
+    cl_event readEvt;
+    status = clEnqueueReadBuffer(s->commandQueue, s->digitCounts_d, CL_FALSE, 0, s->radix * sizeof(cl_uint), s->digitCounts, 1, &evt, &readEvt);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to read digit counts");
+    clReleaseEvent(evt);
+    clFlush(s->commandQueue);
+    status = clWaitForEvents(1, &readEvt);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to wait for digit counts");
+    return readEvt;
+}
+
+// Selects the candidates above bucket and keeps or takes those in it;
+// see selectGather
+static inline cl_event topKGather(TopKSelector* t, cl_mem candidates, cl_mem next, cl_uint shift, cl_uint largest,
+                                  cl_uint bucket, cl_uint outBase, cl_uint bucketBase, cl_uint compact, cl_uint take,
+                                  cl_uint n, cl_event evt) {
+    cl_int status;
+    RadixSorter* s = t->sorter;
+
+    cl_event clearEvt;
+    static const cl_uint zeros[2] = {0, 0};
+    status = clEnqueueWriteBuffer(s->commandQueue, t->counters_d, CL_FALSE, 0, sizeof(zeros), zeros, 1, &evt, &clearEvt);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to clear counters");
+    clReleaseEvent(evt);
+
+    size_t numOfGroups = radixSortBlocks(s, n) < TOPK_GATHER_GROUPS ? radixSortBlocks(s, n) : TOPK_GATHER_GROUPS;
+    size_t globalThreads = numOfGroups * BIN_SIZE;
+    size_t localThreads  = BIN_SIZE;
+    status = clSetKernelArg(t->gatherKernel, 0, sizeof(cl_mem), (void*)&candidates);
+    status |= clSetKernelArg(t->gatherKernel, 1, sizeof(cl_mem), (void*)&t->out_d);
+    status |= clSetKernelArg(t->gatherKernel, 2, sizeof(cl_mem), (void*)&next);
+    status |= clSetKernelArg(t->gatherKernel, 3, sizeof(cl_mem), (void*)&t->counters_d);
+    status |= clSetKernelArg(t->gatherKernel, 4, sizeof(cl_uint), (void*)&shift);
+    status |= clSetKernelArg(t->gatherKernel, 5, sizeof(cl_uint), (void*)&largest);
+    status |= clSetKernelArg(t->gatherKernel, 6, sizeof(cl_uint), (void*)&bucket);
+    status |= clSetKernelArg(t->gatherKernel, 7, sizeof(cl_uint), (void*)&outBase);
+    status |= clSetKernelArg(t->gatherKernel, 8, sizeof(cl_uint), (void*)&bucketBase);
+    status |= clSetKernelArg(t->gatherKernel, 9, sizeof(cl_uint), (void*)&compact);
+    status |= clSetKernelArg(t->gatherKernel, 10, sizeof(cl_uint), (void*)&take);
+    status |= clSetKernelArg(t->gatherKernel, 11, sizeof(cl_uint), (void*)&n);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to set select gather kernel arguments");
+    return radixSortEnqueue(s, t->gatherKernel, 1, &globalThreads, &localThreads, clearEvt, "Failed to enqueue select gather kernel");
+}
+
+// Sorts the k selected keys in out_d, ascending: in local memory as one
+// tile when they fit, else through the radix sorter
+static inline cl_event topKSortSelected(TopKSelector* t, cl_uint k, cl_event evt) {
+    cl_int status;
+    RadixSorter* s = t->sorter;
+
+    if(k <= t->tileKeys) {
+        cl_uint offsets[2] = {0, k};
+        cl_uint tile[4] = {0, k, 0, 1};
+        cl_event writeEvt[2];
+        status = clEnqueueWriteBuffer(s->commandQueue, t->offsets_d, CL_TRUE, 0, sizeof(offsets), offsets, 1, &evt, &writeEvt[0]);
+        CHECK_ERROR(status, CL_SUCCESS, "Failed to write offsets");
+        status = clEnqueueWriteBuffer(s->commandQueue, t->tiles_d, CL_TRUE, 0, sizeof(tile), tile, 1, &writeEvt[0], &writeEvt[1]);
+        CHECK_ERROR(status, CL_SUCCESS, "Failed to write tile");
+        clReleaseEvent(evt);
+        clReleaseEvent(writeEvt[0]);
+
+        size_t localThreads = BIN_SIZE;
+        size_t globalThreads = BIN_SIZE;
+        status = clSetKernelArg(t->tileKernel, 0, sizeof(cl_mem), (void*)&t->out_d);
+        status |= clSetKernelArg(t->tileKernel, 1, sizeof(cl_mem), (void*)&t->offsets_d);
+        status |= clSetKernelArg(t->tileKernel, 2, sizeof(cl_mem), (void*)&t->tiles_d);
+        status |= clSetKernelArg(t->tileKernel, 3, t->tileKeys * s->keySize, NULL);
+        status |= clSetKernelArg(t->tileKernel, 4, t->tileKeys * sizeof(cl_ushort), NULL);
+        CHECK_ERROR(status, CL_SUCCESS, "Failed to set segment tiles kernel arguments");
+        return radixSortEnqueue(s, t->tileKernel, 1, &globalThreads, &localThreads, writeEvt[1], "Failed to enqueue segment tiles kernel");
+    }
+
+    radixSorterReserve(s, k, 0);
+    cl_event copyEvt;
+    status = clEnqueueCopyBuffer(s->commandQueue, t->out_d, s->data_d[0], 0, 0, k * s->keySize, 1, &evt, &copyEvt);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to copy the selected keys to the sorter");
+    clReleaseEvent(evt);
+    int src;
+    evt = radixSortDevice(s, k, 0, copyEvt, &src);
+    status = clEnqueueCopyBuffer(s->commandQueue, s->data_d[src], t->out_d, 0, 0, k * s->keySize, 1, &evt, &copyEvt);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to copy the selected keys from the sorter");
+    clReleaseEvent(evt);
+    return copyEvt;
+}
+
+// ****************************************************************************
+// Function: topKSelectGPU
+//
+// Purpose:
+//   Finds the k largest keys, or the k smallest, of n.  Each round
+//   counts the candidates' digits, the most significant first, selects
+//   every candidate of a bucket beyond the one holding the k-th key and
+//   compacts that bucket into the next round's candidates, so only the
+//   first round reads all n keys.  A bucket that holds every candidate
+//   needs no compaction, and one that holds just the keys still wanted
+//   ends the selection early.  Ties at the k-th key are broken anyhow.
+//
+// Arguments:
+//   t: selector created by topKSelectorCreate
+//   keys: n keys of the radix sorter's type, left as they are
+//   n: number of keys
+//   k: number of keys wanted; all n if more
+//   largest: 1 for the largest keys, 0 for the smallest
+//   out: room for k keys; the selected keys on return, largest first
+//        or smallest first
+//
+// Returns:  0 on success, -1 if the keys are too many
+// ****************************************************************************
+static inline int topKSelectGPU(TopKSelector* t, const void* keys, size_t n, size_t k, int largest, void* out) {
+    cl_int status;
+    RadixSorter* s = t->sorter;
+
+    if(n > (size_t)0x7FFFFFFF) return -1;
+    if(k > n) k = n;
+    t->rounds = 0;
+    if(k == 0) return 0;
+
+    if(n > t->keyCapacity) {
+        t->keys_d = radixSortBuffer(s, t->keys_d, n * s->keySize, "failed to allocate keys_d");
+        t->candidates_d[0] = radixSortBuffer(s, t->candidates_d[0], n * s->keySize, "failed to allocate candidates_d[0]");
+        t->candidates_d[1] = radixSortBuffer(s, t->candidates_d[1], n * s->keySize, "failed to allocate candidates_d[1]");
+        t->keyCapacity = n;
+    }
+    if(k > t->outCapacity) {
+        t->out_d = radixSortBuffer(s, t->out_d, k * s->keySize, "failed to allocate out_d");
+        t->outCapacity = k;
+    }
+
+    cl_event evt;
+    status = clEnqueueWriteBuffer(s->commandQueue, t->keys_d, CL_FALSE, 0, n * s->keySize, keys, 0, NULL, &evt);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to write keys");
+
+    cl_mem candidates = t->keys_d;
+    cl_uint count = (cl_uint)n;         // candidates left
+    cl_uint selected = 0;               // keys selected so far
+    cl_uint wanted = (cl_uint)k;        // keys still wanted
+    int next = 0;
+    for(int pass = s->passes - 1; pass >= 0 && wanted > 0; pass--) {
+        if(count == wanted) {
+            // Every candidate is wanted
+            cl_event copyEvt;
+            status = clEnqueueCopyBuffer(s->commandQueue, candidates, t->out_d, 0, selected * s->keySize, count * s->keySize, 1, &evt, &copyEvt);
+            CHECK_ERROR(status, CL_SUCCESS, "Failed to copy the candidates");
+            clReleaseEvent(evt);
+            evt = copyEvt;
+            selected += count;
+            wanted = 0;
+            break;
+        }
+
+        cl_uint shift = (cl_uint)(pass * s->bits);
+        evt = topKCountDigits(t, candidates, shift, (cl_uint)largest, count, evt);
+        t->rounds++;
+
+        // The bucket holding the wanted-th key, counting from the top
+        cl_uint above = 0;
+        cl_uint bucket = s->radix - 1;
+        while(above + s->digitCounts[bucket] < wanted)
+            above += s->digitCounts[bucket--];
+        cl_uint inBucket = s->digitCounts[bucket];
+        int last = (pass == 0 || above + inBucket == wanted);
+        if(!last && inBucket == count) continue;
+
+        evt = topKGather(t, candidates, t->candidates_d[next], shift, (cl_uint)largest, bucket,
+                         selected, selected + above, last ? 0 : 1, wanted - above, count, evt);
+        selected += above;
+        wanted -= above;
+        if(last) {
+            selected += wanted;
+            wanted = 0;
+        } else {
+            candidates = t->candidates_d[next];
+            next = 1 - next;
+            count = inBucket;
+        }
+    }
+
+    evt = topKSortSelected(t, selected, evt);
+    clFlush(s->commandQueue);
+    status = clEnqueueReadBuffer(s->commandQueue, t->out_d, CL_TRUE, 0, k * s->keySize, out, 1, &evt, NULL);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to read the selected keys");
+    clReleaseEvent(evt);
+
+    // Sorted ascending; the largest keys come largest first
+    if(largest) {
+        char* o = (char*)out;
+        char tmp[sizeof(cl_ulong)];
+        for(size_t i = 0, j = k - 1; i < j; i++, j--) {
+            memcpy(tmp, o + i * s->keySize, s->keySize);
+            memcpy(o + i * s->keySize, o + j * s->keySize, s->keySize);
+            memcpy(o + j * s->keySize, tmp, s->keySize);
+        }
+    }
+    return 0;
+}
+
+static inline void topKSelectorRelease(TopKSelector* t) {
+    cl_mem buffers[] = {t->keys_d, t->candidates_d[0], t->candidates_d[1], t->out_d,
+                        t->counters_d, t->offsets_d, t->tiles_d};
+    for(int i = 0; i < sizeof(buffers)/sizeof(buffers[0]); i++)
+        if(buffers[i] != NULL) clReleaseMemObject(buffers[i]);
+    clReleaseKernel(t->countsKernel);
+    clReleaseKernel(t->gatherKernel);
+    clReleaseKernel(t->tileKernel);
+    memset(t, 0, sizeof(*t));
+}
+
+#endif // TOPK_H_
@@ -0,0 +1,286 @@
+#ifndef REDUCTION_CPU_H_
+#define REDUCTION_CPU_H_
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <functional>
+#include <limits>
+
+// Independent accumulators per thread.  One running result is a chain of
+// dependent operations the compiler may not reorder, floating point ones
+// least of all; as many as fill a vector register or two, folded at the
+// end, let it vectorize the loop and keep several loads in flight.
+#define REDUCE_CPU_LANES 8
+
+// Values per leaf of the pairwise sum, reduced by the lanes
+#define REDUCE_CPU_PAIRWISE_BLOCK 256
+
+// Fewest values worth a thread of their own
+#define REDUCE_CPU_MIN_PER_THREAD (1 << 16)
+
+// How a thread sums its chunk.  Plain sums in lanes; pairwise sums
+// halves recursively, lanes at the leaves, for an error growing with
+// log n rather than n; Kahan carries each lane's rounding error along,
+// for an error independent of n.  Kahan only holds without -ffast-math.
+typedef enum {
+    REDUCE_CPU_PLAIN,
+    REDUCE_CPU_PAIRWISE,
+    REDUCE_CPU_KAHAN
+} ReduceCpuSummation;
+
+// Threads for n values: numThreads, or one per online processor if 0,
+// but no more than leaves each REDUCE_CPU_MIN_PER_THREAD values
+static int reduceCpuThreads(size_t n, int numThreads) {
+    if(numThreads <= 0) numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    size_t most = n / REDUCE_CPU_MIN_PER_THREAD;
+    if(most < 1) most = 1;
+    if((size_t)numThreads > most) numThreads = (int)most;
+    return numThreads < 1 ? 1 : numThreads;
+}
+
+// Runs work on numThreads tasks of taskSize bytes each, the caller taking
+// the first, and any task whose thread fails to start or finds no room
+// for its handle
+static void reduceCpuRun(void* tasks, size_t taskSize, int numThreads, void* (*work)(void*)) {
+    pthread_t* threads = (pthread_t*) malloc(numThreads * sizeof(pthread_t));
+    char* started = (char*) calloc(numThreads, 1);
+    for(int t = 1; t < numThreads; t++) {
+        void* task = (char*)tasks + t * taskSize;
+        if(threads != NULL && started != NULL && pthread_create(&threads[t], NULL, work, task) == 0)
+            started[t] = 1;
+        else
+            work(task);
+    }
+    work(tasks);
+    for(int t = 1; t < numThreads; t++)
+        if(started != NULL && started[t]) pthread_join(threads[t], NULL);
+    free(started);
+    free(threads);
+}
+
+// op over n values in REDUCE_CPU_LANES accumulators of type A, folded
+// pairwise at the end.  op takes and returns an A; values convert to A.
+template <typename A, typename T, typename Op>
+static A reduceLanes(const T* a, size_t n, A identity, Op op) {
+    A acc[REDUCE_CPU_LANES];
+    for(int l = 0; l < REDUCE_CPU_LANES; l++)
+        acc[l] = identity;
+    size_t i = 0;
+    for(; i + REDUCE_CPU_LANES <= n; i += REDUCE_CPU_LANES)
+        for(int l = 0; l < REDUCE_CPU_LANES; l++)
+            acc[l] = op(acc[l], (A)a[i + l]);
+    for(; i < n; i++)
+        acc[0] = op(acc[0], (A)a[i]);
+    for(int width = REDUCE_CPU_LANES / 2; width > 0; width >>= 1)
+        for(int l = 0; l < width; l++)
+            acc[l] = op(acc[l], acc[l + width]);
+    return acc[0];
+}
+
+template <typename A, typename T, typename Op>
+static A reducePairwise(const T* a, size_t n, A identity, Op op) {
+    if(n <= REDUCE_CPU_PAIRWISE_BLOCK) return reduceLanes(a, n, identity, op);
+    size_t half = n / 2;
+    return op(reducePairwise(a, half, identity, op), reducePairwise(a + half, n - half, identity, op));
+}
+
+// Adds value to sum, carrying the rounding error in compensation
+template <typename A>
+static void reduceKahanAdd(A& sum, A& compensation, A value) {
+    A y = value - compensation;
+    A t = sum + y;
+    compensation = (t - sum) - y;
+    sum = t;
+}
+
+template <typename A, typename T>
+static A reduceKahan(const T* a, size_t n) {
+    A sum[REDUCE_CPU_LANES], compensation[REDUCE_CPU_LANES];
+    for(int l = 0; l < REDUCE_CPU_LANES; l++)
+        sum[l] = compensation[l] = 0;
+    size_t i = 0;
+    for(; i + REDUCE_CPU_LANES <= n; i += REDUCE_CPU_LANES)
+        for(int l = 0; l < REDUCE_CPU_LANES; l++)
+            reduceKahanAdd(sum[l], compensation[l], (A)a[i + l]);
+    for(; i < n; i++)
+        reduceKahanAdd(sum[0], compensation[0], (A)a[i]);
+
+    A total = 0, totalCompensation = 0;
+    for(int l = 0; l < REDUCE_CPU_LANES; l++) {
+        reduceKahanAdd(total, totalCompensation, sum[l]);
+        reduceKahanAdd(total, totalCompensation, -compensation[l]);
+    }
+    return total - totalCompensation;
+}
+
+// One thread's chunk and its result
+template <typename A, typename T, typename Op>
+struct ReduceCpuTask {
+    const T* a;
+    size_t n;
+    A identity;
+    const Op* op;               // shared; closures can't be assigned
+    ReduceCpuSummation summation;
+    A result;
+};
+
+template <typename A, typename T, typename Op>
+static void* reduceCpuWorker(void* arg) {
+    ReduceCpuTask<A, T, Op>* task = (ReduceCpuTask<A, T, Op>*) arg;
+    switch(task->summation) {
+        case REDUCE_CPU_PAIRWISE: task->result = reducePairwise(task->a, task->n, task->identity, *task->op); break;
+        case REDUCE_CPU_KAHAN:    task->result = reduceKahan<A>(task->a, task->n); break;
+        default:                  task->result = reduceLanes(task->a, task->n, task->identity, *task->op); break;
+    }
+    return NULL;
+}
+
+template <typename A, typename T, typename Op>
+static A reduceCpuSplit(const T* a, size_t n, A identity, Op op, int numThreads, ReduceCpuSummation summation) {
+    numThreads = reduceCpuThreads(n, numThreads);
+    ReduceCpuTask<A, T, Op>* tasks = new ReduceCpuTask<A, T, Op>[numThreads];
+    for(int t = 0; t < numThreads; t++) {
+        size_t first = n * t / numThreads;
+        size_t last = n * (t + 1) / numThreads;
+        tasks[t].a = a + first;
+        tasks[t].n = last - first;
+        tasks[t].identity = identity;
+        tasks[t].op = &op;
+        tasks[t].summation = summation;
+    }
+    reduceCpuRun(tasks, sizeof(tasks[0]), numThreads, reduceCpuWorker<A, T, Op>);
+
+    // The partials in chunk order, so the result does not depend on
+    // which thread finished first
+    A result = identity, compensation = 0;
+    for(int t = 0; t < numThreads; t++) {
+        if(summation == REDUCE_CPU_KAHAN) reduceKahanAdd(result, compensation, tasks[t].result);
+        else result = op(result, tasks[t].result);
+    }
+    delete[] tasks;
+    return summation == REDUCE_CPU_KAHAN ? result - compensation : result;
+}
+
+// ****************************************************************************
+// Function: reduceCPU
+//
+// Purpose:
+//   Reduces n values with any associative op, a functor or lambda the
+//   compiler inlines: every thread folds a contiguous chunk in
+//   REDUCE_CPU_LANES accumulators, then the per-thread partials are
+//   folded in order.
+//
+// Arguments:
+//   a: n values
+//   n: number of values
+//   identity: identity of op, the result if n is 0
+//   op: A op(A, A)
+//   numThreads: number of threads, 0 for one per online processor
+//
+// Returns:  the reduction, of type A; values convert to A first, so
+//           e.g. ints may be summed in a long
+// ****************************************************************************
+template <typename A, typename T, typename Op>
+static A reduceCPU(const T* a, size_t n, A identity, Op op, int numThreads) {
+    return reduceCpuSplit(a, n, identity, op, numThreads, REDUCE_CPU_PLAIN);
+}
+
+// ****************************************************************************
+// Function: reduceSumCPU
+//
+// Purpose:
+//   Sums n values in an A like reduceCPU, by the given summation.  The
+//   summation only matters for floating point A.
+// ****************************************************************************
+template <typename A, typename T>
+static A reduceSumCPU(const T* a, size_t n, int numThreads, ReduceCpuSummation summation) {
+    return reduceCpuSplit(a, n, (A)0, std::plus<A>(), numThreads, summation);
+}
+
+// Whether a at index beats best at bestIndex for argmin: smaller, or
+// equal and earlier.  NaNs never win.
+template <typename T>
+static bool reduceArgMinBeats(T a, size_t index, T best, size_t bestIndex) {
+    return a < best || (a == best && index < bestIndex);
+}
+
+// Index of the first minimum of n values, first + n if all are NaN.
+// The lanes each keep their own minimum, in order of index.
+template <typename T>
+static size_t reduceArgMinLanes(const T* a, size_t first, size_t n) {
+    const T highest = std::numeric_limits<T>::has_infinity
+                    ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+    T best[REDUCE_CPU_LANES];
+    size_t index[REDUCE_CPU_LANES];
+    for(int l = 0; l < REDUCE_CPU_LANES; l++) {
+        best[l] = highest;
+        index[l] = first + n;
+    }
+    size_t i = 0;
+    for(; i + REDUCE_CPU_LANES <= n; i += REDUCE_CPU_LANES)
+        for(int l = 0; l < REDUCE_CPU_LANES; l++)
+            if(reduceArgMinBeats(a[i + l], first + i + l, best[l], index[l])) {
+                best[l] = a[i + l];
+                index[l] = first + i + l;
+            }
+    for(; i < n; i++)
+        if(reduceArgMinBeats(a[i], first + i, best[0], index[0])) {
+            best[0] = a[i];
+            index[0] = first + i;
+        }
+    for(int l = 1; l < REDUCE_CPU_LANES; l++)
+        if(reduceArgMinBeats(best[l], index[l], best[0], index[0])) {
+            best[0] = best[l];
+            index[0] = index[l];
+        }
+    return index[0];
+}
+
+template <typename T>
+struct ReduceArgMinTask {
+    const T* a;
+    size_t first;
+    size_t n;
+    size_t result;
+};
+
+template <typename T>
+static void* reduceArgMinWorker(void* arg) {
+    ReduceArgMinTask<T>* task = (ReduceArgMinTask<T>*) arg;
+    task->result = reduceArgMinLanes(task->a + task->first, task->first, task->n);
+    return NULL;
+}
+
+// ****************************************************************************
+// Function: reduceArgMinCPU
+//
+// Purpose:
+//   Finds the first minimum of n values like reduceCPU; NaNs are passed
+//   over, as by the OpenCL reduction.
+//
+// Returns:  its index, n if there are no values or all are NaN
+// ****************************************************************************
+template <typename T>
+static size_t reduceArgMinCPU(const T* a, size_t n, int numThreads) {
+    numThreads = reduceCpuThreads(n, numThreads);
+    ReduceArgMinTask<T>* tasks = new ReduceArgMinTask<T>[numThreads];
+    for(int t = 0; t < numThreads; t++) {
+        tasks[t].a = a;
+        tasks[t].first = n * t / numThreads;
+        tasks[t].n = n * (t + 1) / numThreads - tasks[t].first;
+    }
+    reduceCpuRun(tasks, sizeof(tasks[0]), numThreads, reduceArgMinWorker<T>);
+
+    // Chunks in order: a later one only wins with a smaller value
+    size_t best = n;
+    for(int t = 0; t < numThreads; t++) {
+        size_t i = tasks[t].result;
+        if(i < tasks[t].first + tasks[t].n && (best == n || a[i] < a[best])) best = i;
+    }
+    delete[] tasks;
+    return best;
+}
+
+#endif // REDUCTION_CPU_H_
@@ -0,0 +1,140 @@
+/* Element type and operation, set by the host: VALUE_TYPE 0 uint, 1 int,
+   2 float, 3 double; REDUCE_OP 0 sum, 1 min, 2 max, 3 argmin */
+#ifndef VALUE_TYPE
+#define VALUE_TYPE 0
+#endif
+#ifndef REDUCE_OP
+#define REDUCE_OP 0
+#endif
+
+#if VALUE_TYPE == 3
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+/* Integer sums are kept in 64 bits so they do not wrap */
+#if VALUE_TYPE == 0
+#define VALUE_T uint
+#define VALUE_LOWEST 0
+#define VALUE_HIGHEST UINT_MAX
+#define SUM_T ulong
+#elif VALUE_TYPE == 1
+#define VALUE_T int
+#define VALUE_LOWEST INT_MIN
+#define VALUE_HIGHEST INT_MAX
+#define SUM_T long
+#elif VALUE_TYPE == 2
+#define VALUE_T float
+#define VALUE_LOWEST (-INFINITY)
+#define VALUE_HIGHEST INFINITY
+#define SUM_T float
+#else
+#define VALUE_T double
+#define VALUE_LOWEST (-(double)INFINITY)
+#define VALUE_HIGHEST ((double)INFINITY)
+#define SUM_T double
+#endif
+
+#define ARGMIN (REDUCE_OP == 3)
+#if REDUCE_OP == 0
+#define ACC_T SUM_T
+#define IDENTITY ((ACC_T)0)
+#elif REDUCE_OP == 2
+#define ACC_T VALUE_T
+#define IDENTITY VALUE_LOWEST
+#else
+#define ACC_T VALUE_T
+#define IDENTITY VALUE_HIGHEST
+#endif
+
+/* Folds value, found at index, into the running result.  Min and max
+   pass over NaNs; argmin keeps the lowest index of equal values, so the
+   result does not depend on the order values are folded in. */
+void accumulate(ACC_T* acc, uint* accIndex, ACC_T value, uint index) {
+#if REDUCE_OP == 0
+    *acc += value;
+#elif REDUCE_OP == 1
+    if(value < *acc) *acc = value;
+#elif REDUCE_OP == 2
+    if(value > *acc) *acc = value;
+#else
+    if(value < *acc || (value == *acc && index < *accIndex)) {
+        *acc = value;
+        *accIndex = index;
+    }
+#endif
+}
+
+/* Reduces the values of a work-group, one per work-item, by a tree in
+   local memory with a barrier at every level, and writes the group's
+   result to partials.  The group size must be a power of two. */
+void groupReduce(ACC_T acc,
+                 uint accIndex,
+                 __local ACC_T* sdata,
+                 __local uint* sindex,
+                 __global ACC_T* partials,
+                 __global uint* partialIndex) {
+    uint tid = get_local_id(0);
+
+    sdata[tid] = acc;
+#if ARGMIN
+    sindex[tid] = accIndex;
+#endif
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for(uint s = get_local_size(0) / 2; s > 0; s >>= 1) {
+        if(tid < s) {
+#if ARGMIN
+            accumulate(&acc, &accIndex, sdata[tid + s], sindex[tid + s]);
+            sindex[tid] = accIndex;
+#else
+            accumulate(&acc, &accIndex, sdata[tid + s], 0);
+#endif
+            sdata[tid] = acc;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if(tid == 0) {
+        partials[get_group_id(0)] = acc;
+#if ARGMIN
+        partialIndex[get_group_id(0)] = accIndex;
+#endif
+    }
+}
+
+/* First pass: every work-item strides over the n values by the size of
+   the grid, however many there are, and the grid leaves one partial
+   result per work-group */
+__kernel void reduceValues(__global const VALUE_T* input,
+                           uint n,
+                           __global ACC_T* partials,
+                           __global uint* partialIndex,
+                           __local ACC_T* sdata,
+                           __local uint* sindex) {
+
+    ACC_T acc = IDENTITY;
+    uint accIndex = UINT_MAX;
+    for(size_t k = get_global_id(0); k < n; k += get_global_size(0))
+        accumulate(&acc, &accIndex, (ACC_T)input[k], (uint)k);
+    groupReduce(acc, accIndex, sdata, sindex, partials, partialIndex);
+}
+
+/* Later passes: the same over the partial results of the pass before,
+   with their indices for argmin */
+__kernel void reducePartials(__global const ACC_T* input,
+                             __global const uint* inputIndex,
+                             uint n,
+                             __global ACC_T* partials,
+                             __global uint* partialIndex,
+                             __local ACC_T* sdata,
+                             __local uint* sindex) {
+
+    ACC_T acc = IDENTITY;
+    uint accIndex = UINT_MAX;
+    for(size_t k = get_global_id(0); k < n; k += get_global_size(0))
+#if ARGMIN
+        accumulate(&acc, &accIndex, input[k], inputIndex[k]);
+#else
+        accumulate(&acc, &accIndex, input[k], 0);
+#endif
+    groupReduce(acc, accIndex, sdata, sindex, partials, partialIndex);
+}
@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <alloca.h>
+#include <math.h>
+#include <time.h>
+
+#include "reduction_engine.h"
+#include "reduction_cpu.h"
+
+#define DATA_SIZE 4194305       // any length, not just multiples of a block
+#define RUNS 10                 // reductions the bandwidth is averaged over
+
+void loadProgramSource(const char** files,
+                       size_t length,
+                       char** buffer,
+                       size_t* sizes) {
+    /* Read each source file (*.cl) and store the contents into a temporary datastore */
+    for(size_t i=0; i < length; i++) {
+        FILE* file = fopen(files[i], "r");
+        if(file == NULL) {
+            perror("Couldn't read the program file");
+            exit(1);
+        }
+        fseek(file, 0, SEEK_END);
+        sizes[i] = ftell(file);
+        rewind(file); // reset the file pointer so that 'fread' reads from the front
+        buffer[i] = (char*)malloc(sizes[i]+1);
+        buffer[i][sizes[i]] = '\0';
+        fread(buffer[i], sizeof(char), sizes[i], file);
+        fclose(file);
+    }
+}
+
+static const char* typeNames[] = {"uint", "int", "float", "double"};
+static const char* opNames[] = {"sum", "min", "max", "argmin"};
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Random values with the lowest one planted twice, so argmin has a tie
+// to break
+static void fillRandom(void* values, size_t n, ReduceType type) {
+    for(size_t i = 0; i < n; i++) {
+        cl_uint bits = ((cl_uint)rand() << 16) ^ (cl_uint)rand();
+        double d = ((double)rand() / RAND_MAX - 0.5) * 2e3;
+        switch(type) {
+            case REDUCE_UINT:  ((cl_uint*)values)[i] = bits | 1; break;
+            case REDUCE_INT:   ((cl_int*)values)[i] = (cl_int)(bits | 1); break;
+            case REDUCE_FLOAT: ((cl_float*)values)[i] = (cl_float)d; break;
+            default:           ((cl_double*)values)[i] = d; break;
+        }
+    }
+    for(size_t i = n / 3; i < n; i += n / 3 + 1) {
+        switch(type) {
+            case REDUCE_UINT:  ((cl_uint*)values)[i] = 0; break;
+            case REDUCE_INT:   ((cl_int*)values)[i] = -0x7FFFFFFF - 1; break;
+            case REDUCE_FLOAT: ((cl_float*)values)[i] = -1e4f; break;
+            default:           ((cl_double*)values)[i] = -1e4; break;
+        }
+    }
+}
+
+// The host library's answer, and whether the device's matches it:
+// integers exactly, floating point sums to within their rounding
+template <typename T, typename S>
+static bool checkTyped(const T* values, size_t n, ReduceOp op, const void* result, cl_uint index, double eps) {
+    if(op == REDUCE_SUM) {
+        S got = *(const S*)result;
+        if(std::numeric_limits<S>::is_integer) return reduceSumCPU<S>(values, n, 0, REDUCE_CPU_PLAIN) == got;
+        double exact = reduceSumCPU<double>(values, n, 0, REDUCE_CPU_KAHAN);
+        // Partials are never negative, so folding them the same way is
+        // still their sum
+        double magnitude = reduceCPU(values, n, 0.0, [](double x, double y) { return x + fabs(y); }, 0);
+        return fabs(got - exact) <= eps * magnitude * log2((double)n + 2);
+    }
+
+    size_t best = reduceArgMinCPU(values, n, 0);
+    if(op == REDUCE_MAX)
+        return reduceCPU(values, n, values[0], [](T x, T y) { return y > x ? y : x; }, 0) == *(const T*)result;
+    return values[best] == *(const T*)result && (op != REDUCE_ARGMIN || index == best);
+}
+
+static bool checkResult(const void* values, size_t n, ReduceType type, ReduceOp op,
+                        const void* result, cl_uint index) {
+    switch(type) {
+        case REDUCE_UINT:  return checkTyped<cl_uint, cl_ulong>((const cl_uint*)values, n, op, result, index, 0);
+        case REDUCE_INT:   return checkTyped<cl_int, cl_long>((const cl_int*)values, n, op, result, index, 0);
+        case REDUCE_FLOAT: return checkTyped<cl_float, cl_float>((const cl_float*)values, n, op, result, index, 1e-6);
+        default:           return checkTyped<cl_double, cl_double>((const cl_double*)values, n, op, result, index, 1e-15);
+    }
+}
+
+static void printResult(const void* result, ReduceType type, ReduceOp op) {
+    if(op == REDUCE_SUM && type == REDUCE_UINT) printf("%llu", (unsigned long long)*(const cl_ulong*)result);
+    else if(op == REDUCE_SUM && type == REDUCE_INT) printf("%lld", (long long)*(const cl_long*)result);
+    else if(type == REDUCE_UINT) printf("%u", *(const cl_uint*)result);
+    else if(type == REDUCE_INT) printf("%d", *(const cl_int*)result);
+    else if(type == REDUCE_FLOAT) printf("%g", *(const cl_float*)result);
+    else printf("%.17g", *(const cl_double*)result);
+}
+
+int main(int argc, char** argv) {
+    /* OpenCL 1.1 data structures */
+    cl_platform_id* platforms;
+    cl_device_id device;
+    cl_uint numOfPlatforms;
+    cl_int  error;
+
+    // [n] [type] [peakGBs]: every operation over n random values.  The
+    // device's rated bandwidth, which OpenCL does not report, may be
+    // given; the reduction is always held against a device copy.
+    size_t dataSize = DATA_SIZE;
+    ReduceType type = REDUCE_UINT;
+    double peakGBs = 0;
+    if(argc > 1) dataSize = strtoul(argv[1], NULL, 10);
+    if(argc > 2) {
+        for(int t = 0; t <= REDUCE_DOUBLE; t++)
+            if(strcmp(argv[2], typeNames[t]) == 0) type = (ReduceType)t;
+    }
+    if(argc > 3) peakGBs = atof(argv[3]);
+    if(dataSize == 0) dataSize = 1;
+    size_t valueSize = REDUCE_VALUE_SIZE(type);
+
+    //Get the number of platforms
+    //Remember that for each vendor's SDK installed on the computer,
+    //the number of available platform also increased.
+    error = clGetPlatformIDs(0, NULL, &numOfPlatforms);
+    if(error != CL_SUCCESS) {
+        perror("Unable to find any OpenCL platforms");
+        exit(1);
+    }
+
+    platforms = (cl_platform_id*) alloca(sizeof(cl_platform_id) * numOfPlatforms);
+    printf("Number of OpenCL platforms found: %d\n", numOfPlatforms);
+
+    error = clGetPlatformIDs(numOfPlatforms, platforms, NULL);
+    if(error != CL_SUCCESS) {
+        perror("Unable to find any OpenCL platforms");
+        exit(1);
+    }
+    for(cl_uint i = 0; i < numOfPlatforms; i++ ) {
+        // Get the GPU device
+        error = clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_GPU, 1, &device, NULL);
+
+        if(error != CL_SUCCESS) {
+            perror("Can't locate a OpenCL compliant device i.e. GPU");
+            exit(1);
+        }
+        // Create a context
+        cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &error);
+        if(error != CL_SUCCESS) {
+            perror("Can't create a valid OpenCL context");
+            exit(1);
+        }
+
+        const char *file_names[] = {"reduction_engine.cl"};
+        const int NUMBER_OF_FILES = 1;
+        char* buffer[NUMBER_OF_FILES];
+        size_t sizes[NUMBER_OF_FILES];
+        loadProgramSource(file_names, NUMBER_OF_FILES, buffer, sizes);
+
+        cl_command_queue commandQueue = clCreateCommandQueue(context, device, 0, &error);
+        CHECK_ERROR(error, CL_SUCCESS, "failed to create command queue");
+
+        void* values = malloc(dataSize * valueSize);
+        fillRandom(values, dataSize, type);
+        size_t bytes = dataSize * valueSize;
+
+        // A device copy reads and writes every byte once: the bandwidth a
+        // reduction, which only reads, can hope to reach
+        cl_mem copy_d = clCreateBuffer(context, CL_MEM_READ_WRITE, 2 * bytes, NULL, &error);
+        CHECK_ERROR(error, CL_SUCCESS, "failed to allocate copy_d");
+        error = clEnqueueWriteBuffer(commandQueue, copy_d, CL_TRUE, 0, bytes, values, 0, NULL, NULL);
+        CHECK_ERROR(error, CL_SUCCESS, "Failed to write values");
+        double start = now();
+        for(int run = 0; run < RUNS; run++) {
+            error = clEnqueueCopyBuffer(commandQueue, copy_d, copy_d, 0, bytes, bytes, 0, NULL, NULL);
+            CHECK_ERROR(error, CL_SUCCESS, "Failed to copy values");
+        }
+        clFinish(commandQueue);
+        double copyGBs = 2.0 * bytes * RUNS / (now() - start) * 1e-9;
+        clReleaseMemObject(copy_d);
+        printf("elementCount: %zu %s values, device copy: %.2f GB/s", dataSize, typeNames[type], copyGBs);
+        if(peakGBs > 0) printf(", rated peak: %.2f GB/s", peakGBs);
+        printf("\n");
+
+        for(int op = REDUCE_SUM; op <= REDUCE_ARGMIN; op++) {
+            Reducer reducer;
+            reducerCreate(&reducer, context, device, commandQueue, buffer[0], sizes[0], type, (ReduceOp)op);
+
+            cl_ulong result = 0;
+            cl_uint index = 0;
+            error = reduceGPU(&reducer, values, dataSize, &result, &index);
+            CHECK_ERROR(error, 0, "reduction failed");
+            bool passed = checkResult(values, dataSize, type, (ReduceOp)op, &result, index);
+
+            // The values stay on the device; time the passes alone
+            start = now();
+            for(int run = 0; run < RUNS; run++) {
+                int src;
+                cl_event evt = reduceDevice(&reducer, reducer.input_d, (cl_uint)dataSize, NULL, &src);
+                clReleaseEvent(evt);
+            }
+            clFinish(commandQueue);
+            double seconds = (now() - start) / RUNS;
+            double gbs = bytes / seconds * 1e-9;
+
+            printf("%-6s = ", opNames[op]);
+            printResult(&result, type, (ReduceOp)op);
+            if(op == REDUCE_ARGMIN) printf(" at %u", index);
+            printf(": %.3f ms, %d passes of %zu x %zu work-items, %.2f GB/s (%.0f%% of copy",
+                   seconds * 1e3, reducer.passesRun, reduceGroups(&reducer, dataSize), reducer.groupSize,
+                   gbs, 100 * gbs / copyGBs);
+            if(peakGBs > 0) printf(", %.0f%% of peak", 100 * gbs / peakGBs);
+            printf(")\n");
+            if (passed) printf("Passed!\n"); else printf("Failed!\n");
+
+            reducerRelease(&reducer);
+        }
+
+        for(int j=0; j< NUMBER_OF_FILES; j++) { free(buffer[j]); }
+        free(values);
+
+        clReleaseCommandQueue(commandQueue);
+        clReleaseContext(context);
+    }
+    return 0;
+}
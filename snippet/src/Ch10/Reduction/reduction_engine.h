@@ -0,0 +1,287 @@
+#ifndef REDUCTION_ENGINE_H_
+#define REDUCTION_ENGINE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+#ifdef  __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Largest work-group the reduction kernels run in; the tree in local
+// memory takes a power of two
+#define REDUCE_MAX_GROUP 256
+
+// Work-groups per compute unit of the persistent grid.  Every pass runs
+// at most this many however long the input, and strides over it.
+#define REDUCE_GROUPS_PER_UNIT 4
+
+// Fewest values per work-item before a pass spreads over more groups;
+// short inputs and the passes over partial results take fewer groups
+#define REDUCE_MIN_PER_ITEM 8
+
+// Element types and operations, numbered as VALUE_TYPE and REDUCE_OP
+// in reduction_engine.cl
+typedef enum {
+    REDUCE_UINT,
+    REDUCE_INT,
+    REDUCE_FLOAT,
+    REDUCE_DOUBLE
+} ReduceType;
+
+typedef enum {
+    REDUCE_SUM,
+    REDUCE_MIN,
+    REDUCE_MAX,
+    REDUCE_ARGMIN
+} ReduceOp;
+
+#define REDUCE_VALUE_SIZE(type) ((type) == REDUCE_DOUBLE ? sizeof(cl_double) : sizeof(cl_uint))
+
+// Sums of uint and int come back as ulong and long, every other result
+// in the element type
+#define REDUCE_RESULT_SIZE(type, op) \
+    ((op) == REDUCE_SUM && (type) != REDUCE_FLOAT ? sizeof(cl_ulong) : REDUCE_VALUE_SIZE(type))
+
+// Device state of one reduction: reduction_engine.cl built for an
+// element type and operation, and the buffers of its passes.  Like the
+// radix sorter's, the buffers only ever grow.
+typedef struct {
+    cl_context context;
+    cl_device_id device;
+    cl_command_queue commandQueue;
+    cl_program program;
+
+    ReduceType type;
+    ReduceOp op;
+    size_t valueSize;           // bytes per element
+    size_t resultSize;          // bytes per partial result
+    size_t groupSize;           // work-items per group, a power of two
+    size_t maxGroups;           // groups of the persistent grid
+
+    cl_kernel valuesKernel;
+    cl_kernel partialsKernel;
+
+    cl_mem input_d;
+    cl_mem partials_d[2];       // each pass reads one and writes the other
+    cl_mem index_d[2];          // argmin indices of the partial results
+    size_t inputCapacity;       // elements input_d holds
+
+    int passesRun;              // passes the last reduction took
+} Reducer;
+
+// Enqueues one pass.  Like the radix sorter's steps, every pass waits on
+// the event of the one before it, which it releases, and returns its own.
+static cl_event reduceEnqueue(Reducer* r, cl_kernel kernel, size_t groups, cl_event waitEvt, const char* msg) {
+    cl_event execEvt;
+    size_t globalThreads = groups * r->groupSize;
+    size_t localThreads = r->groupSize;
+    cl_int status = clEnqueueNDRangeKernel(r->commandQueue, kernel, 1, NULL, &globalThreads, &localThreads,
+                                           waitEvt != NULL ? 1 : 0, waitEvt != NULL ? &waitEvt : NULL, &execEvt);
+    CHECK_ERROR(status, CL_SUCCESS, msg);
+    if(waitEvt != NULL) clReleaseEvent(waitEvt);
+    return execEvt;
+}
+
+// Groups a pass over n values takes: enough for REDUCE_MIN_PER_ITEM
+// values per work-item, at most the persistent grid
+static size_t reduceGroups(Reducer* r, size_t n) {
+    size_t perGroup = r->groupSize * REDUCE_MIN_PER_ITEM;
+    size_t groups = (n + perGroup - 1) / perGroup;
+    if(groups > r->maxGroups) groups = r->maxGroups;
+    return groups > 0 ? groups : 1;
+}
+
+// Builds reduction_engine.cl for an element type and operation, and
+// sizes the work-groups and the persistent grid from the device
+static void reducerCreate(Reducer* r,
+                          cl_context context,
+                          cl_device_id device,
+                          cl_command_queue commandQueue,
+                          const char* source,
+                          size_t sourceSize,
+                          ReduceType type,
+                          ReduceOp op) {
+    cl_int error;
+
+    memset(r, 0, sizeof(*r));
+    r->context = context;
+    r->device = device;
+    r->commandQueue = commandQueue;
+    r->type = type;
+    r->op = op;
+    r->valueSize = REDUCE_VALUE_SIZE(type);
+    r->resultSize = REDUCE_RESULT_SIZE(type, op);
+
+    // Create the OpenCL program object
+    r->program = clCreateProgramWithSource(context, 1, &source, &sourceSize, &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Can't create the OpenCL program object");
+
+    // Build OpenCL program object and dump the error message, if any
+    char options[48];
+    sprintf(options, "-DVALUE_TYPE=%d -DREDUCE_OP=%d", (int)type, (int)op);
+    error = clBuildProgram(r->program, 1, &device, options, NULL, NULL);
+    if(error != CL_SUCCESS) {
+        // If there's an error whilst building the program, dump the log
+        size_t log_size;
+        clGetProgramBuildInfo(r->program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+        char *program_log = (char*) malloc(log_size+1);
+        program_log[log_size] = '\0';
+        clGetProgramBuildInfo(r->program, device, CL_PROGRAM_BUILD_LOG,
+                              log_size+1, program_log, NULL);
+        printf("\n=== ERROR ===\n\n%s\n=============\n", program_log);
+        free(program_log);
+        exit(1);
+    }
+
+    r->valuesKernel = clCreateKernel(r->program, "reduceValues", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create reduce values kernel");
+    r->partialsKernel = clCreateKernel(r->program, "reducePartials", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create reduce partials kernel");
+
+    // The largest power of two both kernels and the device allow
+    size_t deviceGroup = 0, valuesGroup = 0, partialsGroup = 0;
+    clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &deviceGroup, NULL);
+    clGetKernelWorkGroupInfo(r->valuesKernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &valuesGroup, NULL);
+    clGetKernelWorkGroupInfo(r->partialsKernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &partialsGroup, NULL);
+    r->groupSize = REDUCE_MAX_GROUP;
+    while(r->groupSize > 1 && (r->groupSize > deviceGroup || r->groupSize > valuesGroup || r->groupSize > partialsGroup))
+        r->groupSize >>= 1;
+
+    cl_uint computeUnits = 1;
+    clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL);
+    r->maxGroups = (computeUnits > 0 ? computeUnits : 1) * REDUCE_GROUPS_PER_UNIT;
+
+    for(int i = 0; i < 2; i++) {
+        r->partials_d[i] = clCreateBuffer(context, CL_MEM_READ_WRITE, r->maxGroups * r->resultSize, NULL, &error);
+        CHECK_ERROR(error, CL_SUCCESS, "failed to allocate partials_d");
+        r->index_d[i] = clCreateBuffer(context, CL_MEM_READ_WRITE, r->maxGroups * sizeof(cl_uint), NULL, &error);
+        CHECK_ERROR(error, CL_SUCCESS, "failed to allocate index_d");
+    }
+}
+
+// Grows input_d to hold n elements
+static void reducerReserve(Reducer* r, size_t n) {
+    cl_int error;
+
+    if(n <= r->inputCapacity) return;
+    if(r->input_d != NULL) clReleaseMemObject(r->input_d);
+    r->input_d = clCreateBuffer(r->context, CL_MEM_READ_ONLY, n * r->valueSize, NULL, &error);
+    CHECK_ERROR(error, CL_SUCCESS, "failed to allocate input_d");
+    r->inputCapacity = n;
+}
+
+// Sets the arguments one pass shares with every other: what it writes
+// and its local memory
+static void reduceSetOutput(Reducer* r, cl_kernel kernel, cl_uint first, int dst) {
+    cl_int status;
+    status = clSetKernelArg(kernel, first, sizeof(cl_mem), (void*)&r->partials_d[dst]);
+    status |= clSetKernelArg(kernel, first + 1, sizeof(cl_mem), (void*)&r->index_d[dst]);
+    status |= clSetKernelArg(kernel, first + 2, r->groupSize * r->resultSize, NULL);
+    status |= clSetKernelArg(kernel, first + 3, (r->op == REDUCE_ARGMIN ? r->groupSize : 1) * sizeof(cl_uint), NULL);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to set reduction kernel arguments");
+}
+
+// ****************************************************************************
+// Function: reduceDevice
+//
+// Purpose:
+//   Reduces n elements already on the device.  The first pass folds
+//   them into one partial result per group of the persistent grid; each
+//   further pass folds those, on the device, until one is left.  Only
+//   the first pass reads the input, so the reduction runs at the speed
+//   the device reads memory whatever n is.
+//
+// Arguments:
+//   r: reducer created by reducerCreate
+//   input: n elements of the reducer's type
+//   n: number of elements, at least 1
+//   evt: event the first pass waits on, released; may be NULL
+//   result: set to the index of the partials_d (and index_d) buffer
+//           whose first element is the result
+//
+// Returns:  the event of the last pass
+// ****************************************************************************
+static cl_event reduceDevice(Reducer* r, cl_mem input, cl_uint n, cl_event evt, int* result) {
+    cl_int status;
+
+    size_t groups = reduceGroups(r, n);
+    status = clSetKernelArg(r->valuesKernel, 0, sizeof(cl_mem), (void*)&input);
+    status |= clSetKernelArg(r->valuesKernel, 1, sizeof(cl_uint), (void*)&n);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to set reduction kernel arguments");
+    reduceSetOutput(r, r->valuesKernel, 2, 0);
+    evt = reduceEnqueue(r, r->valuesKernel, groups, evt, "Failed to enqueue reduce values kernel");
+    r->passesRun = 1;
+
+    int src = 0;
+    while(groups > 1) {
+        cl_uint count = (cl_uint)groups;
+        groups = reduceGroups(r, count);
+        status = clSetKernelArg(r->partialsKernel, 0, sizeof(cl_mem), (void*)&r->partials_d[src]);
+        status |= clSetKernelArg(r->partialsKernel, 1, sizeof(cl_mem), (void*)&r->index_d[src]);
+        status |= clSetKernelArg(r->partialsKernel, 2, sizeof(cl_uint), (void*)&count);
+        CHECK_ERROR(status, CL_SUCCESS, "Failed to set reduction kernel arguments");
+        reduceSetOutput(r, r->partialsKernel, 3, 1 - src);
+        evt = reduceEnqueue(r, r->partialsKernel, groups, evt, "Failed to enqueue reduce partials kernel");
+        src = 1 - src;
+        r->passesRun++;
+    }
+    *result = src;
+    return evt;
+}
+
+// ****************************************************************************
+// Function: reduceGPU
+//
+// Purpose:
+//   Reduces n elements of host memory: their sum, min, max, or min and
+//   the lowest index holding it.  NaNs are summed but passed over by the
+//   others.
+//
+// Arguments:
+//   r: reducer created by reducerCreate
+//   values: n elements of the reducer's type
+//   n: number of elements
+//   result: room for REDUCE_RESULT_SIZE bytes, the result on return
+//   index: for argmin, the index of the result on return; may be NULL
+//
+// Returns:  0 on success, -1 if there are no elements or too many
+// ****************************************************************************
+static int reduceGPU(Reducer* r, const void* values, size_t n, void* result, cl_uint* index) {
+    cl_int status;
+
+    if(n == 0 || n > (size_t)0xFFFFFFFF) return -1;
+    reducerReserve(r, n);
+
+    cl_event evt;
+    status = clEnqueueWriteBuffer(r->commandQueue, r->input_d, CL_FALSE, 0, n * r->valueSize, values, 0, NULL, &evt);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to write values");
+    int src;
+    evt = reduceDevice(r, r->input_d, (cl_uint)n, evt, &src);
+
+    if(r->op == REDUCE_ARGMIN && index != NULL) {
+        status = clEnqueueReadBuffer(r->commandQueue, r->index_d[src], CL_FALSE, 0, sizeof(cl_uint), index, 1, &evt, NULL);
+        CHECK_ERROR(status, CL_SUCCESS, "Failed to read the index");
+    }
+    status = clEnqueueReadBuffer(r->commandQueue, r->partials_d[src], CL_TRUE, 0, r->resultSize, result, 1, &evt, NULL);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to read the result");
+    clReleaseEvent(evt);
+    return 0;
+}
+
+static void reducerRelease(Reducer* r) {
+    cl_mem buffers[] = {r->input_d, r->partials_d[0], r->partials_d[1], r->index_d[0], r->index_d[1]};
+    for(size_t i = 0; i < sizeof(buffers)/sizeof(buffers[0]); i++)
+        if(buffers[i] != NULL) clReleaseMemObject(buffers[i]);
+    clReleaseKernel(r->valuesKernel);
+    clReleaseKernel(r->partialsKernel);
+    clReleaseProgram(r->program);
+    memset(r, 0, sizeof(*r));
+}
+
+#endif // REDUCTION_ENGINE_H_
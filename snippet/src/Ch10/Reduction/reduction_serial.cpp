@@ -1,24 +1,97 @@
 #include <cstdlib>
+#include <cmath>
+#include <ctime>
 #include <iostream>
 
+#include "reduction_cpu.h"
+
+#define DATA_SIZE (1 << 26)
+
+// The serial reduction the host library replaces: op through a function
+// pointer, one accumulator, so neither inlined nor vectorized
 template<typename T>
-T reduce(T (*f)(T, T), 
+T reduce(T (*f)(T, T),
          size_t n,
          T a[],
          T identity)
 {
   T accum = identity;
-  for(size_t i = 0; i < n ; ++i) 
+  for(size_t i = 0; i < n ; ++i)
         accum = f(accum, a[i]);
   return accum;
 }
 
-int add(int a, int b) {return a + b;}
-int identity = 0;
-int main(int argc, char** argv) {
-       int a[100];
-       for(int i = 0; i < 100; ++i) a[i] = i+1;
-       int sum = reduce<int>(add, 100, a, identity); 
-       std::cout << "Total sum = " << sum << std::endl;
+long add(long a, long b) {return a + b;}
+float addf(float a, float b) {return a + b;}
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
 }
 
+// [n] [threads]: sums, min and argmin of n values, serially as before
+// and by the host library on one thread and on all of them
+int main(int argc, char** argv) {
+    size_t n = DATA_SIZE;
+    int numThreads = 0;
+    if(argc > 1) n = strtoul(argv[1], NULL, 10);
+    if(argc > 2) numThreads = atoi(argv[2]);
+    if(n == 0) n = 1;
+    int threads = reduceCpuThreads(n, numThreads);
+
+    long* a = new long[n];
+    float* f = new float[n];
+    for(size_t i = 0; i < n; ++i) {
+        a[i] = rand() % 2001 - 1000;
+        f[i] = (float)rand() / RAND_MAX;
+    }
+    std::cout << "elementCount: " << n << ", threads: " << threads << std::endl;
+
+    double start = now();
+    long serial = reduce<long>(add, n, a, 0L);
+    double serialSeconds = now() - start;
+    start = now();
+    long lanes = reduceCPU(a, n, 0L, [](long x, long y) { return x + y; }, 1);
+    double lanesSeconds = now() - start;
+    start = now();
+    long parallel = reduceCPU(a, n, 0L, [](long x, long y) { return x + y; }, numThreads);
+    double parallelSeconds = now() - start;
+    std::cout << "Total sum = " << serial << std::endl;
+    std::cout << "Serial:   " << serialSeconds * 1e3 << " ms" << std::endl;
+    std::cout << "Lanes:    " << lanesSeconds * 1e3 << " ms, " << serialSeconds / lanesSeconds << "x" << std::endl;
+    std::cout << "Parallel: " << parallelSeconds * 1e3 << " ms, " << serialSeconds / parallelSeconds << "x" << std::endl;
+    bool passed = lanes == serial && parallel == serial;
+
+    // Floats against a long double sum: the serial one drifts with n,
+    // pairwise and Kahan hardly
+    long double exact = 0;
+    for(size_t i = 0; i < n; ++i) exact += f[i];
+    start = now();
+    float serialf = reduce<float>(addf, n, f, 0.0f);
+    serialSeconds = now() - start;
+    std::cout << "Float sum = " << (double)exact << std::endl;
+    std::cout << "Serial:   " << serialSeconds * 1e3 << " ms, relative error " << fabsl(serialf - exact) / exact << std::endl;
+    const char* summationNames[] = {"Plain:    ", "Pairwise: ", "Kahan:    "};
+    for(int s = REDUCE_CPU_PLAIN; s <= REDUCE_CPU_KAHAN; s++) {
+        start = now();
+        float sum = reduceSumCPU<float>(f, n, numThreads, (ReduceCpuSummation)s);
+        double seconds = now() - start;
+        std::cout << summationNames[s] << seconds * 1e3 << " ms, " << serialSeconds / seconds << "x, relative error "
+                  << fabsl(sum - exact) / exact << std::endl;
+    }
+    float kahan = reduceSumCPU<float>(f, n, numThreads, REDUCE_CPU_KAHAN);
+    passed = passed && fabsl(kahan - exact) <= 1e-6 * exact;
+
+    long least = reduceCPU(a, n, a[0], [](long x, long y) { return y < x ? y : x; }, numThreads);
+    size_t first = reduceArgMinCPU(a, n, numThreads);
+    size_t expected = 0;
+    for(size_t i = 1; i < n; ++i)
+        if(a[i] < a[expected]) expected = i;
+    std::cout << "Min = " << least << " first at " << first << std::endl;
+    passed = passed && first == expected && least == a[expected];
+    if(passed) std::cout << "Passed!" << std::endl; else std::cout << "Failed!" << std::endl;
+
+    delete[] a;
+    delete[] f;
+}
@@ -0,0 +1,229 @@
+#define _POSIX_C_SOURCE 199309L  // clock_gettime under -std=c99
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <alloca.h>
+#include <math.h>
+#include <time.h>
+
+#include "scan.h"
+
+#define DATA_SIZE 4194305       // any length, not just multiples of a block
+#define RUNS 10                 // scans the throughput is averaged over
+
+// The custom operator of the sample: the last non-zero value so far, a
+// fill-forward that is associative but not commutative
+#define LAST_NON_ZERO "(b) != 0 ? (b) : (a)"
+
+void loadProgramSource(const char** files,
+                       size_t length,
+                       char** buffer,
+                       size_t* sizes) {
+    /* Read each source file (*.cl) and store the contents into a temporary datastore */
+    for(size_t i=0; i < length; i++) {
+        FILE* file = fopen(files[i], "r");
+        if(file == NULL) {
+            perror("Couldn't read the program file");
+            exit(1);
+        }
+        fseek(file, 0, SEEK_END);
+        sizes[i] = ftell(file);
+        rewind(file); // reset the file pointer so that 'fread' reads from the front
+        buffer[i] = (char*)malloc(sizes[i]+1);
+        buffer[i][sizes[i]] = '\0';
+        fread(buffer[i], sizeof(char), sizes[i], file);
+        fclose(file);
+    }
+}
+
+static const char* typeNames[] = {"uint", "int", "float", "ulong", "long", "double"};
+static const char* opNames[] = {"add", "min", "max", "last"};
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Small random values, a quarter of them zero for the fill-forward;
+// integers small enough that sums of millions stay exact in any type
+static void fillRandom(void* values, size_t n, ScanType type) {
+    for(size_t i = 0; i < n; i++) {
+        int r = rand() % 4 == 0 ? 0 : rand() % 1000 - (type == SCAN_UINT || type == SCAN_ULONG ? 0 : 500);
+        double d = r == 0 ? 0 : (double)rand() / RAND_MAX - 0.5;
+        switch(type) {
+            case SCAN_UINT:   ((cl_uint*)values)[i] = (cl_uint)r; break;
+            case SCAN_INT:    ((cl_int*)values)[i] = r; break;
+            case SCAN_FLOAT:  ((cl_float*)values)[i] = (cl_float)d; break;
+            case SCAN_ULONG:  ((cl_ulong*)values)[i] = (cl_ulong)r << 20; break;
+            case SCAN_LONG:   ((cl_long*)values)[i] = (cl_long)r << 20; break;
+            default:          ((cl_double*)values)[i] = d; break;
+        }
+    }
+}
+
+// Serial scan on the host, in the element type
+#define SCAN_CPU(T, LOWEST, HIGHEST)                                                \
+    {                                                                               \
+        const T* a = (const T*)in;                                                  \
+        T* b = (T*)out;                                                             \
+        T acc = op == SCAN_MIN ? HIGHEST : op == SCAN_MAX ? LOWEST : 0;             \
+        for(size_t i = 0; i < n; i++) {                                             \
+            if(exclusive) b[i] = acc;                                               \
+            switch(op) {                                                            \
+                case SCAN_ADD: acc += a[i]; break;                                  \
+                case SCAN_MIN: if(a[i] < acc) acc = a[i]; break;                    \
+                case SCAN_MAX: if(a[i] > acc) acc = a[i]; break;                    \
+                default:       if(a[i] != 0) acc = a[i]; break;                     \
+            }                                                                       \
+            if(!exclusive) b[i] = acc;                                              \
+        }                                                                           \
+    }
+
+static void scanCPU(const void* in, void* out, size_t n, ScanType type, ScanOp op, int exclusive) {
+    switch(type) {
+        case SCAN_UINT:  SCAN_CPU(cl_uint, 0, UINT32_MAX); break;
+        case SCAN_INT:   SCAN_CPU(cl_int, INT32_MIN, INT32_MAX); break;
+        case SCAN_FLOAT: SCAN_CPU(cl_float, -INFINITY, INFINITY); break;
+        case SCAN_ULONG: SCAN_CPU(cl_ulong, 0, UINT64_MAX); break;
+        case SCAN_LONG:  SCAN_CPU(cl_long, INT64_MIN, INT64_MAX); break;
+        default:         SCAN_CPU(cl_double, -INFINITY, INFINITY); break;
+    }
+}
+
+// Integers must match exactly; floating point sums, added up in another
+// order, to within their rounding, which grows with their index from
+// first on
+static size_t countMatches(const void* expected, const void* got, size_t first, size_t n, ScanType type, ScanOp op) {
+    size_t size = SCAN_VALUE_SIZE(type);
+    size_t matches = 0;
+    for(size_t i = 0; i < n; i++) {
+        if(op == SCAN_ADD && type == SCAN_FLOAT) {
+            float e = ((const cl_float*)expected)[i], g = ((const cl_float*)got)[i];
+            matches += fabsf(e - g) <= 1e-4f * (1 + sqrtf((float)(first + i)));
+        } else if(op == SCAN_ADD && type == SCAN_DOUBLE) {
+            double e = ((const cl_double*)expected)[i], g = ((const cl_double*)got)[i];
+            matches += fabs(e - g) <= 1e-12 * (1 + sqrt((double)(first + i)));
+        } else {
+            matches += memcmp((const char*)expected + i * size, (const char*)got + i * size, size) == 0;
+        }
+    }
+    return matches;
+}
+
+int main(int argc, char** argv) {
+    /* OpenCL 1.1 data structures */
+    cl_platform_id* platforms;
+    cl_device_id device;
+    cl_uint numOfPlatforms;
+    cl_int  error;
+
+    // [n] [type] [op]: inclusive and exclusive scans of n random values;
+    // op is add, min, max, or last for the last non-zero value, a
+    // custom operator
+    size_t dataSize = DATA_SIZE;
+    ScanType type = SCAN_UINT;
+    ScanOp op = SCAN_ADD;
+    if(argc > 1) dataSize = strtoul(argv[1], NULL, 10);
+    if(argc > 2) {
+        for(int t = 0; t <= SCAN_DOUBLE; t++)
+            if(strcmp(argv[2], typeNames[t]) == 0) type = (ScanType)t;
+    }
+    if(argc > 3) {
+        for(int o = 0; o <= SCAN_CUSTOM; o++)
+            if(strcmp(argv[3], opNames[o]) == 0) op = (ScanOp)o;
+    }
+    if(dataSize == 0) dataSize = 1;
+    size_t valueSize = SCAN_VALUE_SIZE(type);
+
+    //Get the number of platforms
+    //Remember that for each vendor's SDK installed on the computer,
+    //the number of available platform also increased.
+    error = clGetPlatformIDs(0, NULL, &numOfPlatforms);
+    if(error != CL_SUCCESS) {
+        perror("Unable to find any OpenCL platforms");
+        exit(1);
+    }
+
+    platforms = (cl_platform_id*) alloca(sizeof(cl_platform_id) * numOfPlatforms);
+    printf("Number of OpenCL platforms found: %d\n", numOfPlatforms);
+
+    error = clGetPlatformIDs(numOfPlatforms, platforms, NULL);
+    if(error != CL_SUCCESS) {
+        perror("Unable to find any OpenCL platforms");
+        exit(1);
+    }
+    for(cl_int i = 0; i < numOfPlatforms; i++ ) {
+        // Get the GPU device
+        error = clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_GPU, 1, &device, NULL);
+
+        if(error != CL_SUCCESS) {
+            perror("Can't locate a OpenCL compliant device i.e. GPU");
+            exit(1);
+        }
+        // Create a context
+        cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &error);
+        if(error != CL_SUCCESS) {
+            perror("Can't create a valid OpenCL context");
+            exit(1);
+        }
+
+        const char *file_names[] = {"Scan.cl"};
+        const int NUMBER_OF_FILES = 1;
+        char* buffer[NUMBER_OF_FILES];
+        size_t sizes[NUMBER_OF_FILES];
+        loadProgramSource(file_names, NUMBER_OF_FILES, buffer, sizes);
+
+        cl_command_queue commandQueue = clCreateCommandQueue(context, device, 0, &error);
+        CHECK_ERROR(error, CL_SUCCESS, "failed to create command queue");
+
+        Scanner scanner;
+        scannerCreate(&scanner, context, device, commandQueue, buffer[0], sizes[0], type, op,
+                      op == SCAN_CUSTOM ? LAST_NON_ZERO : NULL, op == SCAN_CUSTOM ? "0" : NULL);
+
+        void* values = malloc(dataSize * valueSize + 1);
+        void* scanned = malloc(dataSize * valueSize + 1);
+        void* expected = malloc(dataSize * valueSize + 1);
+        fillRandom(values, dataSize, type);
+        printf("elementCount: %zu %s values, op: %s, group: %zu work-items x %d values\n",
+               dataSize, typeNames[type], opNames[op], scanner.groupSize, SCAN_ITEMS);
+
+        // The total of all values, which both scans return: the last
+        // value of the inclusive scan
+        cl_ulong expectedTotal = 0;
+        scanCPU(values, expected, dataSize, type, op, 0);
+        memcpy(&expectedTotal, (char*)expected + (dataSize - 1) * valueSize, valueSize);
+
+        for(int exclusive = 0; exclusive <= 1; exclusive++) {
+            cl_ulong total = 0;
+            error = scanGPU(&scanner, values, scanned, dataSize, exclusive, &total);
+            CHECK_ERROR(error, 0, "scan failed");
+            scanCPU(values, expected, dataSize, type, op, exclusive);
+            size_t acc = countMatches(expected, scanned, 0, dataSize, type, op);
+            int totalMatches = countMatches(&expectedTotal, &total, dataSize - 1, 1, type, op) == 1;
+
+            // The values stay on the device; time the kernels alone
+            double start = now();
+            for(int run = 0; run < RUNS; run++) {
+                cl_event evt = scanDevice(&scanner, scanner.data_d, scanner.data_d, (cl_uint)dataSize, exclusive, NULL);
+                clReleaseEvent(evt);
+            }
+            clFinish(commandQueue);
+            double seconds = (now() - start) / RUNS;
+            printf("%s scan: %.3f ms, %zu tiles, %.2f Mvalues/s, %.2f GB/s\n", exclusive ? "Exclusive" : "Inclusive",
+                   seconds * 1e3, scanner.tilesRun, dataSize / seconds * 1e-6, 2.0 * dataSize * valueSize / seconds * 1e-9);
+            if (acc == dataSize && totalMatches) printf("Passed:%zu!\n", acc); else printf("Failed:%zu!\n", acc);
+        }
+
+        for(int j=0; j< NUMBER_OF_FILES; j++) { free(buffer[j]); }
+        free(values);
+        free(scanned);
+        free(expected);
+
+        scannerRelease(&scanner);
+        clReleaseCommandQueue(commandQueue);
+        clReleaseContext(context);
+    }
+    return 0;
+}
@@ -0,0 +1,201 @@
+/* Element type, set by the host: 0 uint, 1 int, 2 float, 3 ulong,
+   4 long, 5 double */
+#ifndef SCAN_TYPE
+#define SCAN_TYPE 0
+#endif
+
+/* Operator, likewise: 0 add, 1 min, 2 max, 3 the host's own, which it
+   defines as SCAN_COMBINE(a, b) with its identity SCAN_IDENTITY ahead of
+   this source.  It must be associative; it need not be commutative, a
+   is always the earlier operand. */
+#ifndef SCAN_OP
+#define SCAN_OP 0
+#endif
+
+/* Values each work-item scans in a row */
+#ifndef SCAN_ITEMS
+#define SCAN_ITEMS 8
+#endif
+
+#if SCAN_TYPE == 5
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+#if SCAN_TYPE == 0
+#define T uint
+#define T_LOWEST 0
+#define T_HIGHEST UINT_MAX
+#elif SCAN_TYPE == 1
+#define T int
+#define T_LOWEST INT_MIN
+#define T_HIGHEST INT_MAX
+#elif SCAN_TYPE == 2
+#define T float
+#define T_LOWEST (-INFINITY)
+#define T_HIGHEST INFINITY
+#elif SCAN_TYPE == 3
+#define T ulong
+#define T_LOWEST 0
+#define T_HIGHEST ULONG_MAX
+#elif SCAN_TYPE == 4
+#define T long
+#define T_LOWEST LONG_MIN
+#define T_HIGHEST LONG_MAX
+#else
+#define T double
+#define T_LOWEST (-(double)INFINITY)
+#define T_HIGHEST ((double)INFINITY)
+#endif
+
+#if SCAN_OP == 0
+#define SCAN_COMBINE(a, b) ((a) + (b))
+#define SCAN_IDENTITY ((T)0)
+#elif SCAN_OP == 1
+#define SCAN_COMBINE(a, b) ((b) < (a) ? (b) : (a))
+#define SCAN_IDENTITY T_HIGHEST
+#elif SCAN_OP == 2
+#define SCAN_COMBINE(a, b) ((b) > (a) ? (b) : (a))
+#define SCAN_IDENTITY T_LOWEST
+#endif
+
+/* Scans a chunk of count values, at most SCAN_ITEMS per work-item, from
+   input[first] on, after carry.  The chunk is loaded into local memory
+   with coalesced reads; every work-item scans its SCAN_ITEMS values in a
+   row, the work-items' totals are scanned across the group with a
+   barrier at every step, and every value is combined with what comes
+   before it.  Leaves the inclusive scan in values and returns it at the
+   end of the chunk. */
+T scanChunk(__global const T* input,
+            uint first,
+            uint count,
+            T carry,
+            __local T* values,
+            __local T* totals) {
+    uint tid = get_local_id(0);
+    uint size = get_local_size(0);
+
+    for(uint i = tid; i < size * SCAN_ITEMS; i += size)
+        values[i] = i < count ? input[first + i] : SCAN_IDENTITY;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    T total = SCAN_IDENTITY;
+    for(uint j = 0; j < SCAN_ITEMS; j++) {
+        total = SCAN_COMBINE(total, values[tid * SCAN_ITEMS + j]);
+        values[tid * SCAN_ITEMS + j] = total;
+    }
+    totals[tid] = total;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(uint offset = 1; offset < size; offset <<= 1) {
+        T before = tid >= offset ? totals[tid - offset] : SCAN_IDENTITY;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if(tid >= offset) totals[tid] = SCAN_COMBINE(before, totals[tid]);
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    T before = tid > 0 ? SCAN_COMBINE(carry, totals[tid - 1]) : carry;
+    for(uint j = 0; j < SCAN_ITEMS; j++)
+        values[tid * SCAN_ITEMS + j] = SCAN_COMBINE(before, values[tid * SCAN_ITEMS + j]);
+    T chunkTotal = SCAN_COMBINE(carry, totals[size - 1]);
+    barrier(CLK_LOCAL_MEM_FENCE);
+    return chunkTotal;
+}
+
+/* Reduces a chunk as scanChunk loads it, without scanning it: every
+   work-item combines its SCAN_ITEMS values in a row, and the work-items'
+   totals are combined in a tree whose pairs keep the earlier operand
+   first, one barrier a level.  Returns the chunk's total. */
+T reduceChunk(__global const T* input,
+              uint first,
+              uint count,
+              __local T* values,
+              __local T* totals) {
+    uint tid = get_local_id(0);
+    uint size = get_local_size(0);
+
+    for(uint i = tid; i < size * SCAN_ITEMS; i += size)
+        values[i] = i < count ? input[first + i] : SCAN_IDENTITY;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    T total = SCAN_IDENTITY;
+    for(uint j = 0; j < SCAN_ITEMS; j++)
+        total = SCAN_COMBINE(total, values[tid * SCAN_ITEMS + j]);
+    totals[tid] = total;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(uint offset = 1; offset < size; offset <<= 1) {
+        if((tid & (2 * offset - 1)) == 0)
+            totals[tid] = SCAN_COMBINE(totals[tid], totals[tid + offset]);
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    return totals[0];
+}
+
+/* Reduce: the total of every tile, tileSize values from the group's
+   number on, chunk by chunk in order */
+__kernel void scanReduceTiles(__global const T* input,
+                              uint n,
+                              uint tileSize,
+                              __global T* tileSums,
+                              __local T* values,
+                              __local T* totals) {
+    uint chunk = get_local_size(0) * SCAN_ITEMS;
+    uint first = get_group_id(0) * tileSize;
+    uint last = min(n, first + tileSize);
+
+    T carry = SCAN_IDENTITY;
+    for(uint k = first; k < last; k += chunk) {
+        T chunkTotal = reduceChunk(input, k, min(chunk, last - k), values, totals);
+        carry = SCAN_COMBINE(carry, chunkTotal);
+    }
+    if(get_local_id(0) == 0) tileSums[get_group_id(0)] = carry;
+}
+
+/* Scans the numTiles tile totals in place, exclusively, by one group,
+   and appends the total of them all */
+__kernel void scanTileSums(__global T* tileSums,
+                           uint numTiles,
+                           __local T* values,
+                           __local T* totals) {
+    uint tid = get_local_id(0);
+    uint size = get_local_size(0);
+    uint chunk = size * SCAN_ITEMS;
+
+    T carry = SCAN_IDENTITY;
+    for(uint k = 0; k < numTiles; k += chunk) {
+        uint count = min(chunk, numTiles - k);
+        T chunkCarry = carry;
+        carry = scanChunk(tileSums, k, count, carry, values, totals);
+        for(uint i = tid; i < count; i += size)
+            tileSums[k + i] = i > 0 ? values[i - 1] : chunkCarry;
+        barrier(CLK_GLOBAL_MEM_FENCE | CLK_LOCAL_MEM_FENCE);
+    }
+    if(tid == 0) tileSums[numTiles] = carry;
+}
+
+/* Scan: every tile again, after the scanned totals of the tiles before
+   it.  output may be input. */
+__kernel void scanTiles(__global const T* input,
+                        __global T* output,
+                        uint n,
+                        uint tileSize,
+                        uint exclusive,
+                        __global const T* tileSums,
+                        __local T* values,
+                        __local T* totals) {
+    uint tid = get_local_id(0);
+    uint size = get_local_size(0);
+    uint chunk = size * SCAN_ITEMS;
+    uint first = get_group_id(0) * tileSize;
+    uint last = min(n, first + tileSize);
+
+    T carry = tileSums[get_group_id(0)];
+    for(uint k = first; k < last; k += chunk) {
+        uint count = min(chunk, last - k);
+        T chunkCarry = carry;
+        carry = scanChunk(input, k, count, carry, values, totals);
+        for(uint i = tid; i < count; i += size)
+            output[k + i] = !exclusive ? values[i] : i > 0 ? values[i - 1] : chunkCarry;
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+}
@@ -0,0 +1,310 @@
+#ifndef SCAN_H_
+#define SCAN_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+#ifdef  __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Largest work-group the scan kernels run in; the scan across the group
+// takes a power of two
+#define SCAN_MAX_GROUP 256
+
+// Values each work-item scans in a row, SCAN_ITEMS in Scan.cl
+#define SCAN_ITEMS 8
+
+// Tiles per compute unit.  A scan splits its input into at most this
+// many tiles per unit, one work-group each, so the tile totals between
+// the two passes over the input are few enough for one group.
+#define SCAN_TILES_PER_UNIT 4
+
+// Element types and operators, numbered as SCAN_TYPE and SCAN_OP in
+// Scan.cl
+typedef enum {
+    SCAN_UINT,
+    SCAN_INT,
+    SCAN_FLOAT,
+    SCAN_ULONG,
+    SCAN_LONG,
+    SCAN_DOUBLE
+} ScanType;
+
+typedef enum {
+    SCAN_ADD,
+    SCAN_MIN,
+    SCAN_MAX,
+    SCAN_CUSTOM
+} ScanOp;
+
+#define SCAN_VALUE_SIZE(type) ((type) >= SCAN_ULONG ? sizeof(cl_ulong) : sizeof(cl_uint))
+
+// ****************************************************************************
+// Struct: Scanner
+//
+// Purpose:
+//   Prefix sums, or scans by another associative operator, of any length
+//   on the device, by reduce-then-scan: the input is split into a few
+//   large tiles, one per work-group of a grid sized to the device; the
+//   first pass reduces every tile, one group scans the tile totals, and
+//   the second pass scans every tile after the total of those before it.
+//   The input is read twice and written once, with no global
+//   synchronisation between groups, which OpenCL does not promise.
+// ****************************************************************************
+typedef struct {
+    cl_context context;
+    cl_device_id device;
+    cl_command_queue commandQueue;
+    cl_program program;
+
+    ScanType type;
+    size_t valueSize;           // bytes per value
+    size_t groupSize;           // work-items per group, a power of two
+    size_t maxTiles;
+
+    cl_kernel reduceKernel;
+    cl_kernel tileSumsKernel;
+    cl_kernel scanKernel;
+
+    cl_mem tileSums_d;          // maxTiles + 1, the last their total
+    cl_mem data_d;              // scanGPU's values, scanned in place
+    size_t capacity;            // values data_d holds
+
+    size_t tilesRun;            // tiles the last scan took
+} Scanner;
+
+// Enqueues one kernel.  Like the radix sorter's steps, every kernel waits
+// on the event of the one before it, which it releases, and returns its
+// own; the host only waits for the result.
+static cl_event scanEnqueue(Scanner* s, cl_kernel kernel, size_t groups, cl_event waitEvt, const char* msg) {
+    cl_event execEvt;
+    size_t globalThreads = groups * s->groupSize;
+    size_t localThreads = s->groupSize;
+    cl_int status = clEnqueueNDRangeKernel(s->commandQueue, kernel, 1, NULL, &globalThreads, &localThreads,
+                                           waitEvt != NULL ? 1 : 0, waitEvt != NULL ? &waitEvt : NULL, &execEvt);
+    CHECK_ERROR(status, CL_SUCCESS, msg);
+    if(waitEvt != NULL) clReleaseEvent(waitEvt);
+    return execEvt;
+}
+
+// ****************************************************************************
+// Function: scannerCreate
+//
+// Purpose:
+//   Builds Scan.cl for a type and operator, and sizes the work-groups
+//   from the device's local memory and the grid from its compute units.
+//
+// Arguments:
+//   source, sourceSize: Scan.cl
+//   type: element type
+//   op: SCAN_ADD, SCAN_MIN, SCAN_MAX, or SCAN_CUSTOM for combine
+//   combine: for SCAN_CUSTOM, an OpenCL C expression of the earlier
+//            value a and the later value b, e.g. "(b) != 0 ? (b) : (a)";
+//            NULL otherwise
+//   identity: for SCAN_CUSTOM, the identity of combine, e.g. "0"
+// ****************************************************************************
+static void scannerCreate(Scanner* s,
+                          cl_context context,
+                          cl_device_id device,
+                          cl_command_queue commandQueue,
+                          const char* source,
+                          size_t sourceSize,
+                          ScanType type,
+                          ScanOp op,
+                          const char* combine,
+                          const char* identity) {
+    cl_int error;
+
+    memset(s, 0, sizeof(*s));
+    s->context = context;
+    s->device = device;
+    s->commandQueue = commandQueue;
+    s->type = type;
+    s->valueSize = SCAN_VALUE_SIZE(type);
+
+    // A custom operator goes ahead of the source as the macros Scan.cl
+    // expects, which spares quoting it in the build options
+    char* prelude = (char*) malloc(128 + (combine ? strlen(combine) : 0) + (identity ? strlen(identity) : 0));
+    if(op == SCAN_CUSTOM)
+        sprintf(prelude, "#define SCAN_COMBINE(a, b) (%s)\n#define SCAN_IDENTITY ((T)(%s))\n", combine, identity);
+    else
+        prelude[0] = '\0';
+    const char* sources[2] = {prelude, source};
+    size_t sizes[2] = {strlen(prelude), sourceSize};
+
+    // Create the OpenCL program object
+    s->program = clCreateProgramWithSource(context, 2, sources, sizes, &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Can't create the OpenCL program object");
+    free(prelude);
+
+    // Build OpenCL program object and dump the error message, if any
+    char options[64];
+    sprintf(options, "-DSCAN_TYPE=%d -DSCAN_OP=%d -DSCAN_ITEMS=%d", (int)type, (int)op, SCAN_ITEMS);
+    error = clBuildProgram(s->program, 1, &device, options, NULL, NULL);
+    if(error != CL_SUCCESS) {
+        // If there's an error whilst building the program, dump the log
+        size_t log_size;
+        clGetProgramBuildInfo(s->program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+        char *program_log = (char*) malloc(log_size+1);
+        program_log[log_size] = '\0';
+        clGetProgramBuildInfo(s->program, device, CL_PROGRAM_BUILD_LOG,
+                              log_size+1, program_log, NULL);
+        printf("\n=== ERROR ===\n\n%s\n=============\n", program_log);
+        free(program_log);
+        exit(1);
+    }
+
+    s->reduceKernel = clCreateKernel(s->program, "scanReduceTiles", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create scan reduce kernel");
+    s->tileSumsKernel = clCreateKernel(s->program, "scanTileSums", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create scan tile sums kernel");
+    s->scanKernel = clCreateKernel(s->program, "scanTiles", &error);
+    CHECK_ERROR(error, CL_SUCCESS, "Failed to create scan tiles kernel");
+
+    // The largest power of two the device and every kernel allow, whose
+    // chunk and totals fit in half of local memory
+    cl_ulong localMemSize = 0;
+    size_t deviceGroup = 0;
+    clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &localMemSize, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &deviceGroup, NULL);
+    cl_kernel kernels[] = {s->reduceKernel, s->tileSumsKernel, s->scanKernel};
+    for(size_t k = 0; k < sizeof(kernels)/sizeof(kernels[0]); k++) {
+        size_t kernelGroup = 0;
+        clGetKernelWorkGroupInfo(kernels[k], device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernelGroup, NULL);
+        if(kernelGroup < deviceGroup) deviceGroup = kernelGroup;
+    }
+    s->groupSize = SCAN_MAX_GROUP;
+    while(s->groupSize > 1 &&
+          (s->groupSize > deviceGroup || s->groupSize * (SCAN_ITEMS + 1) * s->valueSize > localMemSize / 2))
+        s->groupSize >>= 1;
+
+    cl_uint computeUnits = 1;
+    clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL);
+    s->maxTiles = (computeUnits > 0 ? computeUnits : 1) * SCAN_TILES_PER_UNIT;
+    s->tileSums_d = clCreateBuffer(context, CL_MEM_READ_WRITE, (s->maxTiles + 1) * s->valueSize, NULL, &error);
+    CHECK_ERROR(error, CL_SUCCESS, "failed to allocate tileSums_d");
+}
+
+// Sets the local memory arguments of a kernel from first on: the chunk
+// of values and the work-items' totals
+static void scanSetLocal(Scanner* s, cl_kernel kernel, cl_uint first) {
+    cl_int status;
+    status = clSetKernelArg(kernel, first, s->groupSize * SCAN_ITEMS * s->valueSize, NULL);
+    status |= clSetKernelArg(kernel, first + 1, s->groupSize * s->valueSize, NULL);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to set scan kernel arguments");
+}
+
+// ****************************************************************************
+// Function: scanDevice
+//
+// Purpose:
+//   Scans n values already on the device.  The total of all n is left in
+//   tileSums_d, after the tiles' totals, at index tilesRun.
+//
+// Arguments:
+//   s: scanner created by scannerCreate
+//   input: n values of the scanner's type
+//   output: room for n values; may be input
+//   n: number of values, 1 to 0x7FFFFFFF
+//   exclusive: 0 for an inclusive scan, 1 for an exclusive one, which
+//              starts with the identity
+//   evt: event the first kernel waits on, released; may be NULL
+//
+// Returns:  the event of the last kernel
+// ****************************************************************************
+static cl_event scanDevice(Scanner* s, cl_mem input, cl_mem output, cl_uint n, cl_uint exclusive, cl_event evt) {
+    cl_int status;
+
+    // As few tiles as the grid allows, every one a whole number of chunks
+    size_t chunk = s->groupSize * SCAN_ITEMS;
+    size_t chunks = (n + chunk - 1) / chunk;
+    size_t tiles = chunks < s->maxTiles ? chunks : s->maxTiles;
+    cl_uint tileSize = (cl_uint)((chunks + tiles - 1) / tiles * chunk);
+    tiles = (n + tileSize - 1) / tileSize;
+    cl_uint numTiles = (cl_uint)tiles;
+    s->tilesRun = tiles;
+
+    status = clSetKernelArg(s->reduceKernel, 0, sizeof(cl_mem), (void*)&input);
+    status |= clSetKernelArg(s->reduceKernel, 1, sizeof(cl_uint), (void*)&n);
+    status |= clSetKernelArg(s->reduceKernel, 2, sizeof(cl_uint), (void*)&tileSize);
+    status |= clSetKernelArg(s->reduceKernel, 3, sizeof(cl_mem), (void*)&s->tileSums_d);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to set scan kernel arguments");
+    scanSetLocal(s, s->reduceKernel, 4);
+    evt = scanEnqueue(s, s->reduceKernel, tiles, evt, "Failed to enqueue scan reduce kernel");
+
+    status = clSetKernelArg(s->tileSumsKernel, 0, sizeof(cl_mem), (void*)&s->tileSums_d);
+    status |= clSetKernelArg(s->tileSumsKernel, 1, sizeof(cl_uint), (void*)&numTiles);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to set scan kernel arguments");
+    scanSetLocal(s, s->tileSumsKernel, 2);
+    evt = scanEnqueue(s, s->tileSumsKernel, 1, evt, "Failed to enqueue scan tile sums kernel");
+
+    status = clSetKernelArg(s->scanKernel, 0, sizeof(cl_mem), (void*)&input);
+    status |= clSetKernelArg(s->scanKernel, 1, sizeof(cl_mem), (void*)&output);
+    status |= clSetKernelArg(s->scanKernel, 2, sizeof(cl_uint), (void*)&n);
+    status |= clSetKernelArg(s->scanKernel, 3, sizeof(cl_uint), (void*)&tileSize);
+    status |= clSetKernelArg(s->scanKernel, 4, sizeof(cl_uint), (void*)&exclusive);
+    status |= clSetKernelArg(s->scanKernel, 5, sizeof(cl_mem), (void*)&s->tileSums_d);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to set scan kernel arguments");
+    scanSetLocal(s, s->scanKernel, 6);
+    return scanEnqueue(s, s->scanKernel, tiles, evt, "Failed to enqueue scan tiles kernel");
+}
+
+// ****************************************************************************
+// Function: scanGPU
+//
+// Purpose:
+//   Scans n values of host memory.
+//
+// Arguments:
+//   s: scanner created by scannerCreate
+//   in: n values of the scanner's type
+//   out: room for n values; may be in
+//   n: number of values
+//   exclusive: 0 for an inclusive scan, 1 for an exclusive one
+//   total: the total of all n values on return; may be NULL
+//
+// Returns:  0 on success, -1 if the values are too many
+// ****************************************************************************
+static int scanGPU(Scanner* s, const void* in, void* out, size_t n, int exclusive, void* total) {
+    cl_int status;
+
+    if(n > (size_t)0x7FFFFFFF) return -1;
+    if(n == 0) return 0;
+    if(n > s->capacity) {
+        if(s->data_d != NULL) clReleaseMemObject(s->data_d);
+        s->data_d = clCreateBuffer(s->context, CL_MEM_READ_WRITE, n * s->valueSize, NULL, &status);
+        CHECK_ERROR(status, CL_SUCCESS, "failed to allocate data_d");
+        s->capacity = n;
+    }
+
+    cl_event evt;
+    status = clEnqueueWriteBuffer(s->commandQueue, s->data_d, CL_FALSE, 0, n * s->valueSize, in, 0, NULL, &evt);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to write values");
+    evt = scanDevice(s, s->data_d, s->data_d, (cl_uint)n, exclusive ? 1 : 0, evt);
+    if(total != NULL) {
+        status = clEnqueueReadBuffer(s->commandQueue, s->tileSums_d, CL_FALSE, s->tilesRun * s->valueSize, s->valueSize, total, 1, &evt, NULL);
+        CHECK_ERROR(status, CL_SUCCESS, "Failed to read the total");
+    }
+    status = clEnqueueReadBuffer(s->commandQueue, s->data_d, CL_TRUE, 0, n * s->valueSize, out, 1, &evt, NULL);
+    CHECK_ERROR(status, CL_SUCCESS, "Failed to read the scan");
+    clReleaseEvent(evt);
+    return 0;
+}
+
+static void scannerRelease(Scanner* s) {
+    if(s->data_d != NULL) clReleaseMemObject(s->data_d);
+    clReleaseMemObject(s->tileSums_d);
+    clReleaseKernel(s->reduceKernel);
+    clReleaseKernel(s->tileSumsKernel);
+    clReleaseKernel(s->scanKernel);
+    clReleaseProgram(s->program);
+    memset(s, 0, sizeof(*s));
+}
+
+#endif // SCAN_H_
@@ -1,38 +1,114 @@
+/* Operator, set by the host: 0 min, 1 max, 2 argmin, 3 argmax.  The arg
+   operators find the first index holding the minimum or maximum. */
+#ifndef PAR_OP
+#define PAR_OP 0
+#endif
 
-#pragma OPENCL EXTENSION cl_khr_local_int32_extended_atomics : enable 
-#pragma OPENCL EXTENSION cl_khr_global_int32_extended_atomics : enable 
+/* Set by the host when the device has 64-bit atomics: every group then
+   folds its result into result[0] with one atomic.  Without it, the arg
+   operators leave one result per group in result[group] for the host to
+   fold; min and max always use the 32-bit atomics of OpenCL 1.1. */
+#if PAR_OP >= 2 && defined(PAR_MIN_ATOM64)
+#pragma OPENCL EXTENSION cl_khr_int64_extended_atomics : enable
+#endif
 
-__kernel void par_min(__global uint4* src,
-                      __global uint * globalMin,
-                      __local  uint * localMin,
-                      int             numOfItems,
-                      uint            device) {
+/* min and max reduce the values themselves; argmin and argmax a key
+   packing the value above the index, so one comparison of keys orders by
+   value and breaks ties by index, and one 64-bit atomic moves both.
+   argmax stores the index inverted to make the earliest index largest. */
+#if PAR_OP == 0
+#define KEY uint
+#define KEY_IDENTITY UINT_MAX
+#define COMBINE(a, b) min(a, b)
+#define ATOMIC_COMBINE(p, k) atomic_min(p, k)
+#elif PAR_OP == 1
+#define KEY uint
+#define KEY_IDENTITY 0u
+#define COMBINE(a, b) max(a, b)
+#define ATOMIC_COMBINE(p, k) atomic_max(p, k)
+#elif PAR_OP == 2
+#define KEY ulong
+#define KEY_IDENTITY ULONG_MAX
+#define COMBINE(a, b) min(a, b)
+#define ATOMIC_COMBINE(p, k) atom_min(p, k)
+#define PACK(value, index) (((ulong)(value) << 32) | (index))
+#else
+#define KEY ulong
+#define KEY_IDENTITY 0ul
+#define COMBINE(a, b) max(a, b)
+#define ATOMIC_COMBINE(p, k) atom_max(p, k)
+#define PACK(value, index) (((ulong)(value) << 32) | (uint)~(index))
+#endif
 
-    uint count = ( numOfItems / 4) / get_global_size(0);
-    uint index = (dev == 0) ? get_global_id(0) * count: get_global_id(0);
-    
-    uint stride = (dev == 0) ? 1 : get_global_size(0);
-    uint partialMin = (uint) -1;
+/* Finds the minimum, maximum or its first index of n uints.  Every
+   work-item reads whole uint4s, consecutive work-items consecutive
+   uint4s, striding by the global size, into four lanes of its own; the
+   values beyond the last whole uint4 are read singly the same way.  The
+   group then reduces its work-items' results in a tree in localKeys, one
+   per work-item, the local size a power of two, and its first work-item
+   combines the group's result into result[0] with a single atomic (see
+   PAR_MIN_ATOM64).  base is the index of src[0] in the whole input, so
+   the devices sharing it report the same indices. */
+__kernel void par_min(__global const uint4* src,
+                      uint n,
+                      uint base,
+                      __local KEY* localKeys,
+                      __global KEY* result) {
+    uint gid = get_global_id(0);
+    uint lid = get_local_id(0);
+    uint stride = get_global_size(0);
+    uint numVectors = n / 4;
 
-    for(int i = 0; i < count; ++i, index += stride) {
-        partialMin = min(partialMin, src[index].x);
-        partialMin = min(partialMin, src[index].y);
-        partialMin = min(partialMin, src[index].z);
-        partialMin = min(partialMin, src[index].w);
+#if PAR_OP < 2
+    uint4 best = (uint4)(KEY_IDENTITY);
+    for(uint v = gid; v < numVectors; v += stride)
+        best = COMBINE(best, src[v]);
+    KEY key = COMBINE(COMBINE(best.x, best.y), COMBINE(best.z, best.w));
+    for(uint i = numVectors * 4 + gid; i < n; i += stride)
+        key = COMBINE(key, ((__global const uint*)src)[i]);
+#else
+    /* Every lane keeps its best value and index; it visits its indices in
+       increasing order, so only a strictly better value replaces them,
+       save for the first value, which replaces the identity whatever it
+       is */
+#if PAR_OP == 2
+    uint4 best = (uint4)(UINT_MAX);
+#else
+    uint4 best = (uint4)(0);
+#endif
+    uint4 bestIndex = (uint4)(UINT_MAX);
+    for(uint v = gid; v < numVectors; v += stride) {
+        uint4 x = src[v];
+        uint4 index = (uint4)(v * 4) + (uint4)(0, 1, 2, 3);
+#if PAR_OP == 2
+        int4 take = (x < best) | ((x == best) & (index < bestIndex));
+#else
+        int4 take = (x > best) | ((x == best) & (index < bestIndex));
+#endif
+        best = select(best, x, take);
+        bestIndex = select(bestIndex, index, take);
     }
+    KEY key = KEY_IDENTITY;
+    if(bestIndex.x != UINT_MAX) key = COMBINE(key, PACK(best.x, base + bestIndex.x));
+    if(bestIndex.y != UINT_MAX) key = COMBINE(key, PACK(best.y, base + bestIndex.y));
+    if(bestIndex.z != UINT_MAX) key = COMBINE(key, PACK(best.z, base + bestIndex.z));
+    if(bestIndex.w != UINT_MAX) key = COMBINE(key, PACK(best.w, base + bestIndex.w));
+    for(uint i = numVectors * 4 + gid; i < n; i += stride)
+        key = COMBINE(key, PACK(((__global const uint*)src)[i], base + i));
+#endif
 
-    if(get_local_id(0) == 0) localMin[0] = (uint) -1;
-
-    barrier(CLK_LOCAL_MEM_FENCE);
-
-    atomic_min(localMin, globalMin);
-
+    localKeys[lid] = key;
     barrier(CLK_LOCAL_MEM_FENCE);
+    for(uint s = get_local_size(0) / 2; s > 0; s >>= 1) {
+        if(lid < s) localKeys[lid] = COMBINE(localKeys[lid], localKeys[lid + s]);
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
 
-    if (get_local_id(0) == 0) globalMin[ get_group_id[0] ] = localMin[0];
-}
-
-__kernel void reduce(__global uint4* src,
-                     __global uint * globalMin) {
-    atom_min(globalMin, globalMin[get_global_id(0)]);
+    if(lid == 0) {
+#if PAR_OP < 2 || defined(PAR_MIN_ATOM64)
+        ATOMIC_COMBINE(result, localKeys[0]);
+#else
+        result[get_group_id(0)] = localKeys[0];
+#endif
+    }
 }
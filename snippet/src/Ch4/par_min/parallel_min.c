@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 199309L  // clock_gettime under -std=c99
 #ifdef APPLE
 #include <OpenCL/cl.h>
 #else
@@ -6,18 +7,66 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <alloca.h>
+#include <time.h>
 
-#define NDEVS   2
-#define DATA_SIZE 4096 * 4096;
+#define DATA_SIZE (4096 * 4096)
+#define PROBE_SIZE (1 << 20)    // values each device is timed on alone
+#define GROUPS_PER_UNIT 4       // work-groups per compute unit
+#define MAX_GROUP_SIZE 256
+#define MAX_DEVICES 16
+#define RUNS 10                 // runs the throughput is averaged over
 
 /*
     This program should run on any device that supports OpenCL 1.1
 
-    Note: In the event that it runs on the CPU, then we cannot assign
-          a local_work_size > 1 since the CPU forbids it. In the GPU, 
-          that's an entirely different story :) whew
+    It finds the minimum, maximum, or the first index of either, of one
+    array of uints with every device of every platform at once: each
+    device is timed on the same probe first, then the array is split
+    among them in proportion to the values per second they managed, so
+    they all finish at about the same time.
+
+    Note: In the event that it runs on the CPU, the kernel may not allow
+          a local_work_size > 1; the size is asked of the kernel, and the
+          reduction in the group works with any power of two.
 */
+
+typedef enum {
+    PAR_MIN,
+    PAR_MAX,
+    PAR_ARGMIN,
+    PAR_ARGMAX
+} ParOp;
+
+static const char* opNames[] = {"min", "max", "argmin", "argmax"};
+
+// One device and its share of the input
+typedef struct {
+    cl_device_id device;
+    char name[128];
+    cl_context context;
+    cl_command_queue queue;
+    cl_program program;
+    cl_kernel kernel;
+    int atomic;             // whether the groups combine into one result
+    size_t localSize;
+    size_t maxGroups;
+    size_t keySize;         // 4 for min and max, 8 for argmin and argmax
+
+    cl_mem src;
+    size_t capacity;        // values src holds
+    cl_mem result;
+    void* identities;       // maxGroups identity keys to reset result with
+    void* keys;             // the device's result, read back
+    size_t numKeys;
+
+    cl_uint first;          // its share of the input
+    cl_uint count;
+    double throughput;      // values per second, measured
+} ParMinDevice;
+
 void loadProgramSource(const char** files,
                        size_t length,
                        char** buffer,
@@ -27,7 +76,7 @@ void loadProgramSource(const char** files,
 	      FILE* file = fopen(files[i], "r");
 	      if(file == NULL) {
 	         perror("Couldn't read the program file");
-	         exit(1);   
+	         exit(1);
 	      }
 	      fseek(file, 0, SEEK_END);
 	      sizes[i] = ftell(file);
@@ -39,124 +88,367 @@ void loadProgramSource(const char** files,
 	   }
 }
 
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static cl_ulong keyIdentity(ParOp op) {
+    switch(op) {
+        case PAR_MIN:    return UINT32_MAX;
+        case PAR_ARGMIN: return UINT64_MAX;
+        default:         return 0;
+    }
+}
+
+// The keys combine like the kernel's: the smaller for min and argmin,
+// the larger for max and argmax
+static cl_ulong keyCombine(ParOp op, cl_ulong a, cl_ulong b) {
+    if(op == PAR_MIN || op == PAR_ARGMIN) return b < a ? b : a;
+    return b > a ? b : a;
+}
+
+static cl_ulong keyAt(const void* keys, size_t i, size_t keySize) {
+    return keySize == 4 ? ((const cl_uint*)keys)[i] : ((const cl_ulong*)keys)[i];
+}
+
+static void keySet(void* keys, size_t i, size_t keySize, cl_ulong key) {
+    if(keySize == 4) ((cl_uint*)keys)[i] = (cl_uint)key;
+    else ((cl_ulong*)keys)[i] = key;
+}
+
+// The value and index a key holds; the index is n for min and max, or
+// if there were no values
+static void keyDecode(ParOp op, cl_ulong key, cl_uint n, cl_uint* value, cl_uint* index) {
+    switch(op) {
+        case PAR_MIN:
+        case PAR_MAX:    *value = (cl_uint)key; *index = n; break;
+        case PAR_ARGMIN: *value = (cl_uint)(key >> 32); *index = (cl_uint)key; break;
+        default:         *value = (cl_uint)(key >> 32); *index = ~(cl_uint)key; break;
+    }
+    if(*index > n) *index = n;
+}
+
+// ****************************************************************************
+// Function: parMinSetup
+//
+// Purpose:
+//   Builds the kernel for op on one device, in a context of its own so
+//   devices of different platforms can be mixed.  The groups combine
+//   their results with atomics where the device has them for the key
+//   size; argmin and argmax need 64-bit ones.
+//
+// Arguments:
+//   d: the device's state, filled in
+//   device: the device
+//   source: par_min.cl
+//   size: its length
+//   op: the operator
+//
+// Returns:  nothing; exits on any failure
+// ****************************************************************************
+static void parMinSetup(ParMinDevice* d, cl_device_id device, const char* source, size_t size, ParOp op) {
+    cl_int error;
+    memset(d, 0, sizeof(*d));
+    d->device = device;
+    clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(d->name), d->name, NULL);
+
+    d->context = clCreateContext(NULL, 1, &device, NULL, NULL, &error);
+    if(error != CL_SUCCESS) {
+        perror("Can't create a valid OpenCL context");
+        exit(1);
+    }
+    d->queue = clCreateCommandQueue(d->context, device, 0, &error);
+    if(error != CL_SUCCESS) {
+        perror("Unable to create command-queue");
+        exit(1);
+    }
+
+    size_t extensionsSize = 0;
+    clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, 0, NULL, &extensionsSize);
+    char* extensions = (char*) alloca(extensionsSize + 1);
+    extensions[extensionsSize] = '\0';
+    clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, extensionsSize, extensions, NULL);
+    d->keySize = op == PAR_MIN || op == PAR_MAX ? sizeof(cl_uint) : sizeof(cl_ulong);
+    d->atomic = d->keySize == sizeof(cl_uint) || strstr(extensions, "cl_khr_int64_extended_atomics") != NULL;
+
+    d->program = clCreateProgramWithSource(d->context, 1, &source, &size, &error);
+    if(error != CL_SUCCESS) {
+        perror("Can't create the OpenCL program object");
+        exit(1);
+    }
+    char options[64];
+    sprintf(options, "-DPAR_OP=%d%s", (int)op, d->atomic && d->keySize == sizeof(cl_ulong) ? " -DPAR_MIN_ATOM64" : "");
+#ifdef DEBUG
+    printf("Building for %s with %s\n", d->name, options);
+#endif
+    error = clBuildProgram(d->program, 1, &device, options, NULL, NULL);
+    if(error != CL_SUCCESS) {
+        // If there's an error whilst building the program, dump the log
+        size_t logSize;
+        clGetProgramBuildInfo(d->program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &logSize);
+        char* log = (char*) malloc(logSize + 1);
+        log[logSize] = '\0';
+        clGetProgramBuildInfo(d->program, device, CL_PROGRAM_BUILD_LOG, logSize + 1, log, NULL);
+        printf("\n=== ERROR ===\n\n%s\n=============\n", log);
+        free(log);
+        exit(1);
+    }
+    d->kernel = clCreateKernel(d->program, "par_min", &error);
+    if(error != CL_SUCCESS) {
+        perror("Unable to create the kernel");
+        exit(1);
+    }
+
+    // The largest power of two the kernel allows, for the tree in the group
+    size_t kernelGroupSize;
+    cl_uint computeUnits;
+    clGetKernelWorkGroupInfo(d->kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(kernelGroupSize), &kernelGroupSize, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(computeUnits), &computeUnits, NULL);
+    d->localSize = 1;
+    while(d->localSize * 2 <= kernelGroupSize && d->localSize * 2 <= MAX_GROUP_SIZE) d->localSize *= 2;
+    d->maxGroups = computeUnits * GROUPS_PER_UNIT;
+
+    d->identities = malloc(d->maxGroups * d->keySize);
+    d->keys = malloc(d->maxGroups * d->keySize);
+    for(size_t g = 0; g < d->maxGroups; g++) keySet(d->identities, g, d->keySize, keyIdentity(op));
+    d->result = clCreateBuffer(d->context, CL_MEM_READ_WRITE, d->maxGroups * d->keySize, NULL, &error);
+    if(error != CL_SUCCESS) {
+        perror("Can't create a buffer");
+        exit(1);
+    }
+}
+
+// Enqueues count values from values + first to the device and its
+// reduction of them, and the read of its result, without waiting; the
+// groups are as many as the values keep busy, up to maxGroups
+static void parMinEnqueue(ParMinDevice* d, const cl_uint* values, cl_uint first, cl_uint count) {
+    cl_int error;
+    d->numKeys = 0;
+    if(count == 0) return;
+    if(count > d->capacity) {
+        if(d->src) clReleaseMemObject(d->src);
+        d->src = clCreateBuffer(d->context, CL_MEM_READ_ONLY, count * sizeof(cl_uint), NULL, &error);
+        if(error != CL_SUCCESS) {
+            perror("Can't create a buffer");
+            exit(1);
+        }
+        d->capacity = count;
+    }
+
+    size_t perGroup = d->localSize * 4;
+    size_t numGroups = (count + perGroup - 1) / perGroup;
+    if(numGroups > d->maxGroups) numGroups = d->maxGroups;
+    size_t globalSize = numGroups * d->localSize;
+    d->numKeys = d->atomic ? 1 : numGroups;
+
+    error = clEnqueueWriteBuffer(d->queue, d->src, CL_FALSE, 0, count * sizeof(cl_uint), values + first, 0, NULL, NULL);
+    error |= clEnqueueWriteBuffer(d->queue, d->result, CL_FALSE, 0, d->numKeys * d->keySize, d->identities, 0, NULL, NULL);
+    error |= clSetKernelArg(d->kernel, 0, sizeof(cl_mem), &d->src);
+    error |= clSetKernelArg(d->kernel, 1, sizeof(cl_uint), &count);
+    error |= clSetKernelArg(d->kernel, 2, sizeof(cl_uint), &first);
+    error |= clSetKernelArg(d->kernel, 3, d->localSize * d->keySize, NULL);
+    error |= clSetKernelArg(d->kernel, 4, sizeof(cl_mem), &d->result);
+    error |= clEnqueueNDRangeKernel(d->queue, d->kernel, 1, NULL, &globalSize, &d->localSize, 0, NULL, NULL);
+    error |= clEnqueueReadBuffer(d->queue, d->result, CL_FALSE, 0, d->numKeys * d->keySize, d->keys, 0, NULL, NULL);
+    if(error != CL_SUCCESS) {
+        perror("Unable to enqueue task to command-queue");
+        exit(1);
+    }
+    clFlush(d->queue);
+}
+
+// Waits for the device and folds its result
+static cl_ulong parMinFinish(ParMinDevice* d, ParOp op) {
+    clFinish(d->queue);
+    cl_ulong key = keyIdentity(op);
+    for(size_t g = 0; g < d->numKeys; g++)
+        key = keyCombine(op, key, keyAt(d->keys, g, d->keySize));
+    return key;
+}
+
+// ****************************************************************************
+// Function: parMinMeasure
+//
+// Purpose:
+//   Times every device alone on the same probe of the input, the copy to
+//   the device included, as it is part of every run, averaged over RUNS
+//   runs after one run to warm it up.
+//
+// Arguments:
+//   devices: the devices, their throughput filled in
+//   numDevices: number of devices
+//   values: the input
+//   probe: number of values to time on
+//   op: the operator
+//
+// Returns:  nothing
+// ****************************************************************************
+static void parMinMeasure(ParMinDevice* devices, int numDevices, const cl_uint* values, cl_uint probe, ParOp op) {
+    for(int i = 0; i < numDevices; i++) {
+        parMinEnqueue(&devices[i], values, 0, probe);
+        parMinFinish(&devices[i], op);
+        double start = now();
+        for(int run = 0; run < RUNS; run++) {
+            parMinEnqueue(&devices[i], values, 0, probe);
+            parMinFinish(&devices[i], op);
+        }
+        double seconds = (now() - start) / RUNS;
+        devices[i].throughput = probe / (seconds > 1e-9 ? seconds : 1e-9);
+    }
+}
+
+// Splits n values among the devices in proportion to their throughput,
+// at multiples of 4 so only the last share has values beyond its last
+// whole uint4
+static void parMinSplit(ParMinDevice* devices, int numDevices, cl_uint n) {
+    double total = 0;
+    for(int i = 0; i < numDevices; i++) total += devices[i].throughput;
+    double before = 0;
+    cl_uint first = 0;
+    for(int i = 0; i < numDevices; i++) {
+        before += devices[i].throughput;
+        cl_uint last = i == numDevices - 1 ? n : (cl_uint)(n * (before / total)) & ~3u;
+        if(last < first) last = first;
+        devices[i].first = first;
+        devices[i].count = last - first;
+        first = last;
+    }
+}
+
+// ****************************************************************************
+// Function: parMinMulti
+//
+// Purpose:
+//   Reduces n values by op on all devices at once, each on its share
+//   from parMinSplit: all copies and kernels are enqueued before waiting
+//   for any, then the devices' results are combined.
+//
+// Returns:  the key of the result; see keyDecode
+// ****************************************************************************
+static cl_ulong parMinMulti(ParMinDevice* devices, int numDevices, const cl_uint* values, ParOp op) {
+    for(int i = 0; i < numDevices; i++)
+        parMinEnqueue(&devices[i], values, devices[i].first, devices[i].count);
+    cl_ulong key = keyIdentity(op);
+    for(int i = 0; i < numDevices; i++)
+        key = keyCombine(op, key, parMinFinish(&devices[i], op));
+    return key;
+}
+
+static void parMinRelease(ParMinDevice* d) {
+    if(d->src) clReleaseMemObject(d->src);
+    clReleaseMemObject(d->result);
+    clReleaseKernel(d->kernel);
+    clReleaseProgram(d->program);
+    clReleaseCommandQueue(d->queue);
+    clReleaseContext(d->context);
+    free(d->identities);
+    free(d->keys);
+}
 
 int main(int argc, char** argv) {
-  cl_platform_id platform;
-  int dev;
-  cl_device_type devs[NDEVS] = { CL_DEVICE_TYPE_CPU, CL_DEVICE_TYPE_GPU };
-
-  cl_uint *src_ptr;
-  unsigned int numOfItems = DATA_SIZE;
-
-  src_ptr = (cl_uint*) malloc( numOfItems * sizeof(cl_uint));
-  cl_uint min = (cl_uint) -1;
-
-  for( int i = 0; i < numOfItems; ++i) {
-    src_ptr[i] = (cl_uint) i;
-    min = src_ptr[i] < min? src_ptr[i] : min;
-  }
-
-  // Get the supported platforms
-  clGetPlatformIDs(1, &platform, NULL);
-  for( dev = 0; dev < NDEVS; dev++ ) { 
-    cl_device_id     device;
-    cl_context       context;
-    cl_command_queue cQ;
-    cl_program       program;
-    cl_kernel        paraMin;
-    cl_kernel        reduce;
-
-    cl_mem           src_buffer;
-    cl_mem           dst_buffer;
-    
-    cl_uint          *dst_ptr;
-    
-    clGetDeviceIDs(platform, devs[dev], 1, &device, NULL);
-
-    cl_uint compute_units;
-    size_t  global_work_size;
-    size_t  local_work_size;
-    size_t  num_groups;
-
-    size_t  paramSize = 0;
-    clGetDeviceInfo( device, CL_DEVICE_MAX_COMPUTE_UNITS, 0, NULL, &paramSize );
-    cl_uint* ret = (cl_uint*) alloca(sizeof(cl_uint) * paramSize);
-    clGetDeviceInfo( device, CL_DEVICE_MAX_COMPUTE_UNITS, paramSize, ret, NULL);
-    compute_units = *ret;
-
-    // Since the CPU doesn't permit parallel executing threads per core
-    // hence we assign 1 thread to per core
-    if (devs[dev] == CL_DEVICE_TYPE_CPU ) {
-      global_work_size = compute_units * 1; // 1 thread per core
-      local_work_size = 1;
-    } else {
-      cl_uint ws = 64; // represents the warp (NVIDIA) or wavefront (ATI)
-      global_work_size = compute_units * ws;
-      while( (numOfItems / 4) % global_work_size != 0 ) global_work_size += ws;
-
-      local_work_size = ws;
-    }
-    num_groups = global_work_size / local_work_size;
-
-    context  = clCreateContext(NULL, 1, &device, NULL, NULL, NULL);
-    cQ       = clCreateCommandQueue(context, device, 0, NULL);
-    if (cQ == NULL ) { 
-      printf("Cannot create device, darn...exiting...\n");
-      exit(-1);
+    /* OpenCL 1.1 data structures */
+    cl_platform_id* platforms;
+    cl_uint numOfPlatforms;
+    cl_int  error;
+
+    // [n] [op]: op is min, max, argmin or argmax of n random uints
+    cl_uint numOfItems = DATA_SIZE;
+    ParOp op = PAR_MIN;
+    if(argc > 1) {
+        unsigned long n = strtoul(argv[1], NULL, 10);
+        // Indices must fit a uint and leave UINT_MAX for none
+        numOfItems = n == 0 ? 1 : n >= UINT32_MAX ? UINT32_MAX - 1 : (cl_uint)n;
+    }
+    if(argc > 2) {
+        for(int o = 0; o <= PAR_ARGMAX; o++)
+            if(strcmp(argv[2], opNames[o]) == 0) op = (ParOp)o;
     }
+
+    cl_uint* src_ptr = (cl_uint*) malloc(numOfItems * sizeof(cl_uint));
+    for(cl_uint i = 0; i < numOfItems; ++i)
+        src_ptr[i] = ((cl_uint)rand() << 16) ^ (cl_uint)rand();
+
+    // The expected result, by a serial scan on the host
+    cl_uint expectedValue = src_ptr[0], expectedIndex = 0;
+    for(cl_uint i = 1; i < numOfItems; ++i) {
+        if(op == PAR_MIN || op == PAR_ARGMIN ? src_ptr[i] < expectedValue : src_ptr[i] > expectedValue) {
+            expectedValue = src_ptr[i];
+            expectedIndex = i;
+        }
+    }
+    if(op == PAR_MIN || op == PAR_MAX) expectedIndex = numOfItems;
+
+    //Get the number of platforms
+    //Remember that for each vendor's SDK installed on the computer,
+    //the number of available platform also increased.
+    error = clGetPlatformIDs(0, NULL, &numOfPlatforms);
+    if(error != CL_SUCCESS) {
+        perror("Unable to find any OpenCL platforms");
+        exit(1);
+    }
+    platforms = (cl_platform_id*) alloca(sizeof(cl_platform_id) * numOfPlatforms);
+    printf("Number of OpenCL platforms found: %d\n", numOfPlatforms);
+    error = clGetPlatformIDs(numOfPlatforms, platforms, NULL);
+    if(error != CL_SUCCESS) {
+        perror("Unable to find any OpenCL platforms");
+        exit(1);
+    }
+
     const char* files[1] = {"par_min.cl"};
     const int NUMBER_OF_FILES = 1;
     char* programSource[NUMBER_OF_FILES];
     size_t sizes[NUMBER_OF_FILES];
     loadProgramSource(files, NUMBER_OF_FILES, programSource, sizes);
-    program  = clCreateProgramWithSource(context, 1, (const char**)programSource, NULL, NULL);
-    clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-
-    paraMin  = clCreateKernel(program, "par_min", NULL);
-    reduce   = clCreateKernel(program, "reduce" , NULL);
-
-    printf("Kernels created!");
-
-    // Prepare memory data structures
-    src_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, 
-                                numOfItems * sizeof(cl_uint),
-                                src_ptr, NULL);
-    dst_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, global_work_size * sizeof(cl_uint),
-                                NULL, NULL);
-    dst_ptr = (cl_uint*) malloc(numOfItems * sizeof(cl_uint));
-
-    // Set the necessary arguments to kernel's parameters
-    clSetKernelArg(paraMin, 0, sizeof(cl_mem),     &src_buffer);
-    clSetKernelArg(paraMin, 1, sizeof(cl_mem),     &dst_buffer);
-    clSetKernelArg(paraMin, 2, sizeof(cl_mem),     NULL);
-    clSetKernelArg(paraMin, 3, sizeof(numOfItems), &numOfItems);
-    clSetKernelArg(paraMin, 4, sizeof(dev),        &dev);
-    
-    clSetKernelArg(reduce, 0, sizeof(cl_mem),      &src_buffer);
-    clSetKernelArg(reduce, 0, sizeof(cl_mem),      &dst_buffer);
-
-    // Using events to manage execution dependency
-    // so the kernel 'reduce' runs after 'paraMin'
-    cl_event waitForParaMinToComplete;
-    clEnqueueNDRangeKernel(cQ, paraMin, 1, NULL, &global_work_size, &local_work_size, 0, NULL, &waitForParaMinToComplete);
-    clEnqueueNDRangeKernel(cQ, reduce , 1, NULL, &num_groups, NULL, 1, &waitForParaMinToComplete, NULL);
-
-    clFinish(cQ);
-
-    clEnqueueReadBuffer(cQ, dst_buffer, CL_TRUE, 0, num_groups *sizeof(cl_uint),dst_ptr , 0, NULL, NULL);
-
-    printf("computed min=%d, local min=%d\n", dst_ptr[0], min);
-    if(dst_ptr[0] == min)
-      printf("Check has passed!\n");
-    else
-      printf("Check has failed!\n");
 
-    clReleaseMemObject(dst_buffer);
-    clReleaseProgram(program);
-    clReleaseCommandQueue(cQ);
-    free(dst_ptr);
-  }
+    // Every device of every platform, CPUs and GPUs alike
+    ParMinDevice devices[MAX_DEVICES];
+    int numDevices = 0;
+    for(cl_uint i = 0; i < numOfPlatforms; i++) {
+        cl_uint numOfDevices = 0;
+        cl_device_id ids[MAX_DEVICES];
+        if(clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_ALL, MAX_DEVICES, ids, &numOfDevices) != CL_SUCCESS) continue;
+        if(numOfDevices > MAX_DEVICES) numOfDevices = MAX_DEVICES;
+        for(cl_uint j = 0; j < numOfDevices && numDevices < MAX_DEVICES; j++)
+            parMinSetup(&devices[numDevices++], ids[j], programSource[0], sizes[0], op);
+    }
+    if(numDevices == 0) {
+        perror("Can't locate any OpenCL compliant device");
+        exit(1);
+    }
+
+    parMinMeasure(devices, numDevices, src_ptr, numOfItems < PROBE_SIZE ? numOfItems : PROBE_SIZE, op);
+    parMinSplit(devices, numDevices, numOfItems);
+    printf("elementCount: %u, op: %s\n", numOfItems, opNames[op]);
+    for(int i = 0; i < numDevices; i++) {
+        printf("Device %d: %s, %.2f Mvalues/s alone, %u values from %u, %zu x %zu work-items%s\n",
+               i, devices[i].name, devices[i].throughput * 1e-6, devices[i].count, devices[i].first,
+               devices[i].maxGroups, devices[i].localSize, devices[i].atomic ? "" : ", results per group");
+    }
 
-  free(src_ptr);
-}
+    cl_uint value, index;
+    keyDecode(op, parMinMulti(devices, numDevices, src_ptr, op), numOfItems, &value, &index);
+
+    double start = now();
+    for(int run = 0; run < RUNS; run++)
+        parMinMulti(devices, numDevices, src_ptr, op);
+    double seconds = (now() - start) / RUNS;
 
+    if(op == PAR_MIN || op == PAR_MAX)
+        printf("computed %s=%u, host %s=%u\n", opNames[op], value, opNames[op], expectedValue);
+    else
+        printf("computed %s=%u (value %u), host %s=%u (value %u)\n",
+               opNames[op], index, value, opNames[op], expectedIndex, expectedValue);
+    printf("All devices: %.3f ms, %.2f Mvalues/s, %.2f GB/s\n",
+           seconds * 1e3, numOfItems / seconds * 1e-6, numOfItems * sizeof(cl_uint) / seconds * 1e-9);
+    if(value == expectedValue && index == expectedIndex)
+        printf("Check has passed!\n");
+    else
+        printf("Check has failed!\n");
+
+    for(int i = 0; i < numDevices; i++) parMinRelease(&devices[i]);
+    for(int j = 0; j < NUMBER_OF_FILES; j++) free(programSource[j]);
+    free(src_ptr);
+    return 0;
+}
@@ -2,6 +2,9 @@
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
+#include "spmv_cpu.h"
+#include "program_cache.h"
 
 #ifdef __APPLE_ 
 #include <OpenCL/opencl.h>
@@ -11,13 +14,58 @@
 
 extern const char *cl_source_spmv;
 typedef int bool;
-#define MAX_RELATIVE_ERROR 1e-10
+// Largest normwise relative error accepted from the single precision
+// kernels against the double accumulated reference of spmvCpu; summing
+// a row in another order costs a few ulps of float, about 1e-7
+#define MAX_RELATIVE_ERROR 1e-5
+
+// Cost model of the auto format selection, in units of one coalesced
+// read per non-zero.  A work-item walking its own row (CSR scalar, merge
+// path) reads val and cols uncoalesced; the vector kernel pays for a
+// local memory reduction per row; ELLPACK-R is ruled out when padding
+// would blow up its storage.
+static const double UNCOALESCED_PENALTY = 3.0;
+static const double VECTOR_REDUCTION_COST = 8.0;
+static const double MERGE_PATH_COST = 2.0;
+static const double SELL_PERMUTATION_COST = 0.1;
+static const double ELL_MAX_PAD_RATIO = 8.0;
+
+// Largest normwise relative error accepted from the mixed precision
+// kernels; half storage alone contributes about 5e-4
+static const double MIXED_MAX_RELATIVE_ERROR = 1e-2;
+
+// Work-groups per compute unit the auto mode aims for when shrinking the
+// work-group size on small matrices
+static const int AUTO_GROUPS_PER_CU = 4;
+
+// Iterations per kernel while the auto mode probes candidate formats,
+// 0 outside of a probe
+static int probeIterations = 0;
+
+// Kernels selectable in csrTest
+#define CSR_KERNEL_SCALAR 1
+#define CSR_KERNEL_VECTOR 2
+
+// Number of timed passes and iterations per pass of a test; a probe runs
+// a single short pass
+int testPasses(OptionParser &op)
+{
+    return probeIterations ? 1 : op.getOptionInt("passes");
+}
+
+int testIterations(OptionParser &op)
+{
+    return probeIterations ? probeIterations : op.getOptionInt("iterations");
+}
 
 // ****************************************************************************
 // Function: spmvCpu
 //
 // Purpose: 
-//   Runs sparse matrix vector multiplication on the CPU 
+//   Runs sparse matrix vector multiplication on the CPU, one row after
+//   the other with a double accumulator.  It is the reference every
+//   device kernel and the CPU engine of spmv_cpu.h are checked against,
+//   so it is kept plain and shares no code with them.
 //
 // Arguements: 
 //   val: array holding the non-zero values for the matrix
@@ -37,17 +85,15 @@ typedef int bool;
 void spmvCpu(const float*val, const int *cols, const int *rowDelimiters, 
 	     const float*vec, int dim, float*out) 
 {
-
     for (int i=0; i<dim; i++) {
-        float t = 0; 
+        double t = 0; 
         for (int j=rowDelimiters[i]; j<rowDelimiters[i+1]; j++) 
         {
             int col = cols[j]; 
-            t += val[j] * vec[col];
+            t += (double) val[j] * vec[col];
         }    
-        out[i] = t; 
+        out[i] = (float) t; 
     }
-
 }
 
 // ****************************************************************************
@@ -64,18 +110,26 @@ void spmvCpu(const float*val, const int *cols, const int *rowDelimiters,
 // 
 // Returns:
 //   nothing
-//   prints "Passed" if the vectors agree within a relative error of
-//   MAX_RELATIVE_ERROR and "FAILED" if they are different
+//   prints "Passed" if the vectors agree within a normwise relative
+//   error of MAX_RELATIVE_ERROR, the largest difference over the largest
+//   reference value, and "FAILED" if they are different
 // ****************************************************************************
 bool verifyResults(const float *cpuResults, const float *gpuResults, 
                    const int size, const int pass) 
 {
 
+    double refNorm = 0.0;
+    for (int i=0; i<size; i++) 
+    {
+        if (fabs(cpuResults[i]) > refNorm) refNorm = fabs(cpuResults[i]);
+    }
+
     bool passed = 1; 
     for (int i=0; i<size; i++) 
     {
-        if (fabs(cpuResults[i] - gpuResults[i]) / cpuResults[i] 
-            > MAX_RELATIVE_ERROR) 
+        double d = fabs((double) cpuResults[i] - gpuResults[i]);
+        double relErr = (refNorm > 0.0) ? d / refNorm : d;
+        if (!(relErr <= MAX_RELATIVE_ERROR))   // catches nan
         {
 #ifdef DEBUG_VERBOSE
            printf("Mismatch at i: %d, ref: %f, dev: %f\n", i, cpuResults[i], gpuResults[i]);
@@ -95,6 +149,73 @@ bool verifyResults(const float *cpuResults, const float *gpuResults,
     return passed;
 }
 
+// ****************************************************************************
+// Function: cpuTest
+//
+// Purpose: 
+//   Times the multithreaded CPU engine on the same matrix as the device
+//   kernels, giving the CPU baseline they are compared against.  One
+//   pool serves every pass, and each pass is checked against the scalar
+//   spmvCpu result.
+//
+// Arguements: 
+//   resultDB: result database to store results
+//   op: provides access to command line options
+//   h_val: array holding the non-zero values for the matrix
+//   h_cols: array of column indices for each element of A
+//   h_rowDelimiters: array of size dim+1 holding indices to rows of A; 
+//                  last element is the index one past the last
+//                  element of A
+//   h_vec: dense vector of size dim to be used for multiplication
+//   h_out: input - buffer for result of calculation
+//   numRows: number of rows in matrix
+//   numNonZeroes: number of entries in matrix
+//   refOut: solution computed on cpu
+// ****************************************************************************
+void cpuTest(ResultDatabase& resultDB, OptionParser& op, float* h_val, 
+             int* h_cols, int* h_rowDelimiters, float* h_vec, float* h_out,
+             int numRows, int numNonZeroes, float* refOut)
+{
+    struct CpuSpmvEngine engine;
+    cpuSpmvCreate(&engine, h_rowDelimiters, numRows, 
+                  op.getOptionInt("cpu_threads"), -1);
+
+    int passes = testPasses(op);
+    int iters  = testIterations(op);
+
+    char atts[TEMP_BUFFER_SIZE];
+    sprintf(atts, "%d_elements_%d_rows_%d_threads", numNonZeroes, numRows,
+            engine.numThreads);
+    string testName = string("CPU-CSR-") + CPU_SPMV_ISA_NAMES[engine.isa] +
+        ((sizeof(float) == sizeof(double)) ? "-DP" : "-SP");
+    double gflop = 2 * (double) numNonZeroes;
+
+    // warm up the caches and the pool threads
+    cpuSpmvRun(&engine, h_val, h_cols, h_rowDelimiters, h_vec, h_out);
+
+    for (int k = 0; k < passes; k++)
+    {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int j = 0; j < iters; j++)
+        {
+            cpuSpmvRun(&engine, h_val, h_cols, h_rowDelimiters, h_vec, 
+                       h_out);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double totalTime = (end.tv_sec - start.tv_sec) * 1e9 + 
+                           (end.tv_nsec - start.tv_nsec);
+
+        if (! verifyResults(refOut, h_out, numRows, k)) {
+            break;  // If results don't match, don't report performance
+        }
+        double avgTime = totalTime / (double)iters;
+        resultDB.AddResult(testName, atts, "Gflop/s", gflop/avgTime);
+    }
+
+    cpuSpmvDestroy(&engine);
+}
+
 // ****************************************************************************
 // Function: ellPackTest
 //
@@ -121,16 +242,20 @@ bool verifyResults(const float *cpuResults, const float *gpuResults,
 //   refOut: solution computed on cpu
 //   padded: whether using padding or not
 //   paddedSize: size of matrix when padded
+//   localSize: work-group size of the kernel
+//
+// Returns:  Gflop/s of the last verified pass, 0 on failure
 // 
 // Programmer: Lukasz Wesolowski
 // Creation: June 23, 2010
 // ****************************************************************************
-void ellPackTest(cl_device_id dev, cl_context ctx, string compileFlags, 
+double ellPackTest(cl_device_id dev, cl_context ctx, string compileFlags, 
                  cl_command_queue queue, ResultDatabase& resultDB, 
                  OptionParser& op, float* h_val, int* h_cols, 
                  int* h_rowDelimiters, float* h_vec, float* h_out,
                  int numRows, int numNonZeroes, float* refOut, bool padded,
-                 int paddedSize, const size_t maxImgWidth, bool devSupportsImages)
+                 int paddedSize, const size_t maxImgWidth, bool devSupportsImages,
+                 size_t localSize = BLOCK_SIZE)
 {
     if (devSupportsImages) 
     {
@@ -139,28 +264,15 @@ void ellPackTest(cl_device_id dev, cl_context ctx, string compileFlags,
         compileFlags+=string(texflags);
     }
     
-    // Set up OpenCL Program Object
     int err = 0; 
-    cl_program prog = clCreateProgramWithSource(ctx, 1, &cl_source_spmv, NULL,
-            &err);
-    CL_CHECK_ERROR(err);
 
-    // Build the openCL kernels
-    err = clBuildProgram(prog, 1, &dev, compileFlags.c_str(), NULL, NULL);
-    CL_CHECK_ERROR(err);
-    
-    // If there is a build error, print the output and return
-    if (err != CL_SUCCESS)
+    // Build the openCL kernels, or reuse an earlier build
+    cl_program prog = programCacheGet(ctx, dev, cl_source_spmv, compileFlags,
+            op.getOptionString("program_cache_dir"), resultDB);
+    if (prog == NULL)
     {
-        char log[5000];
-        size_t retsize = 0;
-        err = clGetProgramBuildInfo(prog, dev, CL_PROGRAM_BUILD_LOG, 50000
-                * sizeof(char), log, &retsize);
-        CL_CHECK_ERROR(err);
-        cout << "Retsize: " << retsize << endl;
-        cout << "Log: " << log << endl;
-        return;
-    }  
+        return 0.0;
+    }
    
     int *h_rowLengths = new int[paddedSize];
     int maxrl = 0;
@@ -279,12 +391,14 @@ void ellPackTest(cl_device_id dev, cl_context ctx, string compileFlags,
     err = clSetKernelArg(ellpackr, 5, sizeof(cl_mem), (void*) &d_out);
     CL_CHECK_ERROR(err);
 
-    const size_t globalWorkSize = cmSize;
-    const size_t localWorkSize = BLOCK_SIZE;
+    const size_t localWorkSize = localSize;
+    const size_t globalWorkSize = ((cmSize + localSize - 1) / localSize) *
+        localSize;
     Event kernelExec("ELLPACKR Kernel Execution");
+    double rate = 0.0;
 
-    int passes = op.getOptionInt("passes");
-    int iters  = op.getOptionInt("iterations");
+    int passes = testPasses(op);
+    int iters  = testIterations(op);
     
     for (int k = 0; k < passes; k++)
     {
@@ -312,7 +426,7 @@ void ellPackTest(cl_device_id dev, cl_context ctx, string compileFlags,
          
         // Compare reference solution to GPU result
         if (! verifyResults(refOut, h_out, numRows, k)) {
-            return;
+            break;  // If results don't match, don't report performance
         }
         char atts[TEMP_BUFFER_SIZE];
         char benchName[TEMP_BUFFER_SIZE];
@@ -323,6 +437,7 @@ void ellPackTest(cl_device_id dev, cl_context ctx, string compileFlags,
         sprintf(benchName, "%sELLPACKR-%s", padded ? "Padded_":"",
                 dpTest ? "DP":"SP");
         resultDB.AddResult(benchName, atts, "Gflop/s", gflop/avgTime);
+        rate = gflop/avgTime;
         sprintf(benchName, "%s_PCIe", benchName);
         resultDB.AddResult(benchName, atts, "Gflop/s", gflop / 
             (avgTime + iTransferTime + oTransferTime));   
@@ -347,18 +462,20 @@ void ellPackTest(cl_device_id dev, cl_context ctx, string compileFlags,
 
     // Free host memory
     delete[] h_rowLengths, h_valcm, h_colscm;
+    return rate;
 }
 // ****************************************************************************
-// Function: csrTest
+// Function: sellTest
 //
 // Purpose: 
-//   Runs sparse matrix vector multiplication on the device using the compressed
-//   sparse row format
+//   Runs sparse matrix vector multiplication on the device using the
+//   SELL-C-sigma data format, and reports how much padding it stores
+//   compared to ELLPACK-R
 //
 // Arguements: 
 //   dev: opencl device id
 //   ctx: current opencl context
-//   copmilerFlags: flags to use when compiling ellpackr kernel
+//   compileFlags: flags to use when compiling the sell kernel
 //   queue: the current opencl command queue
 //   resultDB: result database to store results
 //   op: provides access to command line options
@@ -369,196 +486,683 @@ void ellPackTest(cl_device_id dev, cl_context ctx, string compileFlags,
 //                  element of A
 //   h_vec: dense vector of size dim to be used for multiplication
 //   h_out: input - buffer for result of calculation
-//   numRows: number of rows in amtrix
+//   numRows: number of rows in matrix
 //   numNonZeroes: number of entries in matrix
 //   refOut: solution computed on cpu
-//   padded: whether using padding or not
-// 
-// Programmer: Lukasz Wesolowski
-// Creation: June 23, 2010
+//   localSize: work-group size of the kernel
+//
+// Returns:  Gflop/s of the last verified pass, 0 on failure
 // ****************************************************************************
-void csrTest(cl_device_id dev, cl_context ctx, string compileFlags, 
-             cl_command_queue queue, ResultDatabase& resultDB, OptionParser& op,
-             float* h_val, int* h_cols, int* h_rowDelimiters, 
-             float* h_vec, float* h_out, int numRows, int numNonZeroes, 
-             float* refOut, bool padded, const size_t maxImgWidth, bool devSupportsImages)
+double sellTest(cl_device_id dev, cl_context ctx, string compileFlags, 
+              cl_command_queue queue, ResultDatabase& resultDB, 
+              OptionParser& op, float* h_val, int* h_cols, 
+              int* h_rowDelimiters, float* h_vec, float* h_out,
+              int numRows, int numNonZeroes, float* refOut,
+              size_t localSize = BLOCK_SIZE)
 {
-    if (devSupportsImages) 
+    int err = 0; 
+
+    // Build the openCL kernels, or reuse an earlier build
+    cl_program prog = programCacheGet(ctx, dev, cl_source_spmv, compileFlags,
+            op.getOptionString("program_cache_dir"), resultDB);
+    if (prog == NULL)
     {
-        char texflags[64];
-        sprintf(texflags," -DUSE_TEXTURE -DMAX_IMG_WIDTH=%ld", maxImgWidth);
-        compileFlags+=string(texflags);
+        return 0.0;
     }
-    // Set up OpenCL Program Object
-    int err = 0; 
 
-    cl_program prog = clCreateProgramWithSource(ctx, 1, &cl_source_spmv, NULL,
-            &err);
-    CL_CHECK_ERROR(err);
+    int sliceHeight = op.getOptionInt("sell_c");
+    int sortWindow = op.getOptionInt("sell_sigma");
 
-    // Build the openCL kernels
-    err = clBuildProgram(prog, 1, &dev, compileFlags.c_str(), NULL, NULL);
-    // CL_CHECK_ERROR(err);  // if we check and fail here, we never get to see
-                            // the OpenCL compiler's build log
+    // SELL-C-sigma host data structures
+    float *h_valSell;
+    int *h_colsSell, *h_sliceStart, *h_rowLengths, *h_rowPerm;
+    int numSlices, sellSize;
+    convertToSellCSigma(h_val, h_cols, numRows, h_rowDelimiters, sliceHeight,
+                        sortWindow, &h_valSell, &h_colsSell, &h_sliceStart,
+                        &h_rowLengths, &h_rowPerm, &numSlices, &sellSize);
 
-    // If there is a build error, print the output and return
-    if (err != CL_SUCCESS)
+    // Padding that ELLPACK-R would store for the same matrix
+    int maxrl = 0;
+    for (int k=0; k<numRows; k++)
     {
-        char log[5000];
-        size_t retsize = 0;
-        err = clGetProgramBuildInfo(prog, dev, CL_PROGRAM_BUILD_LOG, 5000
-                * sizeof(char), log, &retsize);
-        CL_CHECK_ERROR(err);
-        cout << "Retsize: " << retsize << endl;
-        cout << "Log: " << log << endl;
-        return;
+        if (h_rowDelimiters[k+1] - h_rowDelimiters[k] > maxrl)
+        {
+            maxrl = h_rowDelimiters[k+1] - h_rowDelimiters[k];
+        }
     }
-   
-      // Device data structures
-      cl_mem d_val, d_vec, d_out;
-      cl_mem d_cols, d_rowDelimiters;
+    size_t elemBytes = sizeof(clFloatType) + sizeof(cl_int);
+    double sellPadBytes = (double)(sellSize - numNonZeroes) * elemBytes;
+    double ellPadBytes = ((double)maxrl * numRows - numNonZeroes) * elemBytes;
 
-      // Allocate device memory
-      d_val = clCreateBuffer(ctx, CL_MEM_READ_WRITE, numNonZeroes * 
-          sizeof(clFloatType), NULL, &err);
-      CL_CHECK_ERROR(err);    
-      d_cols = clCreateBuffer(ctx, CL_MEM_READ_WRITE, numNonZeroes * 
-          sizeof(cl_int), NULL, &err);
-      CL_CHECK_ERROR(err);    
-      int imgHeight = 0;
-      if (devSupportsImages)
-      {
-          imgHeight=(numRows+maxImgWidth-1)/maxImgWidth;
-          cl_image_format fmt; fmt.image_channel_data_type=CL_FLOAT;
-          if(sizeof(float)==4)
-              fmt.image_channel_order=CL_R;
-          else
-              fmt.image_channel_order=CL_RG;
-          d_vec = clCreateImage2D( ctx, CL_MEM_READ_ONLY, &fmt, maxImgWidth, 
-              imgHeight, 0, NULL, &err); 
-          CL_CHECK_ERROR(err);
-      } else {
-          d_vec = clCreateBuffer(ctx, CL_MEM_READ_WRITE, numRows * 
-              sizeof(clFloatType), NULL, &err);
-          CL_CHECK_ERROR(err);
-      }
-      d_out = clCreateBuffer(ctx, CL_MEM_READ_WRITE, numRows * 
-          sizeof(clFloatType), NULL, &err);
-      CL_CHECK_ERROR(err);
-      d_rowDelimiters = clCreateBuffer(ctx, CL_MEM_READ_WRITE, (numRows+1) * 
-          sizeof(cl_int), NULL, &err);
-      CL_CHECK_ERROR(err);
-      
-      // Setup events for timing
-      Event valTransfer("transfer Val data over PCIe bus");
-      Event colsTransfer("transfer cols data over PCIe bus");
-      Event vecTransfer("transfer vec data over PCIe bus");
-      Event rowDelimitersTransfer("transfer rowDelimiters data over PCIe bus");
+    // Device data structures
+    cl_mem d_val, d_vec, d_out; // floating point
+    cl_mem d_cols, d_sliceStart, d_rowLengths, d_rowPerm; // integer
 
-      // Transfer data to device
-      err = clEnqueueWriteBuffer(queue, d_val, true, 0, numNonZeroes * 
-          sizeof(float), h_val, 0, NULL, &valTransfer.CLEvent()); 
-      CL_CHECK_ERROR(err);
-      err = clEnqueueWriteBuffer(queue, d_cols, true, 0, numNonZeroes *
-          sizeof(int), h_cols, 0, NULL, &colsTransfer.CLEvent()); 
-      CL_CHECK_ERROR(err);
-      
-      if (devSupportsImages) 
-      {
-          size_t offset[3]={0};
-          size_t size[3]={maxImgWidth,imgHeight,1};
-          err = clEnqueueWriteImage(queue,d_vec, true, offset, size, 
-              0, 0, h_vec, 0, NULL, &vecTransfer.CLEvent());
-          CL_CHECK_ERROR(err);
-      } else 
-      {
-          err = clEnqueueWriteBuffer(queue, d_vec, true, 0, numRows * 
-              sizeof(float), h_vec, 0, NULL, &vecTransfer.CLEvent());
-          CL_CHECK_ERROR(err);
-      }
+    // Allocate device memory
+    d_val = clCreateBuffer(ctx, CL_MEM_READ_WRITE, sellSize *
+        sizeof(clFloatType), NULL, &err);
+    CL_CHECK_ERROR(err);
+    d_cols = clCreateBuffer(ctx, CL_MEM_READ_WRITE, sellSize *
+        sizeof(cl_int), NULL, &err);
+    CL_CHECK_ERROR(err);
+    d_vec = clCreateBuffer(ctx, CL_MEM_READ_WRITE, numRows *
+        sizeof(clFloatType), NULL, &err);
+    CL_CHECK_ERROR(err);
+    d_out = clCreateBuffer(ctx, CL_MEM_READ_WRITE, numRows *
+        sizeof(clFloatType), NULL, &err);
+    CL_CHECK_ERROR(err);
+    d_sliceStart = clCreateBuffer(ctx, CL_MEM_READ_WRITE, (numSlices+1) *
+        sizeof(cl_int), NULL, &err);
+    CL_CHECK_ERROR(err);
+    d_rowLengths = clCreateBuffer(ctx, CL_MEM_READ_WRITE, numRows *
+        sizeof(cl_int), NULL, &err);
+    CL_CHECK_ERROR(err);
+    d_rowPerm = clCreateBuffer(ctx, CL_MEM_READ_WRITE, numRows *
+        sizeof(cl_int), NULL, &err);
+    CL_CHECK_ERROR(err);
 
-      err = clEnqueueWriteBuffer(queue, d_rowDelimiters, true, 0, (numRows+1) *
-          sizeof(int), h_rowDelimiters, 0, NULL, 
-          &rowDelimitersTransfer.CLEvent()); 
-      CL_CHECK_ERROR(err);
-      err = clFinish(queue);
-      CL_CHECK_ERROR(err);
+    // Setup events for timing
+    Event valTransfer("transfer Val data over PCIe bus");
+    Event colsTransfer("transfer cols data over PCIe bus");
+    Event vecTransfer("transfer vec data over PCIe bus");
+    Event sliceStartTransfer("transfer sliceStart data over PCIe bus");
+    Event rowLengthsTransfer("transfer rowLengths data over PCIe bus");
+    Event rowPermTransfer("transfer rowPerm data over PCIe bus");
 
-      valTransfer.FillTimingInfo();
-      colsTransfer.FillTimingInfo();
-      vecTransfer.FillTimingInfo();
-      rowDelimitersTransfer.FillTimingInfo();
+    // Transfer data to device
+    err = clEnqueueWriteBuffer(queue, d_val, true, 0, sellSize * 
+        sizeof(clFloatType), h_valSell, 0, NULL, &valTransfer.CLEvent()); 
+    CL_CHECK_ERROR(err);
+    err = clEnqueueWriteBuffer(queue, d_cols, true, 0, sellSize * 
+        sizeof(cl_int), h_colsSell, 0, NULL, &colsTransfer.CLEvent()); 
+    CL_CHECK_ERROR(err);
+    err = clEnqueueWriteBuffer(queue, d_vec, true, 0, numRows * 
+        sizeof(clFloatType), h_vec, 0, NULL, &vecTransfer.CLEvent()); 
+    CL_CHECK_ERROR(err);
+    err = clEnqueueWriteBuffer(queue, d_sliceStart, true, 0, (numSlices+1) * 
+        sizeof(cl_int), h_sliceStart, 0, NULL, &sliceStartTransfer.CLEvent());
+    CL_CHECK_ERROR(err);
+    err = clEnqueueWriteBuffer(queue, d_rowLengths, true, 0, numRows * 
+        sizeof(cl_int), h_rowLengths, 0, NULL, &rowLengthsTransfer.CLEvent());
+    CL_CHECK_ERROR(err);
+    err = clEnqueueWriteBuffer(queue, d_rowPerm, true, 0, numRows * 
+        sizeof(cl_int), h_rowPerm, 0, NULL, &rowPermTransfer.CLEvent());
+    CL_CHECK_ERROR(err);
 
-      double iTransferTime = valTransfer.StartEndRuntime() + 
-                            colsTransfer.StartEndRuntime() +
-                             vecTransfer.StartEndRuntime() +
-                   rowDelimitersTransfer.StartEndRuntime();
+    err = clFinish(queue);
+    CL_CHECK_ERROR(err);
 
-      int passes = op.getOptionInt("passes");
-      int iters  = op.getOptionInt("iterations");
+    valTransfer.FillTimingInfo();
+    colsTransfer.FillTimingInfo();
+    vecTransfer.FillTimingInfo();
+    sliceStartTransfer.FillTimingInfo();
+    rowLengthsTransfer.FillTimingInfo();
+    rowPermTransfer.FillTimingInfo();
 
-      // Results description info
-      char atts[TEMP_BUFFER_SIZE];
-      sprintf(atts, "%d_elements_%d_rows", numNonZeroes, numRows);
-      string prefix = "";
-      prefix += (padded) ? "Padded_" : "";
-      double gflop = 2 * (double) numNonZeroes;
-      cout << "CSR Scalar Kernel\n";
-      Event kernelExec("kernel Execution");
+    double iTransferTime =  valTransfer.StartEndRuntime() +
+                           colsTransfer.StartEndRuntime() +
+                            vecTransfer.StartEndRuntime() +
+                     sliceStartTransfer.StartEndRuntime() +
+                     rowLengthsTransfer.StartEndRuntime() +
+                        rowPermTransfer.StartEndRuntime();
 
-      // Set up CSR Kernels
-      cl_kernel csrScalar, csrVector;
-      csrScalar  = clCreateKernel(prog, "spmv_csr_scalar_kernel", &err);
-      CL_CHECK_ERROR(err);
-      err = clSetKernelArg(csrScalar, 0, sizeof(cl_mem), (void*) &d_val);
-      CL_CHECK_ERROR(err);
-      err = clSetKernelArg(csrScalar, 1, sizeof(cl_mem), (void*) &d_vec);
-      CL_CHECK_ERROR(err);
-      err = clSetKernelArg(csrScalar, 2, sizeof(cl_mem), (void*) &d_cols);
-      CL_CHECK_ERROR(err);
-      err = clSetKernelArg(csrScalar, 3, sizeof(cl_mem), 
-          (void*) &d_rowDelimiters);
-      CL_CHECK_ERROR(err);
-      err = clSetKernelArg(csrScalar, 4, sizeof(cl_int), (void*) &numRows);
-      CL_CHECK_ERROR(err);
-      err = clSetKernelArg(csrScalar, 5, sizeof(cl_mem), (void*) &d_out);
-      CL_CHECK_ERROR(err);
+    // Set up kernel arguments
+    cl_kernel sell = clCreateKernel(prog, "spmv_sellcs_kernel", &err); 
+    CL_CHECK_ERROR(err);         
+    err = clSetKernelArg(sell, 0, sizeof(cl_mem), (void*) &d_val);
+    CL_CHECK_ERROR(err);
+    err = clSetKernelArg(sell, 1, sizeof(cl_mem), (void*) &d_vec);
+    CL_CHECK_ERROR(err);
+    err = clSetKernelArg(sell, 2, sizeof(cl_mem), (void*) &d_cols);
+    CL_CHECK_ERROR(err);
+    err = clSetKernelArg(sell, 3, sizeof(cl_mem), (void*) &d_sliceStart);
+    CL_CHECK_ERROR(err);
+    err = clSetKernelArg(sell, 4, sizeof(cl_mem), (void*) &d_rowLengths);
+    CL_CHECK_ERROR(err);
+    err = clSetKernelArg(sell, 5, sizeof(cl_mem), (void*) &d_rowPerm);
+    CL_CHECK_ERROR(err);
+    err = clSetKernelArg(sell, 6, sizeof(cl_int), (void*) &numRows);
+    CL_CHECK_ERROR(err);
+    err = clSetKernelArg(sell, 7, sizeof(cl_int), (void*) &sliceHeight);
+    CL_CHECK_ERROR(err);
+    err = clSetKernelArg(sell, 8, sizeof(cl_mem), (void*) &d_out);
+    CL_CHECK_ERROR(err);
 
-      csrVector = clCreateKernel(prog, "spmv_csr_vector_kernel", &err);
+    const size_t localWorkSize = localSize;
+    const size_t globalWorkSize = ((numRows + localSize - 1) / localSize) *
+        localSize;
+    Event kernelExec("SELL Kernel Execution");
 
-      CL_CHECK_ERROR(err);
-      err = clSetKernelArg(csrVector, 0, sizeof(cl_mem), (void*) &d_val);
-      CL_CHECK_ERROR(err);
-      err = clSetKernelArg(csrVector, 1, sizeof(cl_mem), (void*) &d_vec);
-      CL_CHECK_ERROR(err);
-      err = clSetKernelArg(csrVector, 2, sizeof(cl_mem), (void*) &d_cols);
-      CL_CHECK_ERROR(err);
-      err = clSetKernelArg(csrVector, 3, sizeof(cl_mem), 
-          (void*) &d_rowDelimiters);
-      CL_CHECK_ERROR(err);
-      err = clSetKernelArg(csrVector, 4, sizeof(cl_int), (void*) &numRows);
-      CL_CHECK_ERROR(err);
-      err = clSetKernelArg(csrVector, 5, sizeof(cl_mem), (void*) &d_out);
-      CL_CHECK_ERROR(err);
-      
-      // Append correct suffix to resultsDB entry
-      string suffix;
-      if (sizeof(float) == sizeof(float))
-      {
-          suffix = "-SP";
-      } 
-      else 
-      {
-          suffix = "-DP";
-      } 
-         
-      const size_t scalarGlobalWSize = numRows;
-      size_t localWorkSize = BLOCK_SIZE;
-      
-      for (int k = 0; k < passes; k++)
-      {
-          double scalarKernelTime = 0.0;
-          // Run Scalar Kernel
+    int passes = testPasses(op);
+    int iters  = testIterations(op);
+
+    char atts[TEMP_BUFFER_SIZE];
+    char benchName[TEMP_BUFFER_SIZE];
+    sprintf(atts, "%d_elements_%d_rows_C%d_sigma%d", numNonZeroes, numRows,
+            sliceHeight, sortWindow);
+    bool dpTest = (sizeof(float) == sizeof(double));
+    resultDB.AddResult("SELL_Padding", atts, "Bytes", sellPadBytes);
+    resultDB.AddResult("ELLPACKR_Padding", atts, "Bytes", ellPadBytes);
+    double rate = 0.0;
+
+    for (int k = 0; k < passes; k++)
+    {
+        double totalKernelTime = 0.0;
+        for (int j = 0; j < iters; j++)
+        {
+            err = clEnqueueNDRangeKernel(queue, sell, 1, NULL, 
+                &globalWorkSize, &localWorkSize, 0, NULL, 
+                &kernelExec.CLEvent());
+            CL_CHECK_ERROR(err);
+            err = clFinish(queue);
+            CL_CHECK_ERROR(err);
+            kernelExec.FillTimingInfo();
+            totalKernelTime += kernelExec.StartEndRuntime();
+        }
+
+        Event outTransfer("d->h data transfer");
+        err = clEnqueueReadBuffer(queue, d_out, true, 0, numRows * 
+            sizeof(clFloatType), h_out, 0, NULL, &outTransfer.CLEvent());
+        CL_CHECK_ERROR(err);
+        err = clFinish(queue);
+        CL_CHECK_ERROR(err);
+        outTransfer.FillTimingInfo();
+        double oTransferTime = outTransfer.StartEndRuntime();
+
+        // Compare reference solution to GPU result
+        if (! verifyResults(refOut, h_out, numRows, k)) {
+            break;  // If results don't match, don't report performance
+        }
+        double avgTime = totalKernelTime / (double)iters;
+        double gflop = 2 * (double) numNonZeroes;
+        sprintf(benchName, "SELL-C-sigma-%s", dpTest ? "DP":"SP");
+        resultDB.AddResult(benchName, atts, "Gflop/s", gflop/avgTime);
+        rate = gflop/avgTime;
+        strcat(benchName, "_PCIe");
+        resultDB.AddResult(benchName, atts, "Gflop/s", gflop / 
+            (avgTime + iTransferTime + oTransferTime));   
+    }
+
+    err = clReleaseKernel(sell);
+    CL_CHECK_ERROR(err);
+    err = clReleaseProgram(prog);
+    CL_CHECK_ERROR(err);
+
+    // Free device memory
+    err = clReleaseMemObject(d_rowPerm);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_rowLengths);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_sliceStart);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_vec);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_out);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_val);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_cols);
+    CL_CHECK_ERROR(err);
+
+    // Free host memory
+    delete[] h_valSell;
+    delete[] h_colsSell;
+    delete[] h_sliceStart;
+    delete[] h_rowLengths;
+    delete[] h_rowPerm;
+    return rate;
+}
+
+// ****************************************************************************
+// Function: mergeTest
+//
+// Purpose: 
+//   Runs sparse matrix vector multiplication on the device using the
+//   load-balanced merge-path CSR kernel, whose work per thread does not
+//   depend on the row length distribution
+//
+// Arguements: 
+//   dev: opencl device id
+//   ctx: current opencl context
+//   compileFlags: flags to use when compiling the merge kernels
+//   queue: the current opencl command queue
+//   resultDB: result database to store results
+//   op: provides access to command line options
+//   h_val: array holding the non-zero values for the matrix
+//   h_cols: array of column indices for each element of A
+//   h_rowDelimiters: array of size dim+1 holding indices to rows of A; 
+//                  last element is the index one past the last
+//                  element of A
+//   h_vec: dense vector of size dim to be used for multiplication
+//   h_out: input - buffer for result of calculation
+//   numRows: number of rows in matrix
+//   numNonZeroes: number of entries in matrix
+//   refOut: solution computed on cpu
+//
+// Returns:  Gflop/s of the last verified pass, 0 on failure
+// ****************************************************************************
+double mergeTest(cl_device_id dev, cl_context ctx, string compileFlags, 
+               cl_command_queue queue, ResultDatabase& resultDB, 
+               OptionParser& op, float* h_val, int* h_cols, 
+               int* h_rowDelimiters, float* h_vec, float* h_out,
+               int numRows, int numNonZeroes, float* refOut)
+{
+    int err = 0; 
+
+    // Build the openCL kernels, or reuse an earlier build
+    cl_program prog = programCacheGet(ctx, dev, cl_source_spmv, compileFlags,
+            op.getOptionString("program_cache_dir"), resultDB);
+    if (prog == NULL)
+    {
+        return 0.0;
+    }
+
+    // Split the merge path of row ends and non-zeroes into equal pieces
+    int itemsPerThread = op.getOptionInt("merge_items");
+    int numThreads = (numRows + numNonZeroes + itemsPerThread - 1) / 
+                     itemsPerThread;
+
+    // Device data structures
+    cl_mem d_val, d_vec, d_out, d_carryVal; // floating point
+    cl_mem d_cols, d_rowDelimiters, d_carryRow; // integer
+
+    // Allocate device memory
+    d_val = clCreateBuffer(ctx, CL_MEM_READ_WRITE, numNonZeroes *
+        sizeof(clFloatType), NULL, &err);
+    CL_CHECK_ERROR(err);
+    d_cols = clCreateBuffer(ctx, CL_MEM_READ_WRITE, numNonZeroes *
+        sizeof(cl_int), NULL, &err);
+    CL_CHECK_ERROR(err);
+    d_rowDelimiters = clCreateBuffer(ctx, CL_MEM_READ_WRITE, (numRows+1) *
+        sizeof(cl_int), NULL, &err);
+    CL_CHECK_ERROR(err);
+    d_vec = clCreateBuffer(ctx, CL_MEM_READ_WRITE, numRows *
+        sizeof(clFloatType), NULL, &err);
+    CL_CHECK_ERROR(err);
+    d_out = clCreateBuffer(ctx, CL_MEM_READ_WRITE, numRows *
+        sizeof(clFloatType), NULL, &err);
+    CL_CHECK_ERROR(err);
+    d_carryRow = clCreateBuffer(ctx, CL_MEM_READ_WRITE, numThreads *
+        sizeof(cl_int), NULL, &err);
+    CL_CHECK_ERROR(err);
+    d_carryVal = clCreateBuffer(ctx, CL_MEM_READ_WRITE, numThreads *
+        sizeof(clFloatType), NULL, &err);
+    CL_CHECK_ERROR(err);
+
+    // Setup events for timing
+    Event valTransfer("transfer Val data over PCIe bus");
+    Event colsTransfer("transfer cols data over PCIe bus");
+    Event vecTransfer("transfer vec data over PCIe bus");
+    Event rowDelimitersTransfer("transfer rowDelimiters data over PCIe bus");
+
+    // Transfer data to device
+    err = clEnqueueWriteBuffer(queue, d_val, true, 0, numNonZeroes * 
+        sizeof(clFloatType), h_val, 0, NULL, &valTransfer.CLEvent()); 
+    CL_CHECK_ERROR(err);
+    err = clEnqueueWriteBuffer(queue, d_cols, true, 0, numNonZeroes * 
+        sizeof(cl_int), h_cols, 0, NULL, &colsTransfer.CLEvent()); 
+    CL_CHECK_ERROR(err);
+    err = clEnqueueWriteBuffer(queue, d_vec, true, 0, numRows * 
+        sizeof(clFloatType), h_vec, 0, NULL, &vecTransfer.CLEvent()); 
+    CL_CHECK_ERROR(err);
+    err = clEnqueueWriteBuffer(queue, d_rowDelimiters, true, 0, (numRows+1) *
+        sizeof(cl_int), h_rowDelimiters, 0, NULL, 
+        &rowDelimitersTransfer.CLEvent()); 
+    CL_CHECK_ERROR(err);
+
+    err = clFinish(queue);
+    CL_CHECK_ERROR(err);
+
+    valTransfer.FillTimingInfo();
+    colsTransfer.FillTimingInfo();
+    vecTransfer.FillTimingInfo();
+    rowDelimitersTransfer.FillTimingInfo();
+
+    double iTransferTime =  valTransfer.StartEndRuntime() +
+                           colsTransfer.StartEndRuntime() +
+                            vecTransfer.StartEndRuntime() +
+                  rowDelimitersTransfer.StartEndRuntime();
+
+    // Set up kernel arguments
+    cl_kernel merge = clCreateKernel(prog, "spmv_csr_merge_kernel", &err); 
+    CL_CHECK_ERROR(err);         
+    err = clSetKernelArg(merge, 0, sizeof(cl_mem), (void*) &d_val);
+    CL_CHECK_ERROR(err);
+    err = clSetKernelArg(merge, 1, sizeof(cl_mem), (void*) &d_vec);
+    CL_CHECK_ERROR(err);
+    err = clSetKernelArg(merge, 2, sizeof(cl_mem), (void*) &d_cols);
+    CL_CHECK_ERROR(err);
+    err = clSetKernelArg(merge, 3, sizeof(cl_mem), (void*) &d_rowDelimiters);
+    CL_CHECK_ERROR(err);
+    err = clSetKernelArg(merge, 4, sizeof(cl_int), (void*) &numRows);
+    CL_CHECK_ERROR(err);
+    err = clSetKernelArg(merge, 5, sizeof(cl_int), (void*) &numNonZeroes);
+    CL_CHECK_ERROR(err);
+    err = clSetKernelArg(merge, 6, sizeof(cl_int), (void*) &itemsPerThread);
+    CL_CHECK_ERROR(err);
+    err = clSetKernelArg(merge, 7, sizeof(cl_mem), (void*) &d_out);
+    CL_CHECK_ERROR(err);
+    err = clSetKernelArg(merge, 8, sizeof(cl_mem), (void*) &d_carryRow);
+    CL_CHECK_ERROR(err);
+    err = clSetKernelArg(merge, 9, sizeof(cl_mem), (void*) &d_carryVal);
+    CL_CHECK_ERROR(err);
+
+    cl_kernel fixup = clCreateKernel(prog, "spmv_csr_merge_fixup_kernel", 
+                                     &err); 
+    CL_CHECK_ERROR(err);         
+    err = clSetKernelArg(fixup, 0, sizeof(cl_mem), (void*) &d_carryRow);
+    CL_CHECK_ERROR(err);
+    err = clSetKernelArg(fixup, 1, sizeof(cl_mem), (void*) &d_carryVal);
+    CL_CHECK_ERROR(err);
+    err = clSetKernelArg(fixup, 2, sizeof(cl_int), (void*) &numThreads);
+    CL_CHECK_ERROR(err);
+    err = clSetKernelArg(fixup, 3, sizeof(cl_int), (void*) &numRows);
+    CL_CHECK_ERROR(err);
+    err = clSetKernelArg(fixup, 4, sizeof(cl_mem), (void*) &d_out);
+    CL_CHECK_ERROR(err);
+
+    // The merge kernel writes a carry for every launched thread, so the
+    // global size must match numThreads exactly
+    const size_t mergeGlobalWorkSize = numThreads;
+    const size_t fixupLocalWorkSize = BLOCK_SIZE;
+    const size_t fixupGlobalWorkSize = ((numThreads + BLOCK_SIZE - 1) / 
+        BLOCK_SIZE) * BLOCK_SIZE;
+    Event mergeExec("Merge Kernel Execution");
+    Event fixupExec("Merge Fixup Kernel Execution");
+
+    int passes = testPasses(op);
+    int iters  = testIterations(op);
+
+    char atts[TEMP_BUFFER_SIZE];
+    sprintf(atts, "%d_elements_%d_rows", numNonZeroes, numRows);
+    string suffix = (sizeof(float) == sizeof(double)) ? "-DP" : "-SP";
+    double gflop = 2 * (double) numNonZeroes;
+    double rate = 0.0;
+
+    for (int k = 0; k < passes; k++)
+    {
+        double totalKernelTime = 0.0;
+        for (int j = 0; j < iters; j++)
+        {
+            err = clEnqueueNDRangeKernel(queue, merge, 1, NULL, 
+                &mergeGlobalWorkSize, NULL, 0, NULL, &mergeExec.CLEvent());
+            CL_CHECK_ERROR(err);
+            err = clEnqueueNDRangeKernel(queue, fixup, 1, NULL, 
+                &fixupGlobalWorkSize, &fixupLocalWorkSize, 0, NULL, 
+                &fixupExec.CLEvent());
+            CL_CHECK_ERROR(err);
+            err = clFinish(queue);
+            CL_CHECK_ERROR(err);
+            mergeExec.FillTimingInfo();
+            fixupExec.FillTimingInfo();
+            totalKernelTime += mergeExec.StartEndRuntime() + 
+                               fixupExec.StartEndRuntime();
+        }
+
+        Event outTransfer("d->h data transfer");
+        err = clEnqueueReadBuffer(queue, d_out, true, 0, numRows * 
+            sizeof(clFloatType), h_out, 0, NULL, &outTransfer.CLEvent());
+        CL_CHECK_ERROR(err);
+        err = clFinish(queue);
+        CL_CHECK_ERROR(err);
+        outTransfer.FillTimingInfo();
+        double oTransferTime = outTransfer.StartEndRuntime();
+
+        // Compare reference solution to GPU result
+        if (! verifyResults(refOut, h_out, numRows, k)) {
+            break;  // If results don't match, don't report performance
+        }
+        double avgTime = totalKernelTime / (double)iters;
+        string testName = "CSR-MergePath"+suffix;
+        resultDB.AddResult(testName, atts, "Gflop/s", gflop/avgTime);
+        rate = gflop/avgTime;
+        resultDB.AddResult(testName+"_PCIe", atts, "Gflop/s", gflop / 
+            (avgTime + iTransferTime + oTransferTime));   
+    }
+
+    err = clReleaseKernel(merge);
+    CL_CHECK_ERROR(err);
+    err = clReleaseKernel(fixup);
+    CL_CHECK_ERROR(err);
+    err = clReleaseProgram(prog);
+    CL_CHECK_ERROR(err);
+
+    // Free device memory
+    err = clReleaseMemObject(d_carryVal);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_carryRow);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_rowDelimiters);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_vec);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_out);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_val);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_cols);
+    CL_CHECK_ERROR(err);
+    return rate;
+}
+
+// ****************************************************************************
+// Function: csrTest
+//
+// Purpose: 
+//   Runs sparse matrix vector multiplication on the device using the compressed
+//   sparse row format
+//
+// Arguements: 
+//   dev: opencl device id
+//   ctx: current opencl context
+//   copmilerFlags: flags to use when compiling ellpackr kernel
+//   queue: the current opencl command queue
+//   resultDB: result database to store results
+//   op: provides access to command line options
+//   h_val: array holding the non-zero values for the matrix
+//   h_cols: array of column indices for each element of A
+//   h_rowDelimiters: array of size dim+1 holding indices to rows of A; 
+//                  last element is the index one past the last
+//                  element of A
+//   h_vec: dense vector of size dim to be used for multiplication
+//   h_out: input - buffer for result of calculation
+//   numRows: number of rows in amtrix
+//   numNonZeroes: number of entries in matrix
+//   refOut: solution computed on cpu
+//   padded: whether using padding or not
+//   csrKernels: which of the CSR_KERNEL_SCALAR and CSR_KERNEL_VECTOR
+//               kernels to run
+//   scalarLocalSize: work-group size of the scalar kernel
+//
+// Returns:  best Gflop/s of the kernels run, 0 on failure
+// 
+// Programmer: Lukasz Wesolowski
+// Creation: June 23, 2010
+// ****************************************************************************
+double csrTest(cl_device_id dev, cl_context ctx, string compileFlags, 
+             cl_command_queue queue, ResultDatabase& resultDB, OptionParser& op,
+             float* h_val, int* h_cols, int* h_rowDelimiters, 
+             float* h_vec, float* h_out, int numRows, int numNonZeroes, 
+             float* refOut, bool padded, const size_t maxImgWidth, bool devSupportsImages,
+             int csrKernels = CSR_KERNEL_SCALAR | CSR_KERNEL_VECTOR,
+             size_t scalarLocalSize = BLOCK_SIZE)
+{
+    if (devSupportsImages) 
+    {
+        char texflags[64];
+        sprintf(texflags," -DUSE_TEXTURE -DMAX_IMG_WIDTH=%ld", maxImgWidth);
+        compileFlags+=string(texflags);
+    }
+    int err = 0; 
+
+    // Build the openCL kernels, or reuse an earlier build
+    cl_program prog = programCacheGet(ctx, dev, cl_source_spmv, compileFlags,
+            op.getOptionString("program_cache_dir"), resultDB);
+    if (prog == NULL)
+    {
+        return 0.0;
+    }
+   
+      // Device data structures
+      cl_mem d_val, d_vec, d_out;
+      cl_mem d_cols, d_rowDelimiters;
+
+      // Matrices mapped from a CSR cache file are page aligned and stay
+      // mapped for the whole run, so they can back the buffers directly
+      cl_mem_flags matFlags = CL_MEM_READ_WRITE;
+      float *valHostPtr = NULL;
+      int *colsHostPtr = NULL, *rowDelimitersHostPtr = NULL;
+      if (isMappedMatrix(h_val))
+      {
+          matFlags = CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR;
+          valHostPtr = h_val;
+          colsHostPtr = h_cols;
+          rowDelimitersHostPtr = h_rowDelimiters;
+      }
+
+      // Allocate device memory
+      d_val = clCreateBuffer(ctx, matFlags, numNonZeroes * 
+          sizeof(clFloatType), valHostPtr, &err);
+      CL_CHECK_ERROR(err);    
+      d_cols = clCreateBuffer(ctx, matFlags, numNonZeroes * 
+          sizeof(cl_int), colsHostPtr, &err);
+      CL_CHECK_ERROR(err);    
+      int imgHeight = 0;
+      if (devSupportsImages)
+      {
+          imgHeight=(numRows+maxImgWidth-1)/maxImgWidth;
+          cl_image_format fmt; fmt.image_channel_data_type=CL_FLOAT;
+          if(sizeof(float)==4)
+              fmt.image_channel_order=CL_R;
+          else
+              fmt.image_channel_order=CL_RG;
+          d_vec = clCreateImage2D( ctx, CL_MEM_READ_ONLY, &fmt, maxImgWidth, 
+              imgHeight, 0, NULL, &err); 
+          CL_CHECK_ERROR(err);
+      } else {
+          d_vec = clCreateBuffer(ctx, CL_MEM_READ_WRITE, numRows * 
+              sizeof(clFloatType), NULL, &err);
+          CL_CHECK_ERROR(err);
+      }
+      d_out = clCreateBuffer(ctx, CL_MEM_READ_WRITE, numRows * 
+          sizeof(clFloatType), NULL, &err);
+      CL_CHECK_ERROR(err);
+      d_rowDelimiters = clCreateBuffer(ctx, matFlags, (numRows+1) * 
+          sizeof(cl_int), rowDelimitersHostPtr, &err);
+      CL_CHECK_ERROR(err);
+      
+      // Setup events for timing
+      Event valTransfer("transfer Val data over PCIe bus");
+      Event colsTransfer("transfer cols data over PCIe bus");
+      Event vecTransfer("transfer vec data over PCIe bus");
+      Event rowDelimitersTransfer("transfer rowDelimiters data over PCIe bus");
+
+      // Transfer data to device
+      err = clEnqueueWriteBuffer(queue, d_val, true, 0, numNonZeroes * 
+          sizeof(float), h_val, 0, NULL, &valTransfer.CLEvent()); 
+      CL_CHECK_ERROR(err);
+      err = clEnqueueWriteBuffer(queue, d_cols, true, 0, numNonZeroes *
+          sizeof(int), h_cols, 0, NULL, &colsTransfer.CLEvent()); 
+      CL_CHECK_ERROR(err);
+      
+      if (devSupportsImages) 
+      {
+          size_t offset[3]={0};
+          size_t size[3]={maxImgWidth,imgHeight,1};
+          err = clEnqueueWriteImage(queue,d_vec, true, offset, size, 
+              0, 0, h_vec, 0, NULL, &vecTransfer.CLEvent());
+          CL_CHECK_ERROR(err);
+      } else 
+      {
+          err = clEnqueueWriteBuffer(queue, d_vec, true, 0, numRows * 
+              sizeof(float), h_vec, 0, NULL, &vecTransfer.CLEvent());
+          CL_CHECK_ERROR(err);
+      }
+
+      err = clEnqueueWriteBuffer(queue, d_rowDelimiters, true, 0, (numRows+1) *
+          sizeof(int), h_rowDelimiters, 0, NULL, 
+          &rowDelimitersTransfer.CLEvent()); 
+      CL_CHECK_ERROR(err);
+      err = clFinish(queue);
+      CL_CHECK_ERROR(err);
+
+      valTransfer.FillTimingInfo();
+      colsTransfer.FillTimingInfo();
+      vecTransfer.FillTimingInfo();
+      rowDelimitersTransfer.FillTimingInfo();
+
+      double iTransferTime = valTransfer.StartEndRuntime() + 
+                            colsTransfer.StartEndRuntime() +
+                             vecTransfer.StartEndRuntime() +
+                   rowDelimitersTransfer.StartEndRuntime();
+
+      int passes = testPasses(op);
+      int iters  = testIterations(op);
+
+      // Results description info
+      char atts[TEMP_BUFFER_SIZE];
+      sprintf(atts, "%d_elements_%d_rows", numNonZeroes, numRows);
+      string prefix = "";
+      prefix += (padded) ? "Padded_" : "";
+      double gflop = 2 * (double) numNonZeroes;
+      cout << "CSR Scalar Kernel\n";
+      Event kernelExec("kernel Execution");
+
+      // Set up CSR Kernels
+      cl_kernel csrScalar, csrVector;
+      csrScalar  = clCreateKernel(prog, "spmv_csr_scalar_kernel", &err);
+      CL_CHECK_ERROR(err);
+      err = clSetKernelArg(csrScalar, 0, sizeof(cl_mem), (void*) &d_val);
+      CL_CHECK_ERROR(err);
+      err = clSetKernelArg(csrScalar, 1, sizeof(cl_mem), (void*) &d_vec);
+      CL_CHECK_ERROR(err);
+      err = clSetKernelArg(csrScalar, 2, sizeof(cl_mem), (void*) &d_cols);
+      CL_CHECK_ERROR(err);
+      err = clSetKernelArg(csrScalar, 3, sizeof(cl_mem), 
+          (void*) &d_rowDelimiters);
+      CL_CHECK_ERROR(err);
+      err = clSetKernelArg(csrScalar, 4, sizeof(cl_int), (void*) &numRows);
+      CL_CHECK_ERROR(err);
+      err = clSetKernelArg(csrScalar, 5, sizeof(cl_mem), (void*) &d_out);
+      CL_CHECK_ERROR(err);
+
+      csrVector = clCreateKernel(prog, "spmv_csr_vector_kernel", &err);
+
+      CL_CHECK_ERROR(err);
+      err = clSetKernelArg(csrVector, 0, sizeof(cl_mem), (void*) &d_val);
+      CL_CHECK_ERROR(err);
+      err = clSetKernelArg(csrVector, 1, sizeof(cl_mem), (void*) &d_vec);
+      CL_CHECK_ERROR(err);
+      err = clSetKernelArg(csrVector, 2, sizeof(cl_mem), (void*) &d_cols);
+      CL_CHECK_ERROR(err);
+      err = clSetKernelArg(csrVector, 3, sizeof(cl_mem), 
+          (void*) &d_rowDelimiters);
+      CL_CHECK_ERROR(err);
+      err = clSetKernelArg(csrVector, 4, sizeof(cl_int), (void*) &numRows);
+      CL_CHECK_ERROR(err);
+      err = clSetKernelArg(csrVector, 5, sizeof(cl_mem), (void*) &d_out);
+      CL_CHECK_ERROR(err);
+      
+      // Append correct suffix to resultsDB entry
+      string suffix;
+      if (sizeof(float) == sizeof(float))
+      {
+          suffix = "-SP";
+      } 
+      else 
+      {
+          suffix = "-DP";
+      } 
+         
+      size_t localWorkSize = scalarLocalSize;
+      const size_t scalarGlobalWSize = ((numRows + localWorkSize - 1) / 
+          localWorkSize) * localWorkSize;
+      double rate = 0.0;
+      
+      for (int k = 0; k < passes && (csrKernels & CSR_KERNEL_SCALAR); k++)
+      {
+          double scalarKernelTime = 0.0;
+          // Run Scalar Kernel
           for (int j = 0; j < iters; j++)
           {
               err = clEnqueueNDRangeKernel(queue, csrScalar, 1, NULL,
@@ -584,110 +1188,993 @@ void csrTest(cl_device_id dev, cl_context ctx, string compileFlags,
           // Compare reference solution to GPU result
           if (! verifyResults(refOut, h_out, numRows, k))
           {
-               return;  // If results don't match, don't report performance
+               return 0.0;  // If results don't match, don't report performance
+          }
+          scalarKernelTime = scalarKernelTime / (double)iters;
+          string testName = prefix+"CSR-Scalar"+suffix;
+          double totalTransfer = iTransferTime + oTransferTime;
+          resultDB.AddResult(testName, atts, "Gflop/s",
+              gflop/(scalarKernelTime));
+          if (gflop/scalarKernelTime > rate) rate = gflop/scalarKernelTime;
+          resultDB.AddResult(testName+"_PCIe", atts, "Gflop/s",
+              gflop / (scalarKernelTime+totalTransfer));
+      }
+
+      // Clobber correct answer, so we can be sure the vector kernel is correct
+      err = clEnqueueWriteBuffer(queue, d_out, true, 0, numRows * 
+          sizeof(float), h_vec, 0, NULL, NULL); 
+      CL_CHECK_ERROR(err);
+      
+      cout << "CSR Vector Kernel\n";
+      // Verify Local work group size
+      size_t maxLocal = getMaxWorkGroupSize(ctx, csrVector);
+      if (maxLocal < 32)
+      {
+         cout << "Warning: CSRVector requires a work group size >= 32" << endl;
+         cout << "Skipping this kernel." << endl;
+         err = clReleaseMemObject(d_rowDelimiters); 
+         CL_CHECK_ERROR(err);    
+         err = clReleaseMemObject(d_vec); 
+         CL_CHECK_ERROR(err);
+         err = clReleaseMemObject(d_out); 
+         CL_CHECK_ERROR(err);
+         err = clReleaseMemObject(d_val); 
+         CL_CHECK_ERROR(err);
+         err = clReleaseMemObject(d_cols); 
+         CL_CHECK_ERROR(err);
+         err = clReleaseKernel(csrScalar);
+         CL_CHECK_ERROR(err);
+         err = clReleaseKernel(csrVector);
+         CL_CHECK_ERROR(err);
+         err = clReleaseProgram(prog);
+         CL_CHECK_ERROR(err);
+         return rate;
+      }
+      localWorkSize = VECTOR_SIZE;
+      while (localWorkSize+VECTOR_SIZE <= maxLocal && 
+          localWorkSize+VECTOR_SIZE <= BLOCK_SIZE)
+      {
+         localWorkSize += VECTOR_SIZE;
+      }
+      const size_t vectorGlobalWSize = numRows * VECTOR_SIZE; // 1 warp per row
+
+      for (int k = 0; k < passes && (csrKernels & CSR_KERNEL_VECTOR); k++)
+      {
+          // Run Vector Kernel
+          double vectorKernelTime = 0.0;
+          for (int j = 0; j < iters; j++)
+          {              
+             err = clEnqueueNDRangeKernel(queue, csrVector, 1, NULL,
+                  &vectorGlobalWSize, &localWorkSize, 0, NULL, 
+                  &kernelExec.CLEvent());
+             CL_CHECK_ERROR(err);
+             err = clFinish(queue);
+             CL_CHECK_ERROR(err);
+             kernelExec.FillTimingInfo();
+             vectorKernelTime += kernelExec.StartEndRuntime();
+          }   
+          
+         Event outTransfer("d->h data transfer");
+         err = clEnqueueReadBuffer(queue, d_out, true, 0, numRows * 
+             sizeof(float), h_out, 0, NULL, &outTransfer.CLEvent()); 
+         CL_CHECK_ERROR(err);
+         err = clFinish(queue);
+         CL_CHECK_ERROR(err);
+         outTransfer.FillTimingInfo();
+         double oTransferTime = outTransfer.FillTimingInfo();
+         
+          // Compare reference solution to GPU result
+          if (! verifyResults(refOut, h_out, numRows, k))
+          {
+              return 0.0;  // If results don't match, don't report performance
           }
-          scalarKernelTime = scalarKernelTime / (double)iters;
-          string testName = prefix+"CSR-Scalar"+suffix;
+          vectorKernelTime = vectorKernelTime / (double)iters;
+          string testName = prefix+"CSR-Vector"+suffix;
           double totalTransfer = iTransferTime + oTransferTime;
-          resultDB.AddResult(testName, atts, "Gflop/s",
-              gflop/(scalarKernelTime));
+          resultDB.AddResult(testName, atts, "Gflop/s", gflop/vectorKernelTime);
+          if (gflop/vectorKernelTime > rate) rate = gflop/vectorKernelTime;
           resultDB.AddResult(testName+"_PCIe", atts, "Gflop/s",
-              gflop / (scalarKernelTime+totalTransfer));
+                            gflop/(vectorKernelTime+totalTransfer));
       }
+      
+      // Free device memory
+      err = clReleaseMemObject(d_rowDelimiters); 
+      CL_CHECK_ERROR(err);    
+      err = clReleaseMemObject(d_vec); 
+      CL_CHECK_ERROR(err);
+      err = clReleaseMemObject(d_out); 
+      CL_CHECK_ERROR(err);
+      err = clReleaseMemObject(d_val); 
+      CL_CHECK_ERROR(err);
+      err = clReleaseMemObject(d_cols); 
+      CL_CHECK_ERROR(err);
+      err = clReleaseKernel(csrScalar);
+      CL_CHECK_ERROR(err);
+      err = clReleaseKernel(csrVector);
+      CL_CHECK_ERROR(err);
+      err = clReleaseProgram(prog);
+      CL_CHECK_ERROR(err);
+      return rate;
+}
+
+// ****************************************************************************
+// Function: timeSpmmKernel
+//
+// Purpose:
+//   Times one SpMM kernel, checks its result against the reference and
+//   reports it; see spmmTest
+//
+// Returns:  Gflop/s of the last verified pass, 0 on failure
+// ****************************************************************************
+double timeSpmmKernel(cl_command_queue queue, ResultDatabase& resultDB,
+                      OptionParser& op, cl_kernel kernel,
+                      size_t globalWorkSize, size_t localWorkSize,
+                      cl_mem d_out, float* h_out, float* h_outCm,
+                      float* refOut, int numRows, int numVecs, bool rowMajor,
+                      string testName, const char* atts, double gflop)
+{
+    int err = 0;
+    int passes = testPasses(op);
+    int iters  = testIterations(op);
+    double rate = 0.0;
+    Event kernelExec("SpMM Kernel Execution");
+
+    for (int k = 0; k < passes; k++)
+    {
+        double totalKernelTime = 0.0;
+        for (int j = 0; j < iters; j++)
+        {
+            err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL,
+                &globalWorkSize, &localWorkSize, 0, NULL,
+                &kernelExec.CLEvent());
+            CL_CHECK_ERROR(err);
+            err = clFinish(queue);
+            CL_CHECK_ERROR(err);
+            kernelExec.FillTimingInfo();
+            totalKernelTime += kernelExec.StartEndRuntime();
+        }
+
+        err = clEnqueueReadBuffer(queue, d_out, true, 0, numRows * numVecs *
+            sizeof(clFloatType), h_out, 0, NULL, NULL);
+        CL_CHECK_ERROR(err);
+
+        // The reference is column major
+        float *result = h_out;
+        if (rowMajor)
+        {
+            for (int i=0; i<numRows; i++)
+            {
+                for (int v=0; v<numVecs; v++)
+                {
+                    h_outCm[v * numRows + i] = h_out[i * numVecs + v];
+                }
+            }
+            result = h_outCm;
+        }
+
+        // Compare reference solution to GPU result
+        if (! verifyResults(refOut, result, numRows * numVecs, k)) {
+            break;  // If results don't match, don't report performance
+        }
+        double avgTime = totalKernelTime / (double)iters;
+        resultDB.AddResult(testName, atts, "Gflop/s", gflop/avgTime);
+        rate = gflop/avgTime;
+    }
+    return rate;
+}
+
+// ****************************************************************************
+// Function: spmmTest
+//
+// Purpose: 
+//   Multiplies the sparse matrix by a block of spmm_vecs dense vectors
+//   with the CSR vector and ELLPACK-R SpMM kernels, storing the block in
+//   row major and in column major order.  Each non-zero is read once per
+//   block instead of once per vector.
+//
+// Arguements: 
+//   dev: opencl device id
+//   ctx: current opencl context
+//   compileFlags: flags to use when compiling the spmm kernels
+//   queue: the current opencl command queue
+//   resultDB: result database to store results
+//   op: provides access to command line options
+//   h_val: array holding the non-zero values for the matrix
+//   h_cols: array of column indices for each element of A
+//   h_rowDelimiters: array of size dim+1 holding indices to rows of A; 
+//                  last element is the index one past the last
+//                  element of A
+//   numRows: number of rows in matrix
+//   numNonZeroes: number of entries in matrix
+// ****************************************************************************
+void spmmTest(cl_device_id dev, cl_context ctx, string compileFlags, 
+              cl_command_queue queue, ResultDatabase& resultDB, 
+              OptionParser& op, float* h_val, int* h_cols, 
+              int* h_rowDelimiters, int numRows, int numNonZeroes)
+{
+    int numVecs = op.getOptionInt("spmm_vecs");
+    int blockSize = numRows * numVecs;
+    int err = 0;
+
+    // Dense blocks, the reference is one CPU SpMV per vector
+    float *h_vecs = new float[blockSize];
+    float *h_vecsRm = new float[blockSize];
+    float *h_out = new float[blockSize];
+    float *h_outCm = new float[blockSize];
+    float *refOut = new float[blockSize];
+    fill(h_vecs, blockSize, op.getOptionFloat("maxval"));
+    for (int v=0; v<numVecs; v++)
+    {
+        spmvCpu(h_val, h_cols, h_rowDelimiters, h_vecs + v * numRows,
+                numRows, refOut + v * numRows);
+        for (int i=0; i<numRows; i++)
+        {
+            h_vecsRm[i * numVecs + v] = h_vecs[v * numRows + i];
+        }
+    }
+
+    // ELLPACK-R copy of the matrix, not padded
+    int *h_rowLengths = new int[numRows];
+    int maxrl = 0;
+    for (int k=0; k<numRows; k++)
+    {
+        h_rowLengths[k] = h_rowDelimiters[k+1] - h_rowDelimiters[k];
+        if (h_rowLengths[k] > maxrl)
+        {
+            maxrl = h_rowLengths[k];
+        }
+    }
+    float *h_valcm = new float[maxrl * numRows];
+    int *h_colscm = new int[maxrl * numRows];
+    convertToColMajor(h_val, h_cols, numRows, h_rowDelimiters, h_valcm,
+                      h_colscm, h_rowLengths, maxrl, false);
+
+    // Allocate device memory
+    cl_mem d_val = clCreateBuffer(ctx, CL_MEM_READ_ONLY | 
+        CL_MEM_COPY_HOST_PTR, numNonZeroes * sizeof(clFloatType), h_val, 
+        &err);
+    CL_CHECK_ERROR(err);
+    cl_mem d_cols = clCreateBuffer(ctx, CL_MEM_READ_ONLY | 
+        CL_MEM_COPY_HOST_PTR, numNonZeroes * sizeof(cl_int), h_cols, &err);
+    CL_CHECK_ERROR(err);
+    cl_mem d_rowDelimiters = clCreateBuffer(ctx, CL_MEM_READ_ONLY | 
+        CL_MEM_COPY_HOST_PTR, (numRows+1) * sizeof(cl_int), 
+        h_rowDelimiters, &err);
+    CL_CHECK_ERROR(err);
+    cl_mem d_valcm = clCreateBuffer(ctx, CL_MEM_READ_ONLY | 
+        CL_MEM_COPY_HOST_PTR, maxrl * numRows * sizeof(clFloatType), 
+        h_valcm, &err);
+    CL_CHECK_ERROR(err);
+    cl_mem d_colscm = clCreateBuffer(ctx, CL_MEM_READ_ONLY | 
+        CL_MEM_COPY_HOST_PTR, maxrl * numRows * sizeof(cl_int), h_colscm, 
+        &err);
+    CL_CHECK_ERROR(err);
+    cl_mem d_rowLengths = clCreateBuffer(ctx, CL_MEM_READ_ONLY | 
+        CL_MEM_COPY_HOST_PTR, numRows * sizeof(cl_int), h_rowLengths, &err);
+    CL_CHECK_ERROR(err);
+    cl_mem d_vecs = clCreateBuffer(ctx, CL_MEM_READ_ONLY, blockSize * 
+        sizeof(clFloatType), NULL, &err);
+    CL_CHECK_ERROR(err);
+    cl_mem d_out = clCreateBuffer(ctx, CL_MEM_WRITE_ONLY, blockSize * 
+        sizeof(clFloatType), NULL, &err);
+    CL_CHECK_ERROR(err);
+
+    char atts[TEMP_BUFFER_SIZE];
+    sprintf(atts, "%d_elements_%d_rows_%d_vectors", numNonZeroes, numRows,
+            numVecs);
+    string suffix = (sizeof(float) == sizeof(double)) ? "-DP" : "-SP";
+    double gflop = 2 * (double) numNonZeroes * numVecs;
+
+    for (int layout = 0; layout < 2; layout++)
+    {
+        bool rowMajor = (layout == 0);
+        string layoutName = rowMajor ? "-RowMajor" : "-ColMajor";
+
+        // The block width and layout are compile time constants of the
+        // kernels, so the accumulators stay in registers
+        char spmmFlags[64];
+        sprintf(spmmFlags, " -DNUM_VECS=%d%s", numVecs, 
+                rowMajor ? " -DVEC_ROW_MAJOR" : "");
+        string flags = compileFlags + spmmFlags;
+
+        // Build the openCL kernels, or reuse an earlier build
+        cl_program prog = programCacheGet(ctx, dev, cl_source_spmv, flags,
+                op.getOptionString("program_cache_dir"), resultDB);
+        if (prog == NULL)
+        {
+            break;
+        }
+
+        err = clEnqueueWriteBuffer(queue, d_vecs, true, 0, blockSize * 
+            sizeof(clFloatType), rowMajor ? h_vecsRm : h_vecs, 0, NULL, 
+            NULL);
+        CL_CHECK_ERROR(err);
+
+        cl_kernel csrVector = clCreateKernel(prog, "spmm_csr_vector_kernel",
+                &err);
+        CL_CHECK_ERROR(err);
+        err = clSetKernelArg(csrVector, 0, sizeof(cl_mem), (void*) &d_val);
+        CL_CHECK_ERROR(err);
+        err = clSetKernelArg(csrVector, 1, sizeof(cl_mem), (void*) &d_vecs);
+        CL_CHECK_ERROR(err);
+        err = clSetKernelArg(csrVector, 2, sizeof(cl_mem), (void*) &d_cols);
+        CL_CHECK_ERROR(err);
+        err = clSetKernelArg(csrVector, 3, sizeof(cl_mem), 
+            (void*) &d_rowDelimiters);
+        CL_CHECK_ERROR(err);
+        err = clSetKernelArg(csrVector, 4, sizeof(cl_int), (void*) &numRows);
+        CL_CHECK_ERROR(err);
+        err = clSetKernelArg(csrVector, 5, sizeof(cl_mem), (void*) &d_out);
+        CL_CHECK_ERROR(err);
+
+        cl_kernel ellpackr = clCreateKernel(prog, "spmm_ellpackr_kernel", 
+                &err);
+        CL_CHECK_ERROR(err);
+        err = clSetKernelArg(ellpackr, 0, sizeof(cl_mem), (void*) &d_valcm);
+        CL_CHECK_ERROR(err);
+        err = clSetKernelArg(ellpackr, 1, sizeof(cl_mem), (void*) &d_vecs);
+        CL_CHECK_ERROR(err);
+        err = clSetKernelArg(ellpackr, 2, sizeof(cl_mem), (void*) &d_colscm);
+        CL_CHECK_ERROR(err);
+        err = clSetKernelArg(ellpackr, 3, sizeof(cl_mem), 
+            (void*) &d_rowLengths);
+        CL_CHECK_ERROR(err);
+        err = clSetKernelArg(ellpackr, 4, sizeof(cl_int), (void*) &numRows);
+        CL_CHECK_ERROR(err);
+        err = clSetKernelArg(ellpackr, 5, sizeof(cl_mem), (void*) &d_out);
+        CL_CHECK_ERROR(err);
+
+        // A warp per row, at most BLOCK_SIZE work-items per group
+        size_t maxLocal = getMaxWorkGroupSize(ctx, csrVector);
+        if (maxLocal >= VECTOR_SIZE)
+        {
+            size_t localWorkSize = VECTOR_SIZE;
+            while (localWorkSize+VECTOR_SIZE <= maxLocal && 
+                localWorkSize+VECTOR_SIZE <= BLOCK_SIZE)
+            {
+               localWorkSize += VECTOR_SIZE;
+            }
+            size_t rowsPerGroup = localWorkSize / VECTOR_SIZE;
+            size_t globalWorkSize = ((numRows + rowsPerGroup - 1) / 
+                rowsPerGroup) * localWorkSize;
+            cout << "SpMM CSR Vector Kernel" << layoutName << endl;
+            timeSpmmKernel(queue, resultDB, op, csrVector, globalWorkSize,
+                    localWorkSize, d_out, h_out, h_outCm, refOut, numRows,
+                    numVecs, rowMajor, "SpMM-CSR-Vector"+layoutName+suffix,
+                    atts, gflop);
+        }
+        else
+        {
+            cout << "Warning: SpMM CSRVector requires a work group size >= "
+                 << VECTOR_SIZE << ", skipping this kernel." << endl;
+        }
+
+        size_t localWorkSize = BLOCK_SIZE;
+        size_t globalWorkSize = ((numRows + BLOCK_SIZE - 1) / BLOCK_SIZE) *
+            BLOCK_SIZE;
+        cout << "SpMM ELLPACKR Kernel" << layoutName << endl;
+        timeSpmmKernel(queue, resultDB, op, ellpackr, globalWorkSize,
+                localWorkSize, d_out, h_out, h_outCm, refOut, numRows,
+                numVecs, rowMajor, "SpMM-ELLPACKR"+layoutName+suffix, atts,
+                gflop);
+
+        err = clReleaseKernel(csrVector);
+        CL_CHECK_ERROR(err);
+        err = clReleaseKernel(ellpackr);
+        CL_CHECK_ERROR(err);
+        err = clReleaseProgram(prog);
+        CL_CHECK_ERROR(err);
+    }
+
+    // Free device memory
+    err = clReleaseMemObject(d_val);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_cols);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_rowDelimiters);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_valcm);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_colscm);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_rowLengths);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_vecs);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_out);
+    CL_CHECK_ERROR(err);
+
+    // Free host memory
+    delete[] h_vecs;
+    delete[] h_vecsRm;
+    delete[] h_out;
+    delete[] h_outCm;
+    delete[] refOut;
+    delete[] h_rowLengths;
+    delete[] h_valcm;
+    delete[] h_colscm;
+}
+
+// ****************************************************************************
+// Function: mixedTest
+//
+// Purpose: 
+//   Runs the mixed precision CSR vector kernel with every combination of
+//   float or half value storage, float or double accumulation (double
+//   only when the device has cl_khr_fp64) and 32 or 16-bit column
+//   indices.  Reports Gflop/s, bytes of matrix storage and the normwise
+//   relative error against a CPU reference accumulated in double.
+//
+// Arguements: 
+//   dev: opencl device id
+//   ctx: current opencl context
+//   compileFlags: flags to use when compiling the mixed kernel
+//   queue: the current opencl command queue
+//   resultDB: result database to store results
+//   op: provides access to command line options
+//   h_val: array holding the non-zero values for the matrix
+//   h_cols: array of column indices for each element of A
+//   h_rowDelimiters: array of size dim+1 holding indices to rows of A; 
+//                  last element is the index one past the last
+//                  element of A
+//   h_vec: dense vector of size dim to be used for multiplication
+//   h_out: input - buffer for result of calculation
+//   numRows: number of rows in matrix
+//   numNonZeroes: number of entries in matrix
+// ****************************************************************************
+void mixedTest(cl_device_id dev, cl_context ctx, string compileFlags, 
+               cl_command_queue queue, ResultDatabase& resultDB, 
+               OptionParser& op, float* h_val, int* h_cols, 
+               int* h_rowDelimiters, float* h_vec, float* h_out,
+               int numRows, int numNonZeroes)
+{
+    int err = 0;
+
+    // Reference accumulated in double
+    double *refOut = new double[numRows];
+    double refNorm = 0.0;
+    for (int i=0; i<numRows; i++)
+    {
+        double t = 0.0;
+        for (int j=h_rowDelimiters[i]; j<h_rowDelimiters[i+1]; j++)
+        {
+            t += (double) h_val[j] * (double) h_vec[h_cols[j]];
+        }
+        refOut[i] = t;
+        if (fabs(t) > refNorm) refNorm = fabs(t);
+    }
+
+    // Half values and 16-bit columns
+    unsigned short *h_valHalf = new unsigned short[numNonZeroes];
+    convertToHalf(h_val, numNonZeroes, h_valHalf);
+    unsigned short *h_colOffsets = new unsigned short[numNonZeroes];
+    int *h_rowBase = new int[numRows];
+    int *h_wideCols;
+    int numWide;
+    int wideRows = compressColumns(h_cols, h_rowDelimiters, numRows, 
+            h_colOffsets, h_rowBase, &h_wideCols, &numWide);
+    cout << wideRows << " rows keep 32-bit column indices" << endl;
+
+    char extensions[4096];
+    err = clGetDeviceInfo(dev, CL_DEVICE_EXTENSIONS, sizeof(extensions),
+            extensions, NULL);
+    CL_CHECK_ERROR(err);
+    bool hasDouble = strstr(extensions, "cl_khr_fp64") != NULL;
+
+    cl_mem d_val = clCreateBuffer(ctx, CL_MEM_READ_ONLY | 
+        CL_MEM_COPY_HOST_PTR, numNonZeroes * sizeof(float), h_val, &err);
+    CL_CHECK_ERROR(err);
+    cl_mem d_valHalf = clCreateBuffer(ctx, CL_MEM_READ_ONLY | 
+        CL_MEM_COPY_HOST_PTR, numNonZeroes * sizeof(cl_half), h_valHalf, 
+        &err);
+    CL_CHECK_ERROR(err);
+    cl_mem d_cols = clCreateBuffer(ctx, CL_MEM_READ_ONLY | 
+        CL_MEM_COPY_HOST_PTR, numNonZeroes * sizeof(cl_int), h_cols, &err);
+    CL_CHECK_ERROR(err);
+    cl_mem d_colOffsets = clCreateBuffer(ctx, CL_MEM_READ_ONLY | 
+        CL_MEM_COPY_HOST_PTR, numNonZeroes * sizeof(cl_ushort), 
+        h_colOffsets, &err);
+    CL_CHECK_ERROR(err);
+    cl_mem d_rowBase = clCreateBuffer(ctx, CL_MEM_READ_ONLY | 
+        CL_MEM_COPY_HOST_PTR, numRows * sizeof(cl_int), h_rowBase, &err);
+    CL_CHECK_ERROR(err);
+    cl_mem d_wideCols = clCreateBuffer(ctx, CL_MEM_READ_ONLY | 
+        CL_MEM_COPY_HOST_PTR, (numWide > 0 ? numWide : 1) * sizeof(cl_int),
+        h_wideCols, &err);
+    CL_CHECK_ERROR(err);
+    cl_mem d_rowDelimiters = clCreateBuffer(ctx, CL_MEM_READ_ONLY | 
+        CL_MEM_COPY_HOST_PTR, (numRows+1) * sizeof(cl_int), h_rowDelimiters,
+        &err);
+    CL_CHECK_ERROR(err);
+    cl_mem d_vec = clCreateBuffer(ctx, CL_MEM_READ_ONLY | 
+        CL_MEM_COPY_HOST_PTR, numRows * sizeof(float), h_vec, &err);
+    CL_CHECK_ERROR(err);
+    cl_mem d_out = clCreateBuffer(ctx, CL_MEM_WRITE_ONLY, numRows * 
+        sizeof(float), NULL, &err);
+    CL_CHECK_ERROR(err);
+
+    int passes = testPasses(op);
+    int iters  = testIterations(op);
+    char atts[TEMP_BUFFER_SIZE];
+    sprintf(atts, "%d_elements_%d_rows", numNonZeroes, numRows);
+    double gflop = 2 * (double) numNonZeroes;
+    Event kernelExec("Mixed Kernel Execution");
+
+    for (int variant = 0; variant < 8; variant++)
+    {
+        bool storeHalf = variant & 1;
+        bool accumDouble = variant & 2;
+        bool compressCols = variant & 4;
+        if (accumDouble && !hasDouble)
+        {
+            continue;
+        }
+        string testName = string("Mixed-") + (storeHalf ? "Half" : "Float") +
+            (accumDouble ? "-AccDouble" : "-AccFloat") +
+            (compressCols ? "-Col16" : "-Col32");
+        cout << testName << endl;
+
+        string flags = compileFlags;
+        if (storeHalf) flags += " -DSTORE_HALF";
+        if (accumDouble) flags += " -DACCUM_DOUBLE";
+        if (compressCols) flags += " -DCOMPRESS_COLS";
+
+        // Build the openCL kernels, or reuse an earlier build
+        cl_program prog = programCacheGet(ctx, dev, cl_source_spmv, flags,
+                op.getOptionString("program_cache_dir"), resultDB);
+        if (prog == NULL)
+        {
+            continue;
+        }
+
+        cl_kernel mixed = clCreateKernel(prog, "spmv_csr_mixed_kernel", &err);
+        CL_CHECK_ERROR(err);
+        err = clSetKernelArg(mixed, 0, sizeof(cl_mem), 
+            (void*) (storeHalf ? &d_valHalf : &d_val));
+        CL_CHECK_ERROR(err);
+        err = clSetKernelArg(mixed, 1, sizeof(cl_mem), (void*) &d_vec);
+        CL_CHECK_ERROR(err);
+        err = clSetKernelArg(mixed, 2, sizeof(cl_mem), 
+            (void*) (compressCols ? &d_colOffsets : &d_cols));
+        CL_CHECK_ERROR(err);
+        err = clSetKernelArg(mixed, 3, sizeof(cl_mem), (void*) &d_rowBase);
+        CL_CHECK_ERROR(err);
+        err = clSetKernelArg(mixed, 4, sizeof(cl_mem), (void*) &d_wideCols);
+        CL_CHECK_ERROR(err);
+        err = clSetKernelArg(mixed, 5, sizeof(cl_mem), 
+            (void*) &d_rowDelimiters);
+        CL_CHECK_ERROR(err);
+        err = clSetKernelArg(mixed, 6, sizeof(cl_int), (void*) &numRows);
+        CL_CHECK_ERROR(err);
+        err = clSetKernelArg(mixed, 7, sizeof(cl_mem), (void*) &d_out);
+        CL_CHECK_ERROR(err);
 
-      // Clobber correct answer, so we can be sure the vector kernel is correct
-      err = clEnqueueWriteBuffer(queue, d_out, true, 0, numRows * 
-          sizeof(float), h_vec, 0, NULL, NULL); 
-      CL_CHECK_ERROR(err);
-      
-      cout << "CSR Vector Kernel\n";
-      // Verify Local work group size
-      size_t maxLocal = getMaxWorkGroupSize(ctx, csrVector);
-      if (maxLocal < 32)
-      {
-         cout << "Warning: CSRVector requires a work group size >= 32" << endl;
-         cout << "Skipping this kernel." << endl;
-         err = clReleaseMemObject(d_rowDelimiters); 
-         CL_CHECK_ERROR(err);    
-         err = clReleaseMemObject(d_vec); 
-         CL_CHECK_ERROR(err);
-         err = clReleaseMemObject(d_out); 
-         CL_CHECK_ERROR(err);
-         err = clReleaseMemObject(d_val); 
-         CL_CHECK_ERROR(err);
-         err = clReleaseMemObject(d_cols); 
-         CL_CHECK_ERROR(err);
-         err = clReleaseKernel(csrScalar);
-         CL_CHECK_ERROR(err);
-         err = clReleaseKernel(csrVector);
-         CL_CHECK_ERROR(err);
-         err = clReleaseProgram(prog);
-         CL_CHECK_ERROR(err);
-         return;
-      }
-      localWorkSize = VECTOR_SIZE;
-      while (localWorkSize+VECTOR_SIZE <= maxLocal && 
-          localWorkSize+VECTOR_SIZE <= BLOCK_SIZE)
-      {
-         localWorkSize += VECTOR_SIZE;
-      }
-      const size_t vectorGlobalWSize = numRows * VECTOR_SIZE; // 1 warp per row
+        size_t maxLocal = getMaxWorkGroupSize(ctx, mixed);
+        size_t localWorkSize = VECTOR_SIZE;
+        while (localWorkSize+VECTOR_SIZE <= maxLocal && 
+            localWorkSize+VECTOR_SIZE <= BLOCK_SIZE)
+        {
+           localWorkSize += VECTOR_SIZE;
+        }
+        size_t rowsPerGroup = localWorkSize / VECTOR_SIZE;
+        size_t globalWorkSize = ((numRows + rowsPerGroup - 1) / 
+            rowsPerGroup) * localWorkSize;
 
-      for (int k = 0; k < passes; k++)
-      {
-          // Run Vector Kernel
-          double vectorKernelTime = 0.0;
-          for (int j = 0; j < iters; j++)
-          {              
-             err = clEnqueueNDRangeKernel(queue, csrVector, 1, NULL,
-                  &vectorGlobalWSize, &localWorkSize, 0, NULL, 
-                  &kernelExec.CLEvent());
-             CL_CHECK_ERROR(err);
-             err = clFinish(queue);
-             CL_CHECK_ERROR(err);
-             kernelExec.FillTimingInfo();
-             vectorKernelTime += kernelExec.StartEndRuntime();
-          }   
-          
-         Event outTransfer("d->h data transfer");
-         err = clEnqueueReadBuffer(queue, d_out, true, 0, numRows * 
-             sizeof(float), h_out, 0, NULL, &outTransfer.CLEvent()); 
-         CL_CHECK_ERROR(err);
-         err = clFinish(queue);
-         CL_CHECK_ERROR(err);
-         outTransfer.FillTimingInfo();
-         double oTransferTime = outTransfer.FillTimingInfo();
-         
-          // Compare reference solution to GPU result
-          if (! verifyResults(refOut, h_out, numRows, k))
-          {
-              return;  // If results don't match, don't report performance
-          }
-          vectorKernelTime = vectorKernelTime / (double)iters;
-          string testName = prefix+"CSR-Vector"+suffix;
-          double totalTransfer = iTransferTime + oTransferTime;
-          resultDB.AddResult(testName, atts, "Gflop/s", gflop/vectorKernelTime);
-          resultDB.AddResult(testName+"_PCIe", atts, "Gflop/s",
-                            gflop/(vectorKernelTime+totalTransfer));
-      }
-      
-      // Free device memory
-      err = clReleaseMemObject(d_rowDelimiters); 
-      CL_CHECK_ERROR(err);    
-      err = clReleaseMemObject(d_vec); 
-      CL_CHECK_ERROR(err);
-      err = clReleaseMemObject(d_out); 
-      CL_CHECK_ERROR(err);
-      err = clReleaseMemObject(d_val); 
-      CL_CHECK_ERROR(err);
-      err = clReleaseMemObject(d_cols); 
-      CL_CHECK_ERROR(err);
-      err = clReleaseKernel(csrScalar);
-      CL_CHECK_ERROR(err);
-      err = clReleaseKernel(csrVector);
-      CL_CHECK_ERROR(err);
-      err = clReleaseProgram(prog);
-      CL_CHECK_ERROR(err);
+        // Bytes of matrix storage read by the kernel
+        double bytes = numNonZeroes * (storeHalf ? 2.0 : 4.0) + 
+            (numRows + 1) * 4.0;
+        if (compressCols)
+        {
+            bytes += numNonZeroes * 2.0 + numRows * 4.0 + numWide * 4.0;
+        }
+        else
+        {
+            bytes += numNonZeroes * 4.0;
+        }
+
+        for (int k = 0; k < passes; k++)
+        {
+            double totalKernelTime = 0.0;
+            for (int j = 0; j < iters; j++)
+            {
+                err = clEnqueueNDRangeKernel(queue, mixed, 1, NULL,
+                    &globalWorkSize, &localWorkSize, 0, NULL,
+                    &kernelExec.CLEvent());
+                CL_CHECK_ERROR(err);
+                err = clFinish(queue);
+                CL_CHECK_ERROR(err);
+                kernelExec.FillTimingInfo();
+                totalKernelTime += kernelExec.StartEndRuntime();
+            }
+            err = clEnqueueReadBuffer(queue, d_out, true, 0, numRows * 
+                sizeof(float), h_out, 0, NULL, NULL);
+            CL_CHECK_ERROR(err);
+
+            // Normwise relative error against the double reference
+            double maxDiff = 0.0;
+            for (int i=0; i<numRows; i++)
+            {
+                double d = fabs(h_out[i] - refOut[i]);
+                if (!(d <= maxDiff)) maxDiff = d;   // catches nan
+            }
+            double relErr = (refNorm > 0.0) ? maxDiff / refNorm : maxDiff;
+            if (!(relErr <= MIXED_MAX_RELATIVE_ERROR))
+            {
+                printf("---FAILED--- relative error %g\n", relErr);
+                break;  // If results don't match, don't report performance
+            }
+            printf("Passed! relative error %g\n", relErr);
+
+            double avgTime = totalKernelTime / (double)iters;
+            resultDB.AddResult(testName, atts, "Gflop/s", gflop/avgTime);
+            resultDB.AddResult(testName+"_RelErr", atts, "error", relErr);
+            resultDB.AddResult(testName+"_Bytes", atts, "Bytes", bytes);
+        }
+
+        err = clReleaseKernel(mixed);
+        CL_CHECK_ERROR(err);
+        err = clReleaseProgram(prog);
+        CL_CHECK_ERROR(err);
+    }
+
+    // Free device memory
+    err = clReleaseMemObject(d_val);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_valHalf);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_cols);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_colOffsets);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_rowBase);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_wideCols);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_rowDelimiters);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_vec);
+    CL_CHECK_ERROR(err);
+    err = clReleaseMemObject(d_out);
+    CL_CHECK_ERROR(err);
+
+    // Free host memory
+    delete[] refOut;
+    delete[] h_valHalf;
+    delete[] h_colOffsets;
+    delete[] h_rowBase;
+    delete[] h_wideCols;
+}
+
+// Formats the auto mode chooses from
+enum SpmvFormat {
+    SPMV_CSR_SCALAR = 0,
+    SPMV_CSR_VECTOR,
+    SPMV_ELLPACKR,
+    SPMV_SELL,
+    SPMV_MERGE,
+    SPMV_NUM_FORMATS
+};
+
+static const char *SPMV_FORMAT_NAMES[] = {"CSR-Scalar", "CSR-Vector",
+    "ELLPACKR", "SELL-C-sigma", "CSR-MergePath"};
+
+// ****************************************************************************
+// Function: rankFormats
+//
+// Purpose:
+//   Estimates the cost per non-zero of each format from the row length
+//   statistics of a matrix and orders the formats from cheapest to most
+//   expensive
+//
+// Arguments:
+//   stats: row length statistics of the matrix
+//   cost: output - estimated cost of each format
+//   order: output - formats sorted by increasing cost
+//
+// Returns:  nothing
+// ****************************************************************************
+void rankFormats(const RowStats &stats, double cost[], int order[])
+{
+    cost[SPMV_CSR_SCALAR] = UNCOALESCED_PENALTY / stats.warpEfficiency;
+    cost[SPMV_CSR_VECTOR] = 1.0 / stats.vectorEfficiency +
+        VECTOR_REDUCTION_COST / (stats.mean > 1.0 ? stats.mean : 1.0);
+    cost[SPMV_ELLPACKR] = 1.0 / stats.warpEfficiency;
+    if (stats.ellPadRatio > ELL_MAX_PAD_RATIO)
+    {
+        cost[SPMV_ELLPACKR] = HUGE_VAL;
+    }
+    cost[SPMV_SELL] = 1.0 / stats.sellEfficiency + SELL_PERMUTATION_COST;
+    cost[SPMV_MERGE] = MERGE_PATH_COST;
+
+    for (int f=0; f<SPMV_NUM_FORMATS; f++)
+    {
+        int j = f;
+        while (j > 0 && cost[order[j-1]] > cost[f])
+        {
+            order[j] = order[j-1];
+            j--;
+        }
+        order[j] = f;
+    }
+}
+
+// ****************************************************************************
+// Function: chooseLocalSize
+//
+// Purpose:
+//   Picks the largest work-group size, down to 64, that still gives every
+//   compute unit AUTO_GROUPS_PER_CU work-groups
+//
+// Arguments:
+//   dev: opencl device id
+//   numWorkItems: global number of work-items of the kernel
+//
+// Returns:  the work-group size
+// ****************************************************************************
+size_t chooseLocalSize(cl_device_id dev, size_t numWorkItems)
+{
+    cl_uint computeUnits = 1;
+    int err = clGetDeviceInfo(dev, CL_DEVICE_MAX_COMPUTE_UNITS,
+            sizeof(computeUnits), &computeUnits, NULL);
+    CL_CHECK_ERROR(err);
+
+    size_t localSize = BLOCK_SIZE;
+    while (localSize > 64 &&
+           numWorkItems / localSize < (size_t) AUTO_GROUPS_PER_CU * computeUnits)
+    {
+        localSize /= 2;
+    }
+    return localSize;
+}
+
+// ****************************************************************************
+// Function: runFormat
+//
+// Purpose:
+//   Runs the test of one format; see autoTest for the arguments
+//
+// Returns:  Gflop/s of the test, 0 on failure
+// ****************************************************************************
+double runFormat(int format, cl_device_id dev, cl_context ctx,
+                 string compileFlags, cl_command_queue queue,
+                 ResultDatabase& resultDB, OptionParser& op, float* h_val,
+                 int* h_cols, int* h_rowDelimiters, float* h_vec,
+                 float* h_out, int numRows, int numNonZeroes, float* refOut,
+                 int paddedSize, const size_t maxImgWidth,
+                 bool devSupportsImages, size_t localSize)
+{
+    switch (format)
+    {
+    case SPMV_CSR_SCALAR:
+        return csrTest(dev, ctx, compileFlags, queue, resultDB, op, h_val,
+                h_cols, h_rowDelimiters, h_vec, h_out, numRows, numNonZeroes,
+                refOut, false, maxImgWidth, devSupportsImages,
+                CSR_KERNEL_SCALAR, localSize);
+    case SPMV_CSR_VECTOR:
+        return csrTest(dev, ctx, compileFlags, queue, resultDB, op, h_val,
+                h_cols, h_rowDelimiters, h_vec, h_out, numRows, numNonZeroes,
+                refOut, false, maxImgWidth, devSupportsImages,
+                CSR_KERNEL_VECTOR);
+    case SPMV_ELLPACKR:
+        return ellPackTest(dev, ctx, compileFlags, queue, resultDB, op, h_val,
+                h_cols, h_rowDelimiters, h_vec, h_out, numRows, numNonZeroes,
+                refOut, false, paddedSize, maxImgWidth, devSupportsImages,
+                localSize);
+    case SPMV_SELL:
+        return sellTest(dev, ctx, compileFlags, queue, resultDB, op, h_val,
+                h_cols, h_rowDelimiters, h_vec, h_out, numRows, numNonZeroes,
+                refOut, localSize);
+    default:
+        return mergeTest(dev, ctx, compileFlags, queue, resultDB, op, h_val,
+                h_cols, h_rowDelimiters, h_vec, h_out, numRows, numNonZeroes,
+                refOut);
+    }
+}
+
+// ****************************************************************************
+// Function: autoTest
+//
+// Purpose:
+//   Picks the SpMV format and work-group size expected to be fastest
+//   from the row length statistics of the matrix, optionally checks the
+//   pick by timing a short run of the best candidates, and runs only the
+//   chosen format
+//
+// Arguements:
+//   dev: opencl device id
+//   ctx: current opencl context
+//   compileFlags: flags to use when compiling the kernels
+//   queue: the current opencl command queue
+//   resultDB: result database to store results
+//   op: provides access to command line options
+//   h_val: array holding the non-zero values for the matrix
+//   h_cols: array of column indices for each element of A
+//   h_rowDelimiters: array of size dim+1 holding indices to rows of A;
+//                  last element is the index one past the last
+//                  element of A
+//   h_vec: dense vector of size dim to be used for multiplication
+//   h_out: input - buffer for result of calculation
+//   numRows: number of rows in matrix
+//   numNonZeroes: number of entries in matrix
+//   refOut: solution computed on cpu
+//   paddedSize: size of matrix when padded
+//   maxImgWidth: maximum width of the vector image
+//   devSupportsImages: whether the vector is read through an image
+// ****************************************************************************
+void autoTest(cl_device_id dev, cl_context ctx, string compileFlags,
+              cl_command_queue queue, ResultDatabase& resultDB,
+              OptionParser& op, float* h_val, int* h_cols,
+              int* h_rowDelimiters, float* h_vec, float* h_out,
+              int numRows, int numNonZeroes, float* refOut, int paddedSize,
+              const size_t maxImgWidth, bool devSupportsImages)
+{
+    RowStats stats;
+    computeRowStats(h_rowDelimiters, numRows, op.getOptionInt("sell_c"),
+                    op.getOptionInt("sell_sigma"), &stats);
+    cout << "Row lengths: min " << stats.minrl << ", max " << stats.maxrl
+         << ", mean " << stats.mean << ", variance " << stats.variance
+         << ", empty " << stats.emptyRows << endl;
+    cout << "ELLPACK-R padding ratio " << stats.ellPadRatio << endl;
+
+    double cost[SPMV_NUM_FORMATS];
+    int order[SPMV_NUM_FORMATS];
+    rankFormats(stats, cost, order);
+    for (int i=0; i<SPMV_NUM_FORMATS; i++)
+    {
+        cout << "  " << SPMV_FORMAT_NAMES[order[i]] << ": estimated cost "
+             << cost[order[i]] << endl;
+    }
+    size_t localSize = chooseLocalSize(dev, numRows);
+    int format = order[0];
+
+    // Time a short run of the best candidates, results are not reported
+    int candidates = op.getOptionInt("auto_probe");
+    if (candidates > SPMV_NUM_FORMATS)
+    {
+        candidates = SPMV_NUM_FORMATS;
+    }
+    if (candidates > 1)
+    {
+        ResultDatabase probeDB;
+        double bestRate = 0.0;
+        probeIterations = op.getOptionInt("auto_probe_iterations");
+        for (int i=0; i<candidates && cost[order[i]] < HUGE_VAL; i++)
+        {
+            double rate = runFormat(order[i], dev, ctx, compileFlags, queue,
+                    probeDB, op, h_val, h_cols, h_rowDelimiters, h_vec,
+                    h_out, numRows, numNonZeroes, refOut, paddedSize,
+                    maxImgWidth, devSupportsImages, localSize);
+            cout << "  probe " << SPMV_FORMAT_NAMES[order[i]] << ": " << rate
+                 << " Gflop/s" << endl;
+            if (rate > bestRate)
+            {
+                bestRate = rate;
+                format = order[i];
+            }
+        }
+        probeIterations = 0;
+    }
+
+    cout << "Auto format: " << SPMV_FORMAT_NAMES[format] << ", work-group "
+         << "size " << localSize << endl;
+    runFormat(format, dev, ctx, compileFlags, queue, resultDB, op, h_val,
+              h_cols, h_rowDelimiters, h_vec, h_out, numRows, numNonZeroes,
+              refOut, paddedSize, maxImgWidth, devSupportsImages, localSize);
+}
+
+// ****************************************************************************
+// Function: rcmReorder
+//
+// Purpose:
+//   Renumbers the rows and columns of the matrix in reverse Cuthill-McKee
+//   order to bring the vector entries each row reads close together, and
+//   moves the input vector and the reference result to the new
+//   numbering.  Reports the bandwidth before and after.
+//
+// Arguements:
+//   resultDB: result database to store results
+//   op: provides access to command line options
+//   h_val, h_cols, h_rowDelimiters: input - the matrix in CSR format
+//                                   output - the reordered matrix
+//   h_vec: dense vector of size dim, permuted in place
+//   refOut: solution computed on cpu, permuted in place
+//   numRows: number of rows in matrix
+// ****************************************************************************
+void rcmReorder(ResultDatabase& resultDB, OptionParser& op, float** h_val,
+                int** h_cols, int** h_rowDelimiters, float* h_vec,
+                float* refOut, int numRows)
+{
+    char atts[TEMP_BUFFER_SIZE];
+    sprintf(atts, "%d_elements_%d_rows", (*h_rowDelimiters)[numRows], 
+            numRows);
+    int before = matrixBandwidth(*h_cols, *h_rowDelimiters, numRows);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int *perm = new int[numRows];
+    computeRcmOrdering(*h_cols, *h_rowDelimiters, numRows,
+                       op.getOptionFloat("rcm_dense"), perm);
+    float *newVal;
+    int *newCols, *newRowDelimiters;
+    permuteMatrix(*h_val, *h_cols, *h_rowDelimiters, numRows, perm, &newVal,
+                  &newCols, &newRowDelimiters);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) +
+                     (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+    freeMatrix(*h_val, *h_cols, *h_rowDelimiters);
+    *h_val = newVal;
+    *h_cols = newCols;
+    *h_rowDelimiters = newRowDelimiters;
+
+    // The kernels compute P*A*P^T * (P*vec) = P*(A*vec)
+    float *tmp = new float[numRows];
+    permuteVector(h_vec, perm, numRows, false, tmp);
+    memcpy(h_vec, tmp, numRows * sizeof(float));
+    permuteVector(refOut, perm, numRows, false, tmp);
+    memcpy(refOut, tmp, numRows * sizeof(float));
+    delete[] tmp;
+    delete[] perm;
+
+    int after = matrixBandwidth(*h_cols, *h_rowDelimiters, numRows);
+    cout << "RCM bandwidth " << before << " -> " << after << endl;
+    resultDB.AddResult("RCM_Bandwidth_Before", atts, "rows", before);
+    resultDB.AddResult("RCM_Bandwidth_After", atts, "rows", after);
+    resultDB.AddResult("RCM_Time", atts, "s", seconds);
+}
+
+// ****************************************************************************
+// Function: addBenchmarkSpecOptions
+//
+// Purpose:
+//   Add benchmark specific options parsing
+//
+// Arguments:
+//   op: the options parser / parameter database
+//
+// Returns:  nothing
+//
+// ****************************************************************************
+void addBenchmarkSpecOptions(OptionParser &op)
+{
+    op.addOption("iterations", OPT_INT, "100", "Number of SpMV iterations "
+                 "per pass");
+    op.addOption("mm_filename", OPT_STRING, "random", "Name of file "
+                 "which stores the matrix in Matrix Market format");
+    op.addOption("maxval", OPT_FLOAT, "10", "Maximum value for random "
+                 "matrices");
+    op.addOption("program_cache_dir", OPT_STRING, "spmv_program_cache",
+                 "Directory of saved OpenCL program binaries, empty to "
+                 "always compile from source");
+    op.addOption("no_mm_cache", OPT_BOOL, "0", "Do not read or write the "
+                 "binary CSR cache of the Matrix Market file");
+    op.addOption("cpu_threads", OPT_INT, "0", "Threads used by the CPU "
+                 "SpMV engine, 0 for one per core");
+    op.addOption("merge_items", OPT_INT, "16", "Merge path items (rows "
+                 "plus non-zeroes) handled by each thread of the merge kernel");
+    char sellC[16], sellSigma[16];
+    sprintf(sellC, "%d", SELL_SLICE_HEIGHT);
+    sprintf(sellSigma, "%d", SELL_SORT_WINDOW);
+    op.addOption("sell_c", OPT_INT, sellC, "Slice height (C) of the "
+                 "SELL-C-sigma format");
+    op.addOption("sell_sigma", OPT_INT, sellSigma, "Sorting window (sigma) of "
+                 "the SELL-C-sigma format");
+    op.addOption("rcm", OPT_BOOL, "0", "Reorder the matrix with reverse "
+                 "Cuthill-McKee before running the kernels");
+    op.addOption("rcm_dense", OPT_FLOAT, "0", "Rows with more than this "
+                 "many times the mean number of neighbours are numbered last "
+                 "by the reordering, 0 to disable");
+    op.addOption("mixed", OPT_BOOL, "0", "Run the mixed precision "
+                 "storage and accumulation variants of the CSR vector kernel");
+    op.addOption("spmm_vecs", OPT_INT, "8", "Number of dense vectors "
+                 "multiplied at once by the SpMM kernels, 0 to skip them");
+    op.addOption("format", OPT_STRING, "all", "SpMV formats to run: "
+                 "\"all\", or \"auto\" to pick one from the row lengths");
+    op.addOption("auto_probe", OPT_INT, "0", "Number of best candidate "
+                 "formats the auto mode times before choosing, 0 to trust "
+                 "the estimate");
+    op.addOption("auto_probe_iterations", OPT_INT, "10", "Iterations per "
+                 "candidate of the auto mode probe");
 }
 
 // ****************************************************************************
@@ -788,7 +2275,7 @@ void RunTest(cl_device_id dev, cl_context ctx, cl_command_queue queue,
     {   char filename[FIELD_LENGTH];
         strcpy(filename, inFileName.c_str());
         readMatrix(filename, &h_val, &h_cols, &h_rowDelimiters,
-                &nItems, &numRows);
+                &nItems, &numRows, !op.getOptionBool("no_mm_cache"));
     }
     
     // Final Image Check -- Make sure the image format is supported.
@@ -818,17 +2305,43 @@ void RunTest(cl_device_id dev, cl_context ctx, cl_command_queue queue,
     h_rowDelimitersPad = new int[numRows+1];
     fill(h_vec, numRows, op.getOptionFloat("maxval")); 
 
+    // Compute reference solution
+    spmvCpu(h_val, h_cols, h_rowDelimiters, h_vec, numRows, refOut);
+
+    // Reorder after the reference is computed, so every kernel also
+    // checks the permutation
+    if (op.getOptionBool("rcm"))
+    {
+        rcmReorder(resultDB, op, &h_val, &h_cols, &h_rowDelimiters, h_vec,
+                   refOut, numRows);
+    }
+
     // Set up the padded data structures
     int paddedSize = numRows + (PAD_FACTOR - numRows % PAD_FACTOR);
     h_out = new float[paddedSize]; 
     convertToPadded(h_val, h_cols, numRows, h_rowDelimiters, &h_valPad,
             &h_colsPad, h_rowDelimitersPad, &nItemsPadded);
-    
-    // Compute reference solution
-    spmvCpu(h_val, h_cols, h_rowDelimiters, h_vec, numRows, refOut);
+
+    // In auto mode run only the format picked for this matrix
+    bool autoFormat = (op.getOptionString("format") == "auto");
+
+    // Time the CPU engine as the baseline for the device kernels
+    if (!autoFormat)
+    {
+        cout << "CPU Test\n";
+        cpuTest(resultDB, op, h_val, h_cols, h_rowDelimiters, h_vec, h_out,
+                numRows, nItems, refOut);
+    }
 
     // Dispatch based on whether or not device supports OpenCL images
-    if (deviceSupportsImages) 
+    if (autoFormat)
+    {
+        cout << "Auto Format Test\n";
+        autoTest(dev, ctx, compileFlags, queue, resultDB, op, h_val, h_cols,
+                 h_rowDelimiters, h_vec, h_out, numRows, nItems, refOut,
+                 paddedSize, maxImgWidth, deviceSupportsImages);
+    }
+    else if (deviceSupportsImages) 
     {
         cout << "CSR Test\n";
         csrTest<float, clFloatType, true>
@@ -849,6 +2362,16 @@ void RunTest(cl_device_id dev, cl_context ctx, cl_command_queue queue,
             (dev, ctx, compileFlags, queue, resultDB, op, h_val, h_cols, 
              h_rowDelimiters, h_vec, h_out, numRows, nItems, 
              refOut, false, paddedSize, maxImgWidth);
+
+        // Test SELL-C-sigma kernel
+        cout << "SELL-C-sigma Test\n";
+        sellTest(dev, ctx, compileFlags, queue, resultDB, op, h_val, h_cols,
+                 h_rowDelimiters, h_vec, h_out, numRows, nItems, refOut);
+
+        // Test load-balanced merge-path CSR kernel
+        cout << "CSR Merge-Path Test\n";
+        mergeTest(dev, ctx, compileFlags, queue, resultDB, op, h_val, h_cols,
+                  h_rowDelimiters, h_vec, h_out, numRows, nItems, refOut);
     } else {
         cout << "CSR Test\n";
         csrTest<float, clFloatType, false>
@@ -869,9 +2392,41 @@ void RunTest(cl_device_id dev, cl_context ctx, cl_command_queue queue,
             (dev, ctx, compileFlags, queue, resultDB, op, h_val, h_cols, 
              h_rowDelimiters, h_vec, h_out, numRows, nItems, 
              refOut, false, paddedSize, 0);
+
+        // Test SELL-C-sigma kernel
+        cout << "SELL-C-sigma Test\n";
+        sellTest(dev, ctx, compileFlags, queue, resultDB, op, h_val, h_cols,
+                 h_rowDelimiters, h_vec, h_out, numRows, nItems, refOut);
+
+        // Test load-balanced merge-path CSR kernel
+        cout << "CSR Merge-Path Test\n";
+        mergeTest(dev, ctx, compileFlags, queue, resultDB, op, h_val, h_cols,
+                  h_rowDelimiters, h_vec, h_out, numRows, nItems, refOut);
+    }
+
+    // Trade storage precision for bandwidth
+    if (!autoFormat && op.getOptionBool("mixed"))
+    {
+        cout << "Mixed Precision Test\n";
+        mixedTest(dev, ctx, compileFlags, queue, resultDB, op, h_val, h_cols,
+                  h_rowDelimiters, h_vec, h_out, numRows, nItems);
+    }
+
+    // Multiply by a block of vectors, reusing each non-zero
+    if (!autoFormat && op.getOptionInt("spmm_vecs") > 0)
+    {
+        cout << "SpMM Test\n";
+        spmmTest(dev, ctx, compileFlags, queue, resultDB, op, h_val, h_cols,
+                 h_rowDelimiters, numRows, nItems);
     }
-    delete[] h_val, h_cols, h_rowDelimiters, h_vec, h_out;
-    delete[] h_valPad, h_colsPad, h_rowDelimitersPad;
+    programCacheClear();
+    freeMatrix(h_val, h_cols, h_rowDelimiters);
+    delete[] h_vec;
+    delete[] h_out;
+    delete[] refOut;
+    delete[] h_valPad;
+    delete[] h_colsPad;
+    delete[] h_rowDelimitersPad;
 }
 
 int main(int argc, char** argv) {
@@ -0,0 +1,265 @@
+#ifndef PROGRAM_CACHE_H_
+#define PROGRAM_CACHE_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "ResultDatabase.h"
+
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// One built program, kept for the lifetime of the cache
+struct CachedProgram {
+    cl_context ctx;
+    cl_device_id dev;
+    unsigned long long key;
+    std::string flags;
+    cl_program prog;
+};
+
+static std::vector<CachedProgram> programCache;
+
+// 64-bit FNV-1a, used to name and look up cached programs
+static unsigned long long programCacheHash(const char *data, size_t n,
+        unsigned long long h = 14695981039346656037ULL)
+{
+    for (size_t i=0; i<n; i++)
+    {
+        h ^= (unsigned char) data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Hash of a device property string, so binaries of another device or
+// driver are never loaded
+static unsigned long long programCacheHashDeviceInfo(cl_device_id dev,
+        cl_device_info param, unsigned long long h)
+{
+    char info[1024];
+    size_t size = 0;
+    if (clGetDeviceInfo(dev, param, sizeof(info), info, &size) != CL_SUCCESS)
+    {
+        return h;
+    }
+    return programCacheHash(info, size, h);
+}
+
+static double programCacheSeconds()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Reads a program binary written by programCacheStore, NULL if absent
+static unsigned char *programCacheLoad(const std::string &path, size_t *size)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if (f == NULL)
+    {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *binary = NULL;
+    if (n > 0)
+    {
+        binary = new unsigned char[n];
+        if (fread(binary, 1, n, f) != (size_t) n)
+        {
+            delete[] binary;
+            binary = NULL;
+        }
+    }
+    fclose(f);
+    *size = (size_t) n;
+    return binary;
+}
+
+// Writes the binary of a built program; goes through a temporary file so
+// a concurrent reader never sees a partial binary
+static void programCacheStore(const std::string &dir, const std::string &path,
+                              cl_program prog)
+{
+    size_t size = 0;
+    if (clGetProgramInfo(prog, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size,
+                         NULL) != CL_SUCCESS || size == 0)
+    {
+        return;
+    }
+    unsigned char *binary = new unsigned char[size];
+    if (clGetProgramInfo(prog, CL_PROGRAM_BINARIES, sizeof(binary), &binary,
+                         NULL) == CL_SUCCESS)
+    {
+        mkdir(dir.c_str(), 0755);
+        char tmp[32];
+        sprintf(tmp, ".%d", (int) getpid());
+        std::string tmpPath = path + tmp;
+        FILE *f = fopen(tmpPath.c_str(), "wb");
+        if (f != NULL)
+        {
+            bool ok = fwrite(binary, 1, size, f) == size;
+            ok = (fclose(f) == 0) && ok;
+            if (ok)
+            {
+                rename(tmpPath.c_str(), path.c_str());
+            }
+            else
+            {
+                unlink(tmpPath.c_str());
+            }
+        }
+    }
+    delete[] binary;
+}
+
+// ****************************************************************************
+// Function: programCacheGet
+//
+// Purpose:
+//   Returns the program built from source with the given flags for one
+//   device, building it at most once per context.  With a cache
+//   directory, the binary is also saved there and later processes load
+//   it instead of compiling the source.  Every actual build is reported
+//   as Program_Build_Time, so it does not end up in any kernel timing.
+//
+// Arguments:
+//   ctx: opencl context
+//   dev: device to build for
+//   source: program source
+//   flags: compile flags
+//   cacheDir: directory of program binaries, empty to keep them in memory
+//   resultDB: result database to store build times
+//
+// Returns:  the program, retained for the caller (release it when done),
+//           or NULL if it does not build
+// ****************************************************************************
+static cl_program programCacheGet(cl_context ctx, cl_device_id dev,
+                                  const char *source, const std::string &flags,
+                                  const std::string &cacheDir,
+                                  ResultDatabase &resultDB)
+{
+    unsigned long long key = programCacheHash(source, strlen(source));
+    key = programCacheHash(flags.c_str(), flags.size(), key);
+    for (size_t i=0; i<programCache.size(); i++)
+    {
+        CachedProgram &c = programCache[i];
+        if (c.ctx == ctx && c.dev == dev && c.key == key && c.flags == flags)
+        {
+            clRetainProgram(c.prog);
+            return c.prog;
+        }
+    }
+
+    unsigned long long fileKey = key;
+    fileKey = programCacheHashDeviceInfo(dev, CL_DEVICE_VENDOR, fileKey);
+    fileKey = programCacheHashDeviceInfo(dev, CL_DEVICE_NAME, fileKey);
+    fileKey = programCacheHashDeviceInfo(dev, CL_DRIVER_VERSION, fileKey);
+    char name[32];
+    sprintf(name, "/%016llx.bin", fileKey);
+    std::string path = cacheDir + name;
+
+    double start = programCacheSeconds();
+    int err = CL_SUCCESS;
+    cl_program prog = NULL;
+    bool fromBinary = false;
+
+    // Try the saved binary first, fall back to source if the driver
+    // rejects it
+    if (!cacheDir.empty())
+    {
+        size_t size = 0;
+        unsigned char *binary = programCacheLoad(path, &size);
+        if (binary != NULL)
+        {
+            cl_int status;
+            const unsigned char *binaries[1] = {binary};
+            prog = clCreateProgramWithBinary(ctx, 1, &dev, &size, binaries,
+                                             &status, &err);
+            if (err == CL_SUCCESS && status == CL_SUCCESS)
+            {
+                err = clBuildProgram(prog, 1, &dev, flags.c_str(), NULL, NULL);
+                fromBinary = (err == CL_SUCCESS);
+            }
+            if (!fromBinary && prog != NULL)
+            {
+                clReleaseProgram(prog);
+                prog = NULL;
+            }
+            delete[] binary;
+        }
+    }
+
+    if (!fromBinary)
+    {
+        prog = clCreateProgramWithSource(ctx, 1, &source, NULL, &err);
+        if (err != CL_SUCCESS)
+        {
+            return NULL;
+        }
+        err = clBuildProgram(prog, 1, &dev, flags.c_str(), NULL, NULL);
+
+        // If there is a build error, print the output and return
+        if (err != CL_SUCCESS)
+        {
+            char log[5000];
+            size_t retsize = 0;
+            clGetProgramBuildInfo(prog, dev, CL_PROGRAM_BUILD_LOG,
+                                  sizeof(log), log, &retsize);
+            std::cout << "Retsize: " << retsize << std::endl;
+            std::cout << "Log: " << log << std::endl;
+            clReleaseProgram(prog);
+            return NULL;
+        }
+        if (!cacheDir.empty())
+        {
+            programCacheStore(cacheDir, path, prog);
+        }
+    }
+
+    double seconds = programCacheSeconds() - start;
+    resultDB.AddResult("Program_Build_Time",
+                       fromBinary ? "from_binary" : "from_source", "s",
+                       seconds);
+
+    CachedProgram c;
+    c.ctx = ctx;
+    c.dev = dev;
+    c.key = key;
+    c.flags = flags;
+    c.prog = prog;
+    programCache.push_back(c);
+    clRetainProgram(prog);
+    return prog;
+}
+
+// ****************************************************************************
+// Function: programCacheClear
+//
+// Purpose:
+//   Releases every cached program; call before the contexts they were
+//   built in are released
+//
+// Returns:  nothing
+// ****************************************************************************
+static void programCacheClear()
+{
+    for (size_t i=0; i<programCache.size(); i++)
+    {
+        clReleaseProgram(programCache[i].prog);
+    }
+    programCache.clear();
+}
+
+#endif // PROGRAM_CACHE_H_
@@ -248,3 +248,485 @@ spmv_ellpackr_vector_kernel(__global const float * restrict val,
 }
 
 
+
+// ****************************************************************************
+// Function: spmv_sellcs_kernel
+//
+// Purpose:
+//   Computes sparse matrix - vector multiplication on the GPU using
+//   the SELL-C-sigma data storage format, using a thread per row of the
+//   sorted matrix
+//
+// Arguments:
+//   val: array holding the non-zero values for the matrix, stored in
+//   slices of sliceHeight rows in column major format, each padded with
+//   zeros up to the length of the longest row in the slice
+//   vec: dense vector for multiplication
+//   cols: array of column indices for each element of the sparse matrix
+//   sliceStart: array of size numSlices+1 holding the offset of each slice
+//   rowLengths: array storing the length of each row in sorted order
+//   rowPerm: array mapping each sorted row to its original row
+//   dim: number of rows in the matrix
+//   sliceHeight: number of rows per slice
+//   out: output - result from the spmv calculation
+//
+// Returns:  nothing directly
+//           out indirectly through a pointer
+//
+// Modifications:
+//
+// ****************************************************************************
+__kernel void
+spmv_sellcs_kernel(__global const float * restrict val,
+                   __global const float * restrict vec,
+                   __global const int   * restrict cols,
+                   __global const int   * restrict sliceStart,
+                   __global const int   * restrict rowLengths,
+                   __global const int   * restrict rowPerm,
+                   const int dim,
+                   const int sliceHeight,
+                   __global float * restrict out) {
+    int t = get_global_id(0);
+
+    if (t < dim) {
+        int slice = t / sliceHeight;
+        int ind = sliceStart[slice] + (t - slice * sliceHeight);
+        float result = 0.0;
+        int max = rowLengths[t];
+
+        // consecutive threads of a slice read consecutive addresses
+        for (int i = 0; i < max; i++, ind += sliceHeight) {
+            result += val[ind] * vec[cols[ind]];
+        }
+        out[rowPerm[t]] = result;
+    }
+}
+
+// ****************************************************************************
+// Function: spmv_csr_merge_kernel
+//
+// Purpose:
+//   Computes sparse matrix - vector multiplication on the GPU using
+//   the CSR data storage format, splitting the merge of the row end
+//   offsets with the non-zero indices into equal pieces of
+//   itemsPerThread items, so every thread does the same amount of work
+//   regardless of the row length distribution (merge-path SpMV).  Rows
+//   that end inside a thread's piece are written directly; the partial
+//   sum of the row a piece stops in is left in carryRow/carryVal for
+//   spmv_csr_merge_fixup_kernel.
+//
+// Arguments:
+//   val: array holding the non-zero values for the matrix
+//   vec: dense vector for multiplication
+//   cols: array of column indices for each element of the sparse matrix
+//   rowDelimiters: array of size dim+1 holding indices to rows of the matrix
+//                  last element is the index one past the last
+//                  element of the matrix
+//   dim: number of rows in the matrix
+//   nnz: number of non-zero elements in the matrix
+//   itemsPerThread: length of the merge path handled by each thread
+//   out: output - result from the spmv calculation, before fix-up
+//   carryRow: output - row each thread stopped in
+//   carryVal: output - partial sum of that row
+//
+// Returns:  nothing directly
+//           out, carryRow and carryVal indirectly through pointers
+//
+// Modifications:
+//
+// ****************************************************************************
+__kernel void
+spmv_csr_merge_kernel(__global const float * restrict val,
+                      __global const float * restrict vec,
+                      __global const int * restrict cols,
+                      __global const int * restrict rowDelimiters,
+                      const int dim,
+                      const int nnz,
+                      const int itemsPerThread,
+                      __global float * restrict out,
+                      __global int * restrict carryRow,
+                      __global float * restrict carryVal) {
+    int t = get_global_id(0);
+    int pathLength = dim + nnz;
+    int diagonal = min(t * itemsPerThread, pathLength);
+    int diagonalEnd = min(diagonal + itemsPerThread, pathLength);
+
+    // Binary search for the start of this thread's piece of the path:
+    // the number of row ends x merged before diagonal, the remaining
+    // diagonal - x items being non-zeroes
+    __global const int *rowEnds = rowDelimiters + 1;
+    int lo = max(diagonal - nnz, 0);
+    int hi = min(diagonal, dim);
+    while (lo < hi) {
+        int pivot = (lo + hi) >> 1;
+        if (rowEnds[pivot] <= diagonal - pivot - 1) {
+            lo = pivot + 1;
+        } else {
+            hi = pivot;
+        }
+    }
+    int row = lo;
+    int j = diagonal - lo;
+
+    // Consume the piece, emitting a result at every row end
+    float sum = 0;
+    for (int d = diagonal; d < diagonalEnd; d++) {
+        if (row < dim && j < rowEnds[row]) {
+            sum += val[j] * vec[cols[j]];
+            j++;
+        } else {
+            out[row] = sum;
+            sum = 0;
+            row++;
+        }
+    }
+    carryRow[t] = row;
+    carryVal[t] = sum;
+}
+
+// Integer type of the same size as float, to add to out atomically
+#if K_DOUBLE_PRECISION || AMD_DOUBLE_PRECISION
+  #pragma OPENCL EXTENSION cl_khr_int64_base_atomics: enable
+  #define float_bits ulong
+  #define float_cmpxchg atom_cmpxchg
+#else
+  #define float_bits uint
+  #define float_cmpxchg atomic_cmpxchg
+#endif
+
+// Adds value to *p atomically, by compare and swap of its bits
+void atomicAddFloat(volatile __global float *p, float value) {
+    union { float_bits bits; float value; } old, sum;
+    do {
+        old.value = *p;
+        sum.value = old.value + value;
+    } while (float_cmpxchg((volatile __global float_bits *) p, 
+                           old.bits, sum.bits) != old.bits);
+}
+
+// ****************************************************************************
+// Function: spmv_csr_merge_fixup_kernel
+//
+// Purpose:
+//   Adds the partial sums left by spmv_csr_merge_kernel to their rows.
+//   Threads that stopped in the same row are adjacent, so every group
+//   runs a segmented scan over its carries, a new segment starting
+//   wherever the row changes, and the last carry of each segment adds
+//   the segment's sum to its row.  A row that spans many merge threads
+//   is thus reduced in log steps; only a segment that continues into a
+//   neighbouring group adds its sum atomically.
+//
+// Arguments:
+//   carryRow: row each merge thread stopped in
+//   carryVal: partial sum of that row
+//   numCarries: number of merge threads
+//   dim: number of rows in the matrix
+//   out: input/output - result from the spmv calculation
+//
+// Returns:  nothing directly
+//           out indirectly through a pointer
+//
+// Modifications:
+//
+// ****************************************************************************
+__kernel void
+spmv_csr_merge_fixup_kernel(__global const int * restrict carryRow,
+                            __global const float * restrict carryVal,
+                            const int numCarries,
+                            const int dim,
+                            __global float * restrict out) {
+    int t = get_global_id(0);
+    int lid = get_local_id(0);
+    int size = get_local_size(0);
+    int first = get_group_id(0) * size;
+
+    // one carry per work-item, launched with BLOCK_SIZE work-items
+    __local volatile float sums[128];
+    __local volatile int heads[128];
+
+    int row = (t < numCarries) ? carryRow[t] : dim;
+    sums[lid] = (t < numCarries) ? carryVal[t] : 0;
+    heads[lid] = (lid == 0 || t >= numCarries || carryRow[t-1] != row);
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Inclusive segmented scan: a carry takes in the sums before it
+    // until the head of its segment
+    for (int offset = 1; offset < size; offset <<= 1) {
+        float before = 0;
+        int beforeHead = 0;
+        if (lid >= offset) {
+            before = sums[lid - offset];
+            beforeHead = heads[lid - offset];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (lid >= offset && !heads[lid]) {
+            sums[lid] += before;
+            heads[lid] = beforeHead;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (t < numCarries && row < dim) {
+        int continues = (t + 1 < numCarries && carryRow[t+1] == row);
+        if (!continues || lid == size - 1) {
+            // Rows only ever grow, so the segment holds the first carry
+            // of the group if the row came from the group before
+            if (continues || (first > 0 && carryRow[first-1] == row)) {
+                atomicAddFloat(&out[row], sums[lid]);
+            } else {
+                out[row] += sums[lid];
+            }
+        }
+    }
+}
+
+// Number of right-hand sides of the SpMM kernels and layout of the
+// dense blocks: with VEC_ROW_MAJOR the NUM_VECS values of one row are
+// contiguous, otherwise each vector is stored after the other
+#ifndef NUM_VECS
+#define NUM_VECS 4
+#endif
+
+#ifdef VEC_ROW_MAJOR
+#define SPMM_INDEX(row, v, dim) ((row) * NUM_VECS + (v))
+#else
+#define SPMM_INDEX(row, v, dim) ((v) * (dim) + (row))
+#endif
+
+// ****************************************************************************
+// Function: spmm_csr_vector_kernel
+//
+// Purpose:
+//   Multiplies a sparse matrix in CSR format by a block of NUM_VECS
+//   dense vectors, using a warp per row of the sparse matrix.  Each
+//   non-zero is loaded once and used for all NUM_VECS products.
+//
+// Arguments:
+//   val: array holding the non-zero values for the matrix
+//   vecs: dense block of NUM_VECS vectors of size dim, see SPMM_INDEX
+//   cols: array of column indices for each element of the sparse matrix
+//   rowDelimiters: array of size dim+1 holding indices to rows of the matrix
+//                  last element is the index one past the last
+//                  element of the matrix
+//   dim: number of rows in the matrix
+//   out: output - block of NUM_VECS results, same layout as vecs
+//
+// Returns:  nothing
+//           out indirectly through a pointer
+// ****************************************************************************
+__kernel void
+spmm_csr_vector_kernel(__global const float * restrict val,
+                       __global const float * restrict vecs,
+                       __global const int * restrict cols,
+                       __global const int * restrict rowDelimiters,
+                       const int dim,
+                       __global float * restrict out) {
+    // Thread ID in block
+    int t = get_local_id(0);
+    // Thread ID within warp/wavefront
+    int id = t & (VECTOR_SIZE-1);
+    // One warp/wavefront per row
+    int threadsPerBlock = get_local_size(0) / VECTOR_SIZE;
+    int myRow = (get_group_id(0) * threadsPerBlock) + (t / VECTOR_SIZE);
+
+    __local volatile float partialSums[128];
+    float mySum[NUM_VECS];
+    for (int v = 0; v < NUM_VECS; v++) {
+        mySum[v] = 0;
+    }
+
+    if (myRow < dim) {
+        int vecStart = rowDelimiters[myRow];
+        int vecEnd = rowDelimiters[myRow+1];
+        for (int j = vecStart + id; j < vecEnd; j += VECTOR_SIZE) {
+            int col = cols[j];
+            float a = val[j];
+            for (int v = 0; v < NUM_VECS; v++) {
+                mySum[v] += a * vecs[SPMM_INDEX(col, v, dim)];
+            }
+        }
+    }
+
+    // Reduce the partial sums of one vector at a time; every work-item
+    // takes part so the barriers are not divergent
+    for (int v = 0; v < NUM_VECS; v++) {
+        partialSums[t] = mySum[v];
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (id < 16) partialSums[t] += partialSums[t+16];
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (id <  8) partialSums[t] += partialSums[t+ 8];
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (id <  4) partialSums[t] += partialSums[t+ 4];
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (id <  2) partialSums[t] += partialSums[t+ 2];
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (id <  1) partialSums[t] += partialSums[t+ 1];
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        if (id == 0 && myRow < dim) {
+            out[SPMM_INDEX(myRow, v, dim)] = partialSums[t];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+}
+
+// ****************************************************************************
+// Function: spmm_ellpackr_kernel
+//
+// Purpose:
+//   Multiplies a sparse matrix in ELLPACK-R format by a block of
+//   NUM_VECS dense vectors, using a thread per row.  Each non-zero is
+//   loaded once and used for all NUM_VECS products.
+//
+// Arguments:
+//   val: array holding the non-zero values for the matrix in column
+//   major format and padded with zeros up to the length of longest row
+//   vecs: dense block of NUM_VECS vectors of size dim, see SPMM_INDEX
+//   cols: array of column indices for each element of the sparse matrix
+//   rowLengths: array storing the length of each row of the sparse matrix
+//   dim: number of rows in the matrix
+//   out: output - block of NUM_VECS results, same layout as vecs
+//
+// Returns:  nothing directly
+//           out indirectly through a pointer
+// ****************************************************************************
+__kernel void
+spmm_ellpackr_kernel(__global const float * restrict val,
+                     __global const float * restrict vecs,
+                     __global const int   * restrict cols,
+                     __global const int   * restrict rowLengths,
+                     const int dim,
+                     __global float * restrict out) {
+    int t = get_global_id(0);
+
+    if (t < dim) {
+        float result[NUM_VECS];
+        for (int v = 0; v < NUM_VECS; v++) {
+            result[v] = 0;
+        }
+        int max = rowLengths[t];
+
+        for (int i = 0; i < max; i++) {
+            int ind = i * dim + t;
+            int col = cols[ind];
+            float a = val[ind];
+            for (int v = 0; v < NUM_VECS; v++) {
+                result[v] += a * vecs[SPMM_INDEX(col, v, dim)];
+            }
+        }
+        for (int v = 0; v < NUM_VECS; v++) {
+            out[SPMM_INDEX(t, v, dim)] = result[v];
+        }
+    }
+}
+
+// Storage and accumulation types of the mixed precision kernel: values
+// are stored as half with STORE_HALF, partial sums are kept in double
+// with ACCUM_DOUBLE, and column indices are 16-bit offsets from a per
+// row base with COMPRESS_COLS
+#ifdef ACCUM_DOUBLE
+#pragma OPENCL EXTENSION cl_khr_fp64: enable
+typedef double accum_t;
+#else
+typedef float accum_t;
+#endif
+
+#ifdef STORE_HALF
+typedef half store_t;
+#define LOAD_VAL(p, j) vload_half((j), (p))
+#else
+typedef float store_t;
+#define LOAD_VAL(p, j) ((p)[(j)])
+#endif
+
+#ifdef COMPRESS_COLS
+typedef ushort col_t;
+#else
+typedef int col_t;
+#endif
+
+// ****************************************************************************
+// Function: spmv_csr_mixed_kernel
+//
+// Purpose:
+//   Computes sparse matrix - vector multiplication on the GPU using the
+//   CSR format and a warp per row, with the storage and accumulation
+//   precision chosen at compile time (see store_t, accum_t, col_t)
+//
+// Arguments:
+//   val: array holding the non-zero values for the matrix
+//   vec: dense vector for multiplication
+//   cols: column indices, or with COMPRESS_COLS offsets from rowBase
+//   rowBase: with COMPRESS_COLS, the first column of each row, or for rows
+//            whose span does not fit 16 bits -(start in wideCols)-1
+//   wideCols: with COMPRESS_COLS, 32-bit columns of the rows that do not
+//             fit, stored one row after the other
+//   rowDelimiters: array of size dim+1 holding indices to rows of the matrix
+//   dim: number of rows in the matrix
+//   out: output - result from the spmv calculation
+//
+// Returns:  nothing
+//           out indirectly through a pointer
+// ****************************************************************************
+__kernel void
+spmv_csr_mixed_kernel(__global const store_t * restrict val,
+                      __global const float * restrict vec,
+                      __global const col_t * restrict cols,
+                      __global const int * restrict rowBase,
+                      __global const int * restrict wideCols,
+                      __global const int * restrict rowDelimiters,
+                      const int dim,
+                      __global float * restrict out) {
+    // Thread ID in block
+    int t = get_local_id(0);
+    // Thread ID within warp/wavefront
+    int id = t & (VECTOR_SIZE-1);
+    // One warp/wavefront per row
+    int threadsPerBlock = get_local_size(0) / VECTOR_SIZE;
+    int myRow = (get_group_id(0) * threadsPerBlock) + (t / VECTOR_SIZE);
+
+    __local volatile accum_t partialSums[128];
+    accum_t mySum = 0;
+
+    if (myRow < dim) {
+        int vecStart = rowDelimiters[myRow];
+        int vecEnd = rowDelimiters[myRow+1];
+#ifdef COMPRESS_COLS
+        int base = rowBase[myRow];
+        if (base >= 0) {
+            for (int j = vecStart + id; j < vecEnd; j += VECTOR_SIZE) {
+                int col = base + cols[j];
+                mySum += (accum_t) LOAD_VAL(val, j) * vec[col];
+            }
+        } else {
+            __global const int *rowCols = wideCols + (-base - 1) - vecStart;
+            for (int j = vecStart + id; j < vecEnd; j += VECTOR_SIZE) {
+                mySum += (accum_t) LOAD_VAL(val, j) * vec[rowCols[j]];
+            }
+        }
+#else
+        for (int j = vecStart + id; j < vecEnd; j += VECTOR_SIZE) {
+            mySum += (accum_t) LOAD_VAL(val, j) * vec[cols[j]];
+        }
+#endif
+    }
+
+    // Reduce partial sums, every work-item reaches the barriers
+    partialSums[t] = mySum;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (id < 16) partialSums[t] += partialSums[t+16];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (id <  8) partialSums[t] += partialSums[t+ 8];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (id <  4) partialSums[t] += partialSums[t+ 4];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (id <  2) partialSums[t] += partialSums[t+ 2];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (id <  1) partialSums[t] += partialSums[t+ 1];
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Write result
+    if (id == 0 && myRow < dim) {
+        out[myRow] = (float) partialSums[t];
+    }
+}
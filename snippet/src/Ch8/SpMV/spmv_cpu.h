@@ -0,0 +1,376 @@
+#ifndef SPMV_CPU_H_
+#define SPMV_CPU_H_
+
+#include <pthread.h>
+#include <unistd.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPU_SPMV_X86 1
+#endif
+
+// Inner loop used by the CPU engine, picked at start-up from what the
+// processor supports
+enum CpuSpmvIsa {
+    CPU_SPMV_SCALAR = 0,
+    CPU_SPMV_AVX2,
+    CPU_SPMV_AVX512
+};
+
+static const char *CPU_SPMV_ISA_NAMES[] = {"Scalar", "AVX2", "AVX512"};
+
+struct CpuSpmvEngine;
+
+// Work of one thread: a contiguous range of rows
+struct CpuSpmvTask {
+    struct CpuSpmvEngine *engine;
+    int firstRow;
+    int lastRow;
+    int started;        // whether a pool thread of its own runs it
+};
+
+// ****************************************************************************
+// Struct: CpuSpmvEngine
+//
+// Purpose:
+//   Persistent pool of threads computing CSR sparse matrix - vector
+//   products.  Rows are split once, at creation, into ranges holding
+//   about the same number of non-zeroes plus rows, so a few long rows do
+//   not leave the other threads idle.  The caller takes part as
+//   thread 0, and runs as well the ranges of threads that failed to
+//   start.
+// ****************************************************************************
+struct CpuSpmvEngine {
+    int numThreads;
+    int isa;
+    struct CpuSpmvTask *tasks;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    int numStarted;
+    int generation;
+    int pending;
+    int stop;
+
+    // operands of the product in flight
+    const float *val;
+    const int *cols;
+    const int *rowDelimiters;
+    const float *vec;
+    float *out;
+};
+
+// ****************************************************************************
+// Function: spmvRowsScalar, spmvRowsAvx2, spmvRowsAvx512
+//
+// Purpose:
+//   Compute out[r] for rows firstRow..lastRow-1.  The vector versions
+//   gather vec[cols[j]] for 8 or 16 non-zeroes at a time and finish each
+//   row with a scalar tail.
+//
+// Returns:  nothing
+//           out indirectly through a pointer
+// ****************************************************************************
+static void spmvRowsScalar(const float *val, const int *cols,
+                           const int *rowDelimiters, const float *vec,
+                           float *out, int firstRow, int lastRow)
+{
+    for (int i=firstRow; i<lastRow; i++) {
+        float t = 0;
+        for (int j=rowDelimiters[i]; j<rowDelimiters[i+1]; j++)
+        {
+            t += val[j] * vec[cols[j]];
+        }
+        out[i] = t;
+    }
+}
+
+#ifdef CPU_SPMV_X86
+__attribute__((target("avx2,fma")))
+static void spmvRowsAvx2(const float *val, const int *cols,
+                         const int *rowDelimiters, const float *vec,
+                         float *out, int firstRow, int lastRow)
+{
+    for (int i=firstRow; i<lastRow; i++) {
+        int j = rowDelimiters[i];
+        int end = rowDelimiters[i+1];
+        __m256 acc = _mm256_setzero_ps();
+        for (; j + 8 <= end; j += 8)
+        {
+            __m256i idx = _mm256_loadu_si256((const __m256i *) (cols + j));
+            __m256 x = _mm256_i32gather_ps(vec, idx, sizeof(float));
+            acc = _mm256_fmadd_ps(_mm256_loadu_ps(val + j), x, acc);
+        }
+        __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(acc),
+                                 _mm256_extractf128_ps(acc, 1));
+        sum4 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+        sum4 = _mm_add_ss(sum4, _mm_shuffle_ps(sum4, sum4, 1));
+        float t = _mm_cvtss_f32(sum4);
+        for (; j < end; j++)
+        {
+            t += val[j] * vec[cols[j]];
+        }
+        out[i] = t;
+    }
+}
+
+__attribute__((target("avx512f")))
+static void spmvRowsAvx512(const float *val, const int *cols,
+                           const int *rowDelimiters, const float *vec,
+                           float *out, int firstRow, int lastRow)
+{
+    for (int i=firstRow; i<lastRow; i++) {
+        int j = rowDelimiters[i];
+        int end = rowDelimiters[i+1];
+        __m512 acc = _mm512_setzero_ps();
+        for (; j + 16 <= end; j += 16)
+        {
+            __m512i idx = _mm512_loadu_si512((const void *) (cols + j));
+            __m512 x = _mm512_i32gather_ps(idx, vec, sizeof(float));
+            acc = _mm512_fmadd_ps(_mm512_loadu_ps(val + j), x, acc);
+        }
+        // masked gather for the remainder of the row
+        if (j < end)
+        {
+            __mmask16 mask = (__mmask16) ((1u << (end - j)) - 1);
+            __m512i idx = _mm512_maskz_loadu_epi32(mask, cols + j);
+            __m512 x = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask,
+                                                idx, vec, sizeof(float));
+            acc = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, val + j), x,
+                                  acc);
+        }
+        out[i] = _mm512_reduce_add_ps(acc);
+    }
+}
+#endif
+
+// ****************************************************************************
+// Function: cpuSpmvDetectIsa
+//
+// Purpose:
+//   Picks the widest inner loop supported by the processor
+//
+// Returns:  one of CpuSpmvIsa
+// ****************************************************************************
+static int cpuSpmvDetectIsa()
+{
+#ifdef CPU_SPMV_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        return CPU_SPMV_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        return CPU_SPMV_AVX2;
+    }
+#endif
+    return CPU_SPMV_SCALAR;
+}
+
+static void cpuSpmvRunTask(struct CpuSpmvTask *task)
+{
+    struct CpuSpmvEngine *e = task->engine;
+    switch (e->isa)
+    {
+#ifdef CPU_SPMV_X86
+    case CPU_SPMV_AVX512:
+        spmvRowsAvx512(e->val, e->cols, e->rowDelimiters, e->vec, e->out,
+                       task->firstRow, task->lastRow);
+        break;
+    case CPU_SPMV_AVX2:
+        spmvRowsAvx2(e->val, e->cols, e->rowDelimiters, e->vec, e->out,
+                     task->firstRow, task->lastRow);
+        break;
+#endif
+    default:
+        spmvRowsScalar(e->val, e->cols, e->rowDelimiters, e->vec, e->out,
+                       task->firstRow, task->lastRow);
+        break;
+    }
+}
+
+// Body of the pool threads: wait for a new generation, run the task,
+// report completion
+static void *cpuSpmvWorker(void *arg)
+{
+    struct CpuSpmvTask *task = (struct CpuSpmvTask *) arg;
+    struct CpuSpmvEngine *e = task->engine;
+    int seen = 0;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&e->lock);
+        while (e->generation == seen && !e->stop)
+        {
+            pthread_cond_wait(&e->start, &e->lock);
+        }
+        if (e->stop)
+        {
+            pthread_mutex_unlock(&e->lock);
+            return NULL;
+        }
+        seen = e->generation;
+        pthread_mutex_unlock(&e->lock);
+
+        cpuSpmvRunTask(task);
+
+        pthread_mutex_lock(&e->lock);
+        if (--e->pending == 0)
+        {
+            pthread_cond_signal(&e->done);
+        }
+        pthread_mutex_unlock(&e->lock);
+    }
+}
+
+// ****************************************************************************
+// Function: cpuSpmvCreate
+//
+// Purpose:
+//   Starts the thread pool and partitions the rows of a matrix among
+//   the threads by non-zeroes plus rows
+//
+// Arguments:
+//   e: engine to initialize
+//   rowDelimiters: array of size dim+1 holding indices to rows of A
+//   dim: number of rows in the matrix
+//   numThreads: number of threads, 0 for one per online processor
+//   isa: inner loop to use, -1 to detect
+//
+// Returns:  nothing
+// ****************************************************************************
+static void cpuSpmvCreate(struct CpuSpmvEngine *e, const int *rowDelimiters,
+                          int dim, int numThreads, int isa)
+{
+    if (numThreads <= 0)
+    {
+        numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (numThreads > dim)
+    {
+        numThreads = dim;
+    }
+    if (numThreads < 1)
+    {
+        numThreads = 1;
+    }
+
+    memset(e, 0, sizeof(*e));
+    e->numThreads = numThreads;
+    e->isa = (isa < 0) ? cpuSpmvDetectIsa() : isa;
+    e->tasks = new CpuSpmvTask[numThreads];
+    e->threads = new pthread_t[numThreads];
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->start, NULL);
+    pthread_cond_init(&e->done, NULL);
+
+    // thread t starts at the first row whose offset on the combined
+    // rows + non-zeroes axis reaches t/numThreads of the total
+    long total = (long) rowDelimiters[dim] + dim;
+    int row = 0;
+    for (int t=0; t<numThreads; t++)
+    {
+        long target = total * t / numThreads;
+        while (row < dim && (long) rowDelimiters[row] + row < target)
+        {
+            row++;
+        }
+        e->tasks[t].engine = e;
+        e->tasks[t].firstRow = row;
+        e->tasks[t].started = 0;
+        if (t > 0)
+        {
+            e->tasks[t-1].lastRow = row;
+        }
+    }
+    e->tasks[numThreads-1].lastRow = dim;
+
+    for (int t=1; t<numThreads; t++)
+    {
+        e->tasks[t].started = pthread_create(&e->threads[t], NULL,
+                                             cpuSpmvWorker, &e->tasks[t]) == 0;
+        e->numStarted += e->tasks[t].started;
+    }
+}
+
+// ****************************************************************************
+// Function: cpuSpmvRun
+//
+// Purpose:
+//   Computes out = A * vec on the pool; returns once every row is done
+//
+// Arguments:
+//   e: engine created for the sparsity pattern of A
+//   val, cols, rowDelimiters: A in CSR format
+//   vec: dense vector of size dim to be used for multiplication
+//   out: output - result from the spmv calculation
+//
+// Returns:  nothing
+//           out indirectly through a pointer
+// ****************************************************************************
+static void cpuSpmvRun(struct CpuSpmvEngine *e, const float *val,
+                       const int *cols, const int *rowDelimiters,
+                       const float *vec, float *out)
+{
+    pthread_mutex_lock(&e->lock);
+    e->val = val;
+    e->cols = cols;
+    e->rowDelimiters = rowDelimiters;
+    e->vec = vec;
+    e->out = out;
+    e->pending = e->numStarted;
+    e->generation++;
+    pthread_cond_broadcast(&e->start);
+    pthread_mutex_unlock(&e->lock);
+
+    for (int t=0; t<e->numThreads; t++)
+    {
+        if (!e->tasks[t].started)
+        {
+            cpuSpmvRunTask(&e->tasks[t]);
+        }
+    }
+
+    pthread_mutex_lock(&e->lock);
+    while (e->pending > 0)
+    {
+        pthread_cond_wait(&e->done, &e->lock);
+    }
+    pthread_mutex_unlock(&e->lock);
+}
+
+// ****************************************************************************
+// Function: cpuSpmvDestroy
+//
+// Purpose:
+//   Stops and joins the pool threads and frees the engine's memory
+//
+// Arguments:
+//   e: engine created by cpuSpmvCreate
+//
+// Returns:  nothing
+// ****************************************************************************
+static void cpuSpmvDestroy(struct CpuSpmvEngine *e)
+{
+    pthread_mutex_lock(&e->lock);
+    e->stop = 1;
+    pthread_cond_broadcast(&e->start);
+    pthread_mutex_unlock(&e->lock);
+
+    for (int t=1; t<e->numThreads; t++)
+    {
+        if (e->tasks[t].started)
+        {
+            pthread_join(e->threads[t], NULL);
+        }
+    }
+    pthread_cond_destroy(&e->done);
+    pthread_cond_destroy(&e->start);
+    pthread_mutex_destroy(&e->lock);
+    delete[] e->threads;
+    delete[] e->tasks;
+}
+
+#endif // SPMV_CPU_H_
@@ -4,6 +4,17 @@
 #include <cassert>
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstddef>
+#include <climits>
+#include <strings.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "OptionParser.h"
 #include "ResultDatabase.h"
 
@@ -25,17 +36,89 @@ static const int FIELD_LENGTH = 128;
 // If using a matrix market pattern, assign values from 0-MAX_RANDOM_VAL
 static const float MAX_RANDOM_VAL = 10.0f;
 
+// smallest slice of a matrix market file worth parsing on its own thread
+static const long MATRIX_CHUNK_MIN_BYTES = 1 << 20;
+
+// rows longer than this are sorted with qsort instead of insertion sort
+static const int ROW_INSERTION_SORT_LIMIT = 32;
+
+// binary CSR cache file identification and section alignment
+static const char CSR_CACHE_MAGIC[] = "SPMVCSR";
+static const int CSR_CACHE_VERSION = 1;
+static const int CSR_CACHE_ALIGNMENT = 4096;
+static const unsigned long long CSR_CACHE_CHECKSUM_SEED = 14695981039346656037ULL;
+
+// number of cache files that can be mapped at the same time
+static const int MAX_MAPPED_MATRICES = 8;
+
+// rows handled together by a warp/wavefront in the row statistics
+static const int WARP_LENGTH = 32;
+
+// default slice height (C) and sorting window (sigma) for SELL-C-sigma
+static const int SELL_SLICE_HEIGHT = 32;
+static const int SELL_SORT_WINDOW = 1024;
+
 struct Coordinate {
     int x; 
     int y; 
     float val; 
 };
 
+struct RowLength {
+    int row;
+    int length;
+};
+
+// Row length statistics of a CSR matrix, used to pick a storage format.
+// Each efficiency is the fraction of the work-item iterations of a
+// kernel that touch a non-zero rather than idle on padding.
+struct RowStats {
+    int minrl;
+    int maxrl;
+    double mean;
+    double variance;
+    int emptyRows;
+    double ellPadRatio;         // stored elements / nnz for ELLPACK-R
+    double warpEfficiency;      // one row per work-item, warp of 32 rows
+    double vectorEfficiency;    // one warp of WARP_LENGTH per row
+    double sellEfficiency;      // SELL-C-sigma slices
+};
+
 inline int intcmp(const void *v1, const void *v2);
 inline int coordcmp(const void *v1, const void *v2);
+inline int coordvalcmp(const void *v1, const void *v2);
+inline int rowlencmp(const void *v1, const void *v2);
+inline int intdesccmp(const void *v1, const void *v2);
+inline int rowlenasccmp(const void *v1, const void *v2);
+void computeRowStats(const int *rowDelimiters, int dim, int sliceHeight,
+                     int sortWindow, struct RowStats *stats);
+int matrixBandwidth(const int *cols, const int *rowDelimiters, int dim);
+void computeRcmOrdering(const int *cols, const int *rowDelimiters, int dim,
+                        double denseFactor, int *perm);
+template <typename floatType>
+void permuteMatrix(const floatType *A, const int *cols,
+                   const int *rowDelimiters, int dim, const int *perm,
+                   floatType **newA_ptr, int **newcols_ptr,
+                   int **newRowDelimiters_ptr);
+template <typename floatType>
+void permuteVector(const floatType *in, const int *perm, int dim,
+                   bool inverse, floatType *out);
+inline unsigned short floatToHalf(float f);
+template <typename floatType>
+void convertToHalf(const floatType *A, int n, unsigned short *newA);
+int compressColumns(const int *cols, const int *rowDelimiters, int dim,
+                    unsigned short *colOffsets, int *rowBase,
+                    int **wideCols_ptr, int *numWide);
+template <typename floatType>
+void readMatrixMarket(char *filename, floatType **val_ptr, int **cols_ptr, 
+                      int **rowDelimiters_ptr, int *n, int *size);
 template <typename floatType>
 void readMatrix(char *filename, floatType **val_ptr, int **cols_ptr, 
-                int **rowDelimiters_ptr, int *n, int *size);
+                int **rowDelimiters_ptr, int *n, int *size, 
+                bool useCache = true);
+template <typename floatType>
+void freeMatrix(floatType *val, int *cols, int *rowDelimiters);
+inline bool isMappedMatrix(const void *ptr);
 template <typename floatType>
 void fill(floatType *A, const int n, const float maxi);
 void initRandomMatrix(int *cols, int *rowDelimiters, const int n, const int dim);
@@ -49,15 +132,345 @@ template <typename floatType>
 void convertToPadded(floatType *A, int *cols, int dim, int *rowDelimiters, 
                      floatType **newA_ptr, int **newcols_ptr, int *newIndices, 
                      int *newSize); 
+template <typename floatType>
+void convertToSellCSigma(floatType *A, int *cols, int dim, int *rowDelimiters,
+                         int sliceHeight, int sortWindow,
+                         floatType **newA_ptr, int **newcols_ptr,
+                         int **sliceStart_ptr, int **rowLengths_ptr,
+                         int **rowPerm_ptr, int *numSlices, int *newSize);
 
 
 // ****************************************************************************
-// Function: readMatrix
+// Function: skipBlanks, parseIndex, parseValue
 //
 // Purpose:
-//   Reads a sparse matrix from a file of Matrix Market format 
+//   Bounded token readers for the memory mapped Matrix Market parser.
+//   The mapped file is not null terminated, so none of them may read
+//   past end.
+//
+// Returns:
+//   pointer to the first character after the token
+// ****************************************************************************
+static inline const char *skipBlanks(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    {
+        p++;
+    }
+    return p;
+}
+
+static inline const char *parseIndex(const char *p, const char *end, int *value)
+{
+    int v = 0;
+    p = skipBlanks(p, end);
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        v = v * 10 + (*p - '0');
+        p++;
+    }
+    *value = v;
+    return p;
+}
+
+static inline const char *parseValue(const char *p, const char *end, float *value)
+{
+    char token[FIELD_LENGTH];
+    int len = 0;
+    p = skipBlanks(p, end);
+    while (p < end && len < FIELD_LENGTH - 1 && *p != ' ' && *p != '\t' &&
+           *p != '\r' && *p != '\n')
+    {
+        token[len++] = *p++;
+    }
+    token[len] = '\0';
+    *value = (float) strtod(token, NULL);
+    return p;
+}
+
+// One slice of the body of a Matrix Market file, parsed by one thread
+struct MatrixChunk {
+    const char *begin;
+    const char *end;
+    int pattern;
+    int symmetry;           // 0 general, 1 symmetric, -1 skew-symmetric
+    int nRows;
+    int nCols;
+    const char *body;       // start of the body, pattern values hash the
+                            // offset of their line in it
+    int count;              // number of entries, mirrored ones included
+    int rejected;           // entries outside the matrix, skipped
+    struct Coordinate *coords;
+    int *rowCounts;         // shared between chunks, updated atomically
+    int *rowFill;           // shared between chunks, updated atomically
+    void *val;              // CSR arrays, filled by scatterMatrixChunk
+    int *cols;
+};
+
+// Pattern value of the entry on the line at offset from the start of the
+// body, in 0-MAX_RANDOM_VAL; the same however the body is split
+static inline float patternValue(unsigned long long offset)
+{
+    unsigned long long z = offset + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return MAX_RANDOM_VAL * (float) ((z >> 40) / (double) (1ULL << 24));
+}
+
+// ****************************************************************************
+// Function: parseMatrixChunk
+//
+// Purpose:
+//   Thread body that parses the coordinate lines of one chunk, adds the
+//   mirrored entries of symmetric matrices and counts the entries of
+//   every row
+//
+// Arguments:
+//   arg: pointer to a MatrixChunk
+//
+// Returns:  NULL
+// ****************************************************************************
+static void *parseMatrixChunk(void *arg)
+{
+    struct MatrixChunk *chunk = (struct MatrixChunk *) arg;
+    const char *p = chunk->begin;
+    const char *end = chunk->end;
+
+    // size the entry buffer from the number of lines in the chunk
+    int lines = 1;
+    for (const char *q = p; q < end; q++)
+    {
+        q = (const char *) memchr(q, '\n', end - q);
+        if (q == NULL)
+        {
+            break;
+        }
+        lines++;
+    }
+    chunk->coords = new Coordinate[chunk->symmetry ? 2 * lines : lines];
+
+    int index = 0;
+    while (p < end)
+    {
+        const char *eol = (const char *) memchr(p, '\n', end - p);
+        if (eol == NULL)
+        {
+            eol = end;
+        }
+        const char *line = p;
+        p = skipBlanks(p, eol);
+        if (p < eol && *p != '%')
+        {
+            struct Coordinate *c = &chunk->coords[index];
+            p = parseIndex(p, eol, &c->x);
+            p = parseIndex(p, eol, &c->y);
+            if (chunk->pattern)
+            {
+                // assign a random value
+                c->val = patternValue(line - chunk->body);
+            }
+            else
+            {
+                parseValue(p, eol, &c->val);
+            }
+
+            // convert into index-0-as-start representation
+            c->x--;
+            c->y--;
+            if (c->x < 0 || c->x >= chunk->nRows || 
+                c->y < 0 || c->y >= chunk->nCols)
+            {
+                chunk->rejected++;
+                p = eol + 1;
+                continue;
+            }
+            __sync_fetch_and_add(&chunk->rowCounts[c->x], 1);
+            index++;
+
+            // add the mirror element if not on main diagonal
+            if (chunk->symmetry && c->x != c->y)
+            {
+                if (c->y >= chunk->nRows || c->x >= chunk->nCols)
+                {
+                    chunk->rejected++;
+                    p = eol + 1;
+                    continue;
+                }
+                struct Coordinate *m = &chunk->coords[index];
+                m->x = c->y;
+                m->y = c->x;
+                m->val = chunk->symmetry * c->val;
+                __sync_fetch_and_add(&chunk->rowCounts[m->x], 1);
+                index++;
+            }
+        }
+        p = eol + 1;
+    }
+    chunk->count = index;
+    return NULL;
+}
+
+// ****************************************************************************
+// Function: scatterMatrixChunk
+//
+// Purpose:
+//   Thread body that writes the entries of one parsed chunk to their
+//   rows in the CSR arrays
+//
+// Arguments:
+//   arg: pointer to a MatrixChunk whose rowFill holds the next free slot
+//        of every row
+//
+// Returns:  NULL
+// ****************************************************************************
+template <typename floatType>
+void *scatterMatrixChunk(void *arg)
+{
+    struct MatrixChunk *chunk = (struct MatrixChunk *) arg;
+    floatType *val = (floatType *) chunk->val;
+
+    for (int i=0; i<chunk->count; i++)
+    {
+        struct Coordinate *c = &chunk->coords[i];
+        int k = __sync_fetch_and_add(&chunk->rowFill[c->x], 1);
+        val[k] = c->val;
+        chunk->cols[k] = c->y;
+    }
+    delete[] chunk->coords;
+    chunk->coords = NULL;
+    return NULL;
+}
+
+// A range of rows whose entries are sorted by column by one thread
+struct RowRange {
+    int first;
+    int last;
+    int *rowDelimiters;
+    int *cols;
+    void *val;
+};
+
+// ****************************************************************************
+// Function: sortMatrixRows
+//
+// Purpose:
+//   Thread body that sorts the entries of each row in a range by column,
+//   using insertion sort for short rows and qsort for long ones.
+//   Duplicate entries of a row are ordered by value, as the order they
+//   were scattered in depends on the threads.
+//
+// Arguments:
+//   arg: pointer to a RowRange
+//
+// Returns:  NULL
+// ****************************************************************************
+template <typename floatType>
+void *sortMatrixRows(void *arg)
+{
+    struct RowRange *range = (struct RowRange *) arg;
+    floatType *val = (floatType *) range->val;
+    int *cols = range->cols;
+
+    for (int r=range->first; r<range->last; r++)
+    {
+        int start = range->rowDelimiters[r];
+        int end = range->rowDelimiters[r+1];
+        if (end - start <= ROW_INSERTION_SORT_LIMIT)
+        {
+            for (int i=start+1; i<end; i++)
+            {
+                int c = cols[i];
+                floatType v = val[i];
+                int j = i - 1;
+                while (j >= start && 
+                       (cols[j] > c || (cols[j] == c && val[j] > v)))
+                {
+                    cols[j+1] = cols[j];
+                    val[j+1] = val[j];
+                    j--;
+                }
+                cols[j+1] = c;
+                val[j+1] = v;
+            }
+        }
+        else
+        {
+            struct Coordinate *row = new Coordinate[end - start];
+            for (int i=start; i<end; i++)
+            {
+                row[i-start].x = r;
+                row[i-start].y = cols[i];
+                row[i-start].val = val[i];
+            }
+            qsort(row, end - start, sizeof(struct Coordinate), coordvalcmp);
+            for (int i=start; i<end; i++)
+            {
+                cols[i] = row[i-start].y;
+                val[i] = row[i-start].val;
+            }
+            delete[] row;
+        }
+    }
+    return NULL;
+}
+
+// ****************************************************************************
+// Function: runMatrixThreads
+//
+// Purpose:
+//   Runs body on numThreads arguments, one thread each, and waits for
+//   them.  An argument whose thread cannot be created is run by the
+//   calling thread instead.
+//
+// Arguments:
+//   body: thread body
+//   args: the first argument, the others follow argSize bytes apart
+//   argSize: size of an argument
+//   numThreads: number of arguments
+//
+// Returns:  nothing
+// ****************************************************************************
+static void runMatrixThreads(void *(*body)(void *), void *args, 
+                             size_t argSize, int numThreads)
+{
+    pthread_t *threads = new pthread_t[numThreads];
+    bool *started = new bool[numThreads];
+    for (int t=0; t<numThreads; t++)
+    {
+        void *arg = (char *) args + t * argSize;
+        started[t] = (pthread_create(&threads[t], NULL, body, arg) == 0);
+        if (!started[t])
+        {
+            body(arg);
+        }
+    }
+    for (int t=0; t<numThreads; t++)
+    {
+        if (started[t])
+        {
+            pthread_join(threads[t], NULL);
+        }
+    }
+    delete[] started;
+    delete[] threads;
+}
+
+// ****************************************************************************
+// Function: readMatrixMarket
+//
+// Purpose:
+//   Parses a sparse matrix from a file of Matrix Market format 
 //   Returns the data structures for the CSR format
 //
+//   The file is memory mapped and its body split into one chunk per
+//   thread.  Chunks are parsed in parallel while counting the entries of
+//   every row, the row counts are scanned into rowDelimiters, and the
+//   entries are then scattered directly into CSR order, so no global
+//   sort of the coordinates is needed.  General, symmetric,
+//   skew-symmetric and hermitian (real) headers are supported, as are
+//   real, integer and pattern fields.
+//
 // Arguments:
 //   filename: c string with the name of the file to be opened
 //   val_ptr: input - pointer to uninitialized pointer
@@ -84,116 +497,166 @@ void convertToPadded(floatType *A, int *cols, int dim, int *rowDelimiters,
 //           returns n and size indirectly through pointers
 // ****************************************************************************
 template <typename floatType>
-void readMatrix(char *filename, floatType **val_ptr, int **cols_ptr, 
-                int **rowDelimiters_ptr, int *n, int *size) 
+void readMatrixMarket(char *filename, floatType **val_ptr, int **cols_ptr, 
+                      int **rowDelimiters_ptr, int *n, int *size) 
 {
-    std::string line;
     char id[FIELD_LENGTH];
     char object[FIELD_LENGTH]; 
     char format[FIELD_LENGTH]; 
     char field[FIELD_LENGTH]; 
     char symmetry[FIELD_LENGTH]; 
 
-    std::ifstream mfs( filename );
-    if( !mfs.good() )
+    int fd = open(filename, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
     {
         std::cerr << "Error: unable to open matrix file " << filename << std::endl;
         exit( 1 );
     }
+    if (st.st_size == 0)
+    {
+        std::cerr << "Error: file " << filename << " does not store a matrix" << std::endl;
+        exit( 1 );
+    }
 
-    int symmetric = 0; 
-    int pattern = 0; 
-
-    int nRows, nCols, nElements;  
-
-    struct Coordinate *coords;
+    const char *data = (const char *) mmap(NULL, st.st_size, PROT_READ,
+                                           MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        std::cerr << "Error: unable to map matrix file " << filename << std::endl;
+        exit( 1 );
+    }
+    madvise((void *) data, st.st_size, MADV_SEQUENTIAL);
+    const char *end = data + st.st_size;
 
     // read matrix header
-    if( getline( mfs, line ).eof() )
+    const char *eol = (const char *) memchr(data, '\n', end - data);
+    if (eol == NULL)
     {
         std::cerr << "Error: file " << filename << " does not store a matrix" << std::endl;
         exit( 1 );
     }
+    std::string line(data, eol - data);
+    id[0] = object[0] = format[0] = field[0] = symmetry[0] = '\0';
+    sscanf(line.c_str(), "%127s %127s %127s %127s %127s", id, object, format,
+           field, symmetry); 
 
-    sscanf(line.c_str(), "%s %s %s %s %s", id, object, format, field, symmetry); 
-
-    if (strcmp(object, "matrix") != 0) 
+    if (strcasecmp(object, "matrix") != 0) 
     {
         fprintf(stderr, "Error: file %s does not store a matrix\n", filename); 
         exit(1); 
     }
   
-    if (strcmp(format, "coordinate") != 0)
+    if (strcasecmp(format, "coordinate") != 0)
     {
         fprintf(stderr, "Error: matrix representation is dense\n"); 
         exit(1); 
     } 
 
-    if (strcmp(field, "pattern") == 0) 
+    if (strcasecmp(field, "complex") == 0)
     {
-        pattern = 1; 
+        fprintf(stderr, "Error: complex matrices are not supported\n");
+        exit(1);
     }
 
-    if (strcmp(symmetry, "symmetric") == 0) 
+    int pattern = (strcasecmp(field, "pattern") == 0);
+    int symmetric = 0;
+    if (strcasecmp(symmetry, "symmetric") == 0 ||
+        strcasecmp(symmetry, "hermitian") == 0)
+    {
+        symmetric = 1;
+    }
+    else if (strcasecmp(symmetry, "skew-symmetric") == 0)
     {
-        symmetric = 1; 
+        symmetric = -1;
     }
 
-    while (!getline( mfs, line ).eof() )
+    // skip comments and read the matrix size and number of non-zero elements
+    const char *p = eol + 1;
+    int nRows = 0, nCols = 0, nElements = 0;
+    while (p < end)
     {
-        if (line[0] != '%') 
+        eol = (const char *) memchr(p, '\n', end - p);
+        if (eol == NULL)
         {
-            break; 
+            eol = end;
         }
-    } 
-
-    // read the matrix size and number of non-zero elements
-    sscanf(line.c_str(), "%d %d %d", &nRows, &nCols, &nElements); 
+        const char *q = skipBlanks(p, eol);
+        p = eol + 1;
+        if (q < eol && *q != '%')
+        {
+            line.assign(q, eol - q);
+            sscanf(line.c_str(), "%d %d %d", &nRows, &nCols, &nElements); 
+            break;
+        }
+    }
+    if (nRows <= 0)
+    {
+        fprintf(stderr, "Error: file %s has no size line\n", filename);
+        exit(1);
+    }
+    const char *body = (p < end) ? p : end;
 
-    int valSize = nElements * sizeof(struct Coordinate);
-    if (symmetric) 
+    // split the body into chunks that start at line boundaries
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    long bodySize = end - body;
+    int numThreads = (int) (1 + bodySize / MATRIX_CHUNK_MIN_BYTES);
+    if (ncpu > 0 && numThreads > ncpu)
     {
-        valSize*=2; 
-    }                     
-    coords = new Coordinate[valSize]; 
+        numThreads = (int) ncpu;
+    }
 
-    int index = 0; 
-    while (!getline( mfs, line ).eof() )
+    int *rowCounts = new int[nRows+1];
+    memset(rowCounts, 0, (nRows+1) * sizeof(int));
+
+    struct MatrixChunk *chunks = new MatrixChunk[numThreads];
+    const char *chunkBegin = body;
+    for (int t=0; t<numThreads; t++)
     {
-        if (pattern) 
-        {
-            sscanf(line.c_str(), "%d %d", &coords[index].x, &coords[index].y); 
-            // assign a random value 
-            coords[index].val = ((floatType) MAX_RANDOM_VAL * 
-                                 (rand() / (RAND_MAX + 1.0)));
-        }
-        else 
+        const char *chunkEnd = end;
+        if (t < numThreads - 1)
         {
-            // read the value from file
-            sscanf(line.c_str(), "%d %d %f", &coords[index].x, &coords[index].y, 
-                   &coords[index].val); 
+            chunkEnd = body + (bodySize * (t+1)) / numThreads;
+            const char *nl = (const char *) memchr(chunkEnd, '\n', 
+                                                   end - chunkEnd);
+            chunkEnd = (nl == NULL) ? end : nl + 1;
         }
-
-        // convert into index-0-as-start representation
-        coords[index].x--;
-        coords[index].y--;    
-        index++; 
-
-        // add the mirror element if not on main diagonal
-        if (symmetric && coords[index-1].x != coords[index-1].y) 
+        if (chunkEnd < chunkBegin)
         {
-            coords[index].x = coords[index-1].y; 
-            coords[index].y = coords[index-1].x; 
-            coords[index].val = coords[index-1].val; 
-            index++;
+            chunkEnd = chunkBegin;
         }
-    }  
-
-    nElements = index; 
-    // sort the elements
-    qsort(coords, nElements, sizeof(struct Coordinate), coordcmp); 
+        chunks[t].begin = chunkBegin;
+        chunks[t].end = chunkEnd;
+        chunks[t].pattern = pattern;
+        chunks[t].symmetry = symmetric;
+        chunks[t].nRows = nRows;
+        chunks[t].nCols = nCols;
+        chunks[t].body = body;
+        chunks[t].count = 0;
+        chunks[t].rejected = 0;
+        chunks[t].coords = NULL;
+        chunks[t].rowCounts = rowCounts;
+        chunks[t].rowFill = NULL;
+        chunkBegin = chunkEnd;
+    }
+    runMatrixThreads(parseMatrixChunk, chunks, sizeof(chunks[0]), numThreads);
+    munmap((void *) data, st.st_size);
+    close(fd);
 
     // create CSR data structures
+    nElements = 0;
+    int rejected = 0;
+    for (int t=0; t<numThreads; t++)
+    {
+        nElements += chunks[t].count;
+        rejected += chunks[t].rejected;
+    }
+    if (rejected > 0)
+    {
+        std::cerr << "Warning: skipped " << rejected << " entries of " << 
+            filename << " outside its " << nRows << " x " << nCols << 
+            " matrix" << std::endl;
+    }
     *n = nElements; 
     *size = nRows; 
     *val_ptr = new floatType[nElements]; 
@@ -204,119 +667,501 @@ void readMatrix(char *filename, floatType **val_ptr, int **cols_ptr,
     int *cols = *cols_ptr; 
     int *rowDelimiters = *rowDelimiters_ptr; 
 
-    rowDelimiters[0] = 0; 
-    rowDelimiters[nRows] = nElements; 
-    int r=0; 
-    for (int i=0; i<nElements; i++) 
+    // exclusive scan of the row counts, reusing them as fill cursors
+    int sum = 0;
+    for (int r=0; r<nRows; r++)
     {
-        while (coords[i].x != r) 
-        {
-            rowDelimiters[++r] = i; 
-        }
-        val[i] = coords[i].val; 
-        cols[i] = coords[i].y;    
+        rowDelimiters[r] = sum;
+        sum += rowCounts[r];
+        rowCounts[r] = rowDelimiters[r];
+    }
+    rowDelimiters[nRows] = nElements;
+
+    for (int t=0; t<numThreads; t++)
+    {
+        chunks[t].rowFill = rowCounts;
+        chunks[t].val = val;
+        chunks[t].cols = cols;
     }
+    runMatrixThreads(scatterMatrixChunk<floatType>, chunks, sizeof(chunks[0]),
+                     numThreads);
 
-    r = 0; 
+    // entries of a row arrive in file order, sort them by column
+    struct RowRange *ranges = new RowRange[numThreads];
+    for (int t=0; t<numThreads; t++)
+    {
+        ranges[t].first = (int) (((long) nRows * t) / numThreads);
+        ranges[t].last = (int) (((long) nRows * (t+1)) / numThreads);
+        ranges[t].rowDelimiters = rowDelimiters;
+        ranges[t].cols = cols;
+        ranges[t].val = val;
+    }
+    runMatrixThreads(sortMatrixRows<floatType>, ranges, sizeof(ranges[0]),
+                     numThreads);
 
-    delete[] coords;
+    delete[] ranges;
+    delete[] chunks;
+    delete[] rowCounts;
 }
 
+// Binary CSR cache file layout: a CsrCacheHeader followed by
+// rowDelimiters, cols and val, each starting on a CSR_CACHE_ALIGNMENT
+// boundary so that the mapped arrays can back OpenCL buffers created
+// with CL_MEM_USE_HOST_PTR
+struct CsrCacheHeader {
+    char magic[8];
+    int version;
+    int precision;              // sizeof(floatType) of val
+    int nRows;
+    int nElements;
+    long long sourceSize;       // size and mtime of the .mtx file the
+    long long sourceMtime;      // cache was built from
+    long long rowDelimitersOffset;
+    long long colsOffset;
+    long long valOffset;
+    long long fileSize;
+    unsigned long long checksum;        // over the three arrays
+    unsigned long long headerChecksum;  // over all fields above
+};
+
+// Mappings handed out by mapCsrCache, so freeMatrix knows what to unmap
+struct MappedMatrix {
+    void *base;
+    size_t length;
+};
+static MappedMatrix mappedMatrices[MAX_MAPPED_MATRICES];
+
 // ****************************************************************************
-// Function: fill
+// Function: csrCacheChecksum
 //
 // Purpose:
-//   Simple routine to initialize input array
+//   64-bit multiplicative hash over a memory region, processed a word at
+//   a time so checking a cache runs at memory bandwidth
 //
 // Arguments:
-//   A: pointer to the array to initialize
-//   n: number of elements in the array
-//   maxi: specifies range of random values
-//
-// Programmer: Lukasz Wesolowski
-// Creation: June 21, 2010
-// Returns:  nothing
+//   data: start of the region
+//   length: number of bytes
+//   hash: running hash value to continue from
 //
+// Returns:  the updated hash
 // ****************************************************************************
-template <typename floatType>
-void fill(floatType *A, const int n, const float maxi)
+static inline unsigned long long csrCacheChecksum(const void *data, 
+    size_t length, unsigned long long hash)
 {
-    for (int j = 0; j < n; j++) 
+    const unsigned long long prime = 1099511628211ULL;
+    const unsigned char *bytes = (const unsigned char *) data;
+    size_t words = length / sizeof(unsigned long long);
+    for (size_t i=0; i<words; i++)
     {
-        A[j] = ((floatType) maxi * (rand() / (RAND_MAX + 1.0f)));
+        unsigned long long w;
+        memcpy(&w, bytes + i * sizeof(w), sizeof(w));
+        hash = (hash ^ w) * prime;
     }
+    for (size_t i=words * sizeof(unsigned long long); i<length; i++)
+    {
+        hash = (hash ^ bytes[i]) * prime;
+    }
+    return hash;
+}
+
+static inline long long alignCsrCacheOffset(long long offset)
+{
+    return (offset + CSR_CACHE_ALIGNMENT - 1) / CSR_CACHE_ALIGNMENT * 
+           CSR_CACHE_ALIGNMENT;
 }
 
 // ****************************************************************************
-// Function initRandomMatrix
+// Function: writeCsrCache
 //
 // Purpose:
-//   Assigns random positions to a given number of elements in a square
-//   matrix, A.  The function encodes these positions in compressed sparse
-//   row format.
+//   Stores a CSR matrix in the binary cache format.  The file is written
+//   under a temporary name and renamed, so a concurrent reader never maps
+//   a partial cache.
 //
 // Arguments:
-//   cols:          array for column indexes of elements (size should be = n)
-//   rowDelimiters: array of size dim+1 holding indices to rows of A;
-//                  last element is the index one past the last element of A
-//   n:             number of nonzero elements in A
-//   dim:           number of rows/columns in A
-//
-// Programmer: Kyle Spafford
-// Creation: July 28, 2010
-// Returns: nothing
+//   cacheName: c string with the name of the cache file
+//   source: stat of the Matrix Market file the matrix was read from
+//   val, cols, rowDelimiters: the matrix in CSR format
+//   n: number of non-zero elements in the matrix
+//   size: number of rows in the matrix
 //
+// Returns:  true if the cache was written
 // ****************************************************************************
-void initRandomMatrix(int *cols, int *rowDelimiters, const int n, const int dim)
+template <typename floatType>
+bool writeCsrCache(const char *cacheName, const struct stat &source, 
+                   floatType *val, int *cols, int *rowDelimiters, 
+                   int n, int size)
 {
-    int nnzAssigned = 0;
+    struct CsrCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CSR_CACHE_MAGIC, sizeof(header.magic));
+    header.version = CSR_CACHE_VERSION;
+    header.precision = sizeof(floatType);
+    header.nRows = size;
+    header.nElements = n;
+    header.sourceSize = source.st_size;
+    header.sourceMtime = source.st_mtime;
+    header.rowDelimitersOffset = alignCsrCacheOffset(sizeof(header));
+    header.colsOffset = alignCsrCacheOffset(header.rowDelimitersOffset + 
+                                            (size + 1) * sizeof(int));
+    header.valOffset = alignCsrCacheOffset(header.colsOffset + 
+                                           (long long) n * sizeof(int));
+    header.fileSize = header.valOffset + (long long) n * sizeof(floatType);
 
-    // Figure out the probability that a nonzero should be assigned to a given
-    // spot in the matrix
-    double prob = (double)n / ((double)dim * (double)dim);
+    unsigned long long hash = CSR_CACHE_CHECKSUM_SEED;
+    hash = csrCacheChecksum(rowDelimiters, (size + 1) * sizeof(int), hash);
+    hash = csrCacheChecksum(cols, (size_t) n * sizeof(int), hash);
+    hash = csrCacheChecksum(val, (size_t) n * sizeof(floatType), hash);
+    header.checksum = hash;
+    header.headerChecksum = csrCacheChecksum(&header, 
+        offsetof(CsrCacheHeader, headerChecksum), CSR_CACHE_CHECKSUM_SEED);
 
-    // Seed random number generator
-    srand48(8675309L);
+    std::string tmpName = std::string(cacheName) + ".tmp";
+    FILE *f = fopen(tmpName.c_str(), "wb");
+    if (f == NULL)
+    {
+        return false;
+    }
 
-    // Randomly decide whether entry i,j gets a value, but ensure n values
-    // are assigned
-    bool fillRemaining = false;
-    for (int i = 0; i < dim; i++)
+    bool ok = true;
+    static const char zeros[CSR_CACHE_ALIGNMENT] = {0};
+    const void *sections[3] = {rowDelimiters, cols, val};
+    long long offsets[3] = {header.rowDelimitersOffset, header.colsOffset,
+                            header.valOffset};
+    size_t lengths[3] = {(size + 1) * sizeof(int), (size_t) n * sizeof(int),
+                         (size_t) n * sizeof(floatType)};
+    long long written = sizeof(header);
+    ok = ok && fwrite(&header, sizeof(header), 1, f) == 1;
+    for (int s=0; s<3 && ok; s++)
     {
-        rowDelimiters[i] = nnzAssigned;
-        for (int j = 0; j < dim; j++)
-        {
-            int numEntriesLeft = (dim * dim) - ((i * dim) + j);
-            int needToAssign   = n - nnzAssigned;
-            if (numEntriesLeft <= needToAssign) {
-                fillRemaining = true;
-            }
-            if ((nnzAssigned < n && drand48() <= prob) || fillRemaining)
-            {
-                // Assign (i,j) a value
-                cols[nnzAssigned] = j;
-                nnzAssigned++;
-            }
-        }
+        size_t pad = (size_t) (offsets[s] - written);
+        ok = ok && fwrite(zeros, 1, pad, f) == pad;
+        ok = ok && fwrite(sections[s], 1, lengths[s], f) == lengths[s];
+        written = offsets[s] + lengths[s];
     }
-    // Observe the convention to put the number of non zeroes at the end of the
-    // row delimiters array
-    rowDelimiters[dim] = n;
-    assert(nnzAssigned == n);
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmpName.c_str(), cacheName) != 0)
+    {
+        unlink(tmpName.c_str());
+        return false;
+    }
+    return true;
 }
 
 // ****************************************************************************
-// Function printSparse
+// Function: mapCsrCache
 //
 // Purpose:
-//   Prints a sparse matrix in dense form for debugging purposes
+//   Memory maps a binary CSR cache file, after checking that it matches
+//   the current Matrix Market file and precision and that its checksums
+//   hold.  The mapping is private and writable, so callers may modify
+//   the arrays without touching the file.
 //
 // Arguments:
-//   A: array holding the non-zero values for the matrix
-//   n: number of elements in A
-//   dim: number of rows/columns in the matrix
-//   rowDelimiters: array of size dim+1 holding indices to rows of A; 
-//               last element is the index one past the last element of A
+//   cacheName: c string with the name of the cache file
+//   source: stat of the Matrix Market file
+//   val_ptr, cols_ptr, rowDelimiters_ptr: output - arrays inside the
+//                                         mapping
+//   n: output - number of non-zero elements in the matrix
+//   size: output - number of rows in the matrix
+//
+// Returns:  true if the cache was valid and mapped
+// ****************************************************************************
+template <typename floatType>
+bool mapCsrCache(const char *cacheName, const struct stat &source,
+                 floatType **val_ptr, int **cols_ptr, int **rowDelimiters_ptr,
+                 int *n, int *size)
+{
+    int fd = open(cacheName, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(CsrCacheHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    int slot = 0;
+    while (slot < MAX_MAPPED_MATRICES && mappedMatrices[slot].base != NULL)
+    {
+        slot++;
+    }
+    if (slot == MAX_MAPPED_MATRICES)
+    {
+        close(fd);
+        return false;
+    }
+
+    char *base = (char *) mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        return false;
+    }
+
+    struct CsrCacheHeader *header = (struct CsrCacheHeader *) base;
+    bool valid = memcmp(header->magic, CSR_CACHE_MAGIC, 
+                        sizeof(header->magic)) == 0 &&
+        header->headerChecksum == csrCacheChecksum(header, 
+            offsetof(CsrCacheHeader, headerChecksum), CSR_CACHE_CHECKSUM_SEED) &&
+        header->version == CSR_CACHE_VERSION &&
+        header->precision == (int) sizeof(floatType) &&
+        header->sourceSize == (long long) source.st_size &&
+        header->sourceMtime == (long long) source.st_mtime &&
+        header->fileSize == (long long) st.st_size;
+
+    if (valid)
+    {
+        unsigned long long hash = CSR_CACHE_CHECKSUM_SEED;
+        hash = csrCacheChecksum(base + header->rowDelimitersOffset, 
+                                (header->nRows + 1) * sizeof(int), hash);
+        hash = csrCacheChecksum(base + header->colsOffset, 
+                                (size_t) header->nElements * sizeof(int), hash);
+        hash = csrCacheChecksum(base + header->valOffset, 
+                                (size_t) header->nElements * sizeof(floatType),
+                                hash);
+        valid = (hash == header->checksum);
+    }
+    if (!valid)
+    {
+        munmap(base, st.st_size);
+        return false;
+    }
+
+    *rowDelimiters_ptr = (int *) (base + header->rowDelimitersOffset);
+    *cols_ptr = (int *) (base + header->colsOffset);
+    *val_ptr = (floatType *) (base + header->valOffset);
+    *n = header->nElements;
+    *size = header->nRows;
+    mappedMatrices[slot].base = base;
+    mappedMatrices[slot].length = st.st_size;
+    return true;
+}
+
+// ****************************************************************************
+// Function: isMappedMatrix
+//
+// Purpose:
+//   Tells whether an array lives inside a mapped CSR cache file, in which
+//   case it is page aligned and outlives any buffer that uses it as a
+//   CL_MEM_USE_HOST_PTR backing store
+//
+// Arguments:
+//   ptr: array returned by readMatrix
+//
+// Returns:  true if ptr is inside a mapping made by mapCsrCache
+// ****************************************************************************
+inline bool isMappedMatrix(const void *ptr)
+{
+    const char *p = (const char *) ptr;
+    for (int i=0; i<MAX_MAPPED_MATRICES; i++)
+    {
+        const char *base = (const char *) mappedMatrices[i].base;
+        if (base != NULL && p >= base && p < base + mappedMatrices[i].length)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// ****************************************************************************
+// Function: readMatrix
+//
+// Purpose:
+//   Reads a sparse matrix from a file of Matrix Market format 
+//   Returns the data structures for the CSR format
+//
+//   The first load of a file also writes a binary CSR cache next to it
+//   (<filename>.sp.csr or .dp.csr).  Later loads memory map that cache
+//   instead of parsing the text, as long as the Matrix Market file has
+//   not changed.  Matrices returned by readMatrix must be released with
+//   freeMatrix.
+//
+// Arguments:
+//   filename: c string with the name of the file to be opened
+//   val_ptr: input - pointer to uninitialized pointer
+//            output - pointer to array holding the non-zero values
+//                     for the  matrix 
+//   cols_ptr: input - pointer to uninitialized pointer
+//             output - pointer to array of column indices for each
+//                      element of the sparse matrix
+//   rowDelimiters: input - pointer to uninitialized pointer
+//                  output - pointer to array holding
+//                           indices to rows of the matrix
+//   n: input - pointer to uninitialized int
+//      output - pointer to an int holding the number of non-zero
+//               elements in the matrix
+//   size: input - pointer to uninitialized int
+//         output - pointer to an int holding the number of rows in
+//                  the matrix 
+//   useCache: whether to read and write the binary CSR cache
+//
+// Returns:  nothing directly
+//           allocates or maps and returns *val_ptr, *cols_ptr, and
+//           *rowDelimiters_ptr indirectly 
+//           returns n and size indirectly through pointers
+// ****************************************************************************
+template <typename floatType>
+void readMatrix(char *filename, floatType **val_ptr, int **cols_ptr, 
+                int **rowDelimiters_ptr, int *n, int *size, bool useCache)
+{
+    struct stat source;
+    if (!useCache || stat(filename, &source) != 0)
+    {
+        readMatrixMarket(filename, val_ptr, cols_ptr, rowDelimiters_ptr, n,
+                         size);
+        return;
+    }
+
+    std::string cacheName = std::string(filename) + 
+        (sizeof(floatType) == sizeof(double) ? ".dp.csr" : ".sp.csr");
+    if (mapCsrCache(cacheName.c_str(), source, val_ptr, cols_ptr, 
+                    rowDelimiters_ptr, n, size))
+    {
+        return;
+    }
+
+    readMatrixMarket(filename, val_ptr, cols_ptr, rowDelimiters_ptr, n, size);
+    if (!writeCsrCache(cacheName.c_str(), source, *val_ptr, *cols_ptr, 
+                       *rowDelimiters_ptr, *n, *size))
+    {
+        std::cerr << "Warning: unable to write matrix cache " << cacheName 
+                  << std::endl;
+    }
+}
+
+// ****************************************************************************
+// Function: freeMatrix
+//
+// Purpose:
+//   Releases a CSR matrix returned by readMatrix, unmapping it if it came
+//   from a cache file and deleting it otherwise
+//
+// Arguments:
+//   val, cols, rowDelimiters: the matrix in CSR format
+//
+// Returns:  nothing
+// ****************************************************************************
+template <typename floatType>
+void freeMatrix(floatType *val, int *cols, int *rowDelimiters)
+{
+    for (int i=0; i<MAX_MAPPED_MATRICES; i++)
+    {
+        char *base = (char *) mappedMatrices[i].base;
+        if (base != NULL && (char *) rowDelimiters >= base && 
+            (char *) rowDelimiters < base + mappedMatrices[i].length)
+        {
+            munmap(base, mappedMatrices[i].length);
+            mappedMatrices[i].base = NULL;
+            mappedMatrices[i].length = 0;
+            return;
+        }
+    }
+    delete[] val;
+    delete[] cols;
+    delete[] rowDelimiters;
+}
+
+// ****************************************************************************
+// Function: fill
+//
+// Purpose:
+//   Simple routine to initialize input array
+//
+// Arguments:
+//   A: pointer to the array to initialize
+//   n: number of elements in the array
+//   maxi: specifies range of random values
+//
+// Programmer: Lukasz Wesolowski
+// Creation: June 21, 2010
+// Returns:  nothing
+//
+// ****************************************************************************
+template <typename floatType>
+void fill(floatType *A, const int n, const float maxi)
+{
+    for (int j = 0; j < n; j++) 
+    {
+        A[j] = ((floatType) maxi * (rand() / (RAND_MAX + 1.0f)));
+    }
+}
+
+// ****************************************************************************
+// Function initRandomMatrix
+//
+// Purpose:
+//   Assigns random positions to a given number of elements in a square
+//   matrix, A.  The function encodes these positions in compressed sparse
+//   row format.
+//
+// Arguments:
+//   cols:          array for column indexes of elements (size should be = n)
+//   rowDelimiters: array of size dim+1 holding indices to rows of A;
+//                  last element is the index one past the last element of A
+//   n:             number of nonzero elements in A
+//   dim:           number of rows/columns in A
+//
+// Programmer: Kyle Spafford
+// Creation: July 28, 2010
+// Returns: nothing
+//
+// ****************************************************************************
+void initRandomMatrix(int *cols, int *rowDelimiters, const int n, const int dim)
+{
+    int nnzAssigned = 0;
+
+    // Figure out the probability that a nonzero should be assigned to a given
+    // spot in the matrix
+    double prob = (double)n / ((double)dim * (double)dim);
+
+    // Seed random number generator
+    srand48(8675309L);
+
+    // Randomly decide whether entry i,j gets a value, but ensure n values
+    // are assigned
+    bool fillRemaining = false;
+    for (int i = 0; i < dim; i++)
+    {
+        rowDelimiters[i] = nnzAssigned;
+        for (int j = 0; j < dim; j++)
+        {
+            int numEntriesLeft = (dim * dim) - ((i * dim) + j);
+            int needToAssign   = n - nnzAssigned;
+            if (numEntriesLeft <= needToAssign) {
+                fillRemaining = true;
+            }
+            if ((nnzAssigned < n && drand48() <= prob) || fillRemaining)
+            {
+                // Assign (i,j) a value
+                cols[nnzAssigned] = j;
+                nnzAssigned++;
+            }
+        }
+    }
+    // Observe the convention to put the number of non zeroes at the end of the
+    // row delimiters array
+    rowDelimiters[dim] = n;
+    assert(nnzAssigned == n);
+}
+
+// ****************************************************************************
+// Function printSparse
+//
+// Purpose:
+//   Prints a sparse matrix in dense form for debugging purposes
+//
+// Arguments:
+//   A: array holding the non-zero values for the matrix
+//   n: number of elements in A
+//   dim: number of rows/columns in the matrix
+//   rowDelimiters: array of size dim+1 holding indices to rows of A; 
+//               last element is the index one past the last element of A
 // 
 // Programmer: Lukasz Wesolowski
 // Creation: June 22, 2010
@@ -490,6 +1335,700 @@ void convertToPadded(floatType *A, int *cols, int dim, int *rowDelimiters,
 
 }
 
+// ****************************************************************************
+// Function: convertToSellCSigma
+//
+// Purpose:
+//   Converts a CSR matrix into the SELL-C-sigma format.  Rows are sorted
+//   by decreasing length inside windows of sortWindow rows, then grouped
+//   into slices of sliceHeight rows.  Each slice is stored column-major
+//   and padded only to the length of its own longest row, rather than
+//   to the longest row of the whole matrix as in ELLPACK-R.
+//
+// Arguments:
+//   A: array holding the non-zero values for the matrix
+//   cols: array of column indices of the sparse matrix
+//   dim: number of rows/columns in the matrix
+//   rowDelimiters: array holding indices in A to rows of the sparse matrix
+//   sliceHeight: number of rows per slice (C)
+//   sortWindow: number of rows sorted together by length (sigma), should
+//               be a multiple of sliceHeight
+//   newA_ptr: input - pointer to an uninitialized pointer
+//             output - pointer to A in SELL-C-sigma format
+//   newcols_ptr: input - pointer to an uninitialized pointer
+//                output - pointer to cols in SELL-C-sigma format
+//   sliceStart_ptr: input - pointer to an uninitialized pointer
+//                   output - array of size numSlices+1 holding the offset
+//                            of each slice in newA
+//   rowLengths_ptr: input - pointer to an uninitialized pointer
+//                   output - array of size dim holding the length of
+//                            each row in sorted order
+//   rowPerm_ptr: input - pointer to an uninitialized pointer
+//                output - array of size dim mapping each sorted row to
+//                         its row in the original matrix
+//   numSlices: output - number of slices
+//   newSize: output - number of stored elements, including padding
+//
+// Returns:
+//   nothing directly
+//   allocates and returns all pointer arguments indirectly
+// ****************************************************************************
+template <typename floatType>
+void convertToSellCSigma(floatType *A, int *cols, int dim, int *rowDelimiters,
+                         int sliceHeight, int sortWindow,
+                         floatType **newA_ptr, int **newcols_ptr,
+                         int **sliceStart_ptr, int **rowLengths_ptr,
+                         int **rowPerm_ptr, int *numSlices, int *newSize)
+{
+    int nSlices = (dim + sliceHeight - 1) / sliceHeight;
+
+    // sort rows by decreasing length within each sorting window
+    struct RowLength *order = new RowLength[dim];
+    for (int i=0; i<dim; i++)
+    {
+        order[i].row = i;
+        order[i].length = rowDelimiters[i+1] - rowDelimiters[i];
+    }
+    if (sortWindow > 1)
+    {
+        for (int w=0; w<dim; w+=sortWindow)
+        {
+            int count = (dim - w < sortWindow) ? dim - w : sortWindow;
+            qsort(order + w, count, sizeof(struct RowLength), rowlencmp);
+        }
+    }
+
+    *rowLengths_ptr = new int[dim];
+    *rowPerm_ptr = new int[dim];
+    *sliceStart_ptr = new int[nSlices+1];
+    int *rowLengths = *rowLengths_ptr;
+    int *rowPerm = *rowPerm_ptr;
+    int *sliceStart = *sliceStart_ptr;
+
+    for (int i=0; i<dim; i++)
+    {
+        rowPerm[i] = order[i].row;
+        rowLengths[i] = order[i].length;
+    }
+    delete[] order;
+
+    // each slice is as wide as its longest row
+    int totalSize = 0;
+    for (int s=0; s<nSlices; s++)
+    {
+        sliceStart[s] = totalSize;
+        int width = 0;
+        for (int r=s*sliceHeight; r<(s+1)*sliceHeight && r<dim; r++)
+        {
+            if (rowLengths[r] > width)
+            {
+                width = rowLengths[r];
+            }
+        }
+        totalSize += width * sliceHeight;
+    }
+    sliceStart[nSlices] = totalSize;
+    *numSlices = nSlices;
+    *newSize = totalSize;
+
+    *newA_ptr = new floatType[totalSize];
+    *newcols_ptr = new int[totalSize];
+    floatType *newA = *newA_ptr;
+    int *newcols = *newcols_ptr;
+
+    memset(newA, 0, totalSize * sizeof(floatType));
+    memset(newcols, 0, totalSize * sizeof(int));
+
+    // fill each slice in column-major order
+    for (int r=0; r<dim; r++)
+    {
+        int slice = r / sliceHeight;
+        int lane = r - slice * sliceHeight;
+        int start = rowDelimiters[rowPerm[r]];
+        for (int j=0; j<rowLengths[r]; j++)
+        {
+            int k = sliceStart[slice] + j * sliceHeight + lane;
+            newA[k] = A[start+j];
+            newcols[k] = cols[start+j];
+        }
+    }
+}
+
+// ****************************************************************************
+// Function: matrixBandwidth
+//
+// Purpose:
+//   Computes the bandwidth of a CSR matrix, the largest distance of a
+//   non-zero from the diagonal
+//
+// Arguments:
+//   cols: array of column indices for each element of A
+//   rowDelimiters: array of size dim+1 holding indices to rows of A
+//   dim: number of rows in the matrix
+//
+// Returns:  the bandwidth
+// ****************************************************************************
+int matrixBandwidth(const int *cols, const int *rowDelimiters, int dim)
+{
+    int bandwidth = 0;
+    for (int i=0; i<dim; i++)
+    {
+        for (int j=rowDelimiters[i]; j<rowDelimiters[i+1]; j++)
+        {
+            int d = (cols[j] > i) ? cols[j] - i : i - cols[j];
+            if (d > bandwidth) bandwidth = d;
+        }
+    }
+    return bandwidth;
+}
+
+// ****************************************************************************
+// Function: rcmLevels
+//
+// Purpose:
+//   Breadth first search of the reordering graph from root over the rows
+//   not numbered yet, used to find a pseudo-peripheral row
+//
+// Arguments:
+//   adjStart, adj: adjacency lists of the graph
+//   root: row the search starts from
+//   skip: rows excluded from the search
+//   mark, stamp: mark[r] == stamp once r is reached in this search
+//   queue: buffer of size dim for the rows reached
+//   lastLevel: output - index in queue of the first row of the last level
+//   numReached: output - number of rows reached
+//
+// Returns:  the number of levels below root (its eccentricity)
+// ****************************************************************************
+int rcmLevels(const int *adjStart, const int *adj, int root, const char *skip,
+              int *mark, int stamp, int *queue, int *lastLevel,
+              int *numReached)
+{
+    int head = 0, tail = 0, levels = 0;
+    queue[tail++] = root;
+    mark[root] = stamp;
+    *lastLevel = 0;
+    while (head < tail)
+    {
+        int levelEnd = tail;
+        *lastLevel = head;
+        for (; head < levelEnd; head++)
+        {
+            int r = queue[head];
+            for (int j=adjStart[r]; j<adjStart[r+1]; j++)
+            {
+                int c = adj[j];
+                if (!skip[c] && mark[c] != stamp)
+                {
+                    mark[c] = stamp;
+                    queue[tail++] = c;
+                }
+            }
+        }
+        if (tail > levelEnd) levels++;
+    }
+    *numReached = tail;
+    return levels;
+}
+
+// ****************************************************************************
+// Function: computeRcmOrdering
+//
+// Purpose:
+//   Computes a reverse Cuthill-McKee ordering of the rows of a square
+//   matrix from the structure of A + A^T.  Each connected component is
+//   numbered breadth first from a pseudo-peripheral row, visiting the
+//   neighbours of a row by increasing degree, and the order is reversed
+//   at the end.  With denseFactor > 0, rows of degree above denseFactor
+//   times the mean are left out of the search and numbered last, so a
+//   few dense rows do not pull every component into one wide band.
+//
+// Arguments:
+//   cols: array of column indices for each element of A
+//   rowDelimiters: array of size dim+1 holding indices to rows of A
+//   dim: number of rows in the matrix
+//   denseFactor: degree partitioning threshold, 0 to disable
+//   perm: output - array of size dim, perm[i] is the row of A numbered i
+//
+// Returns:  nothing directly
+//           perm indirectly through a pointer
+// ****************************************************************************
+void computeRcmOrdering(const int *cols, const int *rowDelimiters, int dim,
+                        double denseFactor, int *perm)
+{
+    // Adjacency lists of A + A^T without the diagonal and duplicates
+    int *adjStart = new int[dim+1];
+    memset(adjStart, 0, (dim+1) * sizeof(int));
+    for (int i=0; i<dim; i++)
+    {
+        for (int j=rowDelimiters[i]; j<rowDelimiters[i+1]; j++)
+        {
+            if (cols[j] != i && cols[j] < dim)
+            {
+                adjStart[i+1]++;
+                adjStart[cols[j]+1]++;
+            }
+        }
+    }
+    for (int i=0; i<dim; i++)
+    {
+        adjStart[i+1] += adjStart[i];
+    }
+    int *adj = new int[adjStart[dim]];
+    int *fillPos = new int[dim];
+    memcpy(fillPos, adjStart, dim * sizeof(int));
+    for (int i=0; i<dim; i++)
+    {
+        for (int j=rowDelimiters[i]; j<rowDelimiters[i+1]; j++)
+        {
+            if (cols[j] != i && cols[j] < dim)
+            {
+                adj[fillPos[i]++] = cols[j];
+                adj[fillPos[cols[j]]++] = i;
+            }
+        }
+    }
+    int numEdges = 0, maxDegree = 0;
+    for (int i=0; i<dim; i++)
+    {
+        int start = adjStart[i];
+        int end = fillPos[i];
+        qsort(adj + start, end - start, sizeof(int), intcmp);
+        adjStart[i] = numEdges;
+        for (int j=start; j<end; j++)
+        {
+            if (j == start || adj[j] != adj[j-1])
+            {
+                adj[numEdges++] = adj[j];
+            }
+        }
+        if (numEdges - adjStart[i] > maxDegree)
+        {
+            maxDegree = numEdges - adjStart[i];
+        }
+    }
+    adjStart[dim] = numEdges;
+    delete[] fillPos;
+
+    // Rows left out of the search are dense or already numbered
+    char *skip = new char[dim];
+    int numDense = 0;
+    double threshold = denseFactor * numEdges / (dim > 0 ? dim : 1);
+    for (int i=0; i<dim; i++)
+    {
+        skip[i] = denseFactor > 0 && adjStart[i+1] - adjStart[i] > threshold;
+        if (skip[i])
+        {
+            perm[dim - 1 - numDense++] = i;
+        }
+    }
+
+    int *mark = new int[dim];
+    int *queue = new int[dim];
+    memset(mark, 0, dim * sizeof(int));
+    int stamp = 0;
+    struct RowLength *neighbours = new RowLength[maxDegree + 1];
+    int numbered = 0;
+
+    for (int seed=0; seed<dim; seed++)
+    {
+        if (skip[seed]) continue;
+
+        // George-Liu search for a pseudo-peripheral root: move to the
+        // lowest degree row of the last level while the eccentricity grows
+        int root = seed, lastLevel, numReached;
+        int levels = rcmLevels(adjStart, adj, root, skip, mark, ++stamp,
+                               queue, &lastLevel, &numReached);
+        for (;;)
+        {
+            int candidate = queue[lastLevel];
+            for (int q=lastLevel+1; q<numReached; q++)
+            {
+                int r = queue[q];
+                if (adjStart[r+1] - adjStart[r] <
+                    adjStart[candidate+1] - adjStart[candidate])
+                {
+                    candidate = r;
+                }
+            }
+            int candidateLevels = rcmLevels(adjStart, adj, candidate, skip,
+                    mark, ++stamp, queue, &lastLevel, &numReached);
+            if (candidateLevels <= levels) break;
+            root = candidate;
+            levels = candidateLevels;
+        }
+
+        // Cuthill-McKee numbering of the component, perm is the queue
+        int head = numbered;
+        perm[numbered++] = root;
+        skip[root] = 1;
+        while (head < numbered)
+        {
+            int r = perm[head++];
+            int count = 0;
+            for (int j=adjStart[r]; j<adjStart[r+1]; j++)
+            {
+                int c = adj[j];
+                if (!skip[c])
+                {
+                    skip[c] = 1;
+                    neighbours[count].row = c;
+                    neighbours[count].length = adjStart[c+1] - adjStart[c];
+                    count++;
+                }
+            }
+            qsort(neighbours, count, sizeof(struct RowLength), rowlenasccmp);
+            for (int n=0; n<count; n++)
+            {
+                perm[numbered++] = neighbours[n].row;
+            }
+        }
+    }
+
+    // Reverse the Cuthill-McKee order, dense rows stay last
+    for (int i=0, j=numbered-1; i<j; i++, j--)
+    {
+        int t = perm[i];
+        perm[i] = perm[j];
+        perm[j] = t;
+    }
+
+    delete[] neighbours;
+    delete[] queue;
+    delete[] mark;
+    delete[] skip;
+    delete[] adj;
+    delete[] adjStart;
+}
+
+// ****************************************************************************
+// Function: permuteMatrix
+//
+// Purpose:
+//   Applies a symmetric permutation to a square CSR matrix: row i of the
+//   result is row perm[i] of A, with column c renumbered to the position
+//   of c in perm.  Rows of the result are sorted by column.
+//
+// Arguments:
+//   A: array holding the non-zero values for the matrix
+//   cols: array of column indices for each element of A
+//   rowDelimiters: array of size dim+1 holding indices to rows of A
+//   dim: number of rows in the matrix
+//   perm: permutation, perm[i] is the row of A that becomes row i
+//   newA_ptr, newcols_ptr, newRowDelimiters_ptr: output - the permuted
+//   matrix, allocated with new[]
+//
+// Returns:  nothing directly
+//           permuted matrix indirectly through pointers
+// ****************************************************************************
+template <typename floatType>
+void permuteMatrix(const floatType *A, const int *cols,
+                   const int *rowDelimiters, int dim, const int *perm,
+                   floatType **newA_ptr, int **newcols_ptr,
+                   int **newRowDelimiters_ptr)
+{
+    int nnz = rowDelimiters[dim];
+    int *iperm = new int[dim];
+    for (int i=0; i<dim; i++)
+    {
+        iperm[perm[i]] = i;
+    }
+
+    floatType *newA = new floatType[nnz];
+    int *newcols = new int[nnz];
+    int *newRowDelimiters = new int[dim+1];
+    newRowDelimiters[0] = 0;
+    for (int i=0; i<dim; i++)
+    {
+        int k = newRowDelimiters[i];
+        for (int j=rowDelimiters[perm[i]]; j<rowDelimiters[perm[i]+1]; j++)
+        {
+            newA[k] = A[j];
+            newcols[k] = iperm[cols[j]];
+            k++;
+        }
+        newRowDelimiters[i+1] = k;
+    }
+    delete[] iperm;
+
+    struct RowRange all;
+    all.first = 0;
+    all.last = dim;
+    all.rowDelimiters = newRowDelimiters;
+    all.cols = newcols;
+    all.val = newA;
+    sortMatrixRows<floatType>(&all);
+
+    *newA_ptr = newA;
+    *newcols_ptr = newcols;
+    *newRowDelimiters_ptr = newRowDelimiters;
+}
+
+// ****************************************************************************
+// Function: permuteVector
+//
+// Purpose:
+//   Moves a dense vector to or from the numbering of a permuted matrix:
+//   out[i] = in[perm[i]], or out[perm[i]] = in[i] when inverse is set
+//
+// Arguments:
+//   in: vector to permute
+//   perm: permutation given to permuteMatrix
+//   dim: size of the vectors
+//   inverse: undo the permutation instead of applying it
+//   out: output - permuted vector, must not alias in
+//
+// Returns:  nothing directly
+//           out indirectly through a pointer
+// ****************************************************************************
+template <typename floatType>
+void permuteVector(const floatType *in, const int *perm, int dim,
+                   bool inverse, floatType *out)
+{
+    for (int i=0; i<dim; i++)
+    {
+        if (inverse)
+        {
+            out[perm[i]] = in[i];
+        }
+        else
+        {
+            out[i] = in[perm[i]];
+        }
+    }
+}
+
+// ****************************************************************************
+// Function: floatToHalf
+//
+// Purpose:
+//   Rounds a float to the nearest IEEE 754 half precision value (ties to
+//   even), with overflow to infinity and gradual underflow
+//
+// Returns:  the bits of the half value
+// ****************************************************************************
+inline unsigned short floatToHalf(float f)
+{
+    unsigned int x;
+    memcpy(&x, &f, sizeof(x));
+    unsigned int sign = (x >> 16) & 0x8000;
+    unsigned int mant = x & 0x7fffff;
+    int exp = (int) ((x >> 23) & 0xff) - 127 + 15;
+
+    if (((x >> 23) & 0xff) == 0xff)
+    {
+        return sign | 0x7c00 | (mant ? 0x200 : 0);   // inf or nan
+    }
+    if (exp >= 31)
+    {
+        return sign | 0x7c00;
+    }
+    if (exp <= 0)
+    {
+        if (exp < -10)
+        {
+            return sign;
+        }
+        // subnormal, the implicit bit becomes part of the mantissa
+        mant |= 0x800000;
+        int shift = 14 - exp;
+        unsigned int h = mant >> shift;
+        unsigned int rem = mant & ((1u << shift) - 1);
+        unsigned int halfway = 1u << (shift - 1);
+        if (rem > halfway || (rem == halfway && (h & 1)))
+        {
+            h++;
+        }
+        return sign | h;
+    }
+    // a carry out of the mantissa correctly bumps the exponent
+    unsigned int h = ((unsigned int) exp << 10) | (mant >> 13);
+    unsigned int rem = mant & 0x1fff;
+    if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+    {
+        h++;
+    }
+    return sign | h;
+}
+
+// ****************************************************************************
+// Function: convertToHalf
+//
+// Purpose:
+//   Converts an array of values to half precision storage
+//
+// Arguments:
+//   A: values to convert
+//   n: number of values
+//   newA: output - half precision bits of each value
+//
+// Returns:  nothing directly
+//           newA indirectly through a pointer
+// ****************************************************************************
+template <typename floatType>
+void convertToHalf(const floatType *A, int n, unsigned short *newA)
+{
+    for (int i=0; i<n; i++)
+    {
+        newA[i] = floatToHalf((float) A[i]);
+    }
+}
+
+// ****************************************************************************
+// Function: compressColumns
+//
+// Purpose:
+//   Stores the column indices of a CSR matrix as 16-bit offsets from the
+//   first column of their row.  Rows whose columns span more than 16 bits
+//   keep 32-bit indices in a separate array, and their rowBase entry
+//   holds -(start of the row in that array)-1.
+//
+// Arguments:
+//   cols: array of column indices for each element of A
+//   rowDelimiters: array of size dim+1 holding indices to rows of A
+//   dim: number of rows in the matrix
+//   colOffsets: output - array of size nnz of 16-bit column offsets
+//   rowBase: output - array of size dim, see above
+//   wideCols_ptr: output - 32-bit columns of the rows that do not fit,
+//                 allocated with new[] (at least one element)
+//   numWide: output - number of entries in wideCols
+//
+// Returns:  the number of rows that did not fit
+// ****************************************************************************
+int compressColumns(const int *cols, const int *rowDelimiters, int dim,
+                    unsigned short *colOffsets, int *rowBase,
+                    int **wideCols_ptr, int *numWide)
+{
+    int wideRows = 0;
+    *numWide = 0;
+    for (int i=0; i<dim; i++)
+    {
+        int lo = INT_MAX, hi = -1;
+        for (int j=rowDelimiters[i]; j<rowDelimiters[i+1]; j++)
+        {
+            if (cols[j] < lo) lo = cols[j];
+            if (cols[j] > hi) hi = cols[j];
+        }
+        if (hi >= 0 && hi - lo > USHRT_MAX)
+        {
+            wideRows++;
+            *numWide += rowDelimiters[i+1] - rowDelimiters[i];
+        }
+    }
+
+    int *wideCols = new int[*numWide > 0 ? *numWide : 1];
+    int wide = 0;
+    for (int i=0; i<dim; i++)
+    {
+        int lo = INT_MAX, hi = -1;
+        for (int j=rowDelimiters[i]; j<rowDelimiters[i+1]; j++)
+        {
+            if (cols[j] < lo) lo = cols[j];
+            if (cols[j] > hi) hi = cols[j];
+        }
+        if (hi >= 0 && hi - lo > USHRT_MAX)
+        {
+            rowBase[i] = -wide - 1;
+            for (int j=rowDelimiters[i]; j<rowDelimiters[i+1]; j++)
+            {
+                wideCols[wide++] = cols[j];
+                colOffsets[j] = 0;
+            }
+        }
+        else
+        {
+            rowBase[i] = (hi >= 0) ? lo : 0;
+            for (int j=rowDelimiters[i]; j<rowDelimiters[i+1]; j++)
+            {
+                colOffsets[j] = (unsigned short) (cols[j] - lo);
+            }
+        }
+    }
+    *wideCols_ptr = wideCols;
+    return wideRows;
+}
+
+// ****************************************************************************
+// Function: computeRowStats
+//
+// Purpose:
+//   Computes row length statistics of a CSR matrix: mean, variance and
+//   extremes of the row lengths, the padding ELLPACK-R would store, and
+//   how well the row-per-thread, warp-per-row and SELL-C-sigma kernels
+//   would keep their work-items busy on it
+//
+// Arguments:
+//   rowDelimiters: array of size dim+1 holding indices to rows of A
+//   dim: number of rows in the matrix
+//   sliceHeight: SELL-C-sigma slice height (C)
+//   sortWindow: SELL-C-sigma sorting window (sigma)
+//   stats: output - the statistics
+//
+// Returns:  nothing directly
+//           stats indirectly through a pointer
+// ****************************************************************************
+void computeRowStats(const int *rowDelimiters, int dim, int sliceHeight,
+                     int sortWindow, struct RowStats *stats)
+{
+    double nnz = rowDelimiters[dim];
+    double sumSq = 0;
+    double warpWork = 0, vectorWork = 0, sellWork = 0;
+    int *lengths = new int[dim];
+
+    stats->minrl = (dim > 0) ? rowDelimiters[1] - rowDelimiters[0] : 0;
+    stats->maxrl = 0;
+    stats->emptyRows = 0;
+    int warpMax = 0;
+    for (int i=0; i<dim; i++)
+    {
+        int rl = rowDelimiters[i+1] - rowDelimiters[i];
+        lengths[i] = rl;
+        sumSq += (double) rl * rl;
+        if (rl > stats->maxrl) stats->maxrl = rl;
+        if (rl < stats->minrl) stats->minrl = rl;
+        if (rl == 0) stats->emptyRows++;
+
+        // a warp iterates as long as its longest row
+        if (rl > warpMax) warpMax = rl;
+        if (i % WARP_LENGTH == WARP_LENGTH - 1 || i == dim - 1)
+        {
+            warpWork += (double) warpMax * WARP_LENGTH;
+            warpMax = 0;
+        }
+
+        // a vector of WARP_LENGTH work-items makes at least one pass
+        int passes = (rl + WARP_LENGTH - 1) / WARP_LENGTH;
+        vectorWork += (double) (passes > 0 ? passes : 1) * WARP_LENGTH;
+    }
+
+    // SELL-C-sigma: sort each window, every slice runs to its longest row
+    if (sortWindow > 1)
+    {
+        for (int w=0; w<dim; w+=sortWindow)
+        {
+            int count = (dim - w < sortWindow) ? dim - w : sortWindow;
+            qsort(lengths + w, count, sizeof(int), intdesccmp);
+        }
+    }
+    for (int s=0; s<dim; s+=sliceHeight)
+    {
+        int width = 0;
+        for (int r=s; r<s+sliceHeight && r<dim; r++)
+        {
+            if (lengths[r] > width) width = lengths[r];
+        }
+        sellWork += (double) width * sliceHeight;
+    }
+    delete[] lengths;
+
+    stats->mean = (dim > 0) ? nnz / dim : 0;
+    stats->variance = (dim > 0) ? sumSq / dim - stats->mean * stats->mean : 0;
+    stats->ellPadRatio = (nnz > 0) ? (double) stats->maxrl * dim / nnz : 1;
+    stats->warpEfficiency = (warpWork > 0) ? nnz / warpWork : 1;
+    stats->vectorEfficiency = (vectorWork > 0) ? nnz / vectorWork : 1;
+    stats->sellEfficiency = (sellWork > 0) ? nnz / sellWork : 1;
+}
+
 // comparison functions used for qsort
 
 inline int intcmp(const void *v1, const void *v2)
@@ -498,6 +2037,12 @@ inline int intcmp(const void *v1, const void *v2)
 }
 
 
+inline int intdesccmp(const void *v1, const void *v2)
+{
+    return (*(int *)v2 - *(int *)v1);
+}
+
+
 inline int coordcmp(const void *v1, const void *v2)
 {
     struct Coordinate *c1 = (struct Coordinate *) v1;
@@ -513,4 +2058,49 @@ inline int coordcmp(const void *v1, const void *v2)
     }
 }
 
+// sorts like coordcmp, equal coordinates by value
+inline int coordvalcmp(const void *v1, const void *v2)
+{
+    int order = coordcmp(v1, v2);
+    if (order != 0)
+    {
+        return order;
+    }
+    float a = ((struct Coordinate *) v1)->val;
+    float b = ((struct Coordinate *) v2)->val;
+    return (a > b) - (a < b);
+}
+
+// sorts by decreasing length, ties keep the original row order
+inline int rowlencmp(const void *v1, const void *v2)
+{
+    struct RowLength *r1 = (struct RowLength *) v1;
+    struct RowLength *r2 = (struct RowLength *) v2;
+
+    if (r1->length != r2->length)
+    {
+        return (r2->length - r1->length);
+    }
+    else
+    {
+        return (r1->row - r2->row);
+    }
+}
+
+
+inline int rowlenasccmp(const void *v1, const void *v2)
+{
+    struct RowLength *r1 = (struct RowLength *) v1;
+    struct RowLength *r2 = (struct RowLength *) v2;
+
+    if (r1->length != r2->length)
+    {
+        return (r1->length - r2->length);
+    }
+    else
+    {
+        return (r1->row - r2->row);
+    }
+}
+
 #endif // SPMV_UTIL_H_
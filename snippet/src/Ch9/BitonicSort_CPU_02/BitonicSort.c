@@ -0,0 +1,80 @@
+#define _POSIX_C_SOURCE 200112L  // clock_gettime, sysconf and pthread_barrier under -std=c99
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bitonicsort_cpu.h"
+
+#define DATA_SIZE (1<<24)                // as many keys as the GPU version sorts
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int compareInts(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+static void fillRandom(int* data, size_t length) {
+    for(size_t i = 0; i < length; i++)
+        data[i] = (int)(((unsigned)rand() << 16) ^ (unsigned)rand());
+}
+
+int main(int argc, char** argv) {
+    // [n] [threads]: any n, random keys of the whole int range, sorted
+    // with every sorting network the processor has, on one thread and
+    // on all of them
+    size_t dataSize = DATA_SIZE;
+    int numThreads = 0;
+    if(argc > 1) dataSize = strtoul(argv[1], NULL, 10);
+    if(argc > 2) numThreads = atoi(argv[2]);
+    if(numThreads <= 0) numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+
+    int* input = (int*) malloc((dataSize + 1) * sizeof(int));
+    int* keys = (int*) malloc((dataSize + 1) * sizeof(int));
+    int* reference = (int*) malloc((dataSize + 1) * sizeof(int));
+    fillRandom(input, dataSize);
+    printf("elementCount: %zu, threads: %d\n", dataSize, numThreads);
+
+    memcpy(reference, input, dataSize * sizeof(int));
+    double start = now();
+    qsort(reference, dataSize, sizeof(int), compareInts);
+    double seconds = now() - start;
+    printf("qsort:              %9.3f ms %8.2f Mkeys/s\n", seconds * 1e3, dataSize / seconds * 1e-6);
+
+    int isaCount = bitonicCpuDetectIsa() + 1;
+    int threadCounts[2] = {1, numThreads};
+    for(int isa = 0; isa < isaCount; isa++) {
+        for(int t = 0; t < (numThreads > 1 ? 2 : 1); t++) {
+            int threads = threadCounts[t];
+            for(int ascending = 1; ascending >= 0; ascending--) {
+                memcpy(keys, input, dataSize * sizeof(int));
+                start = now();
+                int error = bitonicSortCPU(keys, dataSize, ascending, threads, isa);
+                seconds = now() - start;
+                if(error != 0) {
+                    printf("%s: out of memory\n", BITONIC_CPU_ISA_NAMES[isa]);
+                    continue;
+                }
+
+                size_t acc = 0;
+                for(size_t i = 0; i < dataSize; i++) {
+                    if(keys[i] == reference[ascending ? i : dataSize - 1 - i]) acc++;
+                }
+                printf("%-6s %2d thread%s %s: %9.3f ms %8.2f Mkeys/s  ", BITONIC_CPU_ISA_NAMES[isa], threads,
+                       threads > 1 ? "s" : " ", ascending ? " ascending" : "descending",
+                       seconds * 1e3, dataSize / seconds * 1e-6);
+                if (acc == dataSize) printf("Passed:%zu!\n", acc); else printf("Failed:%zu!\n", acc);
+            }
+        }
+    }
+
+    free(input);
+    free(keys);
+    free(reference);
+    return 0;
+}
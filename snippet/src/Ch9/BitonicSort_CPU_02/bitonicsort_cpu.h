@@ -0,0 +1,514 @@
+#ifndef BITONICSORT_CPU_H_
+#define BITONICSORT_CPU_H_
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BITONIC_CPU_X86 1
+#endif
+
+// Keys sorted in registers and merged as a whole before the merge
+// passes; the input is padded with INT_MAX to a multiple of it
+#define BITONIC_CPU_BLOCK 64
+
+// Sorting networks used by the engine, picked at start-up from what the
+// processor supports
+typedef enum {
+    BITONIC_CPU_SCALAR = 0,
+    BITONIC_CPU_SSE41,
+    BITONIC_CPU_AVX2
+} BitonicCpuIsa;
+
+static const char* BITONIC_CPU_ISA_NAMES[] = {"Scalar", "SSE4.1", "AVX2"};
+
+// ****************************************************************************
+// Struct: BitonicCpuSort
+//
+// Purpose:
+//   State shared by the threads of one sort.  Keys are copied with their
+//   padding into buffers[0], and every merge pass goes from one buffer
+//   to the other; the threads meet at the barrier between passes.  They
+//   wait at the start gate until the caller knows how many of them
+//   started, which sizes the barrier and the shares.
+// ****************************************************************************
+typedef struct {
+    int* keys;
+    size_t n;
+    size_t padded;
+    int ascending;
+    int isa;
+    int numThreads;
+    int* buffers[2];
+    pthread_barrier_t barrier;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    int ready;
+} BitonicCpuSort;
+
+typedef struct {
+    BitonicCpuSort* sort;
+    int id;
+} BitonicCpuWorker;
+
+static void bitonicCpuMergeScalar(const int* a, size_t na, const int* b, size_t nb, int* out) {
+    while(na > 0 && nb > 0) {
+        if(*a <= *b) { *out++ = *a++; na--; }
+        else         { *out++ = *b++; nb--; }
+    }
+    memcpy(out, a, na * sizeof(int));
+    memcpy(out + na, b, nb * sizeof(int));
+}
+
+// Merges the w sorted keys left in carry with the ends of both runs
+static void bitonicCpuMergeTail(const int* carry, size_t w, const int* a, size_t na,
+                                const int* b, size_t nb, int* out) {
+    while(w > 0) {
+        if(na > 0 && *a < *carry && (nb == 0 || *a <= *b)) { *out++ = *a++; na--; }
+        else if(nb > 0 && *b < *carry)                     { *out++ = *b++; nb--; }
+        else                                                { *out++ = *carry++; w--; }
+    }
+    bitonicCpuMergeScalar(a, na, b, nb, out);
+}
+
+static void bitonicCpuSortBlockScalar(int* block) {
+    for(int i = 1; i < BITONIC_CPU_BLOCK; i++) {
+        int key = block[i];
+        int j = i;
+        for(; j > 0 && block[j - 1] > key; j--) block[j] = block[j - 1];
+        block[j] = key;
+    }
+}
+
+#ifdef BITONIC_CPU_X86
+// ****************************************************************************
+// Function: bitonicCpuMerge4, bitonicCpuMerge8
+//
+// Purpose:
+//   Bitonic merge of two sorted registers.  Reversing b makes a:b
+//   bitonic; one min/max splits it in a low and a high bitonic half,
+//   each sorted by compare-exchanges at distances w/2 .. 1 done with
+//   shuffles and blends.
+//
+// Returns:  nothing
+//           the lower keys in *a, the higher in *b, both sorted
+// ****************************************************************************
+__attribute__((target("sse4.1")))
+static inline __m128i bitonicCpuHalfClean4(__m128i v) {
+    __m128i t = _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+    v = _mm_blend_epi16(_mm_min_epi32(v, t), _mm_max_epi32(v, t), 0xF0);
+    t = _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_blend_epi16(_mm_min_epi32(v, t), _mm_max_epi32(v, t), 0xCC);
+}
+
+__attribute__((target("sse4.1")))
+static inline void bitonicCpuMerge4(__m128i* a, __m128i* b) {
+    __m128i r = _mm_shuffle_epi32(*b, _MM_SHUFFLE(0, 1, 2, 3));
+    __m128i lo = _mm_min_epi32(*a, r);
+    __m128i hi = _mm_max_epi32(*a, r);
+    *a = bitonicCpuHalfClean4(lo);
+    *b = bitonicCpuHalfClean4(hi);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i bitonicCpuHalfClean8(__m256i v) {
+    __m256i t = _mm256_permute2x128_si256(v, v, 0x01);
+    v = _mm256_blend_epi32(_mm256_min_epi32(v, t), _mm256_max_epi32(v, t), 0xF0);
+    t = _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+    v = _mm256_blend_epi32(_mm256_min_epi32(v, t), _mm256_max_epi32(v, t), 0xCC);
+    t = _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm256_blend_epi32(_mm256_min_epi32(v, t), _mm256_max_epi32(v, t), 0xAA);
+}
+
+__attribute__((target("avx2")))
+static inline void bitonicCpuMerge8(__m256i* a, __m256i* b) {
+    __m256i r = _mm256_permutevar8x32_epi32(*b, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+    __m256i lo = _mm256_min_epi32(*a, r);
+    __m256i hi = _mm256_max_epi32(*a, r);
+    *a = bitonicCpuHalfClean8(lo);
+    *b = bitonicCpuHalfClean8(hi);
+}
+
+// ****************************************************************************
+// Function: bitonicCpuMergeSse41, bitonicCpuMergeAvx2
+//
+// Purpose:
+//   Merges two sorted runs a register at a time: the register of higher
+//   keys left by the last merge is merged with the next register of the
+//   run whose next key is smaller, and the lower register is stored.
+//   The last keys, less than a register of either run, are merged by
+//   bitonicCpuMergeTail.
+//
+// Returns:  nothing
+//           the na + nb keys in out, sorted
+// ****************************************************************************
+__attribute__((target("sse4.1")))
+static void bitonicCpuMergeSse41(const int* a, size_t na, const int* b, size_t nb, int* out) {
+    if(na < 4 || nb < 4) {
+        bitonicCpuMergeScalar(a, na, b, nb, out);
+        return;
+    }
+    __m128i x = _mm_loadu_si128((const __m128i*) a);
+    __m128i y = _mm_loadu_si128((const __m128i*) b);
+    a += 4; na -= 4;
+    b += 4; nb -= 4;
+    for(;;) {
+        bitonicCpuMerge4(&x, &y);
+        _mm_storeu_si128((__m128i*) out, x);
+        out += 4;
+        x = y;
+        if(na >= 4 && (nb < 4 || *a <= *b)) {
+            if(nb < 4 && nb > 0 && *b < *a) break;
+            y = _mm_loadu_si128((const __m128i*) a);
+            a += 4; na -= 4;
+        } else if(nb >= 4) {
+            if(na < 4 && na > 0 && *a < *b) break;
+            y = _mm_loadu_si128((const __m128i*) b);
+            b += 4; nb -= 4;
+        } else {
+            break;
+        }
+    }
+    int carry[4];
+    _mm_storeu_si128((__m128i*) carry, x);
+    bitonicCpuMergeTail(carry, 4, a, na, b, nb, out);
+}
+
+__attribute__((target("avx2")))
+static void bitonicCpuMergeAvx2(const int* a, size_t na, const int* b, size_t nb, int* out) {
+    if(na < 8 || nb < 8) {
+        bitonicCpuMergeScalar(a, na, b, nb, out);
+        return;
+    }
+    __m256i x = _mm256_loadu_si256((const __m256i*) a);
+    __m256i y = _mm256_loadu_si256((const __m256i*) b);
+    a += 8; na -= 8;
+    b += 8; nb -= 8;
+    for(;;) {
+        bitonicCpuMerge8(&x, &y);
+        _mm256_storeu_si256((__m256i*) out, x);
+        out += 8;
+        x = y;
+        if(na >= 8 && (nb < 8 || *a <= *b)) {
+            if(nb < 8 && nb > 0 && *b < *a) break;
+            y = _mm256_loadu_si256((const __m256i*) a);
+            a += 8; na -= 8;
+        } else if(nb >= 8) {
+            if(na < 8 && na > 0 && *a < *b) break;
+            y = _mm256_loadu_si256((const __m256i*) b);
+            b += 8; nb -= 8;
+        } else {
+            break;
+        }
+    }
+    int carry[8];
+    _mm256_storeu_si256((__m256i*) carry, x);
+    bitonicCpuMergeTail(carry, 8, a, na, b, nb, out);
+}
+
+// Merges the sorted runs of width keys in block until the block is one
+// run, ending in block
+static void bitonicCpuMergeBlock(int* block, int width,
+                                 void (*merge)(const int*, size_t, const int*, size_t, int*)) {
+    int scratch[BITONIC_CPU_BLOCK];
+    int* src = block;
+    int* dst = scratch;
+    for(; width < BITONIC_CPU_BLOCK; width <<= 1) {
+        for(int i = 0; i < BITONIC_CPU_BLOCK; i += 2 * width)
+            merge(src + i, width, src + i + width, width, dst + i);
+        int* t = src; src = dst; dst = t;
+    }
+    if(src != block) memcpy(block, src, sizeof(scratch));
+}
+
+// ****************************************************************************
+// Function: bitonicCpuSortBlockSse41, bitonicCpuSortBlockAvx2
+//
+// Purpose:
+//   Sorts BITONIC_CPU_BLOCK keys.  w registers of w keys go through a
+//   sorting network of min/max, which sorts each column; a transpose
+//   turns the columns into sorted registers, which are then merged.
+//
+// Returns:  nothing
+// ****************************************************************************
+#define BITONIC_CPU_CMPX(MIN, MAX, v, i, j) do {                                \
+        __typeof__(v[0]) t = MIN(v[i], v[j]);                                   \
+        v[j] = MAX(v[i], v[j]);                                                 \
+        v[i] = t;                                                               \
+    } while(0)
+
+__attribute__((target("sse4.1")))
+static void bitonicCpuSortBlockSse41(int* block) {
+    for(int s = 0; s < BITONIC_CPU_BLOCK; s += 16) {
+        __m128i v[4];
+        for(int i = 0; i < 4; i++) v[i] = _mm_loadu_si128((const __m128i*) (block + s + 4 * i));
+
+        BITONIC_CPU_CMPX(_mm_min_epi32, _mm_max_epi32, v, 0, 1);
+        BITONIC_CPU_CMPX(_mm_min_epi32, _mm_max_epi32, v, 2, 3);
+        BITONIC_CPU_CMPX(_mm_min_epi32, _mm_max_epi32, v, 0, 2);
+        BITONIC_CPU_CMPX(_mm_min_epi32, _mm_max_epi32, v, 1, 3);
+        BITONIC_CPU_CMPX(_mm_min_epi32, _mm_max_epi32, v, 1, 2);
+
+        __m128i t0 = _mm_unpacklo_epi32(v[0], v[1]);
+        __m128i t1 = _mm_unpacklo_epi32(v[2], v[3]);
+        __m128i t2 = _mm_unpackhi_epi32(v[0], v[1]);
+        __m128i t3 = _mm_unpackhi_epi32(v[2], v[3]);
+        v[0] = _mm_unpacklo_epi64(t0, t1);
+        v[1] = _mm_unpackhi_epi64(t0, t1);
+        v[2] = _mm_unpacklo_epi64(t2, t3);
+        v[3] = _mm_unpackhi_epi64(t2, t3);
+
+        bitonicCpuMerge4(&v[0], &v[1]);
+        bitonicCpuMerge4(&v[2], &v[3]);
+        for(int i = 0; i < 4; i++) _mm_storeu_si128((__m128i*) (block + s + 4 * i), v[i]);
+    }
+    bitonicCpuMergeBlock(block, 8, bitonicCpuMergeSse41);
+}
+
+__attribute__((target("avx2")))
+static void bitonicCpuSortBlockAvx2(int* block) {
+    __m256i v[8];
+    for(int i = 0; i < 8; i++) v[i] = _mm256_loadu_si256((const __m256i*) (block + 8 * i));
+
+    // 19 comparators sort 8 inputs (Knuth, TAOCP 5.3.4)
+    BITONIC_CPU_CMPX(_mm256_min_epi32, _mm256_max_epi32, v, 0, 2);
+    BITONIC_CPU_CMPX(_mm256_min_epi32, _mm256_max_epi32, v, 1, 3);
+    BITONIC_CPU_CMPX(_mm256_min_epi32, _mm256_max_epi32, v, 4, 6);
+    BITONIC_CPU_CMPX(_mm256_min_epi32, _mm256_max_epi32, v, 5, 7);
+    BITONIC_CPU_CMPX(_mm256_min_epi32, _mm256_max_epi32, v, 0, 4);
+    BITONIC_CPU_CMPX(_mm256_min_epi32, _mm256_max_epi32, v, 1, 5);
+    BITONIC_CPU_CMPX(_mm256_min_epi32, _mm256_max_epi32, v, 2, 6);
+    BITONIC_CPU_CMPX(_mm256_min_epi32, _mm256_max_epi32, v, 3, 7);
+    BITONIC_CPU_CMPX(_mm256_min_epi32, _mm256_max_epi32, v, 0, 1);
+    BITONIC_CPU_CMPX(_mm256_min_epi32, _mm256_max_epi32, v, 2, 3);
+    BITONIC_CPU_CMPX(_mm256_min_epi32, _mm256_max_epi32, v, 4, 5);
+    BITONIC_CPU_CMPX(_mm256_min_epi32, _mm256_max_epi32, v, 6, 7);
+    BITONIC_CPU_CMPX(_mm256_min_epi32, _mm256_max_epi32, v, 2, 4);
+    BITONIC_CPU_CMPX(_mm256_min_epi32, _mm256_max_epi32, v, 3, 5);
+    BITONIC_CPU_CMPX(_mm256_min_epi32, _mm256_max_epi32, v, 1, 4);
+    BITONIC_CPU_CMPX(_mm256_min_epi32, _mm256_max_epi32, v, 3, 6);
+    BITONIC_CPU_CMPX(_mm256_min_epi32, _mm256_max_epi32, v, 1, 2);
+    BITONIC_CPU_CMPX(_mm256_min_epi32, _mm256_max_epi32, v, 3, 4);
+    BITONIC_CPU_CMPX(_mm256_min_epi32, _mm256_max_epi32, v, 5, 6);
+
+    __m256i t[8];
+    for(int i = 0; i < 8; i += 2) {
+        t[i]     = _mm256_unpacklo_epi32(v[i], v[i + 1]);
+        t[i + 1] = _mm256_unpackhi_epi32(v[i], v[i + 1]);
+    }
+    for(int i = 0; i < 8; i += 4) {
+        v[i]     = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+        v[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+        v[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+        v[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+    }
+    for(int i = 0; i < 4; i++) {
+        t[i]     = _mm256_permute2x128_si256(v[i], v[i + 4], 0x20);
+        t[i + 4] = _mm256_permute2x128_si256(v[i], v[i + 4], 0x31);
+    }
+
+    for(int i = 0; i < 8; i += 2) {
+        bitonicCpuMerge8(&t[i], &t[i + 1]);
+        _mm256_storeu_si256((__m256i*) (block + 8 * i), t[i]);
+        _mm256_storeu_si256((__m256i*) (block + 8 * i + 8), t[i + 1]);
+    }
+    bitonicCpuMergeBlock(block, 16, bitonicCpuMergeAvx2);
+}
+#endif
+
+// ****************************************************************************
+// Function: bitonicCpuDetectIsa
+//
+// Purpose:
+//   Picks the widest sorting network supported by the processor
+//
+// Returns:  one of BitonicCpuIsa
+// ****************************************************************************
+static int bitonicCpuDetectIsa(void) {
+#ifdef BITONIC_CPU_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) return BITONIC_CPU_AVX2;
+    if(__builtin_cpu_supports("sse4.1")) return BITONIC_CPU_SSE41;
+#endif
+    return BITONIC_CPU_SCALAR;
+}
+
+static void bitonicCpuSortBlock(int isa, int* block) {
+    switch(isa) {
+#ifdef BITONIC_CPU_X86
+    case BITONIC_CPU_AVX2:  bitonicCpuSortBlockAvx2(block);  break;
+    case BITONIC_CPU_SSE41: bitonicCpuSortBlockSse41(block); break;
+#endif
+    default:                bitonicCpuSortBlockScalar(block); break;
+    }
+}
+
+static void bitonicCpuMerge(int isa, const int* a, size_t na, const int* b, size_t nb, int* out) {
+    switch(isa) {
+#ifdef BITONIC_CPU_X86
+    case BITONIC_CPU_AVX2:  bitonicCpuMergeAvx2(a, na, b, nb, out);  break;
+    case BITONIC_CPU_SSE41: bitonicCpuMergeSse41(a, na, b, nb, out); break;
+#endif
+    default:                bitonicCpuMergeScalar(a, na, b, nb, out); break;
+    }
+}
+
+// Keys of a that come first among the first k keys of the merge of a
+// and b, ties going to a
+static size_t bitonicCpuCoRank(const int* a, size_t na, const int* b, size_t nb, size_t k) {
+    size_t lo = k > nb ? k - nb : 0;
+    size_t hi = k < na ? k : na;
+    while(lo < hi) {
+        size_t i = lo + (hi - lo) / 2;
+        if(a[i] <= b[k - i - 1]) lo = i + 1;
+        else hi = i;
+    }
+    return lo;
+}
+
+// ****************************************************************************
+// Function: bitonicCpuWorker
+//
+// Purpose:
+//   One thread of a sort.  Each thread pads and sorts its share of the
+//   blocks, then in every pass writes its share of the output: the runs
+//   of width keys meeting there are split where the thread's share
+//   starts and ends, so all threads keep busy down to the last pass,
+//   which merges only two runs.
+//
+// Returns:  NULL
+// ****************************************************************************
+static void* bitonicCpuWorker(void* arg) {
+    BitonicCpuWorker* w = (BitonicCpuWorker*) arg;
+    BitonicCpuSort* s = w->sort;
+    pthread_mutex_lock(&s->lock);
+    while(!s->ready)
+        pthread_cond_wait(&s->start, &s->lock);
+    pthread_mutex_unlock(&s->lock);
+
+    size_t padded = s->padded;
+    size_t blocks = padded / BITONIC_CPU_BLOCK;
+    int* src = s->buffers[0];
+    int* dst = s->buffers[1];
+
+    size_t first = blocks * w->id / s->numThreads;
+    size_t last = blocks * (w->id + 1) / s->numThreads;
+    for(size_t b = first; b < last; b++) {
+        size_t begin = b * BITONIC_CPU_BLOCK;
+        size_t count = begin + BITONIC_CPU_BLOCK <= s->n ? BITONIC_CPU_BLOCK : s->n - begin;
+        memcpy(src + begin, s->keys + begin, count * sizeof(int));
+        for(size_t i = count; i < BITONIC_CPU_BLOCK; i++) src[begin + i] = INT_MAX;
+        bitonicCpuSortBlock(s->isa, src + begin);
+    }
+
+    size_t lo = padded * w->id / s->numThreads;
+    size_t hi = padded * (w->id + 1) / s->numThreads;
+    for(size_t width = BITONIC_CPU_BLOCK; width < padded; width <<= 1) {
+        pthread_barrier_wait(&s->barrier);
+        for(size_t start = lo - lo % (2 * width); start < hi; start += 2 * width) {
+            const int* a = src + start;
+            size_t na = padded - start < width ? padded - start : width;
+            const int* b = a + na;
+            size_t nb = padded - start - na < width ? padded - start - na : width;
+            size_t k0 = (lo > start ? lo : start) - start;
+            size_t k1 = (hi < start + na + nb ? hi : start + na + nb) - start;
+            size_t i0 = bitonicCpuCoRank(a, na, b, nb, k0);
+            size_t i1 = bitonicCpuCoRank(a, na, b, nb, k1);
+            bitonicCpuMerge(s->isa, a + i0, i1 - i0, b + (k0 - i0), (k1 - i1) - (k0 - i0), dst + start + k0);
+        }
+        int* t = src; src = dst; dst = t;
+    }
+    pthread_barrier_wait(&s->barrier);
+
+    lo = s->n * w->id / s->numThreads;
+    hi = s->n * (w->id + 1) / s->numThreads;
+    if(s->ascending) {
+        memcpy(s->keys + lo, src + lo, (hi - lo) * sizeof(int));
+    } else {
+        for(size_t i = lo; i < hi; i++) s->keys[i] = src[s->n - 1 - i];
+    }
+    return NULL;
+}
+
+// ****************************************************************************
+// Function: bitonicSortCPU
+//
+// Purpose:
+//   Sorts n ints of any number, in place.  Blocks of BITONIC_CPU_BLOCK
+//   keys are sorted by sorting networks in registers, then merged in
+//   passes of vectorized bitonic merges, all passes spread over the
+//   threads.  The input is padded with INT_MAX up to whole blocks; the
+//   padding sorts last and is dropped.
+//
+// Arguments:
+//   keys: the keys
+//   n: number of keys
+//   ascending: 1 for ascending order, 0 for descending
+//   numThreads: number of threads, 0 for one per online processor
+//   isa: sorting networks to use, -1 to detect
+//
+// Returns:  0, or -1 if out of memory
+// ****************************************************************************
+static int bitonicSortCPU(int* keys, size_t n, int ascending, int numThreads, int isa) {
+    if(n < 2) return 0;
+    if(numThreads <= 0) numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+
+    BitonicCpuSort s;
+    s.keys = keys;
+    s.n = n;
+    s.padded = (n + BITONIC_CPU_BLOCK - 1) / BITONIC_CPU_BLOCK * BITONIC_CPU_BLOCK;
+    s.ascending = ascending;
+    s.isa = (isa < 0) ? bitonicCpuDetectIsa() : isa;
+    if((size_t) numThreads > s.padded / BITONIC_CPU_BLOCK) numThreads = (int) (s.padded / BITONIC_CPU_BLOCK);
+    if(numThreads < 1) numThreads = 1;
+    s.buffers[0] = (int*) malloc(s.padded * sizeof(int));
+    s.buffers[1] = (int*) malloc(s.padded * sizeof(int));
+    BitonicCpuWorker* workers = (BitonicCpuWorker*) malloc(numThreads * sizeof(BitonicCpuWorker));
+    pthread_t* threads = (pthread_t*) malloc(numThreads * sizeof(pthread_t));
+    if(s.buffers[0] == NULL || s.buffers[1] == NULL || workers == NULL || threads == NULL) {
+        free(s.buffers[0]);
+        free(s.buffers[1]);
+        free(workers);
+        free(threads);
+        return -1;
+    }
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.start, NULL);
+    s.ready = 0;
+
+    // the caller takes part as thread 0; the threads that start are
+    // numbered in order and sort with it, the barrier sized to them
+    int started = 1;
+    workers[0].sort = &s;
+    workers[0].id = 0;
+    for(int i = 1; i < numThreads; i++) {
+        workers[started].sort = &s;
+        workers[started].id = started;
+        if(pthread_create(&threads[started], NULL, bitonicCpuWorker, &workers[started]) == 0)
+            started++;
+    }
+    pthread_mutex_lock(&s.lock);
+    s.numThreads = started;
+    pthread_barrier_init(&s.barrier, NULL, started);
+    s.ready = 1;
+    pthread_cond_broadcast(&s.start);
+    pthread_mutex_unlock(&s.lock);
+
+    bitonicCpuWorker(&workers[0]);
+    for(int i = 1; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    pthread_barrier_destroy(&s.barrier);
+    pthread_cond_destroy(&s.start);
+    pthread_mutex_destroy(&s.lock);
+    free(s.buffers[0]);
+    free(s.buffers[1]);
+    free(workers);
+    free(threads);
+    return 0;
+}
+
+#endif // BITONICSORT_CPU_H_
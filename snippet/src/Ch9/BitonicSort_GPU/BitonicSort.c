@@ -8,6 +8,7 @@
 #include <time.h>
 
 #include "bitonicsort_config.h"
+#include "bitonicsort.h"
 
 #ifdef  __APPLE__
 #include <OpenCL/opencl.h>
@@ -15,7 +16,7 @@
 #include <CL/cl.h>
 #endif
 
-#define GROUP_SIZE 256                   // ATI HD7870 has 20 parallel compute units
+#define GROUP_SIZE BITONIC_GROUP_SIZE    // ATI HD7870 has 20 parallel compute units
 const unsigned int LENGTH = 1<<24;       
 const unsigned int _SHARED_MEM_ = GROUP_SIZE * sizeof(cl_uint); // Size of shared memory on the GPU/CPU device (CPU doesn't matter)
 
@@ -51,6 +52,15 @@ decipherEvent(cl_event* event) {
     return 0;
 }
 
+/* Checks the whole array is ordered in the given direction */
+int isSorted(const cl_int* data, unsigned int length, cl_uint sortOrder) {
+    for(unsigned int i = 1; i < length; ++i) {
+        if(sortOrder ? (data[i-1] > data[i]) : (data[i-1] < data[i]))
+            return 0;
+    }
+    return 1;
+}
+
 void fillRandom(int* data, unsigned int length, unsigned int seed) {
     int* iptr = data;
     
@@ -135,8 +145,10 @@ int main(int argc, char** argv) {
 	    }
         /* Build OpenCL program object and dump the error message, if any */
         char *program_log;
-        const char options[] = "";
+        char options[64];
         size_t log_size;
+        cl_uint localSize = bitonicLocalSortSize(device, LENGTH);
+        sprintf(options, "-DLOCAL_SORT_SIZE=%u", localSize);
 
         error = clBuildProgram(program, 1, &device, options, NULL, NULL);
 	    if(error != CL_SUCCESS) {
@@ -152,14 +164,14 @@ int main(int argc, char** argv) {
 	    }
        
         // Queue is created with profiling enabled 
-        cl_command_queue_properties props;
+        cl_command_queue_properties props = 0;
         props |= CL_QUEUE_PROFILING_ENABLE;
 
         queue = clCreateCommandQueue(context, device, props, &error);
 
 #ifdef USE_SHARED_MEM
         cl_kernel kernel = clCreateKernel(program, "bitonicSort_sharedmem", &error);
-#elif def USE_SHARED_MEM_2
+#elif defined(USE_SHARED_MEM_2)
         cl_kernel kernel = clCreateKernel(program, "bitonicSort_sharedmem_2", &error);
 #else
         cl_kernel kernel = clCreateKernel(program, "bitonicSort", &error);
@@ -178,9 +190,10 @@ int main(int argc, char** argv) {
         clSetKernelArg(kernel, 3, sizeof(cl_uint),(void*)&sortOrder);
 #ifdef USE_SHARED_MEM
         clSetKernelArg(kernel, 4, (GROUP_SIZE << 1) *sizeof(cl_uint),NULL);
-#elif def USE_SHARED_MEM_2
+#elif defined(USE_SHARED_MEM_2)
         clSetKernelArg(kernel, 5, (GROUP_SIZE << 2) *sizeof(cl_uint),NULL);
 #endif 
+#if defined(USE_SHARED_MEM) || defined(USE_SHARED_MEM_2) || defined(USE_GLOBAL_STAGES_ONLY)
         size_t globalThreads[1] = {LENGTH/2};
         size_t threadsPerGroup[1] = {GROUP_SIZE};
 
@@ -214,6 +227,36 @@ int main(int argc, char** argv) {
 		        printf("Execution of the bitonic sort took %lu.%lu s\n", (executionEnd - executionStart)/1000000000, (executionEnd - executionStart)%1000000000);
             }
         } 
+#else
+        /* The schedule of bitonicsort.h, timed launch by launch */
+        cl_kernel localKernel = clCreateKernel(program, "bitonicSort_local", &error);
+        cl_uint maxLaunches = 1 + stages * (stages + 1) / 2;
+        cl_event* events = (cl_event*) malloc(maxLaunches * sizeof(cl_event));
+        cl_uint launches = 0;
+        error = bitonicSortEnqueue(queue, kernel, localKernel, device_A_in, LENGTH, localSize,
+                                   sortOrder, events, &launches);
+        if(error != CL_SUCCESS) {
+            printf("Kernel execution failure!\n");
+            exit(-22);
+        }
+        clFinish(queue);
+
+        cl_ulong totalTime = 0;
+        for(cl_uint l = 0; l < launches; ++l) {
+            cl_ulong executionStart, executionEnd;
+            clGetEventProfilingInfo(events[l], CL_PROFILING_COMMAND_START, sizeof(executionStart), &executionStart, NULL);
+            clGetEventProfilingInfo(events[l], CL_PROFILING_COMMAND_END, sizeof(executionEnd), &executionEnd, NULL);
+            totalTime += executionEnd - executionStart;
+            clReleaseEvent(events[l]);
+        }
+        free(events);
+        clReleaseKernel(localKernel);
+
+        // each launch reads and writes the whole array once
+        printf("Bitonic sort of %u elements: %u launches (%u with global stages only), tile of %u elements\n",
+               LENGTH, launches, stages * (stages + 1) / 2, localSize);
+        printf("Execution of the bitonic sort took %lu.%09lu s\n", totalTime/1000000000, totalTime%1000000000);
+#endif
         clEnqueueReadBuffer(queue,
                             device_A_in,
                             CL_TRUE,
@@ -223,6 +266,7 @@ int main(int argc, char** argv) {
                             0,
                             NULL,
                             NULL);
+        printf("Sorted: %s\n", isSorted(host_A_out, LENGTH, sortOrder) ? "yes" : "NO");
 
         /* Clean up */
         for(i=0; i< NUMBER_OF_FILES; i++) { free(buffer[i]); }
@@ -1,5 +1,11 @@
 #define GROUP_SIZE 256
 
+// Number of elements a work-group sorts in local memory; the host sets
+// it from the device's local memory size
+#ifndef LOCAL_SORT_SIZE
+#define LOCAL_SORT_SIZE (GROUP_SIZE << 1)
+#endif
+
 __kernel 
 void bitonicSort(__global uint * data,
                  const uint stage, 
@@ -187,3 +193,59 @@ void bitonicSort_sharedmem_2(__global uint * data,
     }
     
 }
+
+/*
+ * Runs every sub-stage of stages firstStage..lastStage whose pair
+ * distance fits in a tile of LOCAL_SORT_SIZE elements, in local memory.
+ * With firstStage = 0 it sorts whole tiles (all stages up to
+ * log2(LOCAL_SORT_SIZE)-1); with firstStage = lastStage it finishes one
+ * larger stage after the global kernel has done its long distances.
+ * Pairs and directions are numbered as in bitonicSort, so both kernels
+ * can be mixed freely.
+ */
+__kernel
+void bitonicSort_local(__global uint * data,
+                       const uint firstStage,
+                       const uint lastStage,
+                       const uint direction) {
+
+    __local uint tile[LOCAL_SORT_SIZE];
+    uint localId = get_local_id(0);
+    uint localSize = get_local_size(0);
+    uint base = get_group_id(0) * LOCAL_SORT_SIZE;
+    // global number of the first pair of this tile
+    uint firstPair = get_group_id(0) * (LOCAL_SORT_SIZE >> 1);
+
+    for(uint i = localId; i < LOCAL_SORT_SIZE; i += localSize)
+        tile[i] = data[base + i];
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(uint stage = firstStage; stage <= lastStage; ++stage) {
+        uint distanceBetweenPairs = 1 << stage;
+        if(distanceBetweenPairs > (LOCAL_SORT_SIZE >> 1))
+            distanceBetweenPairs = LOCAL_SORT_SIZE >> 1;
+
+        for(; distanceBetweenPairs > 0; distanceBetweenPairs >>= 1) {
+            for(uint pair = localId; pair < (LOCAL_SORT_SIZE >> 1); pair += localSize) {
+                uint leftId = (pair % distanceBetweenPairs) +
+                              (pair / distanceBetweenPairs) * (distanceBetweenPairs << 1);
+                uint rightId = leftId + distanceBetweenPairs;
+
+                uint sortIncreasing = direction;
+                if(((firstPair + pair) >> stage) % 2 == 1)
+                    sortIncreasing = 1 - sortIncreasing;
+
+                uint leftElement = tile[leftId];
+                uint rightElement = tile[rightId];
+                if((leftElement > rightElement) == (sortIncreasing != 0)) {
+                    tile[leftId]  = rightElement;
+                    tile[rightId] = leftElement;
+                }
+            }
+            barrier(CLK_LOCAL_MEM_FENCE);
+        }
+    }
+
+    for(uint i = localId; i < LOCAL_SORT_SIZE; i += localSize)
+        data[base + i] = tile[i];
+}
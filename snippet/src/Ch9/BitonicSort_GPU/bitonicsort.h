@@ -0,0 +1,100 @@
+#ifndef BITONICSORT_H_
+#define BITONICSORT_H_
+
+#ifdef  __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#define BITONIC_GROUP_SIZE 256           // GROUP_SIZE of BitonicSort.cl
+#define BITONIC_MAX_LOCAL_SORT_SIZE 4096 // Largest tile sorted in local memory by bitonicSort_local
+
+/*
+ Largest power of two number of elements, at most BITONIC_MAX_LOCAL_SORT_SIZE
+ and length, whose tile fits in half of the device's local memory; the
+ LOCAL_SORT_SIZE BitonicSort.cl is to be built with
+*/
+static inline cl_uint bitonicLocalSortSize(cl_device_id device, size_t length) {
+    cl_ulong localMem = 0;
+    clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(localMem), &localMem, NULL);
+    cl_uint size = BITONIC_GROUP_SIZE << 1;
+    while((size << 1) <= BITONIC_MAX_LOCAL_SORT_SIZE &&
+          (size << 1) <= length &&
+          (size << 1) * sizeof(cl_uint) <= localMem / 2)
+        size <<= 1;
+    return size;
+}
+
+/*
+ Enqueues the bitonic sort of the length elements of data, a power of two
+ no smaller than localSize, with the kernels of BitonicSort.cl built for a
+ LOCAL_SORT_SIZE of localSize.  Sub-stages whose pairs lie within a tile
+ of localSize elements run in local memory: one launch sorts every tile,
+ then each larger stage runs its long distances with bitonicSort (one
+ launch each) and all the short ones in a single bitonicSort_local launch.
+ The queue is in order, so launches are not waited on one by one.
+
+ If events is not NULL it receives the event of every launch, room for
+ 1 + stages * (stages + 1) / 2 of them; *launches counts the launches
+ enqueued.  Every launch is checked, and the first failure stops the
+ schedule and is returned.
+*/
+static inline cl_int bitonicSortEnqueue(cl_command_queue queue,
+                                        cl_kernel kernel,
+                                        cl_kernel localKernel,
+                                        cl_mem data,
+                                        size_t length,
+                                        cl_uint localSize,
+                                        cl_uint sortOrder,
+                                        cl_event* events,
+                                        cl_uint* launches) {
+    cl_int error;
+    size_t globalThreads[1] = {length / 2};
+    size_t localGlobalThreads[1] = {(length / localSize) * BITONIC_GROUP_SIZE};
+    size_t threadsPerGroup[1] = {BITONIC_GROUP_SIZE};
+
+    cl_uint stages = 0;
+    for(size_t i = length; i > 1; i >>= 1)
+        ++stages;
+    cl_uint localStages = 0;
+    for(cl_uint i = localSize; i > 1; i >>= 1)
+        ++localStages;
+    if(localStages > stages)
+        localStages = stages;
+
+    *launches = 0;
+    cl_uint firstStage = 0;
+    cl_uint lastStage = localStages - 1;
+    error = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&data);
+    error |= clSetKernelArg(kernel, 3, sizeof(cl_uint), (void*)&sortOrder);
+    error |= clSetKernelArg(localKernel, 0, sizeof(cl_mem), (void*)&data);
+    error |= clSetKernelArg(localKernel, 1, sizeof(cl_uint), (void*)&firstStage);
+    error |= clSetKernelArg(localKernel, 2, sizeof(cl_uint), (void*)&lastStage);
+    error |= clSetKernelArg(localKernel, 3, sizeof(cl_uint), (void*)&sortOrder);
+    if(error != CL_SUCCESS) return error;
+    error = clEnqueueNDRangeKernel(queue, localKernel, 1, NULL, localGlobalThreads, threadsPerGroup,
+                                   0, NULL, events != NULL ? &events[*launches] : NULL);
+    if(error == CL_SUCCESS) (*launches)++;
+
+    for(cl_uint stage = localStages; stage < stages && error == CL_SUCCESS; ++stage) {
+        error = clSetKernelArg(kernel, 1, sizeof(cl_uint), (void*)&stage);
+        for(cl_uint subStage = 0; error == CL_SUCCESS && (1u << (stage - subStage)) > (localSize >> 1); subStage++) {
+            error = clSetKernelArg(kernel, 2, sizeof(cl_uint), (void*)&subStage);
+            if(error != CL_SUCCESS) break;
+            error = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, globalThreads, threadsPerGroup,
+                                           0, NULL, events != NULL ? &events[*launches] : NULL);
+            if(error == CL_SUCCESS) (*launches)++;
+        }
+        if(error != CL_SUCCESS) break;
+        error = clSetKernelArg(localKernel, 1, sizeof(cl_uint), (void*)&stage);
+        error |= clSetKernelArg(localKernel, 2, sizeof(cl_uint), (void*)&stage);
+        if(error != CL_SUCCESS) break;
+        error = clEnqueueNDRangeKernel(queue, localKernel, 1, NULL, localGlobalThreads, threadsPerGroup,
+                                       0, NULL, events != NULL ? &events[*launches] : NULL);
+        if(error == CL_SUCCESS) (*launches)++;
+    }
+    return error;
+}
+
+#endif // BITONICSORT_H_
@@ -2,3 +2,4 @@
 #define DEBUG_VERBOSE
 /* #undef USE_SHARED_MEM */
 /* #undef USE_SHARED_MEM_2 */
+/* #undef USE_GLOBAL_STAGES_ONLY */